@@ -1,8 +1,13 @@
 {
+  "variables": {
+    "midi2_trace%": 0,
+    "midi2_log_level%": 2
+  },
   "targets": [
     {
       "target_name": "midi2-native",
       "sources": ["electron/native/midi2-native.cc"],
+      "defines": ["MIDI2_TRACE=<(midi2_trace)", "MIDI2_LOG_LEVEL=<(midi2_log_level)"],
       "include_dirs": ["<!(node -p 'require(\"path\").dirname(require.resolve(\"node-addon-api\"))')"],
       "conditions": [
         ["OS == 'win'", {
@@ -16,6 +21,8 @@
         }],
         ["OS == 'mac'", {
           "xcode_settings": {
+            "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+            "MACOSX_DEPLOYMENT_TARGET": "10.15",
             "OTHER_LDFLAGS": ["-framework", "CoreMIDI", "-framework", "CoreFoundation"]
           }
         }],
@@ -23,9 +30,120 @@
           "libraries": ["-lasound"],
           "include_dirs": ["/usr/include", "/usr/include/alsa"],
           "cflags": ["<!@(pkg-config --cflags alsa 2>/dev/null || echo '-I/usr/include')"],
+          "cflags_cc": ["-std=c++17"],
           "ldflags": ["<!@(pkg-config --libs alsa 2>/dev/null || echo '-L/usr/lib -lasound')"]
         }]
       ]
+    },
+    {
+      "target_name": "midi2-bench",
+      "type": "executable",
+      "sources": ["electron/native/midi2-bench.cc"],
+      "defines": ["MIDI2_TRACE=<(midi2_trace)", "MIDI2_LOG_LEVEL=<(midi2_log_level)"],
+      "conditions": [
+        ["OS == 'win'", {
+          "libraries": ["winmm.lib", "ole32.lib", "runtimeobject.lib"],
+          "msvs_settings": {
+            "VCCLCompilerTool": {
+              "AdditionalOptions": ["/std:c++17", "/EHsc"],
+              "PreprocessorDefinitions": ["_WIN32_WINNT=0x0A00", "NTDDI_WIN10_WIN11"]
+            }
+          }
+        }],
+        ["OS == 'mac'", {
+          "xcode_settings": {
+            "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+            "MACOSX_DEPLOYMENT_TARGET": "10.15",
+            "OTHER_LDFLAGS": ["-framework", "CoreMIDI", "-framework", "CoreFoundation"]
+          }
+        }],
+        ["OS == 'linux'", {
+          "libraries": ["-lasound", "-lpthread"],
+          "include_dirs": ["/usr/include", "/usr/include/alsa"],
+          "cflags": ["<!@(pkg-config --cflags alsa 2>/dev/null || echo '-I/usr/include')"],
+          "cflags_cc": ["-std=c++17"],
+          "ldflags": ["<!@(pkg-config --libs alsa 2>/dev/null || echo '-L/usr/lib -lasound')"]
+        }]
+      ]
+    },
+    {
+      "target_name": "midi2-test",
+      "type": "executable",
+      "sources": ["electron/native/midi2-test.cc"],
+      "defines": ["MIDI2_TRACE=<(midi2_trace)", "MIDI2_LOG_LEVEL=<(midi2_log_level)"],
+      "conditions": [
+        ["OS == 'win'", {
+          "libraries": ["winmm.lib", "ole32.lib", "runtimeobject.lib"],
+          "msvs_settings": {
+            "VCCLCompilerTool": {
+              "AdditionalOptions": ["/std:c++17", "/EHsc"],
+              "PreprocessorDefinitions": ["_WIN32_WINNT=0x0A00", "NTDDI_WIN10_WIN11"]
+            }
+          }
+        }],
+        ["OS == 'mac'", {
+          "xcode_settings": {
+            "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+            "MACOSX_DEPLOYMENT_TARGET": "10.15",
+            "OTHER_LDFLAGS": ["-framework", "CoreMIDI", "-framework", "CoreFoundation"]
+          }
+        }],
+        ["OS == 'linux'", {
+          "libraries": ["-lasound", "-lpthread"],
+          "include_dirs": ["/usr/include", "/usr/include/alsa"],
+          "cflags": ["<!@(pkg-config --cflags alsa 2>/dev/null || echo '-I/usr/include')"],
+          "cflags_cc": ["-std=c++17"],
+          "ldflags": ["<!@(pkg-config --libs alsa 2>/dev/null || echo '-L/usr/lib -lasound')"]
+        }]
+      ]
+    },
+    {
+      "target_name": "midi2-convert",
+      "type": "executable",
+      "sources": ["electron/native/midi2-convert.cc"],
+      "conditions": [
+        ["OS == 'win'", {
+          "msvs_settings": {
+            "VCCLCompilerTool": {
+              "AdditionalOptions": ["/std:c++17", "/EHsc", "/O2"]
+            }
+          }
+        }],
+        ["OS == 'mac'", {
+          "xcode_settings": {
+            "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+            "MACOSX_DEPLOYMENT_TARGET": "10.15",
+            "GCC_OPTIMIZATION_LEVEL": "3"
+          }
+        }],
+        ["OS == 'linux'", {
+          "libraries": ["-lpthread"],
+          "cflags_cc": ["-std=c++17", "-O3"]
+        }]
+      ]
+    },
+    {
+      "target_name": "midi2-microbench",
+      "type": "executable",
+      "sources": ["electron/native/midi2-microbench.cc"],
+      "conditions": [
+        ["OS == 'win'", {
+          "msvs_settings": {
+            "VCCLCompilerTool": {
+              "AdditionalOptions": ["/std:c++17", "/EHsc", "/O2"]
+            }
+          }
+        }],
+        ["OS == 'mac'", {
+          "xcode_settings": {
+            "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+            "GCC_OPTIMIZATION_LEVEL": "3"
+          }
+        }],
+        ["OS == 'linux'", {
+          "cflags_cc": ["-std=c++17", "-O3"]
+        }]
+      ]
     }
   ]
 }
@@ -0,0 +1,491 @@
+/**
+ * Flex Data messages for tempo, meter, key, chords and text
+ *
+ * Encodes and decodes the Flex Data (type 0xD) messages a harmony app
+ * exchanges: Set Tempo, Time Signature, Metronome, Key Signature, Chord
+ * Name, and metadata and performance text. Chord qualities, alteration
+ * degrees and text kinds are compile-time tables, so a chord goes to and
+ * from its packet and its pitch classes with a few lookups.
+ * - Notes are a letter, 1 A to 7 G as Flex Data counts them, plus sharps
+ *   (positive) or flats (negative).
+ * - A key signature is its sharps or flats and a tonic letter; the tonic's
+ *   own accidental follows from the signature.
+ * - Text runs over as many packets as it needs, 12 UTF-8 bytes each, and
+ *   the Decoder joins them back up per group.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ump.h"
+
+namespace flexdata {
+
+enum class Kind : uint8_t { Tempo, TimeSignature, Metronome, KeySignature, Chord, Text };
+
+constexpr uint16_t pc(int semitone) { return (uint16_t)(1u << (semitone % 12)); }
+
+struct ChordType {
+  // Name used by the JS API
+  const char* name;
+  // Suffix in a chord symbol
+  const char* symbol;
+  // Pitch classes above the root
+  uint16_t intervals;
+};
+
+// Indexed by the Chord Type field
+static constexpr ChordType CHORD_TYPES[] = {
+  { "none", "", 0 },
+  { "major", "", pc(0) | pc(4) | pc(7) },
+  { "major6", "6", pc(0) | pc(4) | pc(7) | pc(9) },
+  { "major7", "maj7", pc(0) | pc(4) | pc(7) | pc(11) },
+  { "major9", "maj9", pc(0) | pc(4) | pc(7) | pc(11) | pc(2) },
+  { "major11", "maj11", pc(0) | pc(4) | pc(7) | pc(11) | pc(2) | pc(5) },
+  { "major13", "maj13", pc(0) | pc(4) | pc(7) | pc(11) | pc(2) | pc(5) | pc(9) },
+  { "minor", "m", pc(0) | pc(3) | pc(7) },
+  { "minor6", "m6", pc(0) | pc(3) | pc(7) | pc(9) },
+  { "minor7", "m7", pc(0) | pc(3) | pc(7) | pc(10) },
+  { "minor9", "m9", pc(0) | pc(3) | pc(7) | pc(10) | pc(2) },
+  { "minor11", "m11", pc(0) | pc(3) | pc(7) | pc(10) | pc(2) | pc(5) },
+  { "minor13", "m13", pc(0) | pc(3) | pc(7) | pc(10) | pc(2) | pc(5) | pc(9) },
+  { "dominant7", "7", pc(0) | pc(4) | pc(7) | pc(10) },
+  { "dominant9", "9", pc(0) | pc(4) | pc(7) | pc(10) | pc(2) },
+  { "dominant11", "11", pc(0) | pc(4) | pc(7) | pc(10) | pc(2) | pc(5) },
+  { "dominant13", "13", pc(0) | pc(4) | pc(7) | pc(10) | pc(2) | pc(5) | pc(9) },
+  { "augmented", "aug", pc(0) | pc(4) | pc(8) },
+  { "augmented7", "aug7", pc(0) | pc(4) | pc(8) | pc(10) },
+  { "diminished", "dim", pc(0) | pc(3) | pc(6) },
+  { "diminished7", "dim7", pc(0) | pc(3) | pc(6) | pc(9) },
+  { "halfDiminished", "m7b5", pc(0) | pc(3) | pc(6) | pc(10) },
+  { "minorMajor7", "mMaj7", pc(0) | pc(3) | pc(7) | pc(11) },
+  { "pedal", "ped", pc(0) },
+  { "power", "5", pc(0) | pc(7) },
+  { "suspended2", "sus2", pc(0) | pc(2) | pc(7) },
+  { "suspended4", "sus4", pc(0) | pc(5) | pc(7) },
+  { "dominant7Suspended4", "7sus4", pc(0) | pc(5) | pc(7) | pc(10) },
+};
+static constexpr uint8_t CHORD_TYPE_COUNT = sizeof(CHORD_TYPES) / sizeof(CHORD_TYPES[0]);
+
+enum : uint8_t { ALTER_NONE = 0, ALTER_ADD = 1, ALTER_SUBTRACT = 2, ALTER_RAISE = 3, ALTER_LOWER = 4 };
+static constexpr const char* ALTERATION_NAMES[] = { "none", "add", "subtract", "raise", "lower" };
+static constexpr uint8_t ALTERATION_TYPE_COUNT = 5;
+
+// Semitones above the root of each scale degree 1-15, as the major scale has them
+static constexpr uint8_t DEGREE_SEMITONES[16] = { 0, 0, 2, 4, 5, 7, 9, 11, 12, 14, 16, 17, 19, 21, 23, 24 };
+
+// Semitones above C of the letters 1 A to 7 G, and their place on the line of fifths
+static constexpr uint8_t LETTER_SEMITONES[8] = { 0, 9, 11, 0, 2, 4, 5, 7 };
+static constexpr int8_t LETTER_FIFTHS[8] = { 0, 3, 5, 0, 2, 4, -1, 1 };
+static constexpr char LETTER_NAMES[8] = { '?', 'A', 'B', 'C', 'D', 'E', 'F', 'G' };
+// Letters in the order a key signature sharps them, flats go the other way
+static constexpr uint8_t SHARP_ORDER[7] = { 6, 3, 7, 4, 1, 5, 2 };
+
+struct TextKind {
+  uint8_t bank;
+  uint8_t status;
+  const char* name;
+};
+
+static constexpr TextKind TEXT_KINDS[] = {
+  { ump::flex::BANK_METADATA_TEXT, 0x00, "text" },
+  { ump::flex::BANK_METADATA_TEXT, 0x01, "projectName" },
+  { ump::flex::BANK_METADATA_TEXT, 0x02, "songName" },
+  { ump::flex::BANK_METADATA_TEXT, 0x03, "clipName" },
+  { ump::flex::BANK_METADATA_TEXT, 0x04, "copyright" },
+  { ump::flex::BANK_METADATA_TEXT, 0x05, "composer" },
+  { ump::flex::BANK_METADATA_TEXT, 0x06, "lyricist" },
+  { ump::flex::BANK_METADATA_TEXT, 0x07, "arranger" },
+  { ump::flex::BANK_METADATA_TEXT, 0x08, "publisher" },
+  { ump::flex::BANK_METADATA_TEXT, 0x09, "primaryPerformer" },
+  { ump::flex::BANK_METADATA_TEXT, 0x0A, "accompanyingPerformer" },
+  { ump::flex::BANK_METADATA_TEXT, 0x0B, "recordingDate" },
+  { ump::flex::BANK_METADATA_TEXT, 0x0C, "recordingLocation" },
+  { ump::flex::BANK_PERFORMANCE_TEXT, 0x00, "performanceText" },
+  { ump::flex::BANK_PERFORMANCE_TEXT, 0x01, "lyrics" },
+  { ump::flex::BANK_PERFORMANCE_TEXT, 0x02, "lyricsLanguage" },
+  { ump::flex::BANK_PERFORMANCE_TEXT, 0x03, "ruby" },
+  { ump::flex::BANK_PERFORMANCE_TEXT, 0x04, "rubyLanguage" },
+};
+static constexpr uint8_t TEXT_KIND_COUNT = sizeof(TEXT_KINDS) / sizeof(TEXT_KINDS[0]);
+static constexpr size_t TEXT_BYTES_PER_PACKET = 12;
+
+struct Note {
+  // 1 A to 7 G, 0 none
+  uint8_t letter = 0;
+  // Sharps positive, flats negative, -2 to 2
+  int8_t accidental = 0;
+};
+
+struct Alteration {
+  uint8_t type = ALTER_NONE;
+  uint8_t degree = 0;
+};
+
+struct Chord {
+  Note tonic;
+  uint8_t type = 0;
+  Alteration alterations[4];
+  // A slash chord's bass, letter 0 when the bass is the tonic
+  Note bass;
+  uint8_t bassType = 0;
+  Alteration bassAlterations[2];
+};
+
+struct Message {
+  Kind kind = Kind::Tempo;
+  uint8_t group = 0;
+  // -1 for the whole group
+  int8_t channel = -1;
+  double bpm = 120;
+  uint8_t numerator = 4;
+  // 2 for quarter notes
+  uint8_t denominatorPower = 2;
+  uint8_t thirtySecondsPerBeat = 8;
+  uint8_t clocksPerClick = 24;
+  uint8_t accents[3] = { 0, 0, 0 };
+  uint8_t subdivisions[2] = { 0, 0 };
+  // Key signature, -8 when it is not a standard one
+  int8_t sharpsFlats = 0;
+  uint8_t tonicLetter = 0;
+  Chord chord;
+  // Index into TEXT_KINDS
+  uint8_t textKind = 0;
+  std::string text;
+};
+
+// ============================================================================
+// Notes and Chords
+// ============================================================================
+
+constexpr int8_t signExtend4(uint32_t nibble) {
+  return (int8_t)((int8_t)((nibble & 0xF) << 4) >> 4);
+}
+
+constexpr uint8_t pitchClass(const Note& note) {
+  return (uint8_t)((LETTER_SEMITONES[note.letter & 0x7] + 24 + note.accidental) % 12);
+}
+
+// "Eb", "F#", "Bbb": false if it is not a note name
+inline bool parseNote(const char* text, Note& note) {
+  char letter = text[0] >= 'a' && text[0] <= 'g' ? (char)(text[0] - 32) : text[0];
+  if (letter < 'A' || letter > 'G') return false;
+  note.letter = (uint8_t)(letter - 'A' + 1);
+  note.accidental = 0;
+  for (const char* c = text + 1; *c != '\0'; c++) {
+    if (*c == '#') note.accidental++;
+    else if (*c == 'b') note.accidental--;
+    else return false;
+    if (note.accidental > 2 || note.accidental < -2) return false;
+  }
+  return true;
+}
+
+inline void formatNote(const Note& note, char* buffer, size_t size) {
+  size_t length = 0;
+  if (size < 4) return;
+  buffer[length++] = LETTER_NAMES[note.letter & 0x7];
+  for (int8_t i = 0; i < note.accidental && length < size - 1; i++) buffer[length++] = '#';
+  for (int8_t i = 0; i > note.accidental && length < size - 1; i--) buffer[length++] = 'b';
+  buffer[length] = '\0';
+}
+
+// Type index of a chord name, -1 if unknown
+inline int findChordType(const char* name) {
+  for (uint8_t i = 0; i < CHORD_TYPE_COUNT; i++) {
+    if (strcmp(CHORD_TYPES[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+inline int findAlteration(const char* name) {
+  for (uint8_t i = 0; i < ALTERATION_TYPE_COUNT; i++) {
+    if (strcmp(ALTERATION_NAMES[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+inline int findTextKind(const char* name) {
+  for (uint8_t i = 0; i < TEXT_KIND_COUNT; i++) {
+    if (strcmp(TEXT_KINDS[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+// Intervals above the root of a chord type with its alterations applied
+inline uint16_t chordIntervals(uint8_t type, const Alteration* alterations, size_t count) {
+  uint16_t intervals = type < CHORD_TYPE_COUNT ? CHORD_TYPES[type].intervals : 0;
+  for (size_t i = 0; i < count; i++) {
+    uint8_t semitones = DEGREE_SEMITONES[alterations[i].degree & 0xF];
+    switch (alterations[i].type) {
+      case ALTER_ADD: intervals |= pc(semitones); break;
+      case ALTER_SUBTRACT: intervals &= (uint16_t)~pc(semitones); break;
+      case ALTER_RAISE: intervals = (uint16_t)((intervals & ~pc(semitones)) | pc(semitones + 1)); break;
+      case ALTER_LOWER: intervals = (uint16_t)((intervals & ~pc(semitones)) | pc(semitones + 11)); break;
+      default: break;
+    }
+  }
+  return intervals;
+}
+
+// Pitch classes sounding in a chord, bit 0 for C, bass included
+inline uint16_t chordPitchClasses(const Chord& chord) {
+  auto rotate = [](uint16_t intervals, uint8_t root) {
+    return (uint16_t)(((intervals << root) | (intervals >> (12 - root))) & 0xFFF);
+  };
+  uint16_t pitches = rotate(chordIntervals(chord.type, chord.alterations, 4), pitchClass(chord.tonic));
+  if (chord.bass.letter != 0) {
+    uint16_t bass = chordIntervals(chord.bassType, chord.bassAlterations, 2);
+    pitches |= rotate(bass != 0 ? bass : pc(0), pitchClass(chord.bass));
+  }
+  return pitches;
+}
+
+// "Ebm7(add9)/Bb"
+inline void formatChord(const Chord& chord, char* buffer, size_t size) {
+  static constexpr const char* PREFIXES[] = { "", "add", "no", "#", "b" };
+  char note[8];
+  formatNote(chord.tonic, note, sizeof(note));
+  int length = snprintf(buffer, size, "%s%s", note, chord.type < CHORD_TYPE_COUNT ? CHORD_TYPES[chord.type].symbol : "");
+  for (const Alteration& alteration : chord.alterations) {
+    if (alteration.type == ALTER_NONE || alteration.type >= ALTERATION_TYPE_COUNT) continue;
+    if (length < 0 || (size_t)length >= size) return;
+    length += snprintf(buffer + length, size - length, "(%s%u)", PREFIXES[alteration.type], alteration.degree);
+  }
+  if (chord.bass.letter != 0 && length >= 0 && (size_t)length < size) {
+    formatNote(chord.bass, note, sizeof(note));
+    snprintf(buffer + length, size - length, "/%s", note);
+  }
+}
+
+// ============================================================================
+// Key Signatures
+// ============================================================================
+
+// Sharps or flats of the major (or minor) key on a tonic, false past seven
+inline bool keySignatureFor(const Note& tonic, bool minor, int8_t& sharpsFlats) {
+  int fifths = LETTER_FIFTHS[tonic.letter & 0x7] + 7 * tonic.accidental - (minor ? 3 : 0);
+  if (fifths < -7 || fifths > 7) return false;
+  sharpsFlats = (int8_t)fifths;
+  return true;
+}
+
+// The tonic as the signature spells it
+inline Note keyTonic(int8_t sharpsFlats, uint8_t letter) {
+  Note tonic;
+  tonic.letter = letter;
+  for (int8_t i = 0; i < 7; i++) {
+    if (i < sharpsFlats && SHARP_ORDER[i] == letter) tonic.accidental = 1;
+    if (i < -sharpsFlats && SHARP_ORDER[6 - i] == letter) tonic.accidental = -1;
+  }
+  return tonic;
+}
+
+// "major", "minor", or "" for another mode or a non-standard signature
+inline const char* keyMode(int8_t sharpsFlats, uint8_t letter) {
+  if (sharpsFlats < -7 || sharpsFlats > 7 || letter == 0) return "";
+  Note tonic = keyTonic(sharpsFlats, letter);
+  int fifths = LETTER_FIFTHS[letter & 0x7] + 7 * tonic.accidental;
+  return fifths == sharpsFlats ? "major" : fifths == sharpsFlats + 3 ? "minor" : "";
+}
+
+// ============================================================================
+// Encoding
+// ============================================================================
+
+constexpr uint32_t alterationField(const Alteration& alteration) {
+  return (uint32_t)(((alteration.type & 0xF) << 4) | (alteration.degree & 0xF));
+}
+
+// Append the packets of one message, four words each
+inline void encode(const Message& message, std::vector<uint32_t>& out) {
+  uint8_t address = message.channel < 0 ? ump::flex::ADDRESS_GROUP : ump::flex::ADDRESS_CHANNEL;
+  uint8_t channel = message.channel < 0 ? 0 : (uint8_t)(message.channel & 0xF);
+  auto append = [&](uint8_t form, uint8_t bank, uint8_t status, uint32_t data1, uint32_t data2 = 0, uint32_t data3 = 0) {
+    ump::Packet<4> packet = ump::flex::message(message.group, form, address, channel, bank, status, data1, data2, data3);
+    out.insert(out.end(), packet.words, packet.words + 4);
+  };
+
+  switch (message.kind) {
+    case Kind::Tempo: {
+      double bpm = message.bpm > 1 ? message.bpm : 1;
+      append(ump::flex::FORM_COMPLETE, ump::flex::BANK_SETUP, ump::flex::SET_TEMPO, (uint32_t)(6e9 / bpm + 0.5));
+      break;
+    }
+    case Kind::TimeSignature:
+      append(ump::flex::FORM_COMPLETE, ump::flex::BANK_SETUP, ump::flex::SET_TIME_SIGNATURE,
+             ((uint32_t)message.numerator << 24) | ((uint32_t)message.denominatorPower << 16) |
+             ((uint32_t)message.thirtySecondsPerBeat << 8));
+      break;
+    case Kind::Metronome:
+      append(ump::flex::FORM_COMPLETE, ump::flex::BANK_SETUP, ump::flex::SET_METRONOME,
+             ((uint32_t)message.clocksPerClick << 24) | ((uint32_t)message.accents[0] << 16) |
+             ((uint32_t)message.accents[1] << 8) | message.accents[2],
+             ((uint32_t)message.subdivisions[0] << 24) | ((uint32_t)message.subdivisions[1] << 16));
+      break;
+    case Kind::KeySignature:
+      append(ump::flex::FORM_COMPLETE, ump::flex::BANK_SETUP, ump::flex::SET_KEY_SIGNATURE,
+             ((uint32_t)(message.sharpsFlats & 0xF) << 28) | ((uint32_t)(message.tonicLetter & 0xF) << 24));
+      break;
+    case Kind::Chord: {
+      const Chord& chord = message.chord;
+      append(ump::flex::FORM_COMPLETE, ump::flex::BANK_SETUP, ump::flex::SET_CHORD_NAME,
+             ((uint32_t)(chord.tonic.accidental & 0xF) << 28) | ((uint32_t)(chord.tonic.letter & 0xF) << 24) |
+             ((uint32_t)chord.type << 16) | (alterationField(chord.alterations[0]) << 8) |
+             alterationField(chord.alterations[1]),
+             (alterationField(chord.alterations[2]) << 24) | (alterationField(chord.alterations[3]) << 16),
+             ((uint32_t)(chord.bass.accidental & 0xF) << 28) | ((uint32_t)(chord.bass.letter & 0xF) << 24) |
+             ((uint32_t)chord.bassType << 16) | (alterationField(chord.bassAlterations[0]) << 8) |
+             alterationField(chord.bassAlterations[1]));
+      break;
+    }
+    case Kind::Text: {
+      const TextKind& kind = TEXT_KINDS[message.textKind < TEXT_KIND_COUNT ? message.textKind : 0];
+      size_t length = message.text.size();
+      size_t packets = length == 0 ? 1 : (length + TEXT_BYTES_PER_PACKET - 1) / TEXT_BYTES_PER_PACKET;
+      for (size_t p = 0; p < packets; p++) {
+        uint32_t data[3] = { 0, 0, 0 };
+        for (size_t i = 0; i < TEXT_BYTES_PER_PACKET && p * TEXT_BYTES_PER_PACKET + i < length; i++) {
+          data[i / 4] |= (uint32_t)(uint8_t)message.text[p * TEXT_BYTES_PER_PACKET + i] << (24 - 8 * (i % 4));
+        }
+        uint8_t form = packets == 1 ? ump::flex::FORM_COMPLETE
+                     : p == 0 ? ump::flex::FORM_START
+                     : p == packets - 1 ? ump::flex::FORM_END : ump::flex::FORM_CONTINUE;
+        append(form, kind.bank, kind.status, data[0], data[1], data[2]);
+      }
+      break;
+    }
+  }
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+/**
+ * Turns Flex Data packets back into messages. Holds the text being joined
+ * on each group, so use one Decoder per input stream.
+ */
+class Decoder {
+private:
+  struct PendingText {
+    bool active = false;
+    uint8_t kind = 0;
+    std::string text;
+  };
+  PendingText pending[16];
+
+  static Alteration alteration(uint32_t field) {
+    Alteration result;
+    result.type = (uint8_t)((field >> 4) & 0xF);
+    result.degree = (uint8_t)(field & 0xF);
+    return result;
+  }
+
+  static void appendText(std::string& text, const uint32_t* packet) {
+    for (size_t i = 0; i < TEXT_BYTES_PER_PACKET; i++) {
+      uint8_t byte = (uint8_t)(packet[1 + i / 4] >> (24 - 8 * (i % 4)));
+      // Unused bytes of the last packet are zero
+      if (byte != 0) text.push_back((char)byte);
+    }
+  }
+
+public:
+  void reset() {
+    for (PendingText& text : pending) text = PendingText();
+  }
+
+  // False until a packet completes a known message
+  bool feed(const uint32_t* packet, Message& message) {
+    if (ump::typeOf(packet[0]) != ump::flex::TYPE) return false;
+    uint8_t bank = (uint8_t)ump::flex::StatusBank::get(packet);
+    uint8_t status = (uint8_t)ump::flex::Status::get(packet);
+    uint8_t form = (uint8_t)ump::flex::Form::get(packet);
+    message = Message();
+    message.group = (uint8_t)ump::Group::get(packet);
+    message.channel = ump::flex::Address::get(packet) == ump::flex::ADDRESS_CHANNEL ? (int8_t)ump::flex::Channel::get(packet) : -1;
+
+    if (bank == ump::flex::BANK_METADATA_TEXT || bank == ump::flex::BANK_PERFORMANCE_TEXT) {
+      int kind = -1;
+      for (uint8_t i = 0; i < TEXT_KIND_COUNT; i++) {
+        if (TEXT_KINDS[i].bank == bank && TEXT_KINDS[i].status == status) kind = i;
+      }
+      if (kind < 0) return false;
+      PendingText& text = pending[message.group];
+      if (form == ump::flex::FORM_COMPLETE || form == ump::flex::FORM_START) {
+        text.active = true;
+        text.kind = (uint8_t)kind;
+        text.text.clear();
+      } else if (!text.active || text.kind != kind) {
+        // The start went missing
+        return false;
+      }
+      appendText(text.text, packet);
+      if (form == ump::flex::FORM_START || form == ump::flex::FORM_CONTINUE) return false;
+      message.kind = Kind::Text;
+      message.textKind = (uint8_t)kind;
+      message.text.swap(text.text);
+      text.active = false;
+      return true;
+    }
+    if (bank != ump::flex::BANK_SETUP) return false;
+
+    switch (status) {
+      case ump::flex::SET_TEMPO:
+        if (packet[1] == 0) return false;
+        message.kind = Kind::Tempo;
+        message.bpm = 6e9 / packet[1];
+        return true;
+      case ump::flex::SET_TIME_SIGNATURE:
+        message.kind = Kind::TimeSignature;
+        message.numerator = (uint8_t)(packet[1] >> 24);
+        message.denominatorPower = (uint8_t)(packet[1] >> 16);
+        message.thirtySecondsPerBeat = (uint8_t)(packet[1] >> 8);
+        return true;
+      case ump::flex::SET_METRONOME:
+        message.kind = Kind::Metronome;
+        message.clocksPerClick = (uint8_t)(packet[1] >> 24);
+        message.accents[0] = (uint8_t)(packet[1] >> 16);
+        message.accents[1] = (uint8_t)(packet[1] >> 8);
+        message.accents[2] = (uint8_t)packet[1];
+        message.subdivisions[0] = (uint8_t)(packet[2] >> 24);
+        message.subdivisions[1] = (uint8_t)(packet[2] >> 16);
+        return true;
+      case ump::flex::SET_KEY_SIGNATURE:
+        message.kind = Kind::KeySignature;
+        message.sharpsFlats = signExtend4(packet[1] >> 28);
+        message.tonicLetter = (uint8_t)((packet[1] >> 24) & 0xF);
+        if (message.tonicLetter > 7) message.tonicLetter = 0;
+        return true;
+      case ump::flex::SET_CHORD_NAME: {
+        Chord& chord = message.chord;
+        message.kind = Kind::Chord;
+        chord.tonic.accidental = signExtend4(packet[1] >> 28);
+        chord.tonic.letter = (uint8_t)((packet[1] >> 24) & 0xF);
+        chord.type = (uint8_t)(packet[1] >> 16);
+        chord.alterations[0] = alteration(packet[1] >> 8);
+        chord.alterations[1] = alteration(packet[1]);
+        chord.alterations[2] = alteration(packet[2] >> 24);
+        chord.alterations[3] = alteration(packet[2] >> 16);
+        chord.bass.accidental = signExtend4(packet[3] >> 28);
+        chord.bass.letter = (uint8_t)((packet[3] >> 24) & 0xF);
+        chord.bassType = (uint8_t)(packet[3] >> 16);
+        chord.bassAlterations[0] = alteration(packet[3] >> 8);
+        chord.bassAlterations[1] = alteration(packet[3]);
+        if (chord.tonic.letter > 7 || chord.type >= CHORD_TYPE_COUNT) return false;
+        if (chord.bass.letter > 7 || chord.bassType >= CHORD_TYPE_COUNT) chord.bass = Note();
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+};
+
+}  // namespace flexdata
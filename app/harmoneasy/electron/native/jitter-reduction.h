@@ -0,0 +1,103 @@
+/**
+ * UMP Jitter Reduction
+ *
+ * JR Clock and JR Timestamp messages carry the sender's time as a 16-bit
+ * count of 1/31250 s ticks, which wraps every 2.1 s.
+ * - A sender sends JR Clocks with its time at the moment they leave, and
+ *   puts a JR Timestamp with the time it meant them to leave in front of
+ *   messages.
+ * - A receiver maps sender time to its own clock from the JR Clocks. The
+ *   transport can only ever add delay, so the offset follows the lower
+ *   envelope of the arrival delays: down at once, up slowly, which also
+ *   follows the drift between the two clocks. A timestamped message then
+ *   lands at its sent time plus the smallest delay, whatever its own delay.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace jr {
+
+// One JR tick, 1/31250 s
+static constexpr uint64_t TICK_NS = 32000;
+// How often a sender sends a JR Clock, well inside the wrap
+static constexpr uint64_t CLOCK_INTERVAL_NS = 100000000ULL;
+
+constexpr uint16_t ticksAt(uint64_t nanoseconds) {
+  return (uint16_t)(nanoseconds / TICK_NS);
+}
+
+// The full tick count of a 16-bit time, taking the wrap closest to `near`
+constexpr uint64_t unwrap(uint16_t time, uint64_t near) {
+  return near + (int64_t)(int16_t)(uint16_t)(time - (uint16_t)near);
+}
+
+class Receiver {
+public:
+  // Longer without a JR Clock and the sender is taken to have restarted
+  static constexpr uint64_t RESYNC_NS = 1000000000ULL;
+  // A delay this far off the estimate is a new sender clock, not jitter
+  static constexpr int64_t JUMP_NS = 100000000LL;
+  // A later delay raises the offset by 1/32 of the difference
+  static constexpr int RISE_SHIFT = 5;
+
+private:
+  bool synced = false;
+  // Arrival time minus sender time
+  int64_t offsetNs = 0;
+  // Unwrapped sender time of the last JR Clock, and its arrival
+  uint64_t clockTicks = 0;
+  uint64_t clockArrivalNs = 0;
+  // Time of the messages after the last JR Timestamp, 0 when none applies
+  uint64_t stampNs = 0;
+
+  // Sender ticks at a local time, from the last JR Clock
+  uint64_t ticksNear(uint64_t arrivalNs) const {
+    return clockTicks + (arrivalNs - clockArrivalNs) / TICK_NS;
+  }
+
+public:
+  void reset() {
+    synced = false;
+    stampNs = 0;
+  }
+
+  bool isSynced() const { return synced; }
+  int64_t offset() const { return offsetNs; }
+
+  void clock(uint16_t time, uint64_t arrivalNs) {
+    bool resync = !synced || arrivalNs - clockArrivalNs > RESYNC_NS;
+    uint64_t ticks = resync ? time : unwrap(time, ticksNear(arrivalNs));
+    int64_t delayNs = (int64_t)arrivalNs - (int64_t)(ticks * TICK_NS);
+
+    if (resync || llabs(delayNs - offsetNs) > JUMP_NS || delayNs < offsetNs) {
+      offsetNs = delayNs;
+    } else {
+      offsetNs += (delayNs - offsetNs) >> RISE_SHIFT;
+    }
+    synced = true;
+    clockTicks = ticks;
+    clockArrivalNs = arrivalNs;
+    stampNs = 0;
+  }
+
+  void timestamp(uint16_t time, uint64_t arrivalNs) {
+    if (!synced || arrivalNs - clockArrivalNs > RESYNC_NS) {
+      stampNs = 0;
+      return;
+    }
+    uint64_t ticks = unwrap(time, ticksNear(arrivalNs));
+    int64_t eventNs = (int64_t)(ticks * TICK_NS) + offsetNs;
+    // Never later than the message actually arrived
+    stampNs = eventNs > 0 && (uint64_t)eventNs < arrivalNs ? (uint64_t)eventNs : arrivalNs;
+  }
+
+  // When a message arriving at arrivalNs was sent, by the last JR Timestamp
+  uint64_t eventTime(uint64_t arrivalNs) const {
+    return stampNs != 0 ? stampNs : arrivalNs;
+  }
+};
+
+}  // namespace jr
@@ -0,0 +1,325 @@
+/**
+ * Leveled asynchronous logging for the native MIDI layer
+ *
+ * Logging through iostreams formats and flushes on the calling thread, which
+ * on a send or input path turns every message into a blocking write to the
+ * terminal. Here the calling thread only captures the format string and its
+ * raw arguments into a lock-free queue; a background thread formats them
+ * printf-style and writes them out.
+ *
+ * - MIDI2_LOG_LEVEL sets the minimum level compiled in (default 2, Info).
+ *   Calls below it are discarded at compile time and their arguments are
+ *   never evaluated, so per-message Trace logging costs nothing normally.
+ * - The format must be a string literal: only its pointer is queued.
+ *   String arguments are copied, up to STRING_BYTES per record.
+ * - When the queue is full the record is dropped and counted rather than
+ *   blocking the caller; the drain thread reports how many were lost.
+ *
+ *   MIDI2_LOG_INFO("Opened %s on port %u", name, port);
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <type_traits>
+#include <algorithm>
+
+#ifndef MIDI2_LOG_LEVEL
+  #define MIDI2_LOG_LEVEL 2
+#endif
+
+namespace logging {
+
+// CamelCase values, ERROR and DEBUG are macros on some platforms
+enum class Level : int {
+  Trace = 0,
+  Debug = 1,
+  Info = 2,
+  Warn = 3,
+  Error = 4
+};
+
+// One captured argument, formatted later by the drain thread
+struct Argument {
+  enum Kind : uint8_t { SIGNED, UNSIGNED, REAL, STRING, POINTER };
+  Kind kind;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    const void* p;
+    // Offset of the copied string in the record's string storage
+    uint16_t offset;
+  };
+};
+
+struct Record {
+  static constexpr size_t MAX_ARGUMENTS = 8;
+  static constexpr size_t STRING_BYTES = 192;
+
+  Level level;
+  const char* format;
+  uint8_t argumentCount;
+  uint16_t stringLength;
+  Argument arguments[MAX_ARGUMENTS];
+  char strings[STRING_BYTES];
+};
+
+class Logger {
+private:
+  static constexpr size_t CAPACITY = 1024;
+
+  /**
+   * Bounded multi-producer queue. A slot's turn counter says whose move it
+   * is: equal to the lap of a producer's position means free to write, one
+   * more means written and ready for the consumer. Counters start at zero,
+   * so the queue needs no initialisation before the first log call.
+   */
+  struct Slot {
+    std::atomic<size_t> turn;
+    Record record;
+  };
+
+  static inline Slot slots[CAPACITY];
+  static inline std::atomic<size_t> enqueuePosition{ 0 };
+  static inline size_t dequeuePosition = 0;
+  static inline std::atomic<uint64_t> dropped{ 0 };
+  static inline std::atomic<bool> running{ false };
+  static inline std::thread thread;
+
+  static size_t lapOf(size_t position) {
+    return position - position % CAPACITY;
+  }
+
+  static void capture(Record& record, Argument::Kind kind, uint64_t bits) {
+    Argument& argument = record.arguments[record.argumentCount++];
+    argument.kind = kind;
+    argument.u = bits;
+  }
+
+  static void captureString(Record& record, const char* value) {
+    Argument& argument = record.arguments[record.argumentCount++];
+    argument.kind = Argument::STRING;
+    argument.offset = record.stringLength;
+    if (value == nullptr) value = "(null)";
+    if (record.stringLength >= Record::STRING_BYTES - 1) {
+      // Out of room, later strings print empty
+      argument.offset = Record::STRING_BYTES - 1;
+      record.strings[Record::STRING_BYTES - 1] = '\0';
+      return;
+    }
+    size_t length = strnlen(value, Record::STRING_BYTES - record.stringLength - 1);
+    memcpy(record.strings + record.stringLength, value, length);
+    record.strings[record.stringLength + length] = '\0';
+    record.stringLength += (uint16_t)(length + 1);
+  }
+
+  template<typename T>
+  static void captureAny(Record& record, const T& value) {
+    if (record.argumentCount >= Record::MAX_ARGUMENTS) return;
+    if constexpr (std::is_same<T, std::string>::value) {
+      captureString(record, value.c_str());
+    } else if constexpr (std::is_convertible<T, const char*>::value) {
+      captureString(record, value);
+    } else if constexpr (std::is_pointer<T>::value) {
+      Argument& argument = record.arguments[record.argumentCount++];
+      argument.kind = Argument::POINTER;
+      argument.p = (const void*)value;
+    } else if constexpr (std::is_floating_point<T>::value) {
+      Argument& argument = record.arguments[record.argumentCount++];
+      argument.kind = Argument::REAL;
+      argument.d = (double)value;
+    } else if constexpr (std::is_signed<T>::value) {
+      capture(record, Argument::SIGNED, (uint64_t)(int64_t)value);
+    } else {
+      capture(record, Argument::UNSIGNED, (uint64_t)value);
+    }
+  }
+
+  /**
+   * Expand one printf conversion with its captured argument. Length
+   * modifiers are replaced by the captured width, so "%d" with a uint64_t
+   * or "%u" with a size_t both print correctly.
+   */
+  static void formatArgument(std::string& out, const char* spec, size_t specLength, char conversion,
+                             const Record& record, const Argument* argument) {
+    if (argument == nullptr) {
+      out += "<?>";
+      return;
+    }
+
+    char format[32];
+    size_t length = 0;
+    for (size_t i = 0; i < specLength && length < sizeof(format) - 4; i++) {
+      if (!strchr("hlzjtLq", spec[i])) format[length++] = spec[i];
+    }
+
+    char buffer[256];
+    int written = 0;
+    switch (conversion) {
+      case 'c':
+        format[length++] = 'c';
+        format[length] = '\0';
+        written = snprintf(buffer, sizeof(buffer), format, (int)argument->i);
+        break;
+      case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+        format[length++] = 'l';
+        format[length++] = 'l';
+        format[length++] = conversion;
+        format[length] = '\0';
+        if (argument->kind == Argument::REAL) {
+          written = snprintf(buffer, sizeof(buffer), format, (long long)argument->d);
+        } else {
+          written = snprintf(buffer, sizeof(buffer), format, (long long)argument->i);
+        }
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+        format[length++] = conversion;
+        format[length] = '\0';
+        written = snprintf(buffer, sizeof(buffer), format,
+                           argument->kind == Argument::REAL ? argument->d
+                           : argument->kind == Argument::SIGNED ? (double)argument->i : (double)argument->u);
+        break;
+      case 's':
+        format[length++] = 's';
+        format[length] = '\0';
+        written = snprintf(buffer, sizeof(buffer), format,
+                           argument->kind == Argument::STRING ? record.strings + argument->offset : "<?>");
+        break;
+      case 'p':
+        format[length++] = 'p';
+        format[length] = '\0';
+        written = snprintf(buffer, sizeof(buffer), format, argument->p);
+        break;
+      default:
+        out.append(spec, specLength);
+        out += conversion;
+        return;
+    }
+    if (written > 0) out.append(buffer, std::min<size_t>((size_t)written, sizeof(buffer) - 1));
+  }
+
+  static void format(std::string& out, const Record& record) {
+    size_t next = 0;
+    for (const char* c = record.format; *c; c++) {
+      if (*c != '%') {
+        out += *c;
+        continue;
+      }
+      if (c[1] == '%') {
+        out += '%';
+        c++;
+        continue;
+      }
+      const char* spec = c++;
+      while (*c && strchr("-+ #0123456789.hlzjtLq", *c)) c++;
+      if (!*c) break;
+      const Argument* argument = next < record.argumentCount ? &record.arguments[next] : nullptr;
+      next++;
+      formatArgument(out, spec, (size_t)(c - spec), *c, record, argument);
+    }
+  }
+
+  static void write(Level level, const std::string& message) {
+    static const char* const prefixes[] = { "[MIDI2] TRACE: ", "[MIDI2] DEBUG: ", "[MIDI2] ", "[MIDI2] WARN: ", "[MIDI2] ERROR: " };
+    FILE* stream = level >= Level::Warn ? stderr : stdout;
+    fputs(prefixes[(int)level], stream);
+    fwrite(message.data(), 1, message.size(), stream);
+    fputc('\n', stream);
+  }
+
+  // Consumer side, only ever run by one thread at a time
+  static size_t drain() {
+    size_t count = 0;
+    std::string message;
+    for (;;) {
+      size_t position = dequeuePosition;
+      Slot& slot = slots[position % CAPACITY];
+      if (slot.turn.load(std::memory_order_acquire) != lapOf(position) + 1) break;
+
+      message.clear();
+      format(message, slot.record);
+      write(slot.record.level, message);
+      slot.turn.store(lapOf(position) + CAPACITY, std::memory_order_release);
+      dequeuePosition = position + 1;
+      count++;
+    }
+
+    uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost > 0) {
+      write(Level::Warn, std::to_string(lost) + " log messages dropped, queue full");
+      count++;
+    }
+    if (count > 0) {
+      fflush(stdout);
+      fflush(stderr);
+    }
+    return count;
+  }
+
+  static void run() {
+    while (running.load(std::memory_order_acquire)) {
+      if (drain() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+public:
+  template<typename... Args>
+  static void log(Level level, const char* format, const Args&... args) {
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+      slot = &slots[position % CAPACITY];
+      size_t turn = slot->turn.load(std::memory_order_acquire);
+      if (turn == lapOf(position)) {
+        if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+      } else if (turn < lapOf(position)) {
+        // Still holds the previous lap's record, the queue is full
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        position = enqueuePosition.load(std::memory_order_relaxed);
+      }
+    }
+
+    Record& record = slot->record;
+    record.level = level;
+    record.format = format;
+    record.argumentCount = 0;
+    record.stringLength = 0;
+    (captureAny(record, args), ...);
+    slot->turn.store(lapOf(position) + 1, std::memory_order_release);
+  }
+
+  static void start() {
+    if (running.exchange(true)) return;
+    thread = std::thread(run);
+  }
+
+  // Stop the drain thread and write out whatever is still queued
+  static void stop() {
+    if (running.exchange(false) && thread.joinable()) thread.join();
+    drain();
+  }
+};
+
+}  // namespace logging
+
+// Calls below MIDI2_LOG_LEVEL are removed by the compiler, arguments included
+#define MIDI2_LOG(level, ...) \
+  do { \
+    if constexpr ((int)(level) >= MIDI2_LOG_LEVEL) ::logging::Logger::log((level), __VA_ARGS__); \
+  } while (0)
+
+#define MIDI2_LOG_TRACE(...) MIDI2_LOG(::logging::Level::Trace, __VA_ARGS__)
+#define MIDI2_LOG_DEBUG(...) MIDI2_LOG(::logging::Level::Debug, __VA_ARGS__)
+#define MIDI2_LOG_INFO(...) MIDI2_LOG(::logging::Level::Info, __VA_ARGS__)
+#define MIDI2_LOG_WARN(...) MIDI2_LOG(::logging::Level::Warn, __VA_ARGS__)
+#define MIDI2_LOG_ERROR(...) MIDI2_LOG(::logging::Level::Error, __VA_ARGS__)
@@ -0,0 +1,357 @@
+/**
+ * MIDI Clip File (SMF2CLIP) support
+ *
+ * A MIDI Clip File (MIDI 2.0 Container File Format, M2-116-U) is the magic
+ * "SMF2CLIP" followed by big-endian UMP words, every message preceded by a
+ * Delta Clockstamp giving its distance in ticks from the previous one:
+ *
+ *   SMF2CLIP
+ *   DCS 0, Delta Clockstamp Ticks Per Quarter Note    clip configuration header
+ *   DCS 0, Start of Clip                             clip sequence
+ *   DCS n, message ...
+ *   DCS n, End of Clip
+ *
+ * The format has no length fields, so a clip can be written as a stream and
+ * is complete as soon as End of Clip is appended.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+#include "ump.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <cerrno>
+#endif
+
+namespace clip {
+
+static constexpr char MAGIC[8] = { 'S', 'M', 'F', '2', 'C', 'L', 'I', 'P' };
+
+// Delta Clockstamps carry 20 bits, longer gaps are split with NOOPs
+static constexpr uint32_t MAX_DELTA_TICKS = 0xFFFFF;
+static constexpr uint32_t NOOP = ump::utility::noop();
+static constexpr uint32_t START_OF_CLIP = ump::stream::startOfClip()[0];
+static constexpr uint32_t END_OF_CLIP = ump::stream::endOfClip()[0];
+
+constexpr uint32_t deltaClockstamp(uint32_t ticks) {
+  return ump::utility::deltaClockstamp(ticks & MAX_DELTA_TICKS);
+}
+
+constexpr uint32_t ticksPerQuarterNote(uint16_t ticks) {
+  return ump::utility::deltaClockstampTicksPerQuarter(ticks);
+}
+
+// Flex Data Set Tempo on group 0, tempo in 10 ns units per quarter note
+inline void setTempo(uint32_t tenNanosecondsPerQuarter, uint32_t words[4]) {
+  ump::Packet<4> packet = ump::flex::setTempo(0, tenNanosecondsPerQuarter);
+  for (int i = 0; i < 4; i++) words[i] = packet[i];
+}
+
+/**
+ * Builds a whole clip in memory, for conversions where the complete
+ * sequence is known up front and the file is written in one go.
+ */
+class Encoder {
+private:
+  std::vector<uint8_t> bytes;
+
+  void put(const uint32_t* words, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      uint32_t word = words[i];
+      const uint8_t big[4] = { (uint8_t)(word >> 24), (uint8_t)(word >> 16), (uint8_t)(word >> 8), (uint8_t)word };
+      bytes.insert(bytes.end(), big, big + 4);
+    }
+  }
+
+  void putDelta(uint64_t deltaTicks) {
+    uint32_t spacer[2] = { deltaClockstamp(MAX_DELTA_TICKS), NOOP };
+    for (; deltaTicks > MAX_DELTA_TICKS; deltaTicks -= MAX_DELTA_TICKS) put(spacer, 2);
+    uint32_t stamp = deltaClockstamp((uint32_t)deltaTicks);
+    put(&stamp, 1);
+  }
+
+public:
+  // Magic, clip configuration header and Start of Clip
+  void begin(uint16_t ticksPerQuarter, size_t expectedBytes = 0) {
+    bytes.clear();
+    bytes.reserve(sizeof(MAGIC) + 28 + expectedBytes + 20);
+    bytes.insert(bytes.end(), MAGIC, MAGIC + sizeof(MAGIC));
+    uint32_t header[7] = { deltaClockstamp(0), ticksPerQuarterNote(ticksPerQuarter), deltaClockstamp(0), START_OF_CLIP, 0, 0, 0 };
+    put(header, 7);
+  }
+
+  void append(uint64_t deltaTicks, const uint32_t* packet, uint8_t words) {
+    putDelta(deltaTicks);
+    put(packet, words);
+  }
+
+  std::vector<uint8_t>& finish(uint64_t deltaTicks = 0) {
+    putDelta(deltaTicks);
+    uint32_t end[4] = { END_OF_CLIP, 0, 0, 0 };
+    put(end, 4);
+    return bytes;
+  }
+};
+
+/**
+ * Streams a clip to disk through two large buffers. The caller fills one
+ * while a background thread writes the other with a single positioned
+ * write, so appending an event is a copy into memory and memory use stays
+ * constant however long the recording runs.
+ *
+ * append() must be serialised by the caller. If the caller fills both
+ * buffers before the disk catches up, events are dropped and counted
+ * rather than stalling the caller.
+ */
+class StreamWriter {
+public:
+  static constexpr size_t BUFFER_BYTES = 256 * 1024;
+
+private:
+  struct Buffer {
+    std::unique_ptr<uint8_t[]> data;
+    size_t length = 0;
+    // Handed to the writer thread and not yet on disk
+    bool pending = false;
+  };
+
+  Buffer buffers[2];
+  int active = 0;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable written;
+  std::thread thread;
+  bool running = false;
+  bool failed = false;
+  std::string failure;
+
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+#else
+  int file = -1;
+#endif
+  uint64_t fileOffset = 0;
+  std::atomic<uint64_t> events{ 0 };
+  std::atomic<uint64_t> dropped{ 0 };
+
+  static void putWord(uint8_t* out, uint32_t word) {
+    out[0] = (uint8_t)(word >> 24);
+    out[1] = (uint8_t)(word >> 16);
+    out[2] = (uint8_t)(word >> 8);
+    out[3] = (uint8_t)word;
+  }
+
+  bool writeAt(const uint8_t* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+#ifdef _WIN32
+      OVERLAPPED position = {};
+      position.Offset = (DWORD)offset;
+      position.OffsetHigh = (DWORD)(offset >> 32);
+      DWORD count = 0;
+      if (!WriteFile(file, data, (DWORD)length, &count, &position) || count == 0) return false;
+#else
+      ssize_t count = pwrite(file, data, length, (off_t)offset);
+      if (count < 0 && errno == EINTR) continue;
+      if (count <= 0) return false;
+#endif
+      data += count;
+      length -= (size_t)count;
+      offset += (uint64_t)count;
+    }
+    return true;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      Buffer* next = buffers[0].pending ? &buffers[0] : buffers[1].pending ? &buffers[1] : nullptr;
+      if (next == nullptr) {
+        if (!running) return;
+        wake.wait(lock);
+        continue;
+      }
+
+      // The producer never touches a pending buffer, so write it unlocked
+      uint64_t offset = fileOffset;
+      fileOffset += next->length;
+      lock.unlock();
+      bool ok = writeAt(next->data.get(), next->length, offset);
+      lock.lock();
+
+      if (!ok && !failed) {
+        failed = true;
+        failure = "Write to clip file failed";
+      }
+      next->length = 0;
+      next->pending = false;
+      written.notify_all();
+    }
+  }
+
+  /**
+   * Hand the active buffer to the writer. If the other buffer is still on
+   * its way to disk, either wait for it or give up and return false.
+   */
+  bool swap(bool wait) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (buffers[active ^ 1].pending) {
+      if (!wait) return false;
+      written.wait(lock, [this] { return !buffers[active ^ 1].pending; });
+    }
+    buffers[active].pending = true;
+    active ^= 1;
+    wake.notify_one();
+    return true;
+  }
+
+  // Copies whole words or nothing, so a dropped event never leaves half a packet
+  bool put(const uint32_t* words, size_t count, bool wait = false) {
+    size_t bytes = count * 4;
+    Buffer* buffer = &buffers[active];
+    if (buffer->length + bytes > BUFFER_BYTES) {
+      if (!swap(wait)) return false;
+      buffer = &buffers[active];
+    }
+    for (size_t i = 0; i < count; i++) putWord(buffer->data.get() + buffer->length + i * 4, words[i]);
+    buffer->length += bytes;
+    return true;
+  }
+
+public:
+  ~StreamWriter() {
+    std::string error;
+    close(error);
+  }
+
+  /**
+   * Create the file and write the magic, the clip configuration header and
+   * Start of Clip. A non-zero tempo adds a Set Tempo at the start of the clip.
+   */
+  bool open(const std::string& path, uint16_t ticksPerQuarter, uint32_t tenNanosecondsPerQuarter, std::string& error) {
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      error = "Cannot create " + path;
+      return false;
+    }
+#else
+    file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file < 0) {
+      error = "Cannot create " + path + ": " + strerror(errno);
+      return false;
+    }
+#endif
+
+    for (Buffer& buffer : buffers) {
+      buffer.data.reset(new uint8_t[BUFFER_BYTES]);
+      buffer.length = 0;
+      buffer.pending = false;
+    }
+    active = 0;
+    fileOffset = 0;
+    failed = false;
+
+    memcpy(buffers[0].data.get(), MAGIC, sizeof(MAGIC));
+    buffers[0].length = sizeof(MAGIC);
+    uint32_t header[4] = { deltaClockstamp(0), ticksPerQuarterNote(ticksPerQuarter), deltaClockstamp(0), START_OF_CLIP };
+    uint32_t startPadding[3] = { 0, 0, 0 };
+    put(header, 4);
+    put(startPadding, 3);
+    if (tenNanosecondsPerQuarter > 0) {
+      uint32_t tempo[5];
+      tempo[0] = deltaClockstamp(0);
+      setTempo(tenNanosecondsPerQuarter, tempo + 1);
+      put(tempo, 5);
+    }
+
+    running = true;
+    thread = std::thread(&StreamWriter::run, this);
+    return true;
+  }
+
+  /**
+   * Append one UMP packet `deltaTicks` after the previous one.
+   * Returns false if it was dropped because both buffers were full.
+   */
+  bool append(uint32_t deltaTicks, const uint32_t* packet, uint8_t words) {
+    // Delta Clockstamp followed by a packet of up to four words
+    uint32_t staged[1 + 4];
+    while (deltaTicks > MAX_DELTA_TICKS) {
+      staged[0] = deltaClockstamp(MAX_DELTA_TICKS);
+      staged[1] = NOOP;
+      if (!put(staged, 2)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      deltaTicks -= MAX_DELTA_TICKS;
+    }
+    staged[0] = deltaClockstamp(deltaTicks);
+    memcpy(staged + 1, packet, words * 4);
+    if (!put(staged, 1 + words)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    events.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * Append End of Clip, wait for everything to reach the disk and close the
+   * file. Safe to call more than once.
+   */
+  bool close(std::string& error, uint32_t deltaTicks = 0) {
+    if (!running) return !failed;
+
+    // The end marker must not be dropped, so this waits for the disk if needed
+    uint32_t spacer[2] = { deltaClockstamp(MAX_DELTA_TICKS), NOOP };
+    for (; deltaTicks > MAX_DELTA_TICKS; deltaTicks -= MAX_DELTA_TICKS) put(spacer, 2, true);
+    uint32_t end[5] = { deltaClockstamp(deltaTicks), END_OF_CLIP, 0, 0, 0 };
+    put(end, 5, true);
+    if (buffers[active].length > 0) swap(true);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+      wake.notify_one();
+    }
+    thread.join();
+
+#ifdef _WIN32
+    CloseHandle(file);
+    file = INVALID_HANDLE_VALUE;
+#else
+    ::close(file);
+    file = -1;
+#endif
+    for (Buffer& buffer : buffers) buffer.data.reset();
+
+    if (failed) error = failure;
+    return !failed;
+  }
+
+  uint64_t eventCount() const { return events.load(std::memory_order_relaxed); }
+  uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+  // Bytes handed to the disk so far, final after close()
+  uint64_t bytesWritten() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fileOffset;
+  }
+};
+
+}  // namespace clip
@@ -0,0 +1,253 @@
+/**
+ * Batch conversion between Standard MIDI Files and MIDI Clip Files
+ *
+ * Inputs are memory-mapped and every output is built in memory and written
+ * with a single call, so a conversion is one pass over the mapping with no
+ * per-event allocation. Files are independent, so a batch is spread over a
+ * pool of worker threads pulling the next file from a shared counter and
+ * throughput scales with cores until the disk becomes the limit.
+ * - SMF to clip: tracks are merged, channel and SysEx events become MIDI 1.0
+ *   UMP on group 0 and Set Tempo becomes Flex Data Set Tempo. SMPTE
+ *   divisions are mapped to an equivalent ticks per quarter note at 120 BPM.
+ * - Clip to SMF: a format 0 file, every group merged into the one track,
+ *   MIDI 2.0 messages downscaled and Flex Data Set Tempo kept as Set Tempo.
+ *
+ * Shared by the addon (convertMidiFiles) and the midi2-convert CLI.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cmath>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <filesystem>
+#include <system_error>
+
+#include "midi-file.h"
+
+namespace convert {
+
+enum class Target { Clip, Smf };
+
+static constexpr const char* CLIP_EXTENSION = ".midi2";
+static constexpr const char* SMF_EXTENSION = ".mid";
+
+struct Job {
+  std::string input;
+  std::string output;
+};
+
+struct Result {
+  std::string input;
+  std::string output;
+  // Empty when the conversion succeeded
+  std::string error;
+  uint64_t events = 0;
+  double milliseconds = 0;
+};
+
+inline bool smfToClip(const uint8_t* data, size_t size, std::vector<uint8_t>& out, uint64_t& events, std::string& error) {
+  midifile::SmfReader reader;
+  reader.setTempoEvents(true);
+  if (!reader.open(data, size, error)) return false;
+
+  uint16_t division = reader.timeDivision();
+  uint16_t ticksPerQuarter = division;
+  bool smpte = (division & 0x8000) != 0;
+  if (smpte) {
+    // Half a second per quarter note at the default tempo keeps every tick in place
+    int framesPerSecond = -(int8_t)(division >> 8);
+    uint32_t ticksPerFrame = division & 0xFF;
+    double ticksPerSecond = (framesPerSecond == 29 ? 29.97 : framesPerSecond) * (ticksPerFrame ? ticksPerFrame : 1);
+    ticksPerQuarter = (uint16_t)std::max<double>(1.0, std::min<double>(32767.0, std::round(ticksPerSecond / 2)));
+  }
+  if (ticksPerQuarter == 0) ticksPerQuarter = 480;
+
+  clip::Encoder encoder;
+  encoder.begin(ticksPerQuarter, size * 3);
+  midifile::Event event;
+  uint64_t lastTick = 0;
+  events = 0;
+  while (reader.next(event)) {
+    // An SMPTE file has no tempo, its time is absolute
+    if (smpte && ump::flex::isSetTempo(event.words)) continue;
+    encoder.append(event.tick - lastTick, event.words, event.count);
+    lastTick = event.tick;
+    events++;
+  }
+  out.swap(encoder.finish());
+  return true;
+}
+
+inline bool clipToSmf(const uint8_t* data, size_t size, std::vector<uint8_t>& out, uint64_t& events, std::string& error) {
+  midifile::ClipReader reader;
+  if (!reader.open(data, size, error)) return false;
+
+  midifile::SmfWriter writer;
+  ump::UmpToMidi1Translator translator;
+  std::vector<uint8_t> sysEx;
+  midifile::Event event;
+  uint64_t tick = 0;
+  bool begun = false;
+  events = 0;
+
+  auto emit = [&](uint8_t, const uint8_t* bytes, size_t length) {
+    // SysEx arrives in fragments, the SMF event needs the whole message
+    if (bytes[0] == 0xF0 || !sysEx.empty()) {
+      sysEx.insert(sysEx.end(), bytes, bytes + length);
+      if (sysEx.back() != 0xF7) return;
+      writer.message(tick, sysEx.data(), sysEx.size());
+      sysEx.clear();
+      return;
+    }
+    writer.message(tick, bytes, length);
+  };
+
+  while (reader.next(event)) {
+    if (!begun) {
+      // The configuration header has been read once the first event is out
+      writer.begin(reader.timeDivision(), size / 2);
+      begun = true;
+    }
+    tick = event.tick;
+    events++;
+    if (ump::flex::isSetTempo(event.words)) {
+      writer.tempo(tick, (event.words[1] + 50) / 100);
+      continue;
+    }
+    translator.feed(event.words, event.count, emit);
+  }
+  if (!begun) writer.begin(reader.timeDivision());
+  out.swap(writer.finish(tick));
+  return true;
+}
+
+inline bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes, std::string& error) {
+  std::error_code code;
+  std::filesystem::path parent = std::filesystem::u8path(path).parent_path();
+  if (!parent.empty()) std::filesystem::create_directories(parent, code);
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    error = "Cannot create " + path;
+    return false;
+  }
+  bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  ok = fclose(file) == 0 && ok;
+  if (!ok) error = "Write to " + path + " failed";
+  return ok;
+}
+
+// Convert one file, the direction follows the input's magic
+inline Result convertFile(const Job& job) {
+  Result result;
+  result.input = job.input;
+  result.output = job.output;
+  auto start = std::chrono::steady_clock::now();
+
+  midifile::MappedFile file;
+  std::vector<uint8_t> bytes;
+  if (file.open(job.input, result.error)) {
+    bool isClip = file.size() >= sizeof(clip::MAGIC) && memcmp(file.data(), clip::MAGIC, sizeof(clip::MAGIC)) == 0;
+    bool ok = isClip ? clipToSmf(file.data(), file.size(), bytes, result.events, result.error)
+                     : smfToClip(file.data(), file.size(), bytes, result.events, result.error);
+    file.close();
+    if (ok) writeFile(job.output, bytes, result.error);
+  }
+
+  result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+static inline bool hasExtension(const std::filesystem::path& path, std::initializer_list<const char*> extensions) {
+  std::string extension = path.extension().u8string();
+  for (char& c : extension) c = (char)tolower((unsigned char)c);
+  for (const char* candidate : extensions) {
+    if (extension == candidate) return true;
+  }
+  return false;
+}
+
+/**
+ * List the conversions for `input`, a single file or a directory searched
+ * recursively for files of the source format. Outputs mirror the input
+ * tree under `outputRoot` with the target's extension.
+ */
+inline bool collectJobs(const std::string& input, const std::string& outputRoot, Target target,
+                        std::vector<Job>& jobs, std::string& error) {
+  namespace fs = std::filesystem;
+  std::error_code code;
+  fs::path root = fs::u8path(input);
+  fs::path destination = fs::u8path(outputRoot);
+  const char* extension = target == Target::Clip ? CLIP_EXTENSION : SMF_EXTENSION;
+
+  auto add = [&](const fs::path& source, const fs::path& relative) {
+    fs::path output = destination / relative;
+    output.replace_extension(extension);
+    jobs.push_back(Job{ source.u8string(), output.u8string() });
+  };
+
+  if (fs::is_regular_file(root, code)) {
+    add(root, root.filename());
+    return true;
+  }
+  if (!fs::is_directory(root, code)) {
+    error = "Cannot read " + input;
+    return false;
+  }
+
+  for (fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, code), end;
+       it != end; it.increment(code)) {
+    if (code) break;
+    if (!it->is_regular_file(code)) continue;
+    bool source = target == Target::Clip ? hasExtension(it->path(), { ".mid", ".midi", ".smf", ".kar" })
+                                         : hasExtension(it->path(), { ".midi2" });
+    if (source) add(it->path(), it->path().lexically_relative(root));
+  }
+  if (code) {
+    error = "Cannot list " + input + ": " + code.message();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Convert every job on `threads` workers (0 for one per core). onResult, if
+ * given, is called as each file finishes, one call at a time. Results come
+ * back in job order.
+ */
+inline std::vector<Result> run(const std::vector<Job>& jobs, unsigned threads,
+                               const std::function<void(const Result&)>& onResult = nullptr) {
+  std::vector<Result> results(jobs.size());
+  if (threads == 0) threads = std::max<unsigned>(1, std::thread::hardware_concurrency());
+  if (threads > jobs.size()) threads = (unsigned)std::max<size_t>(1, jobs.size());
+
+  std::atomic<size_t> next{ 0 };
+  std::mutex reportMutex;
+  auto work = [&]() {
+    for (size_t index = next.fetch_add(1); index < jobs.size(); index = next.fetch_add(1)) {
+      results[index] = convertFile(jobs[index]);
+      if (onResult) {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        onResult(results[index]);
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < threads; i++) workers.emplace_back(work);
+  work();
+  for (std::thread& worker : workers) worker.join();
+  return results;
+}
+
+}  // namespace convert
@@ -0,0 +1,689 @@
+/**
+ * Memory-mapped readers for Standard MIDI Files and MIDI Clip Files
+ *
+ * Files are mapped rather than read, and events are decoded one at a time
+ * straight from the mapping, so opening a large multi-track file costs no
+ * parse and no per-event allocation. Both readers yield UMP packets with
+ * their position in nanoseconds after applying the file's tempo map:
+ * - SMF 1.0 (format 0, 1 and 2): tracks are merged in tick order, channel
+ *   and SysEx events are translated to UMP on group 0, Set Tempo meta
+ *   events and SMPTE divisions are honoured
+ * - MIDI Clip File (SMF2CLIP): Delta Clockstamps, Delta Clockstamp Ticks
+ *   Per Quarter Note and Flex Data Set Tempo drive the timing, everything
+ *   between Start of Clip and End of Clip is yielded as is
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "ump-translator.h"
+#include "midi-clip.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <cerrno>
+#endif
+
+namespace midifile {
+
+// Read-only mapping of a whole file
+class MappedFile {
+private:
+  const uint8_t* bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#endif
+
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    close();
+  }
+
+  bool open(const std::string& path, std::string& error) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      error = "Cannot open " + path;
+      return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    length = (size_t)size.QuadPart;
+    if (length > 0) {
+      mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      bytes = mapping ? (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+      if (bytes == nullptr) {
+        error = "Cannot map " + path;
+        close();
+        return false;
+      }
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      error = "Cannot open " + path + ": " + strerror(errno);
+      return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+      error = "Cannot stat " + path + ": " + strerror(errno);
+      ::close(fd);
+      return false;
+    }
+    length = (size_t)info.st_size;
+    if (length > 0) {
+      void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        error = "Cannot map " + path + ": " + strerror(errno);
+        ::close(fd);
+        length = 0;
+        return false;
+      }
+      // Events are walked front to back
+      madvise(mapped, length, MADV_SEQUENTIAL);
+      bytes = (const uint8_t*)mapped;
+    }
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+#endif
+    return true;
+  }
+
+  void close() {
+#ifdef _WIN32
+    if (bytes != nullptr) UnmapViewOfFile(bytes);
+    if (mapping != nullptr) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (bytes != nullptr) munmap((void*)bytes, length);
+#endif
+    bytes = nullptr;
+    length = 0;
+  }
+
+  const uint8_t* data() const { return bytes; }
+  size_t size() const { return length; }
+};
+
+struct Event {
+  // Position from the start of the file after applying the tempo map
+  uint64_t timeNs;
+  uint64_t tick;
+  uint16_t track;
+  uint8_t count;
+  uint32_t words[4];
+};
+
+static inline uint32_t readBigEndian32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint16_t readBigEndian16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Variable-length quantity, at most four bytes; false if it runs off the end
+static inline bool readVarLength(const uint8_t*& cursor, const uint8_t* end, uint32_t& value) {
+  value = 0;
+  for (int i = 0; i < 4; i++) {
+    if (cursor >= end) return false;
+    uint8_t byte = *cursor++;
+    value = (value << 7) | (byte & 0x7F);
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+/**
+ * Lazily merges the tracks of a Standard MIDI File in tick order.
+ * Events on the same tick come out in track order, so a tempo change in
+ * the conductor track applies before notes on the same tick.
+ */
+class SmfReader {
+public:
+  struct Track {
+    const uint8_t* start;
+    const uint8_t* end;
+    const uint8_t* cursor;
+    uint64_t nextTick;
+    uint8_t runningStatus;
+    bool done;
+    ump::Midi1ToUmpParser parser;
+  };
+
+private:
+  const uint8_t* bytes = nullptr;
+  size_t length = 0;
+  uint16_t format = 0;
+  uint16_t division = 480;
+  std::vector<Track> tracks;
+
+  // Tempo map state, the time of anchorTick and the tempo from there on
+  uint32_t microsecondsPerQuarter = 500000;
+  uint64_t anchorTick = 0;
+  uint64_t anchorNs = 0;
+
+  // Packets decoded from the last event and not yet returned
+  std::vector<uint32_t> pending;
+  size_t pendingIndex = 0;
+  uint64_t pendingTick = 0;
+  uint64_t pendingNs = 0;
+  uint16_t pendingTrack = 0;
+  // Yield Set Tempo meta events as Flex Data Set Tempo packets
+  bool tempoEvents = false;
+
+  void startTrack(Track& track) {
+    track.cursor = track.start;
+    track.nextTick = 0;
+    track.runningStatus = 0;
+    track.done = false;
+    track.parser.reset();
+    uint32_t delta;
+    // A track that ends after its first delta has no event to decode
+    if (!readVarLength(track.cursor, track.end, delta) || track.cursor >= track.end) {
+      track.done = true;
+      return;
+    }
+    track.nextTick = delta;
+  }
+
+  // Decode the event at the track cursor into `pending`, then read the next delta
+  void decode(Track& track, uint64_t tick) {
+    const uint8_t*& cursor = track.cursor;
+    auto collect = [this](const uint32_t* words, size_t count) {
+      pending.insert(pending.end(), words, words + count);
+    };
+
+    if (cursor >= track.end) {
+      track.done = true;
+      return;
+    }
+    uint8_t status = *cursor;
+    if (status & 0x80) {
+      cursor++;
+    } else {
+      status = track.runningStatus;
+      if (status == 0) {
+        track.done = true;
+        return;
+      }
+    }
+
+    if (status == 0xFF) {
+      uint32_t size;
+      if (cursor >= track.end) { track.done = true; return; }
+      uint8_t type = *cursor++;
+      if (!readVarLength(cursor, track.end, size) || size > (size_t)(track.end - cursor)) {
+        track.done = true;
+        return;
+      }
+      if (type == 0x51 && size == 3) {
+        anchorNs = tickToNanoseconds(tick);
+        anchorTick = tick;
+        microsecondsPerQuarter = ((uint32_t)cursor[0] << 16) | ((uint32_t)cursor[1] << 8) | cursor[2];
+        if (microsecondsPerQuarter == 0) microsecondsPerQuarter = 500000;
+        if (tempoEvents) {
+          uint32_t setTempo[4];
+          clip::setTempo(microsecondsPerQuarter * 100, setTempo);
+          collect(setTempo, 4);
+        }
+      }
+      cursor += size;
+      if (type == 0x2F) {
+        track.done = true;
+        return;
+      }
+    } else if (status == 0xF0 || status == 0xF7) {
+      uint32_t size;
+      if (!readVarLength(cursor, track.end, size) || size > (size_t)(track.end - cursor)) {
+        track.done = true;
+        return;
+      }
+      // F7 events continue a SysEx split across events, or carry raw bytes
+      if (status == 0xF0) {
+        uint8_t start = 0xF0;
+        track.parser.feed(&start, 1, collect);
+      }
+      track.parser.feed(cursor, size, collect);
+      cursor += size;
+    } else {
+      track.runningStatus = status;
+      uint8_t message[3] = { status, 0, 0 };
+      uint8_t kind = status & 0xF0;
+      size_t dataBytes = kind == 0xC0 || kind == 0xD0 ? 1 : 2;
+      if ((size_t)(track.end - cursor) < dataBytes) {
+        track.done = true;
+        return;
+      }
+      for (size_t i = 0; i < dataBytes; i++) message[1 + i] = *cursor++ & 0x7F;
+      track.parser.feed(message, 1 + dataBytes, collect);
+    }
+
+    uint32_t delta;
+    if (cursor >= track.end || !readVarLength(cursor, track.end, delta)) {
+      track.done = true;
+      return;
+    }
+    track.nextTick = tick + delta;
+  }
+
+public:
+  uint64_t tickToNanoseconds(uint64_t tick) const {
+    if (division & 0x8000) {
+      // SMPTE: frames per second (negative, 29 means 29.97) times ticks per frame
+      int framesPerSecond = -(int8_t)(division >> 8);
+      uint32_t ticksPerFrame = division & 0xFF;
+      double ticksPerSecond = (framesPerSecond == 29 ? 29.97 : framesPerSecond) * (ticksPerFrame ? ticksPerFrame : 1);
+      return (uint64_t)(tick * 1e9 / ticksPerSecond);
+    }
+    return anchorNs + (tick - anchorTick) * microsecondsPerQuarter * 1000ULL / (division ? division : 480);
+  }
+
+  bool open(const uint8_t* data, size_t size, std::string& error) {
+    bytes = data;
+    length = size;
+    tracks.clear();
+    if (size < 14 || memcmp(data, "MThd", 4) != 0) {
+      error = "Not a Standard MIDI File";
+      return false;
+    }
+    uint32_t headerLength = readBigEndian32(data + 4);
+    format = readBigEndian16(data + 8);
+    uint16_t declaredTracks = readBigEndian16(data + 10);
+    division = readBigEndian16(data + 12);
+    if (headerLength > size - 8) {
+      error = "Standard MIDI File header is truncated";
+      return false;
+    }
+
+    const uint8_t* cursor = data + 8 + headerLength;
+    const uint8_t* end = data + size;
+    while ((size_t)(end - cursor) >= 8 && tracks.size() < declaredTracks) {
+      uint32_t chunkLength = readBigEndian32(cursor + 4);
+      const uint8_t* body = cursor + 8;
+      // Truncated files keep what is there
+      const uint8_t* bodyEnd = chunkLength > (size_t)(end - body) ? end : body + chunkLength;
+      if (memcmp(cursor, "MTrk", 4) == 0) {
+        Track track;
+        track.start = body;
+        track.end = bodyEnd;
+        tracks.push_back(track);
+      }
+      cursor = bodyEnd;
+    }
+    if (tracks.empty()) {
+      error = "Standard MIDI File has no tracks";
+      return false;
+    }
+    rewind();
+    return true;
+  }
+
+  void rewind() {
+    for (Track& track : tracks) startTrack(track);
+    microsecondsPerQuarter = 500000;
+    anchorTick = 0;
+    anchorNs = 0;
+    pending.clear();
+    pendingIndex = 0;
+  }
+
+  bool next(Event& event) {
+    while (pendingIndex >= pending.size()) {
+      pending.clear();
+      pendingIndex = 0;
+
+      Track* earliest = nullptr;
+      uint16_t earliestIndex = 0;
+      for (size_t i = 0; i < tracks.size(); i++) {
+        Track& track = tracks[i];
+        if (track.done) continue;
+        if (earliest == nullptr || track.nextTick < earliest->nextTick) {
+          earliest = &track;
+          earliestIndex = (uint16_t)i;
+        }
+      }
+      if (earliest == nullptr) return false;
+
+      uint64_t tick = earliest->nextTick;
+      decode(*earliest, tick);
+      pendingTick = tick;
+      pendingNs = tickToNanoseconds(tick);
+      pendingTrack = earliestIndex;
+    }
+
+    uint8_t count = ump::packetWordsOf(pending[pendingIndex]);
+    event.tick = pendingTick;
+    event.timeNs = pendingNs;
+    event.track = pendingTrack;
+    event.count = count;
+    for (uint8_t i = 0; i < count; i++) event.words[i] = pending[pendingIndex + i];
+    pendingIndex += count;
+    return true;
+  }
+
+  void setTempoEvents(bool enabled) { tempoEvents = enabled; }
+  uint16_t formatType() const { return format; }
+  uint16_t timeDivision() const { return division; }
+  size_t trackCount() const { return tracks.size(); }
+};
+
+// Walks the clip sequence of a MIDI Clip File
+class ClipReader {
+private:
+  const uint8_t* bytes = nullptr;
+  const uint8_t* end = nullptr;
+  const uint8_t* cursor = nullptr;
+  uint64_t tick = 0;
+  uint16_t ticksPerQuarter = 96;
+  // 10 ns units per quarter note, 120 BPM until a Set Tempo says otherwise
+  uint32_t tempo = 50000000;
+  uint64_t anchorTick = 0;
+  uint64_t anchorNs = 0;
+  bool started = false;
+
+public:
+  uint64_t tickToNanoseconds(uint64_t at) const {
+    return anchorNs + (at - anchorTick) * tempo * 10ULL / ticksPerQuarter;
+  }
+
+  bool open(const uint8_t* data, size_t size, std::string& error) {
+    if (size < sizeof(clip::MAGIC) || memcmp(data, clip::MAGIC, sizeof(clip::MAGIC)) != 0) {
+      error = "Not a MIDI Clip File";
+      return false;
+    }
+    bytes = data;
+    end = data + size;
+    rewind();
+    return true;
+  }
+
+  void rewind() {
+    cursor = bytes + sizeof(clip::MAGIC);
+    tick = 0;
+    ticksPerQuarter = 96;
+    tempo = 50000000;
+    anchorTick = 0;
+    anchorNs = 0;
+    started = false;
+  }
+
+  bool next(Event& event) {
+    while (cursor + 4 <= end) {
+      uint32_t first = readBigEndian32(cursor);
+      ump::MessageType type = ump::typeOf(first);
+      uint8_t count = ump::packetWords(type);
+      if (cursor + count * 4 > end) return false;
+      uint32_t words[4];
+      for (uint8_t i = 0; i < count; i++) words[i] = readBigEndian32(cursor + i * 4);
+      cursor += count * 4;
+
+      if (type == ump::MessageType::Utility) {
+        uint8_t status = (uint8_t)ump::utility::Status::get(words);
+        if (status == ump::utility::DELTA_CLOCKSTAMP) {
+          tick += ump::utility::Data::get(words);
+        } else if (status == ump::utility::DELTA_TICKS_PER_QUARTER && ump::utility::Ticks::get(words) != 0) {
+          anchorNs = tickToNanoseconds(tick);
+          anchorTick = tick;
+          ticksPerQuarter = (uint16_t)ump::utility::Ticks::get(words);
+        }
+        continue;
+      }
+      if (type == ump::MessageType::Stream) {
+        uint16_t status = (uint16_t)ump::stream::Status::get(words);
+        if (status == ump::stream::START_OF_CLIP) started = true;
+        if (status == ump::stream::END_OF_CLIP) return false;
+        continue;
+      }
+      if (ump::flex::isSetTempo(words) && words[1] != 0) {
+        // Flex Data Set Tempo, also passed on to the receiver
+        anchorNs = tickToNanoseconds(tick);
+        anchorTick = tick;
+        tempo = words[1];
+      }
+      if (!started) continue;
+
+      event.tick = tick;
+      event.timeNs = tickToNanoseconds(tick);
+      event.track = 0;
+      event.count = count;
+      memcpy(event.words, words, count * 4);
+      return true;
+    }
+    return false;
+  }
+
+  uint16_t timeDivision() const { return ticksPerQuarter; }
+};
+
+enum class Format { Smf, Clip };
+
+// Either reader behind one interface, chosen from the file's magic
+class EventReader {
+private:
+  MappedFile file;
+  Format kind = Format::Smf;
+  SmfReader smf;
+  ClipReader clipReader;
+
+public:
+  bool open(const std::string& path, std::string& error) {
+    if (!file.open(path, error)) return false;
+    if (file.size() >= 8 && memcmp(file.data(), clip::MAGIC, 8) == 0) {
+      kind = Format::Clip;
+      return clipReader.open(file.data(), file.size(), error);
+    }
+    kind = Format::Smf;
+    return smf.open(file.data(), file.size(), error);
+  }
+
+  bool next(Event& event) {
+    return kind == Format::Clip ? clipReader.next(event) : smf.next(event);
+  }
+
+  void rewind() {
+    if (kind == Format::Clip) clipReader.rewind();
+    else smf.rewind();
+  }
+
+  Format format() const { return kind; }
+  size_t trackCount() const { return kind == Format::Clip ? 1 : smf.trackCount(); }
+};
+
+/**
+ * Channel voice messages of a whole file as parallel arrays, one row per
+ * message in playback order. Meta and SysEx events shape the timing but
+ * are not rows. type is the status nibble (0x8-0xE); pitch bend keeps its
+ * LSB in data1 and MSB in data2, and messages with one data byte leave
+ * data2 at 0.
+ */
+struct Columns {
+  // Seconds from the start after the tempo map
+  std::vector<double> time;
+  std::vector<uint32_t> tick;
+  std::vector<uint16_t> track;
+  std::vector<uint8_t> type;
+  std::vector<uint8_t> channel;
+  std::vector<uint8_t> data1;
+  std::vector<uint8_t> data2;
+
+  void reserve(size_t rows) {
+    time.reserve(rows);
+    tick.reserve(rows);
+    track.reserve(rows);
+    type.reserve(rows);
+    channel.reserve(rows);
+    data1.reserve(rows);
+    data2.reserve(rows);
+  }
+
+  size_t size() const { return type.size(); }
+};
+
+// Decode an SMF held in memory in one pass over its events
+inline bool decodeColumns(const uint8_t* data, size_t size, Columns& columns, SmfReader& reader, std::string& error) {
+  if (!reader.open(data, size, error)) return false;
+  // Running status packs a note into as little as three bytes
+  columns.reserve(size / 3);
+
+  Event event;
+  while (reader.next(event)) {
+    if (ump::typeOf(event.words[0]) != ump::MessageType::Midi1ChannelVoice) continue;
+    ump::View<ump::MessageType::Midi1ChannelVoice> view(event.words);
+    columns.time.push_back(event.timeNs / 1e9);
+    columns.tick.push_back((uint32_t)event.tick);
+    columns.track.push_back(event.track);
+    columns.type.push_back((uint8_t)view.get<ump::midi1::Opcode>());
+    columns.channel.push_back((uint8_t)view.get<ump::midi1::Channel>());
+    columns.data1.push_back((uint8_t)view.get<ump::midi1::Data1>());
+    columns.data2.push_back((uint8_t)view.get<ump::midi1::Data2>());
+  }
+  return true;
+}
+
+/**
+ * Builds a format 0 SMF in memory. Messages are appended in tick order;
+ * channel messages use running status, SysEx is stored as F0 events and
+ * anything else that is not a channel message is escaped with F7.
+ */
+class SmfWriter {
+private:
+  std::vector<uint8_t> bytes;
+  size_t trackStart = 0;
+  uint64_t lastTick = 0;
+  uint8_t runningStatus = 0;
+
+  void putVarLength(uint32_t value) {
+    uint8_t staged[4];
+    int length = 0;
+    do {
+      staged[length++] = (uint8_t)(value & 0x7F);
+      value >>= 7;
+    } while (value > 0 && length < 4);
+    while (length > 1) bytes.push_back(staged[--length] | 0x80);
+    bytes.push_back(staged[0]);
+  }
+
+  void putDelta(uint64_t tick) {
+    uint64_t delta = tick > lastTick ? tick - lastTick : 0;
+    // Four VLQ bytes hold 28 bits, longer gaps are bridged by empty text events
+    while (delta > 0x0FFFFFFF) {
+      putVarLength(0x0FFFFFFF);
+      const uint8_t text[3] = { 0xFF, 0x01, 0x00 };
+      bytes.insert(bytes.end(), text, text + 3);
+      delta -= 0x0FFFFFFF;
+    }
+    putVarLength((uint32_t)delta);
+    lastTick = tick > lastTick ? tick : lastTick;
+  }
+
+  static void putBigEndian32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+  }
+
+public:
+  void begin(uint16_t division, size_t expectedBytes = 0) {
+    bytes.clear();
+    bytes.reserve(22 + expectedBytes + 4);
+    const uint8_t header[22] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1,
+                                 (uint8_t)(division >> 8), (uint8_t)division,
+                                 'M', 'T', 'r', 'k', 0, 0, 0, 0 };
+    bytes.insert(bytes.end(), header, header + 22);
+    trackStart = bytes.size();
+    lastTick = 0;
+    runningStatus = 0;
+  }
+
+  void tempo(uint64_t tick, uint32_t microsecondsPerQuarter) {
+    putDelta(tick);
+    const uint8_t meta[6] = { 0xFF, 0x51, 0x03, (uint8_t)(microsecondsPerQuarter >> 16),
+                              (uint8_t)(microsecondsPerQuarter >> 8), (uint8_t)microsecondsPerQuarter };
+    bytes.insert(bytes.end(), meta, meta + 6);
+    runningStatus = 0;
+  }
+
+  // One complete MIDI 1.0 message, or a whole SysEx from F0 to F7
+  void message(uint64_t tick, const uint8_t* data, size_t length) {
+    if (length == 0) return;
+    putDelta(tick);
+    uint8_t status = data[0];
+    if (status >= 0x80 && status < 0xF0) {
+      if (status != runningStatus) bytes.push_back(status);
+      runningStatus = status;
+      bytes.insert(bytes.end(), data + 1, data + length);
+      return;
+    }
+    bool sysEx = status == 0xF0;
+    bytes.push_back(sysEx ? 0xF0 : 0xF7);
+    putVarLength((uint32_t)(sysEx ? length - 1 : length));
+    bytes.insert(bytes.end(), data + (sysEx ? 1 : 0), data + length);
+    runningStatus = 0;
+  }
+
+  // Append End of Track `tick` and fill in the track length
+  std::vector<uint8_t>& finish(uint64_t tick) {
+    putDelta(tick);
+    const uint8_t endOfTrack[3] = { 0xFF, 0x2F, 0x00 };
+    bytes.insert(bytes.end(), endOfTrack, endOfTrack + 3);
+    putBigEndian32(bytes.data() + trackStart - 4, (uint32_t)(bytes.size() - trackStart));
+    return bytes;
+  }
+
+  /**
+   * Encode columns of channel voice messages with one Set Tempo. Rows are
+   * written in tick order; rows on the same tick keep their order, so a
+   * note-off given before a note-on of the same pitch stays first.
+   */
+  static void encode(const uint32_t* ticks, const uint8_t* types, const uint8_t* channels,
+                     const uint8_t* data1, const uint8_t* data2, size_t rows,
+                     uint16_t ticksPerQuarter, uint32_t microsecondsPerQuarter, std::vector<uint8_t>& out) {
+    // Only reorder when the input is not already sorted
+    std::vector<uint32_t> order;
+    bool sorted = true;
+    for (size_t i = 1; i < rows && sorted; i++) sorted = ticks[i] >= ticks[i - 1];
+    if (!sorted) {
+      order.resize(rows);
+      for (size_t i = 0; i < rows; i++) order[i] = (uint32_t)i;
+      std::stable_sort(order.begin(), order.end(), [ticks](uint32_t a, uint32_t b) { return ticks[a] < ticks[b]; });
+    }
+
+    SmfWriter writer;
+    writer.begin(ticksPerQuarter, 7 + rows * 4);
+    writer.tempo(0, microsecondsPerQuarter);
+    uint32_t lastTick = 0;
+    for (size_t n = 0; n < rows; n++) {
+      size_t i = sorted ? n : order[n];
+      uint8_t type = types[i] & 0xF;
+      if (type < 0x8 || type > 0xE) continue;
+      uint8_t message[3] = { (uint8_t)((type << 4) | (channels[i] & 0xF)), (uint8_t)(data1[i] & 0x7F), (uint8_t)(data2[i] & 0x7F) };
+      writer.message(ticks[i], message, type == 0xC || type == 0xD ? 2 : 3);
+      lastTick = ticks[i];
+    }
+    out.swap(writer.finish(lastTick));
+  }
+};
+
+}  // namespace midifile
@@ -0,0 +1,373 @@
+/**
+ * End-to-end benchmark for the native MIDI layer
+ *
+ * Drives the same send path, handle table and input dispatch as the addon
+ * through loopback pairs and prints one JSON document per run, so results
+ * can be stored and diffed. For every output/input pair it reports:
+ * - send-to-receive latency percentiles (p50, p99, p99.9) of paced messages
+ * - maximum sustained messages per second with a bounded in-flight window
+ * - process CPU time per message during the throughput run
+ *
+ * Usage:
+ *   midi2-bench [--backend virtual|alsa|all] [--ports N] [--messages N]
+ *               [--interval-us N] [--seconds N] [--window N]
+ *               [--latency-ms N] [--jitter-ms N] [--baud N]
+ *
+ * Linux runs with --backend alsa use snd-virmidi ports (modprobe snd-virmidi).
+ * A virmidi port writes into the ALSA sequencer rather than its own input,
+ * so output 2k must be routed to input 2k+1 before running, e.g.
+ *   aconnect 'Virtual Raw MIDI 1-0' 'Virtual Raw MIDI 1-1'
+ * Pairs that receive nothing are reported with an error instead of numbers.
+ *
+ * Build with: pnpm run build-native (target midi2-bench)
+ */
+
+#include "midi2-core.h"
+
+#include <cstdio>
+#include <cmath>
+
+#ifndef _WIN32
+  #include <sys/resource.h>
+#endif
+
+// ============================================================================
+// Options
+// ============================================================================
+
+struct BenchOptions {
+  std::string backend = "virtual";
+  uint32_t ports = 1;
+  uint32_t messages = 10000;
+  uint32_t intervalUs = 100;
+  double seconds = 2.0;
+  // Messages allowed in flight during the throughput run
+  uint32_t window = 4096;
+  double latencyMs = 0.0;
+  double jitterMs = 0.0;
+  uint32_t baudRate = 0;
+};
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "[MIDI2] Missing value for " << flag << std::endl;
+      return false;
+    }
+    const char* value = argv[++i];
+    if (flag == "--backend") options.backend = value;
+    else if (flag == "--ports") options.ports = (uint32_t)atoi(value);
+    else if (flag == "--messages") options.messages = (uint32_t)atoi(value);
+    else if (flag == "--interval-us") options.intervalUs = (uint32_t)atoi(value);
+    else if (flag == "--seconds") options.seconds = atof(value);
+    else if (flag == "--window") options.window = (uint32_t)atoi(value);
+    else if (flag == "--latency-ms") options.latencyMs = atof(value);
+    else if (flag == "--jitter-ms") options.jitterMs = atof(value);
+    else if (flag == "--baud") options.baudRate = (uint32_t)atoi(value);
+    else {
+      std::cerr << "[MIDI2] Unknown option " << flag << std::endl;
+      return false;
+    }
+  }
+  if (options.messages == 0 || options.messages > 16384) {
+    std::cerr << "[MIDI2] --messages must be between 1 and 16384" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// ============================================================================
+// Measurement
+// ============================================================================
+
+static uint64_t cpuNanoseconds() {
+#ifdef _WIN32
+  FILETIME created, exited, kernel, user;
+  GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+  auto ticks = [](const FILETIME& time) {
+    return ((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime;
+  };
+  return (ticks(kernel) + ticks(user)) * 100;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  auto nanoseconds = [](const struct timeval& time) {
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_usec * 1000ULL;
+  };
+  return nanoseconds(usage.ru_utime) + nanoseconds(usage.ru_stime);
+#endif
+}
+
+// Note-on whose note and velocity carry a 14-bit sequence number
+static inline uint32_t sequenceMessage(uint32_t sequence) {
+  return 0x20900000u | (((sequence >> 7) & 0x7F) << 8) | (sequence & 0x7F);
+}
+
+static inline uint32_t sequenceOf(uint32_t word) {
+  return (((word >> 8) & 0x7F) << 7) | (word & 0x7F);
+}
+
+static double percentile(std::vector<uint64_t>& sorted, double fraction) {
+  if (sorted.empty()) return 0.0;
+  size_t rank = (size_t)std::ceil(fraction * sorted.size());
+  if (rank > 0) rank--;
+  return sorted[std::min(rank, sorted.size() - 1)] / 1000.0;
+}
+
+struct Pair {
+  MIDIDevice output;
+  MIDIDevice input;
+  uint32_t token = 0;
+  PooledHandle* inputEntry = nullptr;
+
+  // Latency run
+  std::vector<uint64_t> sentAt;
+  std::vector<uint64_t> latencies;
+  std::atomic<uint32_t> received{ 0 };
+
+  // Throughput run
+  std::atomic<uint64_t> counted{ 0 };
+  std::atomic<uint64_t> lastReceivedNs{ 0 };
+  std::atomic<bool> measuring{ false };
+
+  std::string error;
+  double messagesPerSecond = 0.0;
+  uint64_t throughputMessages = 0;
+};
+
+static bool openPair(Pair& pair) {
+  PooledHandle* output = nullptr;
+  if (HandlePool::acquire(pair.output, output) < 0) {
+    pair.error = "failed to open output";
+    return false;
+  }
+  pair.token = HandleTable::allocate(&output, 1, nullptr);
+  if (HandlePool::acquire(pair.input, pair.inputEntry) < 0) {
+    pair.error = "failed to open input";
+    return false;
+  }
+  return true;
+}
+
+static void closePair(Pair& pair) {
+  if (pair.token != 0) HandleTable::release(pair.token);
+  if (pair.inputEntry != nullptr) HandlePool::release(pair.inputEntry);
+}
+
+// Paced sends, one message at a time, so queueing does not hide latency
+static void runLatency(Pair& pair, const BenchOptions& options) {
+  pair.sentAt.assign(options.messages, 0);
+  pair.latencies.assign(options.messages, 0);
+  pair.received = 0;
+
+  OpenHandle* slot = HandleTable::resolve(pair.token);
+  auto interval = std::chrono::microseconds(options.intervalUs);
+  auto next = std::chrono::steady_clock::now();
+
+  for (uint32_t sequence = 0; sequence < options.messages; sequence++) {
+    uint32_t word = sequenceMessage(sequence);
+    pair.sentAt[sequence] = monotonicNanoseconds();
+    while (!WriteUmp(*slot, &word, 1)) {
+      std::this_thread::yield();
+    }
+    next += interval;
+    std::this_thread::sleep_until(next);
+  }
+
+  // Allow for emulated latency, jitter and wire time before counting losses
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (pair.received < options.messages && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+}
+
+// Sends batches as fast as the port accepts them, bounded by the window
+static void runThroughput(Pair& pair, const BenchOptions& options, uint64_t startNs, uint64_t endNs) {
+  OpenHandle* slot = HandleTable::resolve(pair.token);
+  uint32_t batch[64];
+  for (uint32_t i = 0; i < 64; i++) batch[i] = sequenceMessage(i);
+
+  uint64_t sent = 0;
+  while (monotonicNanoseconds() < endNs) {
+    if (sent - pair.counted >= options.window) {
+      // Sleep rather than spin so CPU per message reflects the send path
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+      continue;
+    }
+    if (WriteUmp(*slot, batch, 64)) {
+      sent += 64;
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  // Drain what is still in flight
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (pair.counted < sent && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  pair.throughputMessages = pair.counted;
+  uint64_t elapsed = pair.lastReceivedNs > startNs ? pair.lastReceivedNs - startNs : 0;
+  pair.messagesPerSecond = elapsed > 0 ? pair.throughputMessages * 1e9 / elapsed : 0.0;
+}
+
+// ============================================================================
+// Runs
+// ============================================================================
+
+static std::vector<std::unique_ptr<Pair>> findPairs(const std::string& backend, const BenchOptions& options) {
+  std::vector<MIDIDevice> outputs, inputs;
+  DeviceRegistry::snapshot(outputs, inputs);
+  std::vector<std::unique_ptr<Pair>> pairs;
+
+  if (backend == "virtual") {
+    // Virtual output N loops back to virtual input N
+    for (const MIDIDevice& output : outputs) {
+      if (!output.isVirtual) continue;
+      for (const MIDIDevice& input : inputs) {
+        if (input.isVirtual && input.endpoint == output.endpoint) {
+          pairs.emplace_back(new Pair());
+          pairs.back()->output = output;
+          pairs.back()->input = input;
+        }
+      }
+    }
+  } else if (backend == "alsa") {
+    std::vector<MIDIDevice> virmidiOutputs, virmidiInputs;
+    for (const MIDIDevice& output : outputs) {
+      if (!output.isVirtual && strstr(output.name, "Virtual Raw MIDI")) virmidiOutputs.push_back(output);
+    }
+    for (const MIDIDevice& input : inputs) {
+      if (!input.isVirtual && strstr(input.name, "Virtual Raw MIDI")) virmidiInputs.push_back(input);
+    }
+    for (size_t i = 0; i + 1 < virmidiOutputs.size() && i + 1 < virmidiInputs.size(); i += 2) {
+      if (pairs.size() >= options.ports) break;
+      pairs.emplace_back(new Pair());
+      pairs.back()->output = virmidiOutputs[i];
+      pairs.back()->input = virmidiInputs[i + 1];
+    }
+  }
+  return pairs;
+}
+
+static void printString(const char* text) {
+  putchar('"');
+  for (const char* c = text; *c; c++) {
+    if (*c == '"' || *c == '\\') putchar('\\');
+    putchar(*c);
+  }
+  putchar('"');
+}
+
+static void runBackend(const std::string& backend, const BenchOptions& options, bool& first) {
+  std::vector<std::unique_ptr<Pair>> pairs = findPairs(backend, options);
+
+  uint32_t subscription = InputHub::subscribe(
+    [&pairs](uint64_t deviceId, const uint32_t* words, size_t count, uint64_t timestampNs) {
+      for (auto& pair : pairs) {
+        if (pair->input.id != deviceId) continue;
+        if (pair->measuring) {
+          pair->counted += count;
+          pair->lastReceivedNs = timestampNs;
+          return;
+        }
+        for (size_t i = 0; i < count; i++) {
+          uint32_t sequence = sequenceOf(words[i]);
+          if (sequence >= pair->sentAt.size() || pair->sentAt[sequence] == 0) continue;
+          uint32_t slot = pair->received++;
+          if (slot < pair->latencies.size()) pair->latencies[slot] = timestampNs - pair->sentAt[sequence];
+        }
+        return;
+      }
+    });
+
+  for (auto& pair : pairs) {
+    if (openPair(*pair)) runLatency(*pair, options);
+  }
+
+  // All pairs run their throughput test at once, as a multi-port rig would
+  std::vector<std::thread> senders;
+  uint64_t cpuBefore = cpuNanoseconds();
+  uint64_t startNs = monotonicNanoseconds();
+  uint64_t endNs = startNs + (uint64_t)(options.seconds * 1e9);
+  for (auto& pair : pairs) {
+    if (!pair->error.empty() || pair->received == 0) continue;
+    pair->measuring = true;
+    senders.emplace_back(runThroughput, std::ref(*pair), std::cref(options), startNs, endNs);
+  }
+  for (std::thread& sender : senders) sender.join();
+  uint64_t cpuUsed = cpuNanoseconds() - cpuBefore;
+
+  uint64_t totalMessages = 0;
+  for (auto& pair : pairs) totalMessages += pair->throughputMessages;
+
+  InputHub::unsubscribe(subscription);
+
+  for (auto& pair : pairs) {
+    if (pair->error.empty() && pair->received == 0) pair->error = "no loopback, nothing was received";
+
+    printf("%s\n    {\"backend\": ", first ? "" : ",");
+    first = false;
+    printString(backend.c_str());
+    printf(", \"output\": ");
+    printString(pair->output.name);
+    printf(", \"input\": ");
+    printString(pair->input.name);
+
+    if (!pair->error.empty()) {
+      printf(", \"error\": ");
+      printString(pair->error.c_str());
+      printf("}");
+      closePair(*pair);
+      continue;
+    }
+
+    uint32_t received = std::min<uint32_t>(pair->received, options.messages);
+    std::vector<uint64_t> sorted(pair->latencies.begin(), pair->latencies.begin() + received);
+    std::sort(sorted.begin(), sorted.end());
+
+    printf(",\n     \"latency\": {\"messages\": %u, \"received\": %u, \"p50Us\": %.2f, \"p99Us\": %.2f, \"p999Us\": %.2f, \"maxUs\": %.2f}",
+           options.messages, received, percentile(sorted, 0.5), percentile(sorted, 0.99),
+           percentile(sorted, 0.999), sorted.empty() ? 0.0 : sorted.back() / 1000.0);
+    printf(",\n     \"throughput\": {\"messages\": %llu, \"messagesPerSecond\": %.0f, \"cpuNsPerMessage\": %.1f}}",
+           (unsigned long long)pair->throughputMessages, pair->messagesPerSecond,
+           totalMessages > 0 ? (double)cpuUsed / totalMessages : 0.0);
+    closePair(*pair);
+  }
+}
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) return 1;
+
+  vmidi::LoopbackConfig loopback;
+  loopback.ports = options.ports;
+  loopback.latencyMs = options.latencyMs;
+  loopback.jitterMs = options.jitterMs;
+  loopback.baudRate = options.baudRate;
+  vmidi::Loopback::configure(loopback, VirtualMIDIManager::deliver);
+
+  StartThreads();
+  DeviceRegistry::rescan();
+
+  printf("{\n  \"benchmark\": \"midi2-bench\",\n");
+  printf("  \"options\": {\"messages\": %u, \"intervalUs\": %u, \"seconds\": %.2f, \"window\": %u, "
+         "\"latencyMs\": %.3f, \"jitterMs\": %.3f, \"baud\": %u},\n",
+         options.messages, options.intervalUs, options.seconds, options.window,
+         options.latencyMs, options.jitterMs, options.baudRate);
+  printf("  \"results\": [");
+
+  bool first = true;
+  if (options.backend == "virtual" || options.backend == "all") runBackend("virtual", options, first);
+#if __linux__ && HAS_ALSA
+  if (options.backend == "alsa" || options.backend == "all") runBackend("alsa", options, first);
+#endif
+  printf("\n  ]\n}\n");
+
+  HandleTable::closeAll();
+  StopThreads();
+  HandlePool::closeAll();
+  return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * Batch converter between Standard MIDI Files and MIDI Clip Files
+ *
+ * Converts one file or a whole directory tree on a pool of worker threads,
+ * using the same code as the addon's convertMidiFiles(). Prints one line
+ * per file with its timing, or its error, and a summary at the end. Exits
+ * non-zero if any file failed.
+ *
+ * Usage:
+ *   midi2-convert --to clip|smf [--jobs N] <input file or directory> <output directory>
+ *
+ * --to clip converts .mid/.midi/.smf/.kar files to .midi2, --to smf converts
+ * .midi2 files to .mid. --jobs defaults to one worker per core.
+ *
+ * Build with: pnpm run build-native (target midi2-convert)
+ */
+
+#include "midi-convert.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void printUsage() {
+  fprintf(stderr, "Usage: midi2-convert --to clip|smf [--jobs N] <input> <output directory>\n");
+}
+
+int main(int argc, char** argv) {
+  convert::Target target = convert::Target::Clip;
+  bool hasTarget = false;
+  unsigned jobs = 0;
+  std::vector<std::string> paths;
+
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag == "--to" && i + 1 < argc) {
+      std::string value = argv[++i];
+      if (value != "clip" && value != "smf") {
+        printUsage();
+        return 2;
+      }
+      target = value == "clip" ? convert::Target::Clip : convert::Target::Smf;
+      hasTarget = true;
+    } else if (flag == "--jobs" && i + 1 < argc) {
+      jobs = (unsigned)atoi(argv[++i]);
+    } else if (flag.compare(0, 2, "--") == 0) {
+      printUsage();
+      return 2;
+    } else {
+      paths.push_back(flag);
+    }
+  }
+  if (!hasTarget || paths.size() != 2) {
+    printUsage();
+    return 2;
+  }
+
+  std::vector<convert::Job> work;
+  std::string error;
+  if (!convert::collectJobs(paths[0], paths[1], target, work, error)) {
+    fprintf(stderr, "[MIDI2] %s\n", error.c_str());
+    return 1;
+  }
+
+  unsigned threads = jobs > 0 ? jobs : std::max<unsigned>(1, std::thread::hardware_concurrency());
+  auto start = std::chrono::steady_clock::now();
+  size_t failed = 0;
+  uint64_t events = 0;
+  convert::run(work, threads, [&](const convert::Result& result) {
+    if (result.error.empty()) {
+      printf("%8.2f ms  %8llu events  %s -> %s\n", result.milliseconds,
+             (unsigned long long)result.events, result.input.c_str(), result.output.c_str());
+      events += result.events;
+    } else {
+      printf("%8.2f ms  FAILED  %s: %s\n", result.milliseconds, result.input.c_str(), result.error.c_str());
+      failed++;
+    }
+  });
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%zu files (%zu failed), %llu events in %.3f s on %u threads, %.1f files/s\n",
+         work.size(), failed, (unsigned long long)events, seconds, threads,
+         seconds > 0 ? work.size() / seconds : 0.0);
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,4265 @@
+/**
+ * Platform core of the native MIDI 2.0 module
+ *
+ * Device enumeration, the handle pool and table, input dispatch, hotplug
+ * and the UMP send path, free of any Node-API dependency so the addon
+ * (midi2-native.cc) and native tools such as midi2-bench.cc share one
+ * implementation. Static members are defined here, so include this header
+ * from exactly one translation unit per binary.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <queue>
+#include <deque>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "ump-translator.h"
+#include "ump-kernels.h"
+#include "virtual-midi.h"
+#include "trace.h"
+#include "log.h"
+#include "midi-clip.h"
+#include "midi-file.h"
+#include "midi-convert.h"
+#include "mtc.h"
+#include "jitter-reduction.h"
+#include "flex-data.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <mmsystem.h>
+  #pragma comment(lib, "winmm.lib")
+  #pragma comment(lib, "ole32.lib")
+  #pragma comment(lib, "runtimeobject.lib")
+  
+  // Windows MIDI Services SDK (Windows 11+ with SDK runtime)
+  // See: https://aka.ms/midi
+  // The SDK headers are installed via the Windows MIDI Services App SDK Runtime
+  // which can be downloaded from the official releases
+  #if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0A00
+    // Future: Include official Microsoft.Windows.Devices.Midi2 headers when
+    // available in build environment. For now, use WinRT projection headers.
+    // This requires Windows MIDI Services SDK runtime to be installed:
+    // - Microsoft.Windows.Devices.Midi2.Initialization.hpp
+    // - Microsoft.Windows.Devices.Midi2.Messages.hpp
+    // - Microsoft.Windows.Devices.Midi2.Diagnostics.hpp
+    #define WINDOWS_MIDI_SERVICES_AVAILABLE 1
+  #else
+    #define WINDOWS_MIDI_SERVICES_AVAILABLE 0
+  #endif
+#elif __APPLE__
+  #include <CoreMIDI/CoreMIDI.h>
+  #include <CoreFoundation/CoreFoundation.h>
+#elif __linux__
+  #if __has_include(<alsa/asoundlib.h>)
+    #include <alsa/asoundlib.h>
+    #define HAS_ALSA 1
+  #else
+    #define HAS_ALSA 0
+  #endif
+  #include <sys/inotify.h>
+  #include <poll.h>
+  #include <unistd.h>
+  #include <fcntl.h>
+#endif
+
+// ============================================================================
+// MIDI 2.0 UMP Packet Utilities
+// ============================================================================
+
+struct MIDIDevice {
+  // Position in the current listing, shifts when devices come and go
+  uint32_t index;
+  // Stable identifier, see makeDeviceId()
+  uint64_t id;
+  char name[256];
+  // Platform address used to open the device (e.g. "hw:1,0" on ALSA)
+  char address[64];
+  int isInput;
+  // WinMM device id or CoreMIDI endpoint reference
+  uint32_t endpoint;
+  // ALSA coordinates, -1 on other platforms
+  int card;
+  int device;
+  int subdevice;
+  // Subdevices sharing this card and device, 1 for single-port devices
+  int subdeviceCount;
+  // In-process loopback port, endpoint holds the port number
+  bool isVirtual;
+};
+
+/**
+ * Stable 64-bit device identifier (FNV-1a) derived from the hardware
+ * coordinates and name, so the same port keeps its id across rescans
+ * while its position in the listing may change
+ */
+static inline uint64_t makeDeviceId(int card, int device, int subdevice, const char* name) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  auto mix = [&hash](const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < length; i++) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
+  };
+  int32_t coordinates[3] = { card, device, subdevice };
+  mix(coordinates, sizeof(coordinates));
+  mix(name, strlen(name));
+  return hash;
+}
+
+static inline void formatDeviceId(uint64_t id, char* buffer, size_t length) {
+  snprintf(buffer, length, "%016llx", (unsigned long long)id);
+}
+
+static std::vector<MIDIDevice> midiOutputs;
+static std::vector<MIDIDevice> midiInputs;
+
+// ============================================================================
+// Port Statistics
+// ============================================================================
+
+/**
+ * Counters for one pooled port. Writers bump relaxed atomics once per write
+ * call rather than once per message, so the hot path pays a few uncontended
+ * increments; getStats() reads them without taking any lock.
+ */
+struct PortStats {
+  static constexpr int LATENCY_BUCKETS = 32;
+  
+  std::atomic<uint64_t> packetsSent;
+  std::atomic<uint64_t> bytesSent;
+  std::atomic<uint64_t> packetsReceived;
+  std::atomic<uint64_t> bytesReceived;
+  // Writes the driver accepted only part of
+  std::atomic<uint64_t> shortWrites;
+  // Writes retried because the driver buffer was full (EAGAIN)
+  std::atomic<uint64_t> retries;
+  // Packets given up on after retrying
+  std::atomic<uint64_t> drops;
+  // Deepest driver queue seen, in bytes
+  std::atomic<uint64_t> queueHighWater;
+  // Enqueue to write latency, bucket N counts [2^N, 2^(N+1)) nanoseconds
+  std::atomic<uint64_t> latency[LATENCY_BUCKETS];
+  
+  static void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.fetch_add(amount, std::memory_order_relaxed);
+  }
+  
+  static int bucketOf(uint64_t nanoseconds) {
+    int bucket = 0;
+    while (nanoseconds > 1 && bucket < LATENCY_BUCKETS - 1) {
+      nanoseconds >>= 1;
+      bucket++;
+    }
+    return bucket;
+  }
+  
+  void recordLatency(uint64_t nanoseconds) {
+    add(latency[bucketOf(nanoseconds)], 1);
+  }
+  
+  void raiseHighWater(uint64_t depth) {
+    uint64_t current = queueHighWater.load(std::memory_order_relaxed);
+    while (depth > current && !queueHighWater.compare_exchange_weak(current, depth, std::memory_order_relaxed)) {
+    }
+  }
+};
+
+// Number of complete packets in a run of words, from their type nibbles
+static inline uint64_t countPackets(const uint32_t* words, size_t count) {
+  uint64_t packets = 0;
+  for (size_t i = 0; i < count; i += ump::packetWordsOf(words[i])) {
+    packets++;
+  }
+  return packets;
+}
+
+/**
+ * A platform handle shared by every consumer of one device and direction.
+ * Entries are never freed, only their handle is closed, so callbacks and the
+ * input reader can hold a pointer to an entry safely.
+ */
+struct PooledHandle {
+  uint64_t deviceId;
+  int isInput;
+  bool isVirtual;
+  char address[64];
+  uint32_t endpoint;
+  // Platform handle, null while closed
+  void* handle;
+  // Open tokens referring to this entry
+  std::atomic<int> refs;
+  std::chrono::steady_clock::time_point idleSince;
+  // Input only: turns the incoming byte stream into UMP
+  ump::Midi1ToUmpParser parser;
+  // Input only: open tokens that asked for Jitter Reduction
+  std::atomic<int> jitterReduction;
+  // Input only, delivery thread: maps received JR times to ours
+  jr::Receiver jrReceiver;
+  // Cumulative over every time the handle was open
+  PortStats stats;
+};
+
+// ============================================================================
+// Input Dispatch
+// ============================================================================
+
+typedef std::function<void(uint64_t deviceId, const uint32_t* words, size_t count, uint64_t timestampNs)> InputListener;
+
+static inline uint64_t monotonicNanoseconds() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Fans incoming UMP out to every subscriber. The listener list is swapped
+// copy-on-write so platform input threads never block on subscription changes.
+class InputHub {
+private:
+  typedef std::vector<std::pair<uint32_t, InputListener>> ListenerList;
+  static std::mutex mutex;
+  static std::shared_ptr<const ListenerList> listeners;
+  static uint32_t nextId;
+  
+  // Dispatches that began before a swap hold the old list until they finish;
+  // new ones load the new list, so this cannot be starved by steady input
+  static void waitForDispatches(std::shared_ptr<const ListenerList>& previous) {
+    while (previous.use_count() > 1) std::this_thread::yield();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    previous.reset();
+  }
+  
+public:
+  static uint32_t subscribe(InputListener listener) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto next = std::make_shared<ListenerList>(*std::atomic_load(&listeners));
+    uint32_t id = ++nextId;
+    next->emplace_back(id, std::move(listener));
+    std::atomic_store(&listeners, std::shared_ptr<const ListenerList>(next));
+    return id;
+  }
+  
+  // Returns once no dispatch can still be running the listener, so what it
+  // captured (a threadsafe function, a session) can be released right after.
+  // Must not be called from inside a listener.
+  static void unsubscribe(uint32_t id) {
+    std::shared_ptr<const ListenerList> previous;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      previous = std::atomic_load(&listeners);
+      auto next = std::make_shared<ListenerList>(*previous);
+      for (size_t i = 0; i < next->size(); i++) {
+        if ((*next)[i].first == id) {
+          next->erase(next->begin() + i);
+          break;
+        }
+      }
+      std::atomic_store(&listeners, std::shared_ptr<const ListenerList>(next));
+    }
+    waitForDispatches(previous);
+  }
+  
+  static void clear() {
+    std::shared_ptr<const ListenerList> previous;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      previous = std::atomic_load(&listeners);
+      std::atomic_store(&listeners, std::make_shared<const ListenerList>());
+    }
+    waitForDispatches(previous);
+  }
+  
+  static void dispatch(uint64_t deviceId, const uint32_t* words, size_t count, uint64_t timestampNs) {
+    MIDI2_TRACE_SCOPE(trace::ROUTE, deviceId, words[0]);
+    std::shared_ptr<const ListenerList> current = std::atomic_load(&listeners);
+    for (const auto& entry : *current) {
+      entry.second(deviceId, words, count, timestampNs);
+    }
+  }
+  
+  // Parse bytes from a legacy port and dispatch the resulting packets
+  static void dispatchBytes(PooledHandle& entry, const uint8_t* bytes, size_t length, uint64_t timestampNs) {
+    if (entry.refs.load(std::memory_order_relaxed) == 0) return;
+    MIDI2_TRACE_INSTANT(trace::RECEIVE, entry.deviceId, (uint32_t)length);
+    uint32_t packets[64];
+    size_t count = 0;
+    uint64_t packetCount = 0;
+    entry.parser.feed(bytes, length, [&](const uint32_t* words, size_t wordCount) {
+      if (count + wordCount > 64) {
+        dispatch(entry.deviceId, packets, count, timestampNs);
+        count = 0;
+      }
+      for (size_t i = 0; i < wordCount; i++) packets[count++] = words[i];
+      packetCount++;
+    });
+    if (count > 0) dispatch(entry.deviceId, packets, count, timestampNs);
+    PortStats::add(entry.stats.bytesReceived, length);
+    PortStats::add(entry.stats.packetsReceived, packetCount);
+  }
+};
+
+std::mutex InputHub::mutex;
+std::shared_ptr<const InputHub::ListenerList> InputHub::listeners = std::make_shared<const InputHub::ListenerList>();
+uint32_t InputHub::nextId = 0;
+
+// ============================================================================
+// Platform-Specific Implementations
+// ============================================================================
+
+#ifdef _WIN32
+
+// Windows MIDI 2.0 Implementation (Windows 11+) with WinMM fallback
+class WindowsMIDIManager {
+private:
+  static bool useWindowsMIDIServices;
+  static void* windowsMIDISession;
+  static std::map<uint32_t, HMIDIOUT> openHandles;
+  
+  // WinMM device ids shift on hotplug, so identify a port by its name and
+  // how many identically named ports precede it
+  static void assignId(MIDIDevice& device, const std::vector<MIDIDevice>& previous) {
+    int occurrence = 0;
+    for (const MIDIDevice& other : previous) {
+      if (strcmp(other.name, device.name) == 0) occurrence++;
+    }
+    device.card = -1;
+    device.device = occurrence;
+    device.subdevice = -1;
+    device.subdeviceCount = 1;
+    device.id = makeDeviceId(-1, occurrence, -1, device.name);
+  }
+  
+public:
+  static bool detectWindowsMIDIServices() {
+    #if WINDOWS_MIDI_SERVICES_AVAILABLE
+      try {
+        // Check if Windows MIDI Services runtime is available by checking registry
+        // or attempting CoCreateInstance on MIDI service class
+        MIDI2_LOG_INFO("Windows MIDI Services support detected");
+        return true;
+      } catch (...) {
+        MIDI2_LOG_INFO("Windows MIDI Services not available, using WinMM");
+        return false;
+      }
+    #else
+      MIDI2_LOG_INFO("Using WinMM API (Windows MIDI Services requires Windows 11+)");
+      return false;
+    #endif
+  }
+  
+  static void enumerateOutputs(std::vector<MIDIDevice>& devices) {
+    // Prefer Windows MIDI Services if available
+    if (useWindowsMIDIServices && WINDOWS_MIDI_SERVICES_AVAILABLE) {
+      try {
+        #if WINDOWS_MIDI_SERVICES_AVAILABLE
+        // Windows MIDI Services enumeration would go here
+        // For now, fall back to WinMM as WinRT integration requires event loop
+        #endif
+      } catch (...) {
+        useWindowsMIDIServices = false;
+      }
+    }
+    
+    // Fall back to WinMM API
+    UINT numDevices = midiOutGetNumDevs();
+    
+    for (UINT i = 0; i < numDevices; i++) {
+      MIDIOUTCAPS caps;
+      if (midiOutGetDevCaps(i, &caps, sizeof(caps)) == MMSYSERR_NOERROR) {
+        MIDIDevice device = {};
+        device.index = i;
+        device.isInput = 0;
+        strncpy_s(device.name, sizeof(device.name), caps.szPname, _TRUNCATE);
+        snprintf(device.address, sizeof(device.address), "winmm:out:%u", i);
+        device.endpoint = i;
+        assignId(device, devices);
+        devices.push_back(device);
+      }
+    }
+  }
+  
+  static void enumerateInputs(std::vector<MIDIDevice>& devices) {
+    // Prefer Windows MIDI Services if available
+    if (useWindowsMIDIServices && WINDOWS_MIDI_SERVICES_AVAILABLE) {
+      try {
+        #if WINDOWS_MIDI_SERVICES_AVAILABLE
+        // Windows MIDI Services enumeration would go here
+        #endif
+      } catch (...) {
+        useWindowsMIDIServices = false;
+      }
+    }
+    
+    // Fall back to WinMM API
+    UINT numDevices = midiInGetNumDevs();
+    
+    for (UINT i = 0; i < numDevices; i++) {
+      MIDIINCAPS caps;
+      if (midiInGetDevCaps(i, &caps, sizeof(caps)) == MMSYSERR_NOERROR) {
+        MIDIDevice device = {};
+        device.index = i;
+        device.isInput = 1;
+        strncpy_s(device.name, sizeof(device.name), caps.szPname, _TRUNCATE);
+        snprintf(device.address, sizeof(device.address), "winmm:in:%u", i);
+        device.endpoint = i;
+        assignId(device, devices);
+        devices.push_back(device);
+      }
+    }
+  }
+  
+  // WinMM has no device arrival notification without a window, so the
+  // hotplug watcher compares device counts instead
+  static uint32_t deviceCountSignature() {
+    return (midiOutGetNumDevs() << 16) | (midiInGetNumDevs() & 0xFFFF);
+  }
+  
+  static MMRESULT openOutput(uint32_t deviceIndex, HMIDIOUT& handle) {
+    return midiOutOpen(&handle, deviceIndex, 0, 0, CALLBACK_NULL);
+  }
+  
+  static void CALLBACK inputCallback(HMIDIIN handle, UINT message, DWORD_PTR instance,
+                                     DWORD_PTR param1, DWORD_PTR param2) {
+    if (message != MIM_DATA) return;
+    // Short messages arrive packed little-endian, unused bytes are ignored
+    // by the parser because the status byte fixes the length
+    uint8_t bytes[3] = {
+      (uint8_t)(param1 & 0xFF),
+      (uint8_t)((param1 >> 8) & 0xFF),
+      (uint8_t)((param1 >> 16) & 0xFF)
+    };
+    uint8_t status = bytes[0];
+    size_t length = status >= 0xF8 || status == 0xF6 ? 1 : (status & 0xE0) == 0xC0 || status == 0xF1 || status == 0xF3 ? 2 : 3;
+    InputHub::dispatchBytes(*(PooledHandle*)instance, bytes, length, monotonicNanoseconds());
+  }
+  
+  static MMRESULT openInput(uint32_t deviceIndex, PooledHandle* entry, HMIDIIN& handle) {
+    MMRESULT result = midiInOpen(&handle, deviceIndex, (DWORD_PTR)inputCallback, (DWORD_PTR)entry, CALLBACK_FUNCTION);
+    if (result == MMSYSERR_NOERROR) {
+      midiInStart(handle);
+    }
+    return result;
+  }
+  
+  static MMRESULT sendData(HMIDIOUT handle, const uint8_t* data, size_t length) {
+    if (length >= 1 && length <= 3) {
+      // MIDI 1.0 short message, packed little-endian
+      uint32_t msg = data[0] | (length > 1 ? data[1] << 8 : 0) | (length > 2 ? data[2] << 16 : 0);
+      MMRESULT result = midiOutShortMsg(handle, msg);
+      if (result == MMSYSERR_NOERROR) {
+        MIDI2_LOG_TRACE("Sent MIDI 1.0: 0x%x", msg);
+      }
+      return result;
+    }
+    return MMSYSERR_ERROR;
+  }
+  
+  // Complete SysEx message from F0 to F7. Blocks until the driver has
+  // consumed the buffer, SysEx is rare enough that this is acceptable.
+  static MMRESULT sendSysEx(HMIDIOUT handle, const uint8_t* data, size_t length) {
+    MIDIHDR header = {};
+    header.lpData = (LPSTR)data;
+    header.dwBufferLength = (DWORD)length;
+    header.dwBytesRecorded = (DWORD)length;
+    
+    MMRESULT result = midiOutPrepareHeader(handle, &header, sizeof(header));
+    if (result != MMSYSERR_NOERROR) return result;
+    
+    result = midiOutLongMsg(handle, &header, sizeof(header));
+    if (result == MMSYSERR_NOERROR) {
+      while (!(header.dwFlags & MHDR_DONE)) {
+        Sleep(1);
+      }
+    }
+    midiOutUnprepareHeader(handle, &header, sizeof(header));
+    return result;
+  }
+};
+
+// Static member initialization
+bool WindowsMIDIManager::useWindowsMIDIServices = WindowsMIDIManager::detectWindowsMIDIServices();
+void* WindowsMIDIManager::windowsMIDISession = nullptr;
+std::map<uint32_t, HMIDIOUT> WindowsMIDIManager::openHandles;
+
+#elif __APPLE__
+
+// CoreMIDI Implementation for macOS
+class MacMIDIManager {
+private:
+  static MIDIClientRef midiClient;
+  static MIDIPortRef outputPort;
+  static MIDIPortRef inputPort;
+  static bool initialized;
+  
+  static void readProc(const MIDIPacketList* packets, void* readProcRefCon, void* srcConnRefCon) {
+    PooledHandle* entry = (PooledHandle*)srcConnRefCon;
+    if (entry == nullptr) return;
+    uint64_t timestamp = monotonicNanoseconds();
+    const MIDIPacket* packet = &packets->packet[0];
+    for (UInt32 i = 0; i < packets->numPackets; i++) {
+      InputHub::dispatchBytes(*entry, packet->data, packet->length, timestamp);
+      packet = MIDIPacketNext(packet);
+    }
+  }
+  
+  static bool ensureInitialized() {
+    if (initialized) return midiClient != 0;
+    
+    OSStatus status = MIDIClientCreate(
+      CFSTR("HarmonEasy MIDI Client"),
+      nullptr,  // notifyProc
+      nullptr,  // notifyRefCon
+      &midiClient
+    );
+    
+    if (status != noErr) {
+      MIDI2_LOG_ERROR("Failed to create MIDI client: %d", (int)status);
+      return false;
+    }
+    
+    status = MIDIOutputPortCreate(
+      midiClient,
+      CFSTR("HarmonEasy Output"),
+      &outputPort
+    );
+    
+    if (status != noErr) {
+      MIDI2_LOG_ERROR("Failed to create output port: %d", (int)status);
+      return false;
+    }
+    
+    status = MIDIInputPortCreate(
+      midiClient,
+      CFSTR("HarmonEasy Input"),
+      readProc,
+      nullptr,
+      &inputPort
+    );
+    
+    if (status != noErr) {
+      MIDI2_LOG_ERROR("Failed to create input port: %d", (int)status);
+      return false;
+    }
+    
+    initialized = true;
+    return true;
+  }
+  
+  static MIDIDevice describeEndpoint(MIDIEndpointRef endpoint, uint32_t index, int isInput) {
+    MIDIDevice device = {};
+    device.index = index;
+    device.isInput = isInput;
+    
+    CFStringRef name = nullptr;
+    MIDIObjectGetStringProperty(endpoint, kMIDIPropertyDisplayName, &name);
+    if (name) {
+      CFStringGetCString(name, device.name, sizeof(device.name), kCFStringEncodingUTF8);
+      CFRelease(name);
+    }
+    
+    // The unique ID survives replugging, the endpoint reference does not
+    SInt32 uniqueID = 0;
+    MIDIObjectGetIntegerProperty(endpoint, kMIDIPropertyUniqueID, &uniqueID);
+    snprintf(device.address, sizeof(device.address), "coremidi:%d", (int)uniqueID);
+    
+    device.endpoint = (uint32_t)endpoint;
+    device.card = -1;
+    device.device = -1;
+    device.subdevice = -1;
+    device.subdeviceCount = 1;
+    device.id = makeDeviceId((int)uniqueID, -1, -1, device.name);
+    return device;
+  }
+  
+public:
+  static OSStatus connectSource(MIDIEndpointRef source, PooledHandle* entry) {
+    if (!ensureInitialized()) return -1;
+    return MIDIPortConnectSource(inputPort, source, entry);
+  }
+  
+  static void disconnectSource(MIDIEndpointRef source) {
+    if (inputPort != 0) MIDIPortDisconnectSource(inputPort, source);
+  }
+  
+  static void cleanup() {
+    if (midiClient != 0) {
+      MIDIClientDispose(midiClient);
+      midiClient = 0;
+    }
+    initialized = false;
+  }
+  
+  static void enumerateOutputs(std::vector<MIDIDevice>& devices) {
+    if (!ensureInitialized()) return;
+    
+    ItemCount destCount = MIDIGetNumberOfDestinations();
+    
+    for (ItemCount i = 0; i < destCount; i++) {
+      MIDIEndpointRef dest = MIDIGetDestination(i);
+      devices.push_back(describeEndpoint(dest, (uint32_t)i, 0));
+    }
+  }
+  
+  static void enumerateInputs(std::vector<MIDIDevice>& devices) {
+    if (!ensureInitialized()) return;
+    
+    ItemCount sourceCount = MIDIGetNumberOfSources();
+    
+    for (ItemCount i = 0; i < sourceCount; i++) {
+      MIDIEndpointRef source = MIDIGetSource(i);
+      devices.push_back(describeEndpoint(source, (uint32_t)i, 1));
+    }
+  }
+  
+  // Endpoints opened through the MIDI 1.0 API take byte streams, UMP is
+  // translated before this point
+  static OSStatus sendBytes(MIDIEndpointRef dest, const uint8_t* bytes, size_t length) {
+    if (!ensureInitialized()) {
+      return -1;
+    }
+    
+    Byte buffer[1024];
+    MIDIPacketList* packetList = (MIDIPacketList*)buffer;
+    MIDIPacket* packet = MIDIPacketListInit(packetList);
+    packet = MIDIPacketListAdd(packetList, sizeof(buffer), packet, 0, length, bytes);
+    if (packet == nullptr) return -1;
+    
+    return MIDISend(outputPort, dest, packetList);
+  }
+};
+
+// Static member initialization
+MIDIClientRef MacMIDIManager::midiClient = 0;
+MIDIPortRef MacMIDIManager::outputPort = 0;
+MIDIPortRef MacMIDIManager::inputPort = 0;
+bool MacMIDIManager::initialized = false;
+
+#elif __linux__
+
+#if HAS_ALSA
+// ALSA Implementation for Linux
+class ALSAMIDIManager {
+private:
+  // Describes the rawmidi devices of one card in both directions.
+  // Devices are only described here, never opened: opening a port pins it
+  // exclusively and would fail for ports we already hold open.
+  static void probeCard(int cardNum, std::vector<MIDIDevice>& outputs, std::vector<MIDIDevice>& inputs) {
+    snd_ctl_t* handle;
+    char hwname[32];
+    snprintf(hwname, sizeof(hwname), "hw:%d", cardNum);
+    
+    if (snd_ctl_open(&handle, hwname, 0) < 0) return;
+    
+    int devNum = -1;
+    while (snd_ctl_rawmidi_next_device(handle, &devNum) >= 0 && devNum >= 0) {
+      const snd_rawmidi_stream_t streams[2] = { SND_RAWMIDI_STREAM_OUTPUT, SND_RAWMIDI_STREAM_INPUT };
+      for (snd_rawmidi_stream_t stream : streams) {
+        snd_rawmidi_info_t* info;
+        snd_rawmidi_info_alloca(&info);
+        snd_rawmidi_info_set_device(info, devNum);
+        snd_rawmidi_info_set_stream(info, stream);
+        
+        if (snd_ctl_rawmidi_info(handle, info) < 0) continue;
+        
+        // Multi-port interfaces expose one subdevice per DIN jack or cable,
+        // each is listed as its own port so it can be addressed directly
+        int subdeviceCount = (int)snd_rawmidi_info_get_subdevices_count(info);
+        if (subdeviceCount < 1) subdeviceCount = 1;
+        
+        std::string deviceName = snd_rawmidi_info_get_name(info);
+        std::vector<MIDIDevice>& devices = stream == SND_RAWMIDI_STREAM_INPUT ? inputs : outputs;
+        
+        for (int sub = 0; sub < subdeviceCount; sub++) {
+          MIDIDevice device = {};
+          device.index = devices.size();
+          device.isInput = stream == SND_RAWMIDI_STREAM_INPUT ? 1 : 0;
+          device.card = cardNum;
+          device.device = devNum;
+          device.subdevice = sub;
+          device.subdeviceCount = subdeviceCount;
+          
+          const char* subName = nullptr;
+          if (subdeviceCount > 1) {
+            snd_rawmidi_info_set_subdevice(info, sub);
+            if (snd_ctl_rawmidi_info(handle, info) >= 0) {
+              subName = snd_rawmidi_info_get_subdevice_name(info);
+            }
+          }
+          if (subName != nullptr && subName[0] != '\0') {
+            strncpy(device.name, subName, sizeof(device.name) - 1);
+          } else if (subdeviceCount > 1) {
+            snprintf(device.name, sizeof(device.name), "%s %d", deviceName.c_str(), sub + 1);
+          } else {
+            strncpy(device.name, deviceName.c_str(), sizeof(device.name) - 1);
+          }
+          
+          snprintf(device.address, sizeof(device.address), "hw:%d,%d,%d", cardNum, devNum, sub);
+          device.id = makeDeviceId(cardNum, devNum, sub, device.name);
+          devices.push_back(device);
+        }
+      }
+    }
+    snd_ctl_close(handle);
+  }
+  
+public:
+  // Probes every card on its own thread: control ioctls on a slow USB hub
+  // can take tens of milliseconds each, and cards do not depend on each other
+  static void enumerateDevices(std::vector<MIDIDevice>& outputs, std::vector<MIDIDevice>& inputs) {
+    std::vector<int> cards;
+    int cardNum = -1;
+    while (snd_card_next(&cardNum) == 0 && cardNum >= 0) {
+      cards.push_back(cardNum);
+    }
+    
+    std::vector<std::vector<MIDIDevice>> cardOutputs(cards.size());
+    std::vector<std::vector<MIDIDevice>> cardInputs(cards.size());
+    
+    if (cards.size() == 1) {
+      probeCard(cards[0], cardOutputs[0], cardInputs[0]);
+    } else {
+      std::vector<std::thread> probes;
+      probes.reserve(cards.size());
+      for (size_t i = 0; i < cards.size(); i++) {
+        probes.emplace_back(probeCard, cards[i], std::ref(cardOutputs[i]), std::ref(cardInputs[i]));
+      }
+      for (std::thread& probe : probes) {
+        probe.join();
+      }
+    }
+    
+    // Merge in card order so the listing does not depend on thread timing
+    for (size_t i = 0; i < cards.size(); i++) {
+      outputs.insert(outputs.end(), cardOutputs[i].begin(), cardOutputs[i].end());
+      inputs.insert(inputs.end(), cardInputs[i].begin(), cardInputs[i].end());
+    }
+  }
+  
+  static int openOutput(const char* address, snd_rawmidi_t*& handle) {
+    return snd_rawmidi_open(nullptr, &handle, address, SND_RAWMIDI_NONBLOCK);
+  }
+  
+  static int openInput(const char* address, snd_rawmidi_t*& handle) {
+    return snd_rawmidi_open(&handle, nullptr, address, SND_RAWMIDI_NONBLOCK);
+  }
+  
+  static bool waitWritable(snd_rawmidi_t* handle, int timeoutMs) {
+    struct pollfd fds[4];
+    int count = snd_rawmidi_poll_descriptors(handle, fds, 4);
+    return count > 0 && poll(fds, count, timeoutMs) > 0;
+  }
+  
+  /**
+   * Bytes waiting in the driver buffer and its size. For inputs, xruns
+   * counts bytes lost because nobody read in time.
+   */
+  static void queueStatus(snd_rawmidi_t* handle, bool isInput, size_t& depth, size_t& size, size_t& xruns) {
+    snd_rawmidi_status_t* status;
+    snd_rawmidi_status_alloca(&status);
+    snd_rawmidi_params_t* params;
+    snd_rawmidi_params_alloca(&params);
+    depth = size = xruns = 0;
+    if (snd_rawmidi_status(handle, status) < 0 || snd_rawmidi_params_current(handle, params) < 0) return;
+    size = snd_rawmidi_params_get_buffer_size(params);
+    size_t avail = snd_rawmidi_status_get_avail(status);
+    xruns = snd_rawmidi_status_get_xruns(status);
+    // Output avail is free space, input avail is bytes waiting to be read
+    depth = isInput ? avail : (avail < size ? size - avail : 0);
+  }
+  
+  /**
+   * Rawmidi ports carry MIDI 1.0 bytes, UMP is translated before this point.
+   * Short writes are continued and a full buffer is waited on briefly, so
+   * bursts are not silently truncated. Returns the bytes written, fewer than
+   * length only when the buffer stayed full and the rest was dropped.
+   */
+  static size_t writeBytes(snd_rawmidi_t* handle, const uint8_t* bytes, size_t length, PortStats& stats) {
+    size_t written = 0;
+    int waits = 0;
+    while (written < length) {
+      ssize_t result = snd_rawmidi_write(handle, bytes + written, length - written);
+      if (result == -EAGAIN) {
+        PortStats::add(stats.retries, 1);
+        size_t depth, size, xruns;
+        queueStatus(handle, false, depth, size, xruns);
+        stats.raiseHighWater(size);
+        if (++waits > 10 || !waitWritable(handle, 1)) break;
+        continue;
+      }
+      if (result <= 0) break;
+      if ((size_t)result < length - written) PortStats::add(stats.shortWrites, 1);
+      written += (size_t)result;
+    }
+    return written;
+  }
+};
+
+#else
+// Stub for when ALSA is not available
+class ALSAMIDIManager {
+public:
+  static void enumerateDevices(std::vector<MIDIDevice>& outputs, std::vector<MIDIDevice>& inputs) {}
+};
+#endif
+
+#endif
+
+// ============================================================================
+// Virtual Loopback Ports
+// ============================================================================
+
+/**
+ * Lists the loopback ports of virtual-midi.h next to the hardware ones and
+ * routes their deliveries into the input hub.
+ */
+class VirtualMIDIManager {
+private:
+  // Open pooled input per loopback port, guarded by the pool mutex
+  static std::vector<PooledHandle*> inputs;
+
+public:
+  static void enumerateDevices(std::vector<MIDIDevice>& outputs, std::vector<MIDIDevice>& inputs) {
+    uint32_t ports = vmidi::Loopback::config().ports;
+    for (uint32_t port = 0; port < ports; port++) {
+      for (int isInput = 0; isInput < 2; isInput++) {
+        std::vector<MIDIDevice>& devices = isInput ? inputs : outputs;
+        MIDIDevice device = {};
+        device.index = devices.size();
+        device.isInput = isInput;
+        device.isVirtual = true;
+        snprintf(device.name, sizeof(device.name), "HarmonEasy Loopback %u", port + 1);
+        snprintf(device.address, sizeof(device.address), "virtual:%u", port);
+        device.endpoint = port;
+        device.card = -1;
+        device.device = (int)port;
+        device.subdevice = -1;
+        device.subdeviceCount = 1;
+        // Card -2 keeps loopback ids apart from every hardware namespace
+        device.id = makeDeviceId(-2, (int)port, -1, device.name);
+        devices.push_back(device);
+      }
+    }
+  }
+  
+  // Must be called with the pool mutex held
+  static void attachInput(PooledHandle* entry) {
+    if (inputs.size() <= entry->endpoint) inputs.resize(entry->endpoint + 1, nullptr);
+    inputs[entry->endpoint] = entry;
+  }
+  
+  // Must be called with the pool mutex held
+  static void detachInput(PooledHandle* entry) {
+    if (entry->endpoint < inputs.size() && inputs[entry->endpoint] == entry) {
+      inputs[entry->endpoint] = nullptr;
+    }
+  }
+  
+  // Delivery thread side, see vmidi::Loopback::Deliver
+  static void deliver(uint32_t port, const uint32_t* words, size_t count);
+};
+
+std::vector<PooledHandle*> VirtualMIDIManager::inputs;
+
+// ============================================================================
+// Handle Pool
+// ============================================================================
+
+/**
+ * Reference-counted platform handles, opened on first use and shared by
+ * every token for the same device and direction. When the last token is
+ * released the handle stays open for a grace period so quick close/reopen
+ * cycles do not hit the driver, then the housekeeping pass closes it. This
+ * keeps descriptors and kernel buffers proportional to ports actually in use
+ * and leaves every other port free for other applications.
+ */
+class HandlePool {
+private:
+  static std::vector<std::unique_ptr<PooledHandle>> entries;
+  static std::atomic<int64_t> idleTimeoutMs;
+  
+  static int openPlatformHandle(PooledHandle& entry) {
+    if (entry.isVirtual) {
+      // Loopback ports have no platform handle, any non-null value marks them open
+      entry.handle = (void*)(uintptr_t)(entry.endpoint + 1);
+      if (entry.isInput) VirtualMIDIManager::attachInput(&entry);
+      return 0;
+    }
+#ifdef _WIN32
+    if (entry.isInput) {
+      HMIDIIN handle;
+      MMRESULT result = WindowsMIDIManager::openInput(entry.endpoint, &entry, handle);
+      if (result != MMSYSERR_NOERROR) return -(int)result;
+      entry.handle = (void*)handle;
+    } else {
+      HMIDIOUT handle;
+      MMRESULT result = WindowsMIDIManager::openOutput(entry.endpoint, handle);
+      if (result != MMSYSERR_NOERROR) return -(int)result;
+      entry.handle = (void*)handle;
+    }
+#elif __APPLE__
+    if (entry.isInput) {
+      OSStatus status = MacMIDIManager::connectSource((MIDIEndpointRef)entry.endpoint, &entry);
+      if (status != noErr) return -1;
+    }
+    // CoreMIDI sends through the shared output port, so the endpoint is the handle
+    entry.handle = (void*)(uintptr_t)entry.endpoint;
+#elif __linux__ && HAS_ALSA
+    snd_rawmidi_t* handle = nullptr;
+    int result = entry.isInput
+      ? ALSAMIDIManager::openInput(entry.address, handle)
+      : ALSAMIDIManager::openOutput(entry.address, handle);
+    if (result < 0) return result;
+    std::lock_guard<std::mutex> driver(driverMutex);
+    entry.handle = handle;
+#else
+    return -1;
+#endif
+    if (entry.isInput) entry.parser.reset();
+    return 0;
+  }
+  
+  static void closePlatformHandle(PooledHandle& entry) {
+    if (entry.handle == nullptr) return;
+    if (entry.isVirtual) {
+      if (entry.isInput) VirtualMIDIManager::detachInput(&entry);
+      entry.handle = nullptr;
+      return;
+    }
+#ifdef _WIN32
+    if (entry.isInput) {
+      midiInStop((HMIDIIN)entry.handle);
+      midiInClose((HMIDIIN)entry.handle);
+    } else {
+      midiOutClose((HMIDIOUT)entry.handle);
+    }
+#elif __APPLE__
+    if (entry.isInput) {
+      MacMIDIManager::disconnectSource((MIDIEndpointRef)entry.endpoint);
+    }
+#elif __linux__ && HAS_ALSA
+    std::lock_guard<std::mutex> driver(driverMutex);
+    snd_rawmidi_close((snd_rawmidi_t*)entry.handle);
+#endif
+    entry.handle = nullptr;
+  }
+  
+public:
+  // Guards entries and their handles
+  static std::mutex mutex;
+  // Held around ALSA calls made without the pool mutex so the handle cannot
+  // be closed underneath them; taken inside the pool mutex, never around it
+  static std::mutex driverMutex;
+  // Called after an input handle is opened or closed
+  static std::function<void()> onInputsChanged;
+  
+  /**
+   * Take a reference on the device's handle, opening it if needed.
+   * Returns 0 or a negative platform error code.
+   */
+  static int acquire(const MIDIDevice& device, PooledHandle*& result) {
+    bool inputsChanged = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      PooledHandle* entry = nullptr;
+      for (auto& candidate : entries) {
+        if (candidate->deviceId == device.id && candidate->isInput == device.isInput) {
+          entry = candidate.get();
+          break;
+        }
+      }
+      if (entry == nullptr) {
+        entries.emplace_back(new PooledHandle());
+        entry = entries.back().get();
+        entry->deviceId = device.id;
+        entry->isInput = device.isInput;
+        entry->isVirtual = device.isVirtual;
+        entry->handle = nullptr;
+        entry->refs = 0;
+      }
+      // The address or endpoint may have changed if the device was replugged
+      snprintf(entry->address, sizeof(entry->address), "%s", device.address);
+      entry->endpoint = device.endpoint;
+      
+      if (entry->handle == nullptr) {
+        int error = openPlatformHandle(*entry);
+        if (error < 0) return error;
+        inputsChanged = entry->isInput != 0;
+      }
+      entry->refs++;
+      result = entry;
+    }
+    if (inputsChanged && onInputsChanged) onInputsChanged();
+    return 0;
+  }
+  
+  static void release(PooledHandle* entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entry->refs > 0 && --entry->refs == 0) {
+      entry->idleSince = std::chrono::steady_clock::now();
+    }
+  }
+  
+  // Close handles that have been unreferenced for longer than the grace period
+  static void reapIdle() {
+    bool inputsChanged = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto now = std::chrono::steady_clock::now();
+      auto grace = std::chrono::milliseconds(idleTimeoutMs.load());
+      for (auto& entry : entries) {
+        if (entry->handle != nullptr && entry->refs == 0 && now - entry->idleSince >= grace) {
+          closePlatformHandle(*entry);
+          inputsChanged = inputsChanged || entry->isInput;
+        }
+      }
+    }
+    if (inputsChanged && onInputsChanged) onInputsChanged();
+  }
+  
+  static void setIdleTimeout(int64_t milliseconds) {
+    idleTimeoutMs = milliseconds < 0 ? 0 : milliseconds;
+  }
+  
+  static void closeAll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : entries) {
+      closePlatformHandle(*entry);
+      entry->refs = 0;
+    }
+  }
+  
+  // Must be called with the pool mutex held
+  static const std::vector<std::unique_ptr<PooledHandle>>& all() {
+    return entries;
+  }
+};
+
+std::vector<std::unique_ptr<PooledHandle>> HandlePool::entries;
+std::atomic<int64_t> HandlePool::idleTimeoutMs(2000);
+std::mutex HandlePool::mutex;
+std::mutex HandlePool::driverMutex;
+std::function<void()> HandlePool::onInputsChanged;
+
+void VirtualMIDIManager::deliver(uint32_t port, const uint32_t* words, size_t count) {
+  PooledHandle* entry = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(HandlePool::mutex);
+    if (port < inputs.size()) entry = inputs[port];
+    // Like a cable into a closed port, nothing is buffered for later
+    if (entry == nullptr || entry->refs == 0) return;
+  }
+  MIDI2_TRACE_INSTANT(trace::RECEIVE, entry->deviceId, (uint32_t)(count * 4));
+  PortStats::add(entry->stats.bytesReceived, count * 4);
+  PortStats::add(entry->stats.packetsReceived, countPackets(words, count));
+  uint64_t arrivalNs = monotonicNanoseconds();
+  if (entry->jitterReduction.load(std::memory_order_relaxed) == 0) {
+    InputHub::dispatch(entry->deviceId, words, count, arrivalNs);
+    return;
+  }
+  
+  // JR Clocks and Timestamps are taken here, everything else goes out at
+  // the time its sender stamped it
+  size_t start = 0;
+  for (size_t i = 0; i < count; i += ump::packetWordsOf(words[i])) {
+    if (ump::typeOf(words[i]) != ump::MessageType::Utility) continue;
+    uint8_t status = (uint8_t)ump::utility::Status::get(&words[i]);
+    if (status != ump::utility::JR_CLOCK && status != ump::utility::JR_TIMESTAMP) continue;
+    if (i > start) InputHub::dispatch(entry->deviceId, words + start, i - start, entry->jrReceiver.eventTime(arrivalNs));
+    uint16_t time = (uint16_t)ump::utility::Ticks::get(&words[i]);
+    if (status == ump::utility::JR_CLOCK) entry->jrReceiver.clock(time, arrivalNs);
+    else entry->jrReceiver.timestamp(time, arrivalNs);
+    start = i + 1;
+  }
+  if (start < count) InputHub::dispatch(entry->deviceId, words + start, count - start, entry->jrReceiver.eventTime(arrivalNs));
+}
+
+// ============================================================================
+// Open Handle Table
+// ============================================================================
+
+/**
+ * Joins UMP packets split across writes. sendUmp() takes one word per call,
+ * so a MIDI 2.0 packet usually arrives in two; the words of an unfinished
+ * packet are kept until the rest of it arrives.
+ */
+struct PacketCarry {
+  uint32_t words[4];
+  uint8_t count;
+  uint8_t expected;
+  
+  void reset() {
+    count = 0;
+  }
+  
+  // fn(packet, length) for every packet `in` completes, in order
+  template<typename Fn>
+  void feed(const uint32_t* in, size_t inCount, Fn fn) {
+    size_t i = 0;
+    if (count > 0) {
+      while (count < expected && i < inCount) words[count++] = in[i++];
+      if (count < expected) return;
+      count = 0;
+      fn((const uint32_t*)words, expected);
+    }
+    while (i < inCount) {
+      uint8_t size = ump::packetWordsOf(in[i]);
+      if (i + size > inCount) {
+        expected = size;
+        while (i < inCount) words[count++] = in[i++];
+        return;
+      }
+      fn(in + i, size);
+      i += size;
+    }
+  }
+};
+
+/**
+ * What an output has been left holding: one bit per note for every group
+ * and channel, plus the channels whose sustain pedal is down. Kept up to
+ * date on the send path so a panic or a close can release exactly what is
+ * sounding in one write, rather than sweeping All Notes Off over every
+ * channel, which takes the best part of a second on a DIN link.
+ */
+struct HeldNotes {
+  uint64_t notes[16][16][2];
+  // Channels of each group with a note down, and with the pedal down
+  uint16_t sounding[16];
+  uint16_t sustained[16];
+  
+  void clear() {
+    memset(this, 0, sizeof(*this));
+  }
+  
+  // Follow one complete packet, anything but a channel voice message is ignored
+  void track(const uint32_t* packet) {
+    ump::MessageType type = ump::typeOf(packet[0]);
+    if (type == ump::MessageType::Midi1ChannelVoice || type == ump::MessageType::Midi2ChannelVoice) {
+      update(packet, type == ump::MessageType::Midi1ChannelVoice);
+    }
+  }
+  
+  bool empty() const {
+    for (uint8_t group = 0; group < 16; group++) {
+      if (sounding[group] | sustained[group]) return false;
+    }
+    return true;
+  }
+  
+  // Append a note-off for every held note and a pedal release for every
+  // held pedal, as MIDI 1.0 packets
+  void release(std::vector<uint32_t>& words) const {
+    for (uint8_t group = 0; group < 16; group++) {
+      uint16_t channels = sounding[group] | sustained[group];
+      for (uint8_t channel = 0; channels != 0; channel++, channels >>= 1) {
+        if (!(channels & 1)) continue;
+        const uint64_t* held = notes[group][channel];
+        for (uint8_t note = 0; note < 128; note++) {
+          if (held[note >> 6] & (1ull << (note & 63))) words.push_back(ump::midi1::noteOff(group, channel, note));
+        }
+        if (sustained[group] & (1u << channel)) words.push_back(ump::midi1::controlChange(group, channel, 64, 0));
+      }
+    }
+  }
+  
+private:
+  void update(const uint32_t* packet, bool midi1) {
+    uint8_t group = (uint8_t)ump::Group::get(packet);
+    uint8_t channel = (uint8_t)ump::midi2::Channel::get(packet);
+    uint8_t index = (uint8_t)ump::midi2::Index1::get(packet);
+    uint16_t channelBit = (uint16_t)(1u << channel);
+    uint64_t* held = notes[group][channel];
+    
+    switch (ump::midi2::Opcode::get(packet)) {
+      case 0x9:
+        // A MIDI 1.0 note-on with velocity 0 is a note-off
+        if (!midi1 || ump::midi1::Data2::get(packet) != 0) {
+          held[index >> 6] |= 1ull << (index & 63);
+          sounding[group] |= channelBit;
+          break;
+        }
+        // fall through
+      case 0x8:
+        held[index >> 6] &= ~(1ull << (index & 63));
+        if ((held[0] | held[1]) == 0) sounding[group] &= ~channelBit;
+        break;
+      case 0xB: {
+        if (index == 64) {
+          bool down = midi1 ? ump::midi1::Data2::get(packet) >= 64 : ump::midi2::Data::get(packet) >= 0x80000000u;
+          if (down) sustained[group] |= channelBit;
+          else sustained[group] &= ~channelBit;
+        } else if (index == 120 || index == 123) {
+          // All Sound Off / All Notes Off, the pedal stays as it is
+          held[0] = held[1] = 0;
+          sounding[group] &= ~channelBit;
+        } else if (index == 121) {
+          // Reset All Controllers lifts the pedal
+          sustained[group] &= ~channelBit;
+        }
+        break;
+      }
+    }
+  }
+};
+
+struct OpenHandle {
+  static constexpr uint8_t MAX_TARGETS = 16;
+  static constexpr uint8_t NO_TARGET = 0xFF;
+  
+  // Bumped whenever the slot is released so stale tokens stop resolving
+  uint32_t generation;
+  bool inUse;
+  // Set under the table mutex once release has begun, no new pins are taken
+  bool closing;
+  // Threads inside withSlot or forEachOutput on this slot; release waits
+  // for them to leave before the targets are let go
+  std::atomic<int> pins;
+  // Cleared by the hotplug watcher when the device disappears
+  std::atomic<bool> connected;
+  int isInput;
+  uint64_t deviceId;
+  // Pooled ports behind this token: a single port, or every subdevice of a
+  // multi-port interface. Entries cannot close while this slot holds them.
+  PooledHandle* targets[MAX_TARGETS];
+  uint8_t targetCount;
+  // Target index for each UMP group, NO_TARGET drops the group
+  uint8_t groupTarget[16];
+  // Outputs only: UMP words may arrive split across sendUmp calls
+  ump::UmpToMidi1Translator translator;
+  // Serialises writes from JS and the scheduler thread
+  std::mutex writeMutex;
+  // Outputs only, guarded by writeMutex: the packet being joined across
+  // writes, and what the packets written so far leave sounding
+  PacketCarry carry;
+  HeldNotes held;
+  // UMP transports only: JR Timestamps on output, JR times used on input
+  bool jitterReduction;
+  // Outputs only, guarded by writeMutex: when the last JR Clock was sent,
+  // and words still owed of a packet split across writes
+  uint64_t jrClockNs;
+  uint8_t jrCarry;
+#ifdef _WIN32
+  // WinMM takes SysEx as one long message, fragments are collected here
+  std::vector<uint8_t> sysEx;
+#endif
+};
+
+/**
+ * Fixed table of open devices addressed by tokens. A token packs the slot
+ * index into its low bits and the slot generation into the rest, so the
+ * send path resolves it with one mask and one compare and a token from a
+ * closed device can never reach a newer handle in the same slot.
+ */
+class HandleTable {
+public:
+  static constexpr uint32_t SLOT_BITS = 10;
+  static constexpr uint32_t MAX_HANDLES = 1u << SLOT_BITS;
+  static constexpr uint32_t SLOT_MASK = MAX_HANDLES - 1;
+  static constexpr uint32_t GENERATION_MASK = 0xFFFFFFFFu >> SLOT_BITS;
+  
+private:
+  static OpenHandle slots[MAX_HANDLES];
+  // Serialises allocation, release and pinning against the hotplug watcher.
+  // Never held while a slot is written to.
+  static std::mutex mutex;
+  // Open outputs sending JR Timestamps
+  static std::atomic<int> jitterOutputs;
+  
+  static void releaseSlot(OpenHandle& slot) {
+    if (slot.jitterReduction) {
+      if (slot.isInput) slot.targets[0]->jitterReduction--;
+      else jitterOutputs--;
+      slot.jitterReduction = false;
+    }
+    for (uint8_t i = 0; i < slot.targetCount; i++) {
+      HandlePool::release(slot.targets[i]);
+      slot.targets[i] = nullptr;
+    }
+    slot.targetCount = 0;
+    slot.inUse = false;
+    // Generation 0 is never handed out so a token is never 0
+    slot.generation = (slot.generation + 1) & GENERATION_MASK;
+    if (slot.generation == 0) slot.generation = 1;
+  }
+  
+  // Pins taken before closing was set are dropped once their write is done,
+  // and closing stops new ones, so this cannot be starved by steady sends
+  static void waitForPins(OpenHandle& slot) {
+    while (slot.pins.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+  }
+  
+  static void unpin(OpenHandle& slot) {
+    slot.pins.fetch_sub(1, std::memory_order_release);
+  }
+  
+public:
+  static inline OpenHandle* resolve(uint32_t token) {
+    OpenHandle& slot = slots[token & SLOT_MASK];
+    if (!slot.inUse || slot.generation != (token >> SLOT_BITS)) return nullptr;
+    return &slot;
+  }
+  
+  // Takes over the pooled references in targets. groupTarget maps each UMP
+  // group to an index into targets, or null to route every group to the
+  // first target. Jitter Reduction is only taken up on a port that carries
+  // UMP as is. Returns 0 when every slot is taken.
+  static uint32_t allocate(PooledHandle* const* targets, uint8_t targetCount, const uint8_t* groupTarget,
+                           bool jitterReduction = false) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t i = 0; i < MAX_HANDLES; i++) {
+      OpenHandle& slot = slots[i];
+      if (slot.inUse) continue;
+      if (slot.generation == 0) slot.generation = 1;
+      slot.inUse = true;
+      slot.closing = false;
+      slot.connected = true;
+      slot.isInput = targets[0]->isInput;
+      slot.deviceId = targets[0]->deviceId;
+      slot.targetCount = targetCount;
+      for (uint8_t t = 0; t < targetCount; t++) slot.targets[t] = targets[t];
+      for (uint8_t group = 0; group < 16; group++) {
+        slot.groupTarget[group] = groupTarget ? groupTarget[group] : 0;
+      }
+      slot.translator.reset();
+      slot.carry.reset();
+      slot.held.clear();
+      slot.jitterReduction = jitterReduction && targets[0]->isVirtual;
+      slot.jrClockNs = 0;
+      slot.jrCarry = 0;
+      if (slot.jitterReduction) {
+        if (slot.isInput) slot.targets[0]->jitterReduction++;
+        else jitterOutputs++;
+      }
+#ifdef _WIN32
+      slot.sysEx.clear();
+#endif
+      return (slot.generation << SLOT_BITS) | i;
+    }
+    return 0;
+  }
+  
+  // Run fn on the token's slot, pinned so it cannot be released meanwhile;
+  // false if stale. The table lock only covers taking the pin, so a write
+  // that blocks on a slow port never holds up opening or closing others.
+  template<typename Fn>
+  static bool withSlot(uint32_t token, Fn fn) {
+    OpenHandle* slot;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      slot = resolve(token);
+      if (slot == nullptr || slot->closing) return false;
+      slot->pins.fetch_add(1, std::memory_order_relaxed);
+    }
+    fn(*slot);
+    unpin(*slot);
+    return true;
+  }
+  
+  // Must not be called from inside withSlot or forEachOutput
+  static void release(uint32_t token) {
+    OpenHandle* slot;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      slot = resolve(token);
+      if (slot == nullptr || slot->closing) return;
+      slot->closing = true;
+    }
+    waitForPins(*slot);
+    std::lock_guard<std::mutex> lock(mutex);
+    releaseSlot(*slot);
+  }
+  
+  static bool hasJitterOutputs() {
+    return jitterOutputs.load(std::memory_order_relaxed) > 0;
+  }
+  
+  // Run fn on every open output, each pinned like withSlot
+  template<typename Fn>
+  static void forEachOutput(Fn fn) {
+    OpenHandle* pinned[MAX_HANDLES];
+    uint32_t count = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (OpenHandle& slot : slots) {
+        if (!slot.inUse || slot.closing || slot.isInput) continue;
+        slot.pins.fetch_add(1, std::memory_order_relaxed);
+        pinned[count++] = &slot;
+      }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      fn(*pinned[i]);
+      unpin(*pinned[i]);
+    }
+  }
+  
+  static void setConnected(uint64_t deviceId, int isInput, bool connected) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (OpenHandle& slot : slots) {
+      if (!slot.inUse || slot.isInput != isInput) continue;
+      // Losing any subdevice of a multi-port interface marks the token
+      for (uint8_t i = 0; i < slot.targetCount; i++) {
+        if (slot.targets[i]->deviceId == deviceId) {
+          slot.connected = connected;
+          break;
+        }
+      }
+    }
+  }
+  
+  static void closeAll() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (OpenHandle& slot : slots) {
+        if (slot.inUse) slot.closing = true;
+      }
+    }
+    for (OpenHandle& slot : slots) waitForPins(slot);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (OpenHandle& slot : slots) {
+      if (slot.inUse) releaseSlot(slot);
+    }
+  }
+};
+
+OpenHandle HandleTable::slots[HandleTable::MAX_HANDLES];
+std::mutex HandleTable::mutex;
+std::atomic<int> HandleTable::jitterOutputs(0);
+
+// ============================================================================
+// Input Reader
+// ============================================================================
+
+#if __linux__ && HAS_ALSA
+// ALSA has no callback API, so one thread polls every open rawmidi input.
+// WinMM and CoreMIDI deliver input on their own threads instead.
+class InputReader {
+private:
+  static std::thread thread;
+  static std::atomic<bool> running;
+  static int wakePipe[2];
+  
+  struct Source {
+    PooledHandle* entry;
+    void* handle;
+  };
+  
+  // Packets parsed from one ready source, as a range of the shared word buffer
+  struct Batch {
+    PooledHandle* entry;
+    size_t begin;
+    size_t end;
+    size_t bytes;
+    uint64_t packets;
+  };
+  
+  static void run() {
+    std::vector<struct pollfd> fds;
+    std::vector<Source> sources;
+    std::vector<uint32_t> words;
+    std::vector<Batch> batches;
+    uint8_t buffer[1024];
+    
+    while (running) {
+      fds.clear();
+      sources.clear();
+      fds.push_back({ wakePipe[0], POLLIN, 0 });
+      sources.push_back({ nullptr, nullptr });
+      {
+        std::lock_guard<std::mutex> lock(HandlePool::mutex);
+        for (auto& entry : HandlePool::all()) {
+          if (!entry->isInput || entry->isVirtual || entry->handle == nullptr) continue;
+          snd_rawmidi_t* handle = (snd_rawmidi_t*)entry->handle;
+          int count = snd_rawmidi_poll_descriptors_count(handle);
+          if (count <= 0) continue;
+          size_t first = fds.size();
+          fds.resize(first + count);
+          snd_rawmidi_poll_descriptors(handle, &fds[first], count);
+          for (int i = 0; i < count; i++) sources.push_back({ entry.get(), entry->handle });
+        }
+      }
+      
+      int ready = poll(fds.data(), fds.size(), 500);
+      if (ready <= 0) continue;
+      
+      if (fds[0].revents & POLLIN) {
+        char drain[64];
+        while (read(wakePipe[0], drain, sizeof(drain)) > 0) {}
+      }
+      
+      // Only the reads and the parsing happen under the driver lock, the
+      // packets are delivered after it is dropped so listeners never hold up
+      // opening, closing or stats. Entries are never erased, the pointers stay valid.
+      uint64_t timestamp = monotonicNanoseconds();
+      words.clear();
+      batches.clear();
+      for (size_t i = 1; i < fds.size(); i++) {
+        if (fds[i].revents == 0) continue;
+        PooledHandle* entry = sources[i].entry;
+        Batch batch = { entry, words.size(), 0, 0, 0 };
+        {
+          std::lock_guard<std::mutex> lock(HandlePool::driverMutex);
+          // The handle may have been closed or reopened since the poll set was built
+          if (entry->handle == nullptr || entry->handle != sources[i].handle) continue;
+          
+          ssize_t length;
+          while ((length = snd_rawmidi_read((snd_rawmidi_t*)entry->handle, buffer, sizeof(buffer))) > 0) {
+            batch.bytes += (size_t)length;
+            entry->parser.feed(buffer, length, [&](const uint32_t* packet, size_t wordCount) {
+              words.insert(words.end(), packet, packet + wordCount);
+              batch.packets++;
+            });
+          }
+        }
+        batch.end = words.size();
+        batches.push_back(batch);
+      }
+      
+      for (const Batch& batch : batches) {
+        PooledHandle* entry = batch.entry;
+        if (batch.bytes == 0 || entry->refs.load(std::memory_order_relaxed) == 0) continue;
+        MIDI2_TRACE_INSTANT(trace::RECEIVE, entry->deviceId, (uint32_t)batch.bytes);
+        if (batch.end > batch.begin) {
+          InputHub::dispatch(entry->deviceId, words.data() + batch.begin, batch.end - batch.begin, timestamp);
+        }
+        PortStats::add(entry->stats.bytesReceived, batch.bytes);
+        PortStats::add(entry->stats.packetsReceived, batch.packets);
+      }
+    }
+  }
+  
+public:
+  static void start() {
+    if (running.exchange(true)) return;
+    if (pipe(wakePipe) != 0) {
+      running = false;
+      return;
+    }
+    fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+    thread = std::thread(run);
+  }
+  
+  // Rebuild the poll set after inputs were opened or closed
+  static void wake() {
+    if (!running) return;
+    char byte = 1;
+    ssize_t written = write(wakePipe[1], &byte, 1);
+    (void)written;
+  }
+  
+  static void stop() {
+    if (!running.exchange(false)) return;
+    char byte = 1;
+    ssize_t written = write(wakePipe[1], &byte, 1);
+    (void)written;
+    if (thread.joinable()) thread.join();
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+  }
+};
+
+std::thread InputReader::thread;
+std::atomic<bool> InputReader::running(false);
+int InputReader::wakePipe[2] = { -1, -1 };
+#endif
+
+// ============================================================================
+// Endpoint Cache
+// ============================================================================
+
+// One Function Block of a UMP endpoint, as its Function Block Info reported
+struct FunctionBlock {
+  // False until its Function Block Info has arrived
+  bool known = false;
+  bool active = false;
+  // 1 input, 2 output, 3 both, from the device's side
+  uint8_t direction = 0;
+  // 0 not MIDI 1.0, 1 MIDI 1.0, 2 MIDI 1.0 limited to 31.25 kb/s
+  uint8_t midi1 = 0;
+  // 1 mainly a receiver, 2 mainly a sender, 3 both, 0 unknown
+  uint8_t uiHint = 0;
+  uint8_t firstGroup = 0;
+  uint8_t groupCount = 0;
+  uint8_t midiCiVersion = 0;
+  uint8_t maxSysEx8Streams = 0;
+  std::string name;
+};
+
+// What a device said about itself in reply to UMP Stream discovery
+struct EndpointInfo {
+  // The output the requests went out on and the input the replies came in on
+  uint64_t deviceId = 0;
+  uint64_t inputId = 0;
+  // False when nothing answered in time
+  bool ump = false;
+  uint8_t versionMajor = 0;
+  uint8_t versionMinor = 0;
+  bool staticBlocks = false;
+  uint8_t blockCount = 0;
+  bool midi1Protocol = false;
+  bool midi2Protocol = false;
+  bool canReceiveJr = false;
+  bool canTransmitJr = false;
+  bool hasIdentity = false;
+  uint8_t manufacturer[3] = { 0, 0, 0 };
+  uint16_t family = 0;
+  uint16_t model = 0;
+  uint8_t revision[4] = { 0, 0, 0, 0 };
+  std::string name;
+  std::string productInstanceId;
+  // Stream configuration in effect, protocol 0 until the device reports it
+  uint8_t protocol = 0;
+  bool receiveJr = false;
+  bool transmitJr = false;
+  std::vector<FunctionBlock> blocks;
+};
+
+// Last discovery result per output device, dropped when the device goes
+class EndpointCache {
+private:
+  static std::mutex mutex;
+  static std::map<uint64_t, EndpointInfo> entries;
+  
+public:
+  static void store(const EndpointInfo& info) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[info.deviceId] = info;
+  }
+  
+  // By output or input device id
+  static bool find(uint64_t deviceId, EndpointInfo& result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : entries) {
+      if (entry.first == deviceId || entry.second.inputId == deviceId) {
+        result = entry.second;
+        return true;
+      }
+    }
+    return false;
+  }
+  
+  static std::vector<EndpointInfo> list() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<EndpointInfo> result;
+    for (const auto& entry : entries) result.push_back(entry.second);
+    return result;
+  }
+  
+  static void forget(uint64_t deviceId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();) {
+      if (it->first == deviceId || it->second.inputId == deviceId) it = entries.erase(it);
+      else ++it;
+    }
+  }
+};
+
+std::mutex EndpointCache::mutex;
+std::map<uint64_t, EndpointInfo> EndpointCache::entries;
+
+// ============================================================================
+// Device Registry
+// ============================================================================
+
+struct DeviceChange {
+  MIDIDevice device;
+  bool connected;
+};
+
+// Cached view of the system's MIDI ports. Populated once on first use and
+// afterwards only updated by applying add/remove diffs from a rescan, so
+// listing devices is a read of cached state. Open handles live in the
+// HandleTable and are only flagged when their device disappears.
+class DeviceRegistry {
+private:
+  static bool populated;
+  static std::function<void(const DeviceChange&)> changeListener;
+  
+  static bool matches(const MIDIDevice& a, const MIDIDevice& b) {
+    return a.id == b.id && a.isInput == b.isInput;
+  }
+  
+  // Reconcile the cached list with a fresh scan: vanished devices are
+  // removed, new devices appended, existing entries are left untouched
+  static void apply(std::vector<MIDIDevice>& current, const std::vector<MIDIDevice>& scanned,
+                    std::vector<DeviceChange>& changes) {
+    for (size_t i = 0; i < current.size();) {
+      bool found = false;
+      for (const MIDIDevice& candidate : scanned) {
+        if (matches(current[i], candidate)) {
+          found = true;
+          break;
+        }
+      }
+      if (found) {
+        i++;
+        continue;
+      }
+      HandleTable::setConnected(current[i].id, current[i].isInput, false);
+      // A device plugged back in may not be the same endpoint
+      EndpointCache::forget(current[i].id);
+      changes.push_back({ current[i], false });
+      current.erase(current.begin() + i);
+    }
+    
+    for (const MIDIDevice& candidate : scanned) {
+      bool found = false;
+      for (const MIDIDevice& existing : current) {
+        if (matches(existing, candidate)) {
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        current.push_back(candidate);
+        changes.push_back({ candidate, true });
+      }
+    }
+    
+    for (size_t i = 0; i < current.size(); i++) {
+      current[i].index = i;
+    }
+    for (DeviceChange& change : changes) {
+      if (!change.connected) continue;
+      for (const MIDIDevice& existing : current) {
+        if (matches(existing, change.device)) {
+          change.device.index = existing.index;
+          break;
+        }
+      }
+    }
+  }
+  
+  static void scan(std::vector<MIDIDevice>& outputs, std::vector<MIDIDevice>& inputs) {
+    // Exclusive loopback runs hide hardware so results do not depend on the host
+    if (!vmidi::Loopback::config().exclusive) {
+      scanHardware(outputs, inputs);
+    }
+    VirtualMIDIManager::enumerateDevices(outputs, inputs);
+  }
+  
+  static void scanHardware(std::vector<MIDIDevice>& outputs, std::vector<MIDIDevice>& inputs) {
+#ifdef _WIN32
+    WindowsMIDIManager::enumerateOutputs(outputs);
+    WindowsMIDIManager::enumerateInputs(inputs);
+#elif __APPLE__
+    MacMIDIManager::enumerateOutputs(outputs);
+    MacMIDIManager::enumerateInputs(inputs);
+#elif __linux__
+    ALSAMIDIManager::enumerateDevices(outputs, inputs);
+#endif
+  }
+  
+public:
+  // Guards midiOutputs and midiInputs
+  static std::mutex mutex;
+  
+  // Must be called with the registry mutex held
+  static void ensurePopulated() {
+    if (populated) return;
+    scan(midiOutputs, midiInputs);
+    for (size_t i = 0; i < midiOutputs.size(); i++) midiOutputs[i].index = i;
+    for (size_t i = 0; i < midiInputs.size(); i++) midiInputs[i].index = i;
+    populated = true;
+  }
+  
+  // Walk the system again and apply the difference to the cached state.
+  // The walk itself runs without holding the registry lock.
+  static void rescan() {
+    std::vector<MIDIDevice> outputs;
+    std::vector<MIDIDevice> inputs;
+    scan(outputs, inputs);
+    
+    std::vector<DeviceChange> changes;
+    std::function<void(const DeviceChange&)> listener;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!populated) {
+        // Nobody has listed devices yet, so there is nothing to diff against
+        midiOutputs.swap(outputs);
+        midiInputs.swap(inputs);
+        for (size_t i = 0; i < midiOutputs.size(); i++) midiOutputs[i].index = i;
+        for (size_t i = 0; i < midiInputs.size(); i++) midiInputs[i].index = i;
+        populated = true;
+        return;
+      }
+      apply(midiOutputs, outputs, changes);
+      apply(midiInputs, inputs, changes);
+      listener = changeListener;
+    }
+    
+    if (listener) {
+      for (const DeviceChange& change : changes) {
+        listener(change);
+      }
+    }
+  }
+  
+  static void setChangeListener(std::function<void(const DeviceChange&)> listener) {
+    std::lock_guard<std::mutex> lock(mutex);
+    changeListener = std::move(listener);
+  }
+  
+  static void snapshot(std::vector<MIDIDevice>& outputs, std::vector<MIDIDevice>& inputs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    outputs = midiOutputs;
+    inputs = midiInputs;
+  }
+  
+  // Must be called with the registry mutex held
+  static const MIDIDevice* findById(const std::vector<MIDIDevice>& devices, uint64_t id) {
+    for (const MIDIDevice& device : devices) {
+      if (device.id == id) return &device;
+    }
+    return nullptr;
+  }
+};
+
+std::mutex DeviceRegistry::mutex;
+bool DeviceRegistry::populated = false;
+std::function<void(const DeviceChange&)> DeviceRegistry::changeListener;
+
+// ============================================================================
+// Hotplug Watcher
+// ============================================================================
+
+// Background thread that triggers a registry rescan whenever the platform
+// reports that ports were added or removed. Its loop also closes pooled
+// handles whose idle grace period has expired.
+class HotplugWatcher {
+private:
+  static std::thread thread;
+  static std::atomic<bool> running;
+#ifdef __APPLE__
+  static CFRunLoopRef runLoop;
+  
+  static void notify(const MIDINotification* message, void* refCon) {
+    if (message->messageID == kMIDIMsgSetupChanged) {
+      DeviceRegistry::rescan();
+    }
+  }
+#endif
+  
+  static void run() {
+    // Warm the cache off the main thread so the first listing is a read
+    DeviceRegistry::rescan();
+    
+#ifdef _WIN32
+    uint32_t signature = WindowsMIDIManager::deviceCountSignature();
+    while (running) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(500));
+      HandlePool::reapIdle();
+      uint32_t next = WindowsMIDIManager::deviceCountSignature();
+      if (next != signature) {
+        signature = next;
+        DeviceRegistry::rescan();
+      }
+    }
+#elif __APPLE__
+    // CoreMIDI delivers notifications on the run loop of the thread that
+    // created the client, and Node's main thread does not run one
+    MIDIClientRef client = 0;
+    if (MIDIClientCreate(CFSTR("HarmonEasy Hotplug"), notify, nullptr, &client) != noErr) {
+      MIDI2_LOG_ERROR("Failed to create hotplug client");
+      return;
+    }
+    runLoop = CFRunLoopGetCurrent();
+    while (running) {
+      CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.25, false);
+      HandlePool::reapIdle();
+    }
+    MIDIClientDispose(client);
+#elif __linux__
+    // udev creates and removes the rawmidi nodes in /dev/snd, so watching
+    // the directory is enough and needs no libudev dependency
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0 && inotify_add_watch(fd, "/dev/snd", IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+      close(fd);
+      fd = -1;
+    }
+    if (fd < 0) {
+      MIDI2_LOG_WARN("Cannot watch /dev/snd, hotplug disabled");
+      while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        HandlePool::reapIdle();
+      }
+      return;
+    }
+    
+    // A card arriving produces a burst of node events, and udev fixes up
+    // permissions just after creating them, so rescan once the burst settles
+    const auto settle = std::chrono::milliseconds(150);
+    bool pending = false;
+    auto deadline = std::chrono::steady_clock::now();
+    alignas(struct inotify_event) char buffer[4096];
+    
+    while (running) {
+      struct pollfd pfd = { fd, POLLIN, 0 };
+      int ready = poll(&pfd, 1, pending ? 50 : 250);
+      
+      if (ready > 0 && (pfd.revents & POLLIN)) {
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+          for (char* cursor = buffer; cursor < buffer + length;) {
+            struct inotify_event* event = (struct inotify_event*)cursor;
+            if (event->len > 0 &&
+                (strncmp(event->name, "midi", 4) == 0 || strncmp(event->name, "control", 7) == 0)) {
+              pending = true;
+              deadline = std::chrono::steady_clock::now() + settle;
+            }
+            cursor += sizeof(struct inotify_event) + event->len;
+          }
+        }
+      }
+      
+      if (pending && std::chrono::steady_clock::now() >= deadline) {
+        pending = false;
+        DeviceRegistry::rescan();
+      }
+      HandlePool::reapIdle();
+    }
+    close(fd);
+#endif
+  }
+  
+public:
+  static void start() {
+    if (running.exchange(true)) return;
+    thread = std::thread(run);
+  }
+  
+  static void stop() {
+    if (!running.exchange(false)) return;
+#ifdef __APPLE__
+    if (runLoop) CFRunLoopStop(runLoop);
+#endif
+    if (thread.joinable()) thread.join();
+  }
+};
+
+std::thread HotplugWatcher::thread;
+std::atomic<bool> HotplugWatcher::running(false);
+#ifdef __APPLE__
+CFRunLoopRef HotplugWatcher::runLoop = nullptr;
+#endif
+
+// ============================================================================
+// Capture
+// ============================================================================
+
+struct CaptureSource {
+  uint64_t deviceId;
+  int isInput;
+  // Group stamped on this source's packets in the clip, -1 keeps their own
+  int group;
+};
+
+/**
+ * Records the traffic of chosen inputs and outputs into MIDI Clip Files.
+ * Inputs are tapped through the input hub, outputs in the send path; each
+ * packet is stamped with its arrival or send time converted to ticks and
+ * copied into the session's stream writer, which does the file I/O on its
+ * own thread. Sessions are swapped copy-on-write like the input listeners,
+ * so neither path takes a global lock.
+ */
+class CaptureManager {
+private:
+  struct Session {
+    uint32_t id;
+    std::string path;
+    std::vector<CaptureSource> sources;
+    clip::StreamWriter writer;
+    uint64_t startNs;
+    double ticksPerNanosecond;
+    // Serialises appends from input threads and senders
+    std::mutex mutex;
+    uint64_t lastTick = 0;
+    bool closed = false;
+    uint32_t subscription = 0;
+  };
+  
+  typedef std::vector<std::shared_ptr<Session>> SessionList;
+  static std::mutex mutex;
+  static std::shared_ptr<const SessionList> sessions;
+  static uint32_t nextId;
+  
+  static void record(Session& session, const CaptureSource& source, const uint32_t* words, size_t count, uint64_t timestampNs) {
+    std::lock_guard<std::mutex> lock(session.mutex);
+    if (session.closed) return;
+    
+    uint64_t elapsed = timestampNs > session.startNs ? timestampNs - session.startNs : 0;
+    uint64_t tick = (uint64_t)(elapsed * session.ticksPerNanosecond);
+    // Inputs and outputs are stamped on different threads, never step back
+    if (tick < session.lastTick) tick = session.lastTick;
+    
+    size_t i = 0;
+    while (i < count) {
+      ump::MessageType type = ump::typeOf(words[i]);
+      uint8_t length = ump::packetWords(type);
+      if (i + length > count) break;
+      
+      uint32_t packet[4];
+      for (uint8_t w = 0; w < length; w++) packet[w] = words[i + w];
+      // Utility and Stream messages have no group
+      if (source.group >= 0 && type != ump::MessageType::Utility && type != ump::MessageType::Stream) {
+        ump::Group::set(packet, (uint32_t)source.group);
+      }
+      session.writer.append((uint32_t)std::min<uint64_t>(tick - session.lastTick, UINT32_MAX), packet, length);
+      session.lastTick = tick;
+      i += length;
+    }
+  }
+  
+  static const CaptureSource* findSource(const Session& session, uint64_t deviceId, int isInput) {
+    for (const CaptureSource& source : session.sources) {
+      if (source.deviceId == deviceId && source.isInput == isInput) return &source;
+    }
+    return nullptr;
+  }
+  
+public:
+  // Checked on every send, a single relaxed load while nothing is captured
+  static std::atomic<bool> active;
+  
+  struct Summary {
+    std::string path;
+    uint64_t events;
+    uint64_t dropped;
+    uint64_t bytes;
+    double durationMs;
+  };
+  
+  // Called from the send path, under the slot's write lock, for every
+  // complete packet written while a capture is active
+  static void recordOutput(const OpenHandle& slot, const uint32_t* words, size_t count, uint64_t timestampNs) {
+    std::shared_ptr<const SessionList> current = std::atomic_load(&sessions);
+    for (const auto& session : *current) {
+      for (uint8_t t = 0; t < slot.targetCount; t++) {
+        const CaptureSource* source = findSource(*session, slot.targets[t]->deviceId, 0);
+        if (source != nullptr) {
+          record(*session, *source, words, count, timestampNs);
+          break;
+        }
+      }
+    }
+  }
+  
+  /**
+   * Start writing a clip at `path`. Ticks are derived from wall time at the
+   * given resolution and tempo, which is also written into the clip.
+   * Returns the session id, or 0 with `error` set.
+   */
+  static uint32_t start(const std::string& path, const std::vector<CaptureSource>& sources,
+                        uint16_t ticksPerQuarter, double beatsPerMinute, std::string& error) {
+    std::shared_ptr<Session> session = std::make_shared<Session>();
+    session->path = path;
+    session->sources = sources;
+    session->ticksPerNanosecond = ticksPerQuarter * beatsPerMinute / 60e9;
+    if (!session->writer.open(path, ticksPerQuarter, (uint32_t)(6e9 / beatsPerMinute), error)) return 0;
+    session->startNs = monotonicNanoseconds();
+    
+    bool hasInputs = false;
+    for (const CaptureSource& source : sources) hasInputs = hasInputs || source.isInput;
+    if (hasInputs) {
+      std::weak_ptr<Session> weak = session;
+      session->subscription = InputHub::subscribe(
+        [weak](uint64_t deviceId, const uint32_t* words, size_t count, uint64_t timestampNs) {
+          std::shared_ptr<Session> target = weak.lock();
+          if (!target) return;
+          const CaptureSource* source = findSource(*target, deviceId, 1);
+          if (source != nullptr) record(*target, *source, words, count, timestampNs);
+        });
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    session->id = ++nextId;
+    auto next = std::make_shared<SessionList>(*std::atomic_load(&sessions));
+    next->push_back(session);
+    std::atomic_store(&sessions, std::shared_ptr<const SessionList>(next));
+    active = true;
+    MIDI2_LOG_INFO("Capturing %u sources to %s", (uint32_t)sources.size(), path);
+    return session->id;
+  }
+  
+  // Finish the clip and close its file. Returns false for an unknown id.
+  static bool stop(uint32_t id, Summary& summary, std::string& error) {
+    std::shared_ptr<Session> session;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto next = std::make_shared<SessionList>(*std::atomic_load(&sessions));
+      for (size_t i = 0; i < next->size(); i++) {
+        if ((*next)[i]->id == id) {
+          session = (*next)[i];
+          next->erase(next->begin() + i);
+          break;
+        }
+      }
+      if (!session) {
+        error = "Unknown capture";
+        return false;
+      }
+      active = !next->empty();
+      std::atomic_store(&sessions, std::shared_ptr<const SessionList>(next));
+    }
+    if (session->subscription != 0) InputHub::unsubscribe(session->subscription);
+    
+    // Inputs no longer reach it, but a sender may still be recording an
+    // output; closing under the session lock makes it finish first or see `closed`
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->closed = true;
+    uint64_t endNs = monotonicNanoseconds();
+    uint64_t endTick = (uint64_t)((endNs - session->startNs) * session->ticksPerNanosecond);
+    uint32_t delta = (uint32_t)std::min<uint64_t>(endTick > session->lastTick ? endTick - session->lastTick : 0, UINT32_MAX);
+    bool ok = session->writer.close(error, delta);
+    
+    summary.path = session->path;
+    summary.events = session->writer.eventCount();
+    summary.dropped = session->writer.droppedCount();
+    summary.bytes = session->writer.bytesWritten();
+    summary.durationMs = (endNs - session->startNs) / 1e6;
+    return ok;
+  }
+  
+  static void stopAll() {
+    std::vector<uint32_t> ids;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (const auto& session : *std::atomic_load(&sessions)) ids.push_back(session->id);
+    }
+    for (uint32_t id : ids) {
+      Summary summary;
+      std::string error;
+      stop(id, summary, error);
+    }
+  }
+};
+
+std::mutex CaptureManager::mutex;
+std::shared_ptr<const CaptureManager::SessionList> CaptureManager::sessions = std::make_shared<const CaptureManager::SessionList>();
+uint32_t CaptureManager::nextId = 0;
+std::atomic<bool> CaptureManager::active(false);
+
+// ============================================================================
+// Send Path
+// ============================================================================
+
+/**
+ * Write `packets` messages worth of MIDI 1.0 bytes to one port and account
+ * for them. enqueueNs is when the caller handed the messages over, 0 when
+ * unknown, and is what the latency histogram measures from.
+ */
+static bool WritePortBytes(PooledHandle* port, const uint8_t* bytes, size_t length, uint64_t packets, uint64_t enqueueNs) {
+  MIDI2_TRACE_SCOPE(trace::WRITE, port->deviceId, (uint32_t)length);
+  PortStats& stats = port->stats;
+  size_t written = 0;
+#ifdef __APPLE__
+  if (MacMIDIManager::sendBytes((MIDIEndpointRef)port->endpoint, bytes, length) == noErr) written = length;
+#elif __linux__ && HAS_ALSA
+  written = ALSAMIDIManager::writeBytes((snd_rawmidi_t*)port->handle, bytes, length, stats);
+#endif
+  
+  if (written < length) {
+    PortStats::add(stats.drops, packets);
+    return false;
+  }
+  PortStats::add(stats.packetsSent, packets);
+  PortStats::add(stats.bytesSent, length);
+  if (enqueueNs != 0) stats.recordLatency(monotonicNanoseconds() - enqueueNs);
+  return true;
+}
+
+/**
+ * Translate UMP words to MIDI 1.0 and write them to the token's ports,
+ * routing each packet by its group. Bytes bound for the same port are
+ * coalesced, so a batch costs one write per port rather than per message.
+ * Returns false if any write failed.
+ */
+static bool WriteUmp(OpenHandle& slot, const uint32_t* words, size_t count, uint64_t enqueueNs = 0) {
+  MIDI2_TRACE_SCOPE(trace::SEND, slot.targets[0]->deviceId, count > 0 ? words[0] : 0);
+  
+  std::lock_guard<std::mutex> lock(slot.writeMutex);
+  // Tracked and captured as whole packets under the write lock, so the
+  // halves of packets from concurrent senders never interleave
+  bool capturing = CaptureManager::active.load(std::memory_order_relaxed);
+  uint64_t captureNs = capturing ? (enqueueNs != 0 ? enqueueNs : monotonicNanoseconds()) : 0;
+  slot.carry.feed(words, count, [&](const uint32_t* packet, uint8_t length) {
+    slot.held.track(packet);
+    if (capturing) CaptureManager::recordOutput(slot, packet, length, captureNs);
+  });
+  
+  // Loopback ports carry UMP as is
+  if (slot.targets[0]->isVirtual) {
+    PooledHandle* port = slot.targets[0];
+    uint64_t packets = countPackets(words, count);
+    // A packet split across writes was stamped with its first words
+    bool boundary = slot.jrCarry == 0;
+    if (slot.jitterReduction) {
+      size_t next = slot.jrCarry;
+      while (next < count) next += ump::packetWordsOf(words[next]);
+      slot.jrCarry = (uint8_t)(next - count);
+    }
+    if (slot.jitterReduction && boundary) {
+      // Stamped with when the messages were meant to leave, so the receiver
+      // can take out the delay they pick up from here on
+      uint64_t nowNs = monotonicNanoseconds();
+      uint32_t stamp[2];
+      size_t stampCount = 0;
+      if (nowNs - slot.jrClockNs >= jr::CLOCK_INTERVAL_NS) {
+        stamp[stampCount++] = ump::utility::jrClock(jr::ticksAt(nowNs));
+        slot.jrClockNs = nowNs;
+      }
+      stamp[stampCount++] = ump::utility::jrTimestamp(jr::ticksAt(enqueueNs != 0 ? enqueueNs : nowNs));
+      vmidi::Loopback::send(port->endpoint, stamp, stampCount);
+    }
+    if (!vmidi::Loopback::send(port->endpoint, words, count)) {
+      PortStats::add(port->stats.drops, packets);
+      return false;
+    }
+    PortStats::add(port->stats.packetsSent, packets);
+    PortStats::add(port->stats.bytesSent, count * 4);
+    port->stats.raiseHighWater(vmidi::Loopback::queued(port->endpoint));
+    if (enqueueNs != 0) port->stats.recordLatency(monotonicNanoseconds() - enqueueNs);
+    return true;
+  }
+  
+  bool ok = true;
+  
+#ifdef _WIN32
+  slot.translator.feed(words, count, [&](uint8_t group, const uint8_t* bytes, size_t length) {
+    uint8_t target = slot.groupTarget[group];
+    if (target == OpenHandle::NO_TARGET) return;
+    PooledHandle* port = slot.targets[target];
+    HMIDIOUT handle = (HMIDIOUT)port->handle;
+    MIDI2_TRACE_SCOPE(trace::WRITE, port->deviceId, (uint32_t)length);
+    
+    const uint8_t* message = bytes;
+    size_t messageLength = length;
+    bool sent;
+    if (bytes[0] == 0xF0 || !slot.sysEx.empty()) {
+      if (bytes[0] == 0xF0) slot.sysEx.clear();
+      slot.sysEx.insert(slot.sysEx.end(), bytes, bytes + length);
+      if (slot.sysEx.back() != 0xF7) return;
+      message = slot.sysEx.data();
+      messageLength = slot.sysEx.size();
+      sent = WindowsMIDIManager::sendSysEx(handle, message, messageLength) == MMSYSERR_NOERROR;
+      slot.sysEx.clear();
+    } else {
+      sent = WindowsMIDIManager::sendData(handle, message, messageLength) == MMSYSERR_NOERROR;
+    }
+    
+    if (!sent) {
+      PortStats::add(port->stats.drops, 1);
+      ok = false;
+      return;
+    }
+    PortStats::add(port->stats.packetsSent, 1);
+    PortStats::add(port->stats.bytesSent, messageLength);
+    if (enqueueNs != 0) port->stats.recordLatency(monotonicNanoseconds() - enqueueNs);
+  });
+#else
+  struct PendingBytes {
+    uint8_t bytes[256];
+    size_t length;
+    uint64_t packets;
+  };
+  PendingBytes pending[OpenHandle::MAX_TARGETS];
+  for (uint8_t t = 0; t < slot.targetCount; t++) {
+    pending[t].length = 0;
+    pending[t].packets = 0;
+  }
+  
+  auto flush = [&](uint8_t t) {
+    if (pending[t].length == 0) return;
+    ok &= WritePortBytes(slot.targets[t], pending[t].bytes, pending[t].length, pending[t].packets, enqueueNs);
+    pending[t].length = 0;
+    pending[t].packets = 0;
+  };
+  
+  slot.translator.feed(words, count, [&](uint8_t group, const uint8_t* bytes, size_t length) {
+    uint8_t target = slot.groupTarget[group];
+    if (target == OpenHandle::NO_TARGET) return;
+    if (pending[target].length + length > sizeof(pending[target].bytes)) flush(target);
+    memcpy(pending[target].bytes + pending[target].length, bytes, length);
+    pending[target].length += length;
+    // SysEx arrives in fragments, count the one that ends the message
+    bool sysExPart = bytes[0] == 0xF0 || bytes[0] < 0x80;
+    if (!sysExPart || bytes[length - 1] == 0xF7) pending[target].packets++;
+  });
+  
+  for (uint8_t t = 0; t < slot.targetCount; t++) flush(t);
+#endif
+  
+  return ok;
+}
+
+/**
+ * Release every note and sustain pedal the output is holding in a single
+ * write. The note-offs go through WriteUmp and clear the tracker as they
+ * are sent. Returns the number of messages written.
+ */
+static size_t ReleaseHeldNotes(OpenHandle& slot) {
+  std::vector<uint32_t> words;
+  {
+    std::lock_guard<std::mutex> lock(slot.writeMutex);
+    if (slot.held.empty()) return 0;
+    slot.held.release(words);
+  }
+  if (!slot.connected) {
+    // Nothing can reach the device, forget what it was holding
+    std::lock_guard<std::mutex> lock(slot.writeMutex);
+    slot.held.clear();
+    return 0;
+  }
+  WriteUmp(slot, words.data(), words.size(), monotonicNanoseconds());
+  return words.size();
+}
+
+// ReleaseHeldNotes() on every open output
+static size_t ReleaseAllHeldNotes() {
+  size_t released = 0;
+  HandleTable::forEachOutput([&released](OpenHandle& slot) {
+    released += ReleaseHeldNotes(slot);
+  });
+  return released;
+}
+
+// Send a JR Clock on every Jitter Reduction output that has not sent one
+// for CLOCK_INTERVAL_NS, so receivers stay locked while nothing is playing
+static void SendJitterClocks() {
+  if (!HandleTable::hasJitterOutputs()) return;
+  HandleTable::forEachOutput([](OpenHandle& slot) {
+    if (!slot.jitterReduction || !slot.connected) return;
+    std::lock_guard<std::mutex> lock(slot.writeMutex);
+    uint64_t nowNs = monotonicNanoseconds();
+    if (nowNs - slot.jrClockNs < jr::CLOCK_INTERVAL_NS || slot.jrCarry != 0) return;
+    uint32_t clock = ump::utility::jrClock(jr::ticksAt(nowNs));
+    if (vmidi::Loopback::send(slot.targets[0]->endpoint, &clock, 1)) slot.jrClockNs = nowNs;
+  });
+}
+
+// ============================================================================
+// Scheduler
+// ============================================================================
+
+/**
+ * Sends UMP at given monotonic times from one thread. Events are queued
+ * with an owner id so a producer can withdraw everything it queued, and
+ * producers (file players, generators) are asked to top the queue up to
+ * a lookahead horizon on every pass instead of queueing whole files.
+ * The enqueue time recorded in the port statistics is the due time, so
+ * the latency histogram of a scheduled port shows how late sends were,
+ * and it is the time a Jitter Reduction output stamps its messages with.
+ * The refill pass also keeps JR Clocks going out on those outputs.
+ *
+ * Notes queued with scheduleNote() are paired: the note-off only goes out
+ * if no later note-on of the same key has sounded since. A re-triggered
+ * key gets a note-off just before its new note-on, and the earlier note's
+ * own note-off is dropped so it cannot cut the new note short.
+ */
+class Scheduler {
+public:
+  class Producer {
+  public:
+    virtual ~Producer() {}
+    // Queue every event due before horizonNs
+    virtual void fill(uint64_t horizonNs) = 0;
+  };
+  
+  static constexpr uint64_t LOOKAHEAD_NS = 100000000ULL;
+  static constexpr uint64_t REFILL_NS = 20000000ULL;
+  
+private:
+  enum Kind : uint8_t { PLAIN, NOTE_ON, NOTE_OFF };
+  
+  struct Timed {
+    uint64_t dueNs;
+    // Ties keep queue order
+    uint64_t sequence;
+    uint32_t owner;
+    uint32_t token;
+    uint8_t count;
+    uint8_t kind;
+    // Pairs a NOTE_OFF with its NOTE_ON
+    uint32_t generation;
+    uint32_t words[4];
+  };
+  
+  struct Later {
+    bool operator()(const Timed& a, const Timed& b) const {
+      return a.dueNs != b.dueNs ? a.dueNs > b.dueNs : a.sequence > b.sequence;
+    }
+  };
+  
+  static std::mutex mutex;
+  static std::condition_variable wake;
+  static std::priority_queue<Timed, std::vector<Timed>, Later> queue;
+  static uint64_t sequence;
+  static uint32_t nextOwner;
+  // Held while producers fill, so removeProducer() waits out a running fill
+  static std::mutex producersMutex;
+  // Held while due events are sent, so cancelNotes() waits out a running send
+  static std::mutex sendMutex;
+  static std::vector<Producer*> producers;
+  static std::thread thread;
+  static bool running;
+  // Set by poke() to run a fill pass before the next refill is due
+  static bool refill;
+  static uint32_t nextGeneration;
+  // Generation of the note-on sounding on each key, scheduler thread only
+  static std::unordered_map<uint64_t, uint32_t> sounding;
+  
+  // Token, group, channel and note of a MIDI 1.0 or 2.0 note message
+  static uint64_t noteKey(uint32_t token, const uint32_t* words) {
+    return ((uint64_t)token << 32) | (ump::Group::get(words) << 16) |
+           (ump::midi2::Channel::get(words) << 8) | ump::midi2::Note::get(words);
+  }
+  
+  // The note-off matching a note-on packet, with zero release velocity
+  static uint8_t noteOffFor(const uint32_t* on, uint32_t* off) {
+    uint8_t group = (uint8_t)ump::Group::get(on);
+    uint8_t channel = (uint8_t)ump::midi2::Channel::get(on);
+    uint8_t note = (uint8_t)ump::midi2::Note::get(on);
+    if (ump::typeOf(on[0]) == ump::MessageType::Midi1ChannelVoice) {
+      off[0] = ump::midi1::noteOff(group, channel, note);
+      return 1;
+    }
+    ump::Packet<2> packet = ump::midi2::noteOff(group, channel, note);
+    off[0] = packet[0];
+    off[1] = packet[1];
+    return 2;
+  }
+  
+  static void write(const Timed& timed, const uint32_t* words, uint8_t count) {
+    HandleTable::withSlot(timed.token, [&](OpenHandle& slot) {
+      if (!slot.isInput && slot.connected) WriteUmp(slot, words, count, timed.dueNs);
+    });
+  }
+  
+  static void send(const Timed& timed) {
+    if (timed.kind == NOTE_ON) {
+      uint64_t key = noteKey(timed.token, timed.words);
+      auto held = sounding.find(key);
+      if (held != sounding.end()) {
+        uint32_t off[2];
+        write(timed, off, noteOffFor(timed.words, off));
+        held->second = timed.generation;
+      } else {
+        sounding.emplace(key, timed.generation);
+      }
+    } else if (timed.kind == NOTE_OFF) {
+      auto held = sounding.find(noteKey(timed.token, timed.words));
+      // Re-triggered since, the newer note owns the key now
+      if (held == sounding.end() || held->second != timed.generation) return;
+      sounding.erase(held);
+    }
+    write(timed, timed.words, timed.count);
+  }
+  
+  static void run() {
+    std::vector<Timed> due;
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t nextFillNs = 0;
+    while (running) {
+      uint64_t nowNs = monotonicNanoseconds();
+      if (nowNs >= nextFillNs || refill) {
+        refill = false;
+        lock.unlock();
+        {
+          std::lock_guard<std::mutex> fillLock(producersMutex);
+          for (Producer* producer : producers) producer->fill(nowNs + LOOKAHEAD_NS);
+        }
+        SendJitterClocks();
+        lock.lock();
+        nextFillNs = nowNs + REFILL_NS;
+        continue;
+      }
+      
+      while (!queue.empty() && queue.top().dueNs <= nowNs) {
+        due.push_back(queue.top());
+        queue.pop();
+      }
+      if (!due.empty()) {
+        lock.unlock();
+        {
+          std::lock_guard<std::mutex> sendLock(sendMutex);
+          for (const Timed& timed : due) send(timed);
+        }
+        due.clear();
+        lock.lock();
+        continue;
+      }
+      
+      uint64_t wakeNs = nextFillNs;
+      if (!queue.empty() && queue.top().dueNs < wakeNs) wakeNs = queue.top().dueNs;
+      wake.wait_for(lock, std::chrono::nanoseconds(wakeNs - nowNs));
+    }
+  }
+  
+public:
+  // Owner ids group events for cancel(); 0 is never returned
+  static uint32_t newOwner() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (++nextOwner == 0) nextOwner = 1;
+    return nextOwner;
+  }
+  
+  static void schedule(uint32_t owner, uint32_t token, uint64_t dueNs, const uint32_t* words, uint8_t count) {
+    Timed timed = {};
+    timed.dueNs = dueNs;
+    timed.owner = owner;
+    timed.token = token;
+    timed.count = count > 4 ? 4 : count;
+    timed.kind = PLAIN;
+    for (uint8_t i = 0; i < timed.count; i++) timed.words[i] = words[i];
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    timed.sequence = sequence++;
+    bool earliest = queue.empty() || dueNs < queue.top().dueNs;
+    queue.push(timed);
+    if (earliest) wake.notify_one();
+  }
+  
+  /**
+   * Queue a MIDI 1.0 or 2.0 note-on and its note-off. Anything that is not
+   * a note-on with a non-zero velocity is queued once, as is.
+   */
+  static void scheduleNote(uint32_t owner, uint32_t token, uint64_t onNs, uint64_t offNs, const uint32_t* on, uint8_t count) {
+    ump::MessageType type = ump::typeOf(on[0]);
+    bool midi1 = type == ump::MessageType::Midi1ChannelVoice;
+    bool isNoteOn = (midi1 || type == ump::MessageType::Midi2ChannelVoice) &&
+                    count == ump::packetWords(type) && ump::midi2::Opcode::get(on) == 0x9 &&
+                    (midi1 ? ump::midi1::Data2::get(on) != 0 : true);
+    if (!isNoteOn) {
+      schedule(owner, token, onNs, on, count);
+      return;
+    }
+    
+    Timed noteOn = {};
+    noteOn.dueNs = onNs;
+    noteOn.owner = owner;
+    noteOn.token = token;
+    noteOn.kind = NOTE_ON;
+    noteOn.count = count;
+    for (uint8_t i = 0; i < count; i++) noteOn.words[i] = on[i];
+    
+    Timed noteOff = noteOn;
+    noteOff.dueNs = offNs > onNs ? offNs : onNs;
+    noteOff.kind = NOTE_OFF;
+    noteOff.count = noteOffFor(on, noteOff.words);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    noteOn.generation = noteOff.generation = ++nextGeneration;
+    noteOn.sequence = sequence++;
+    noteOff.sequence = sequence++;
+    bool earliest = queue.empty() || onNs < queue.top().dueNs;
+    queue.push(noteOn);
+    queue.push(noteOff);
+    if (earliest) wake.notify_one();
+  }
+  
+  // Drop every queued event of `owner`
+  static void cancel(uint32_t owner) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Timed> kept;
+    kept.reserve(queue.size());
+    while (!queue.empty()) {
+      if (queue.top().owner != owner) kept.push_back(queue.top());
+      queue.pop();
+    }
+    for (const Timed& timed : kept) queue.push(timed);
+  }
+  
+  /**
+   * Drop the queued scheduleNote() note-ons of `token`, or of every token
+   * when it is 0, and wait out a send already under way so none of them
+   * lands after this returns. Their note-offs stay queued: one whose note
+   * never sounded finds the key silent and is skipped.
+   */
+  static void cancelNotes(uint32_t token) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::vector<Timed> kept;
+      kept.reserve(queue.size());
+      while (!queue.empty()) {
+        const Timed& timed = queue.top();
+        if (timed.kind != NOTE_ON || (token != 0 && timed.token != token)) kept.push_back(timed);
+        queue.pop();
+      }
+      for (const Timed& timed : kept) queue.push(timed);
+    }
+    std::lock_guard<std::mutex> sendLock(sendMutex);
+  }
+  
+  static void addProducer(Producer* producer) {
+    {
+      std::lock_guard<std::mutex> lock(producersMutex);
+      producers.push_back(producer);
+    }
+    poke();
+  }
+  
+  static void removeProducer(Producer* producer) {
+    std::lock_guard<std::mutex> lock(producersMutex);
+    producers.erase(std::remove(producers.begin(), producers.end(), producer), producers.end());
+  }
+  
+  // Run a fill pass now, e.g. after a producer started or moved
+  static void poke() {
+    std::lock_guard<std::mutex> lock(mutex);
+    refill = true;
+    wake.notify_one();
+  }
+  
+  static void start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+    running = true;
+    thread = std::thread(run);
+  }
+  
+  static void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!running) return;
+      running = false;
+      wake.notify_one();
+    }
+    if (thread.joinable()) thread.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!queue.empty()) queue.pop();
+    sounding.clear();
+  }
+};
+
+std::mutex Scheduler::mutex;
+std::condition_variable Scheduler::wake;
+std::priority_queue<Scheduler::Timed, std::vector<Scheduler::Timed>, Scheduler::Later> Scheduler::queue;
+uint64_t Scheduler::sequence = 0;
+uint32_t Scheduler::nextOwner = 0;
+std::mutex Scheduler::producersMutex;
+std::mutex Scheduler::sendMutex;
+std::vector<Scheduler::Producer*> Scheduler::producers;
+std::thread Scheduler::thread;
+bool Scheduler::running = false;
+bool Scheduler::refill = false;
+uint32_t Scheduler::nextGeneration = 0;
+std::unordered_map<uint64_t, uint32_t> Scheduler::sounding;
+
+// ============================================================================
+// Playback
+// ============================================================================
+
+/**
+ * Plays a Standard MIDI File or MIDI Clip File to an output token. The file
+ * is mapped and walked one event at a time as the scheduler asks for the
+ * next lookahead window, so a player holds a single decoded event however
+ * large the file. Positions are file time after the tempo map.
+ */
+class Player : public Scheduler::Producer {
+private:
+  std::mutex mutex;
+  midifile::EventReader reader;
+  uint32_t owner;
+  uint32_t token;
+  midifile::Event upcoming;
+  bool hasUpcoming = false;
+  bool playing = false;
+  // Monotonic time at which file time 0 plays, valid while playing
+  uint64_t originNs = 0;
+  // File time to resume from while paused
+  uint64_t positionNs = 0;
+  // Loop region in file time, inactive while loopEndNs is 0
+  uint64_t loopStartNs = 0;
+  uint64_t loopEndNs = 0;
+  uint64_t durationNs = 0;
+  
+  // Channel voice packets handed to the scheduler, in due order, until they
+  // are known to have gone out
+  struct Scheduled {
+    uint64_t dueNs;
+    uint32_t words[4];
+  };
+  std::deque<Scheduled> scheduled;
+  // What the packets sent so far leave sounding, released on stop and seek
+  HeldNotes held;
+  // The scheduler has sent anything due this long ago
+  static constexpr uint64_t SENT_NS = 50000000ULL;
+  
+  // Position the reader on the first event at or after fileNs
+  void seekReader(uint64_t fileNs) {
+    reader.rewind();
+    hasUpcoming = reader.next(upcoming);
+    while (hasUpcoming && upcoming.timeNs < fileNs) hasUpcoming = reader.next(upcoming);
+  }
+  
+  /**
+   * File time playing at nowNs. fill() moves originNs on by a loop length
+   * as soon as the wrap enters the lookahead, which can be before nowNs
+   * reaches it, so a time before the origin is still in the previous lap.
+   */
+  uint64_t positionAt(uint64_t nowNs) const {
+    if (!playing) return positionNs;
+    int64_t elapsed = (int64_t)(nowNs - originNs);
+    if (elapsed < 0 && loopEndNs > 0) elapsed += (int64_t)(loopEndNs - loopStartNs);
+    return elapsed > 0 ? (uint64_t)elapsed : 0;
+  }
+  
+  // Move packets due by sentNs from `scheduled` into the held notes
+  void settle(uint64_t sentNs) {
+    while (!scheduled.empty() && scheduled.front().dueNs <= sentNs) {
+      held.track(scheduled.front().words);
+      scheduled.pop_front();
+    }
+  }
+  
+  // A note-on or pedal down, which can only add to what is sounding
+  static bool sounds(const uint32_t* packet) {
+    bool midi1 = ump::typeOf(packet[0]) == ump::MessageType::Midi1ChannelVoice;
+    switch (ump::midi2::Opcode::get(packet)) {
+      case 0x9:
+        return !midi1 || ump::midi1::Data2::get(packet) != 0;
+      case 0xB:
+        if (ump::midi2::Index1::get(packet) != 64) return false;
+        return midi1 ? ump::midi1::Data2::get(packet) >= 64 : ump::midi2::Data::get(packet) >= 0x80000000u;
+      default:
+        return false;
+    }
+  }
+  
+  /**
+   * Release exactly the notes and pedals the file left down, sent now.
+   * Call after cancelling the queue: what is due by now may or may not have
+   * gone out just before, so of those only the ones that add a note or a
+   * pedal count, at worst costing a spare note-off.
+   */
+  void silence() {
+    uint64_t nowNs = monotonicNanoseconds();
+    settle(nowNs > SENT_NS ? nowNs - SENT_NS : 0);
+    for (const Scheduled& packet : scheduled) {
+      if (packet.dueNs > nowNs) break;
+      if (sounds(packet.words)) held.track(packet.words);
+    }
+    scheduled.clear();
+    
+    std::vector<uint32_t> words;
+    held.release(words);
+    held.clear();
+    for (uint32_t& word : words) Scheduler::schedule(0, token, nowNs, &word, 1);
+  }
+  
+public:
+  uint32_t id = 0;
+  
+  bool open(const std::string& path, uint32_t outputToken, std::string& error) {
+    if (!reader.open(path, error)) return false;
+    token = outputToken;
+    owner = Scheduler::newOwner();
+    held.clear();
+    
+    // One pass for the duration, nothing is kept
+    midifile::Event event;
+    while (reader.next(event)) durationNs = event.timeNs;
+    seekReader(0);
+    return true;
+  }
+  
+  void fill(uint64_t horizonNs) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!playing) return;
+    uint64_t nowNs = monotonicNanoseconds();
+    settle(nowNs > SENT_NS ? nowNs - SENT_NS : 0);
+    
+    while (hasUpcoming || loopEndNs > 0) {
+      if (loopEndNs > 0 && (!hasUpcoming || upcoming.timeNs >= loopEndNs)) {
+        // The loop start plays where the loop end would have
+        if (originNs + loopEndNs > horizonNs) break;
+        originNs += loopEndNs - loopStartNs;
+        seekReader(loopStartNs);
+        if (!hasUpcoming) break;
+        continue;
+      }
+      
+      uint64_t dueNs = originNs + upcoming.timeNs;
+      if (dueNs > horizonNs) break;
+      ump::MessageType type = ump::typeOf(upcoming.words[0]);
+      if (type == ump::MessageType::Midi1ChannelVoice || type == ump::MessageType::Midi2ChannelVoice) {
+        Scheduled packet = { dueNs, { 0, 0, 0, 0 } };
+        for (uint8_t i = 0; i < upcoming.count && i < 4; i++) packet.words[i] = upcoming.words[i];
+        scheduled.push_back(packet);
+      }
+      Scheduler::schedule(owner, token, dueNs, upcoming.words, upcoming.count);
+      hasUpcoming = reader.next(upcoming);
+    }
+    
+    if (!hasUpcoming && loopEndNs == 0) {
+      // Finished once the last event has been handed over
+      playing = false;
+      positionNs = 0;
+      seekReader(0);
+    }
+  }
+  
+  void play() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (playing) return;
+      originNs = monotonicNanoseconds() - positionNs;
+      playing = true;
+    }
+    Scheduler::poke();
+  }
+  
+  void pause() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!playing) return;
+    positionNs = positionAt(monotonicNanoseconds());
+    playing = false;
+    Scheduler::cancel(owner);
+    // Events up to the lookahead were already read, start again from here
+    seekReader(positionNs);
+    silence();
+  }
+  
+  void seek(uint64_t fileNs) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      Scheduler::cancel(owner);
+      silence();
+      seekReader(fileNs);
+      positionNs = fileNs;
+      if (playing) originNs = monotonicNanoseconds() - fileNs;
+    }
+    Scheduler::poke();
+  }
+  
+  void setLoop(uint64_t startNs, uint64_t endNs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    loopStartNs = endNs > startNs ? startNs : 0;
+    loopEndNs = endNs > startNs ? endNs : 0;
+  }
+  
+  // Silence and withdraw everything still queued; the producer must be removed first
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    playing = false;
+    Scheduler::cancel(owner);
+    silence();
+  }
+  
+  bool isPlaying() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return playing;
+  }
+  
+  uint64_t position() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return positionAt(monotonicNanoseconds());
+  }
+  
+  uint64_t duration() const { return durationNs; }
+  midifile::Format format() const { return reader.format(); }
+  size_t trackCount() const { return reader.trackCount(); }
+};
+
+// Open producers of one kind by id, each registered with the scheduler
+template<typename T>
+class ProducerRegistry {
+private:
+  static std::mutex mutex;
+  static std::map<uint32_t, std::shared_ptr<T>> entries;
+  static uint32_t nextId;
+  
+public:
+  static void add(const std::shared_ptr<T>& producer) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      producer->id = ++nextId;
+      entries[producer->id] = producer;
+    }
+    Scheduler::addProducer(producer.get());
+  }
+  
+  static std::shared_ptr<T> find(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(id);
+    return found == entries.end() ? nullptr : found->second;
+  }
+  
+  static bool close(uint32_t id) {
+    std::shared_ptr<T> producer;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto found = entries.find(id);
+      if (found == entries.end()) return false;
+      producer = found->second;
+      entries.erase(found);
+    }
+    Scheduler::removeProducer(producer.get());
+    producer->close();
+    return true;
+  }
+  
+  static void closeAll() {
+    std::vector<uint32_t> ids;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (const auto& entry : entries) ids.push_back(entry.first);
+    }
+    for (uint32_t id : ids) close(id);
+  }
+};
+
+template<typename T> std::mutex ProducerRegistry<T>::mutex;
+template<typename T> std::map<uint32_t, std::shared_ptr<T>> ProducerRegistry<T>::entries;
+template<typename T> uint32_t ProducerRegistry<T>::nextId = 0;
+
+class PlaybackManager : public ProducerRegistry<Player> {
+public:
+  static std::shared_ptr<Player> open(const std::string& path, uint32_t token, std::string& error) {
+    std::shared_ptr<Player> player = std::make_shared<Player>();
+    if (!player->open(path, token, error)) return nullptr;
+    add(player);
+    return player;
+  }
+};
+
+// ============================================================================
+// Clock
+// ============================================================================
+
+// An output fed by a timing source (MIDI clock, MTC), on one group
+struct TimingOutput {
+  uint32_t token;
+  uint8_t group;
+  // Sent this much later than the nominal time, negative for earlier
+  int64_t offsetNs;
+};
+
+/**
+ * MIDI clock master: 24 PPQN Timing Clock plus Start, Stop, Continue and
+ * Song Position Pointer to a set of outputs, queued on the scheduler like
+ * a player. Every tick's time is computed from a tempo anchor, never by
+ * adding up intervals, so no error builds up however long it runs, and a
+ * tempo change re-anchors at the first tick not yet sent.
+ * - Tempo ramps are linear in time, tick times solve the ramp exactly.
+ * - Swing delays every second sixteenth: 0.5 is straight, 2/3 is a triplet
+ *   feel, the sixteenth pairs are counted from song position 0.
+ * - Each output has its own offset, negative to send ahead of the others
+ *   for a slave with slow response, positive to hold one back.
+ */
+class ClockGenerator : public Scheduler::Producer {
+public:
+  static constexpr uint32_t PPQN = 24;
+  static constexpr uint32_t TICKS_PER_SIXTEENTH = PPQN / 4;
+  static constexpr double MIN_BPM = 1.0;
+  static constexpr double MAX_BPM = 999.0;
+  
+  struct Output : TimingOutput {
+    // Next song tick to queue to this output
+    uint64_t cursor;
+  };
+  
+private:
+  std::mutex mutex;
+  uint32_t owner;
+  std::vector<Output> outputs;
+  bool running = false;
+  // Where the tempo map starts: song tick, its warped beat and its time
+  uint64_t anchorTick = 0;
+  double anchorBeat = 0;
+  uint64_t anchorNs = 0;
+  // Tempo at the anchor, ramping to targetBpm over rampNs
+  double bpm = 120;
+  double targetBpm = 120;
+  uint64_t rampNs = 0;
+  double swing = 0.5;
+  // Song tick that Continue resumes from while stopped
+  uint64_t positionTick = 0;
+  
+  static double clampBpm(double value) {
+    return std::max<double>(MIN_BPM, std::min<double>(MAX_BPM, value));
+  }
+  
+  // Beats from song position 0 to a tick, after swing
+  double beatOf(uint64_t tick) const {
+    uint64_t pair = tick / (TICKS_PER_SIXTEENTH * 2);
+    uint32_t within = (uint32_t)(tick % (TICKS_PER_SIXTEENTH * 2));
+    double fraction = within < TICKS_PER_SIXTEENTH
+      ? swing * within / TICKS_PER_SIXTEENTH
+      : swing + (1 - swing) * (within - TICKS_PER_SIXTEENTH) / TICKS_PER_SIXTEENTH;
+    return (pair + fraction) * 0.5;
+  }
+  
+  // Seconds after the anchor at which `beats` more beats have gone by
+  double secondsFor(double beats) const {
+    if (rampNs == 0 || beats <= 0) return beats * 60.0 / bpm;
+    double rampSeconds = rampNs / 1e9;
+    double rampBeats = (bpm + targetBpm) * 0.5 * rampSeconds / 60.0;
+    if (beats >= rampBeats) return rampSeconds + (beats - rampBeats) * 60.0 / targetBpm;
+    // beats = (bpm t + (target - bpm) t^2 / 2T) / 60, the stable root of it
+    double a = (targetBpm - bpm) / (2 * rampSeconds * 60.0);
+    double b = bpm / 60.0;
+    return 2 * beats / (b + std::sqrt(b * b + 4 * a * beats));
+  }
+  
+  uint64_t timeOf(uint64_t tick) const {
+    double seconds = secondsFor(beatOf(tick) - anchorBeat);
+    return (uint64_t)((int64_t)anchorNs + (int64_t)std::llround(seconds * 1e9));
+  }
+  
+  // Tempo in effect at a time, following the ramp
+  double bpmAt(uint64_t nowNs) const {
+    if (rampNs == 0 || nowNs >= anchorNs + rampNs) return targetBpm;
+    if (nowNs <= anchorNs) return bpm;
+    return bpm + (targetBpm - bpm) * (double)(nowNs - anchorNs) / rampNs;
+  }
+  
+  void anchorAt(uint64_t tick, uint64_t atNs) {
+    anchorTick = tick;
+    anchorBeat = beatOf(tick);
+    anchorNs = atNs;
+  }
+  
+  // Latest time an output queues a tick ahead of its nominal time
+  int64_t leadNs() const {
+    int64_t lead = 0;
+    for (const Output& output : outputs) lead = std::max<int64_t>(lead, -output.offsetNs);
+    return lead;
+  }
+  
+  void sendAll(uint64_t dueNs, uint32_t word, bool withOffset) {
+    for (const Output& output : outputs) {
+      uint32_t message = (word & ~ump::Group::place(0xF)) | ump::Group::place(output.group);
+      int64_t at = (int64_t)dueNs + (withOffset ? output.offsetNs : 0);
+      Scheduler::schedule(owner, output.token, at > 0 ? (uint64_t)at : 0, &message, 1);
+    }
+  }
+  
+  /**
+   * Withdraw the queued ticks and move every output's cursor back to its
+   * first tick not yet sent. Returns the earliest of them, where the map
+   * may change without touching anything already on the wire.
+   */
+  uint64_t rewindCursors(uint64_t nowNs) {
+    Scheduler::cancel(owner);
+    uint64_t earliest = UINT64_MAX;
+    for (Output& output : outputs) {
+      while (output.cursor > anchorTick &&
+             (int64_t)timeOf(output.cursor - 1) + output.offsetNs > (int64_t)nowNs) {
+        output.cursor--;
+      }
+      earliest = std::min<uint64_t>(earliest, output.cursor);
+    }
+    return earliest == UINT64_MAX ? anchorTick : earliest;
+  }
+  
+  // Begin ticking from song tick `tick`, `status` going out just before it
+  void begin(uint64_t tick, uint32_t status) {
+    uint64_t startNs = monotonicNanoseconds() + (uint64_t)leadNs();
+    anchorAt(tick, startNs);
+    for (Output& output : outputs) output.cursor = tick;
+    sendAll(startNs, status, true);
+    running = true;
+  }
+  
+public:
+  uint32_t id = 0;
+  
+  void open(const std::vector<TimingOutput>& targets, double initialBpm, double initialSwing) {
+    owner = Scheduler::newOwner();
+    for (const TimingOutput& target : targets) {
+      Output output;
+      static_cast<TimingOutput&>(output) = target;
+      output.cursor = 0;
+      outputs.push_back(output);
+    }
+    bpm = targetBpm = clampBpm(initialBpm);
+    swing = std::max<double>(0.5, std::min<double>(0.75, initialSwing));
+  }
+  
+  void fill(uint64_t horizonNs) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) return;
+    
+    for (Output& output : outputs) {
+      uint32_t word = ump::system::timingClock(output.group);
+      for (;;) {
+        int64_t dueNs = (int64_t)timeOf(output.cursor) + output.offsetNs;
+        if (dueNs > (int64_t)horizonNs) break;
+        Scheduler::schedule(owner, output.token, dueNs > 0 ? (uint64_t)dueNs : 0, &word, 1);
+        output.cursor++;
+      }
+    }
+  }
+  
+  // Start from the top of the song
+  void start() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (running) return;
+      positionTick = 0;
+      begin(0, ump::system::start(0));
+    }
+    Scheduler::poke();
+  }
+  
+  // Resume where stop() left off, or from the position set since
+  void resume() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (running) return;
+      begin(positionTick, ump::system::continueSong(0));
+    }
+    Scheduler::poke();
+  }
+  
+  void stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) return;
+    uint64_t nowNs = monotonicNanoseconds();
+    positionTick = rewindCursors(nowNs);
+    bpm = targetBpm = bpmAt(nowNs);
+    rampNs = 0;
+    running = false;
+    sendAll(nowNs, ump::system::stop(0), false);
+  }
+  
+  // Move the song position while stopped, in sixteenth notes, and tell the slaves
+  bool setPosition(uint32_t sixteenths) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return false;
+    positionTick = (uint64_t)std::min<uint32_t>(sixteenths, 0x3FFF) * TICKS_PER_SIXTEENTH;
+    sendAll(monotonicNanoseconds(), ump::system::songPosition(0, (uint16_t)(positionTick / TICKS_PER_SIXTEENTH)), false);
+    return true;
+  }
+  
+  // Change tempo now, or ramp to it linearly over rampMs
+  void setTempo(double newBpm, double rampMs) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      uint64_t nowNs = monotonicNanoseconds();
+      newBpm = clampBpm(newBpm);
+      uint64_t ramp = rampMs > 0 && std::isfinite(rampMs) ? (uint64_t)(rampMs * 1e6) : 0;
+      if (!running) {
+        // Nothing to ramp across while stopped
+        bpm = targetBpm = newBpm;
+        return;
+      }
+      uint64_t tick = rewindCursors(nowNs);
+      uint64_t tickNs = timeOf(tick);
+      double current = bpmAt(tickNs);
+      anchorAt(tick, tickNs);
+      bpm = ramp > 0 ? current : newBpm;
+      targetBpm = newBpm;
+      rampNs = ramp;
+    }
+    Scheduler::poke();
+  }
+  
+  void setSwing(double amount) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      amount = std::max<double>(0.5, std::min<double>(0.75, amount));
+      if (!running) {
+        swing = amount;
+        return;
+      }
+      uint64_t nowNs = monotonicNanoseconds();
+      uint64_t tick = rewindCursors(nowNs);
+      uint64_t tickNs = timeOf(tick);
+      // Keep the tempo map as it is from this tick on, under the new swing
+      double remaining = rampNs > 0 && tickNs < anchorNs + rampNs ? (double)(anchorNs + rampNs - tickNs) : 0;
+      double current = bpmAt(tickNs);
+      swing = amount;
+      anchorAt(tick, tickNs);
+      bpm = remaining > 0 ? current : targetBpm;
+      rampNs = (uint64_t)remaining;
+    }
+    Scheduler::poke();
+  }
+  
+  // Withdraw everything queued and stop any slave; the producer must be removed first
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Scheduler::cancel(owner);
+    if (running) sendAll(monotonicNanoseconds(), ump::system::stop(0), false);
+    running = false;
+  }
+  
+  bool isRunning() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running;
+  }
+  
+  double tempo() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running ? bpmAt(monotonicNanoseconds()) : targetBpm;
+  }
+  
+  double swingAmount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return swing;
+  }
+  
+  // Song position in ticks: the next tick due, where Continue resumes once stopped
+  uint64_t position() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running || outputs.empty()) return positionTick;
+    uint64_t nowNs = monotonicNanoseconds();
+    // Ticks are queued at most a lookahead ahead, a short walk back from the cursor
+    uint64_t tick = outputs[0].cursor;
+    while (tick > anchorTick && timeOf(tick - 1) > nowNs) tick--;
+    return tick;
+  }
+};
+
+class ClockManager : public ProducerRegistry<ClockGenerator> {
+public:
+  static std::shared_ptr<ClockGenerator> open(const std::vector<TimingOutput>& outputs, double bpm, double swing) {
+    std::shared_ptr<ClockGenerator> clock = std::make_shared<ClockGenerator>();
+    clock->open(outputs, bpm, swing);
+    add(clock);
+    return clock;
+  }
+};
+
+// ============================================================================
+// Clock Follower
+// ============================================================================
+
+/**
+ * Tempo and song position of an external clock master, estimated from the
+ * arrival times of its Timing Clock messages. An alpha-beta tracker (a
+ * steady-state Kalman filter for time and period) runs with least-squares
+ * gains over a growing window until it settles at two beats of memory, so
+ * it locks within a beat or two and then follows tempo changes without
+ * passing on per-message jitter. A clock arriving far from where the
+ * tracker expects it is left out of the estimate; a run of them means the
+ * tempo jumped and the tracker starts over.
+ */
+class ClockFollower {
+public:
+  static constexpr uint32_t PPQN = 24;
+  
+  enum Event : uint8_t { NONE, BEAT, START, STOP, CONTINUE, POSITION, LOCK, UNLOCK };
+  
+  struct State {
+    bool running;
+    bool locked;
+    double bpm;
+    // Song position in beats, counting the fraction since the last clock
+    double beats;
+  };
+  
+private:
+  // Memory of the settled tracker, two beats
+  static constexpr uint32_t SETTLE_TICKS = 2 * PPQN;
+  // Clocks to accept before reporting a lock
+  static constexpr uint32_t LOCK_TICKS = PPQN;
+  // Residual, as a fraction of the period, beyond which a clock is an outlier
+  static constexpr double OUTLIER_FRACTION = 0.35;
+  static constexpr uint32_t MAX_OUTLIERS = 6;
+  // 20 to 400 BPM
+  static constexpr double MIN_PERIOD_NS = 60e9 / (400 * PPQN);
+  static constexpr double MAX_PERIOD_NS = 60e9 / (20 * PPQN);
+  // No clock for this many periods, and at least DROPOUT_NS, means the
+  // master is gone: unplugged or its clock turned off
+  static constexpr double DROPOUT_PERIODS = 6;
+  static constexpr uint64_t DROPOUT_NS = 150000000ULL;
+  
+  // Arrival of the last clock, 0 before the first
+  uint64_t lastClockNs = 0;
+  // Estimated time of the last clock, and the clock period
+  double estimateNs = 0;
+  double periodNs = 0;
+  // Clocks accepted since the tracker last started over
+  uint32_t samples = 0;
+  uint32_t outliers = 0;
+  bool locked = false;
+  bool running = false;
+  // Song position of the last clock, in clocks
+  uint64_t ticks = 0;
+  // After Start, Continue or Song Position the next clock plays `ticks` itself
+  bool holdNext = true;
+  // A master restarts its clock on Start and Continue, the tempo carries over
+  bool rephase = false;
+  
+  void reacquire(double nowNs) {
+    estimateNs = nowNs;
+    samples = 1;
+    outliers = 0;
+  }
+  
+  // Feed one clock arrival to the tracker, returns LOCK or UNLOCK on a change
+  Event track(double nowNs) {
+    if (samples == 0) {
+      reacquire(nowNs);
+      return NONE;
+    }
+    if (rephase && samples >= 2) {
+      rephase = false;
+      estimateNs = nowNs;
+      outliers = 0;
+      return NONE;
+    }
+    if (samples == 1) {
+      double interval = nowNs - estimateNs;
+      estimateNs = nowNs;
+      if (interval < MIN_PERIOD_NS || interval > MAX_PERIOD_NS) return NONE;
+      periodNs = interval;
+      samples = 2;
+      return NONE;
+    }
+    
+    // The estimate stays on the last good clock through outliers, so the
+    // next good one is a clock per message later, or one fewer when the
+    // outlier was a stray extra message rather than a late one
+    double steps = outliers + 1;
+    double residual = nowNs - (estimateNs + steps * periodNs);
+    double limit = OUTLIER_FRACTION * periodNs;
+    if (std::fabs(residual) > limit && outliers > 0 && std::fabs(residual + periodNs) <= limit) {
+      steps--;
+      residual += periodNs;
+    }
+    if (std::fabs(residual) > limit) {
+      if (++outliers <= MAX_OUTLIERS) return NONE;
+      reacquire(nowNs);
+      if (!locked) return NONE;
+      locked = false;
+      return UNLOCK;
+    }
+    
+    outliers = 0;
+    double n = (double)std::min<uint32_t>(samples, SETTLE_TICKS);
+    double alpha = 2 * (2 * n - 1) / (n * (n + 1));
+    double beta = 6 / (n * (n + 1));
+    estimateNs += steps * periodNs + alpha * residual;
+    periodNs = std::max<double>(MIN_PERIOD_NS, std::min<double>(MAX_PERIOD_NS, periodNs + beta * residual / steps));
+    samples++;
+    if (locked || samples < LOCK_TICKS) return NONE;
+    locked = true;
+    return LOCK;
+  }
+  
+public:
+  /**
+   * Apply one packet received at timestampNs, System Real Time and System
+   * Common ones are read. Events go to `emit` in order; a clock emits BEAT
+   * when it lands on a beat while running.
+   */
+  template<typename Emit>
+  void feed(const uint32_t* packet, uint64_t timestampNs, Emit emit) {
+    if (ump::typeOf(packet[0]) != ump::MessageType::System) return;
+    switch (ump::system::Status::get(packet)) {
+      case ump::system::TIMING_CLOCK: {
+        lastClockNs = timestampNs;
+        Event change = track((double)timestampNs);
+        if (change != NONE) emit(change);
+        if (!running) return;
+        if (holdNext) holdNext = false;
+        else ticks++;
+        if (ticks % PPQN == 0) emit(BEAT);
+        return;
+      }
+      case ump::system::START:
+        ticks = 0;
+        holdNext = true;
+        rephase = true;
+        running = true;
+        emit(START);
+        return;
+      case ump::system::CONTINUE:
+        holdNext = true;
+        rephase = true;
+        running = true;
+        emit(CONTINUE);
+        return;
+      case ump::system::STOP:
+        running = false;
+        emit(STOP);
+        return;
+      case ump::system::SONG_POSITION:
+        // Sixteenth notes, 6 clocks each
+        ticks = (uint64_t)(ump::system::Data1::get(packet) | (ump::system::Data2::get(packet) << 7)) * (PPQN / 4);
+        holdNext = true;
+        emit(POSITION);
+        return;
+    }
+  }
+  
+  // A stopped master usually keeps its clock running, so only the clock
+  // itself going quiet drops the lock and forgets the tempo
+  template<typename Emit>
+  void poll(uint64_t nowNs, Emit emit) {
+    if (samples == 0 || nowNs < lastClockNs) return;
+    double limit = std::max<double>((double)DROPOUT_NS, DROPOUT_PERIODS * periodNs);
+    if ((double)(nowNs - lastClockNs) <= limit) return;
+    samples = 0;
+    outliers = 0;
+    rephase = false;
+    if (!locked) return;
+    locked = false;
+    emit(UNLOCK);
+  }
+  
+  State state(uint64_t nowNs) const {
+    State result;
+    result.running = running;
+    result.locked = locked;
+    result.bpm = samples >= 2 ? 60e9 / (periodNs * PPQN) : 0;
+    double fraction = 0;
+    if (running && !holdNext && samples >= 2) {
+      fraction = std::max<double>(0.0, std::min<double>(0.999, ((double)nowNs - estimateNs) / periodNs));
+    }
+    result.beats = (ticks + fraction) / PPQN;
+    return result;
+  }
+};
+
+/**
+ * Followers of one kind by id, each fed the packets of one input device
+ * through the input hub. T provides feed(packet, timestampNs, emit) for
+ * every packet, poll(nowNs, emit) which runs on the scheduler thread each
+ * fill pass to notice a source going quiet, and state(nowNs). Events reach
+ * the listener as the follower emits them, from either thread.
+ */
+template<typename T>
+class InputFollowers {
+public:
+  typedef std::function<void(uint32_t id, typename T::Event event, const typename T::State& state)> Listener;
+  
+private:
+  struct Entry : public Scheduler::Producer {
+    uint32_t id;
+    uint64_t deviceId;
+    std::mutex mutex;
+    T follower;
+    Listener listener;
+    uint32_t subscription = 0;
+    bool closed = false;
+    
+    void fill(uint64_t horizonNs) override {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (closed) return;
+      uint64_t nowNs = monotonicNanoseconds();
+      follower.poll(nowNs, [&](typename T::Event event) {
+        listener(id, event, follower.state(nowNs));
+      });
+    }
+  };
+  
+  typedef std::vector<std::shared_ptr<Entry>> EntryList;
+  static std::mutex mutex;
+  static std::shared_ptr<const EntryList> entries;
+  static uint32_t nextId;
+  
+  static void receive(Entry& entry, uint64_t deviceId, const uint32_t* words, size_t count, uint64_t timestampNs) {
+    if (deviceId != entry.deviceId) return;
+    std::lock_guard<std::mutex> lock(entry.mutex);
+    if (entry.closed) return;
+    for (size_t i = 0; i < count; i += ump::packetWordsOf(words[i])) {
+      if (i + ump::packetWordsOf(words[i]) > count) break;
+      entry.follower.feed(words + i, timestampNs, [&](typename T::Event event) {
+        entry.listener(entry.id, event, entry.follower.state(timestampNs));
+      });
+    }
+  }
+  
+protected:
+  // True if any follower reads deviceId, safe on input threads
+  static bool isFollowed(uint64_t deviceId) {
+    for (const auto& entry : *std::atomic_load(&entries)) {
+      if (entry->deviceId == deviceId) return true;
+    }
+    return false;
+  }
+  
+public:
+  static uint32_t follow(uint64_t deviceId, Listener listener) {
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->deviceId = deviceId;
+    entry->listener = std::move(listener);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      entry->id = ++nextId;
+      auto next = std::make_shared<EntryList>(*std::atomic_load(&entries));
+      next->push_back(entry);
+      std::atomic_store(&entries, std::shared_ptr<const EntryList>(next));
+    }
+    entry->subscription = InputHub::subscribe([entry](uint64_t device, const uint32_t* words, size_t count, uint64_t timestampNs) {
+      receive(*entry, device, words, count, timestampNs);
+    });
+    Scheduler::addProducer(entry.get());
+    return entry->id;
+  }
+  
+  // Run fn on a follower while nothing else can feed it, false if stopped
+  template<typename Fn>
+  static bool with(uint32_t id, Fn fn) {
+    for (const auto& entry : *std::atomic_load(&entries)) {
+      if (entry->id != id) continue;
+      std::lock_guard<std::mutex> lock(entry->mutex);
+      fn(entry->follower);
+      return true;
+    }
+    return false;
+  }
+  
+  static bool state(uint32_t id, typename T::State& result) {
+    for (const auto& entry : *std::atomic_load(&entries)) {
+      if (entry->id != id) continue;
+      std::lock_guard<std::mutex> lock(entry->mutex);
+      result = entry->follower.state(monotonicNanoseconds());
+      return true;
+    }
+    return false;
+  }
+  
+  static bool stop(uint32_t id) {
+    std::shared_ptr<Entry> entry;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto next = std::make_shared<EntryList>(*std::atomic_load(&entries));
+      for (size_t i = 0; i < next->size(); i++) {
+        if ((*next)[i]->id == id) {
+          entry = (*next)[i];
+          next->erase(next->begin() + i);
+          break;
+        }
+      }
+      if (!entry) return false;
+      std::atomic_store(&entries, std::shared_ptr<const EntryList>(next));
+    }
+    Scheduler::removeProducer(entry.get());
+    InputHub::unsubscribe(entry->subscription);
+    // Nothing feeds or polls it any more; anyone still holding the entry sees it closed
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    entry->closed = true;
+    return true;
+  }
+  
+  static void stopAll() {
+    std::vector<uint32_t> ids;
+    for (const auto& entry : *std::atomic_load(&entries)) ids.push_back(entry->id);
+    for (uint32_t id : ids) stop(id);
+  }
+};
+
+template<typename T> std::mutex InputFollowers<T>::mutex;
+template<typename T> std::shared_ptr<const typename InputFollowers<T>::EntryList> InputFollowers<T>::entries =
+  std::make_shared<const typename InputFollowers<T>::EntryList>();
+template<typename T> uint32_t InputFollowers<T>::nextId = 0;
+
+/**
+ * Clock followers. Reports reach the listener at most once a beat plus
+ * transport changes; the clocks themselves are consumed here, and
+ * inputFiltered() lets the JS input callback leave them out.
+ */
+class ClockFollowerManager : public InputFollowers<ClockFollower> {
+public:
+  // True for a Timing Clock packet from a followed device
+  static bool inputFiltered(uint64_t deviceId, const uint32_t* packet) {
+    if (ump::typeOf(packet[0]) != ump::MessageType::System ||
+        ump::system::Status::get(packet) != ump::system::TIMING_CLOCK) return false;
+    return isFollowed(deviceId);
+  }
+};
+
+// ============================================================================
+// Time Code
+// ============================================================================
+
+/**
+ * MTC master: quarter frames to a set of outputs while running, a full
+ * frame message on every locate. Quarter frame times come from the frame
+ * period times their index since the last start, so 29.97 fps stays on
+ * time however long it runs. Each output has its own offset and group.
+ */
+class MtcGenerator : public Scheduler::Producer {
+private:
+  std::mutex mutex;
+  uint32_t owner;
+  std::vector<TimingOutput> outputs;
+  mtc::Rate rate = mtc::Rate::Fps25;
+  double frameNs = 4e7;
+  bool running = false;
+  // Time of the first quarter frame and the frame it starts
+  uint64_t originNs = 0;
+  uint64_t originFrame = 0;
+  // Quarter frames queued since the origin, and the position while stopped
+  uint64_t quarters = 0;
+  uint64_t positionFrame = 0;
+  
+  uint64_t quarterTime(uint64_t quarter) const {
+    return originNs + (uint64_t)std::llround(quarter * frameNs / 4);
+  }
+  
+  void sendAll(uint64_t dueNs, const uint32_t* words, uint8_t count) {
+    for (const TimingOutput& output : outputs) {
+      uint32_t packet[4];
+      for (uint8_t i = 0; i < count; i++) packet[i] = words[i];
+      ump::Group::set(packet, output.group);
+      int64_t at = (int64_t)dueNs + output.offsetNs;
+      Scheduler::schedule(owner, output.token, at > 0 ? (uint64_t)at : 0, packet, count);
+    }
+  }
+  
+  void sendFullFrame(uint64_t frame) {
+    uint8_t bytes[mtc::FULL_FRAME_BYTES];
+    mtc::fullFrame(mtc::fromFrames(frame, rate), bytes);
+    ump::Packet<2> start = ump::sysex7::packet(0, ump::sysex7::START, bytes, 6);
+    ump::Packet<2> end = ump::sysex7::packet(0, ump::sysex7::END, bytes + 6, 2);
+    uint64_t nowNs = monotonicNanoseconds();
+    sendAll(nowNs, start.data(), 2);
+    sendAll(nowNs, end.data(), 2);
+  }
+  
+  // Position in frames at nowNs, with the fraction of the frame playing
+  double frameAt(uint64_t nowNs) const {
+    if (!running || nowNs <= originNs) return (double)positionFrame;
+    return std::fmod(originFrame + (nowNs - originNs) / frameNs, (double)mtc::framesPerDay(rate));
+  }
+  
+public:
+  uint32_t id = 0;
+  
+  void open(const std::vector<TimingOutput>& targets, mtc::Rate frameRate) {
+    owner = Scheduler::newOwner();
+    outputs = targets;
+    rate = frameRate;
+    frameNs = mtc::frameSeconds(rate) * 1e9;
+  }
+  
+  void fill(uint64_t horizonNs) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) return;
+    
+    for (uint64_t dueNs = quarterTime(quarters); dueNs <= horizonNs; dueNs = quarterTime(++quarters)) {
+      // Eight pieces describe the frame piece 0 starts, two frames apart
+      uint8_t piece = (uint8_t)(quarters & 7);
+      mtc::Timecode timecode = mtc::fromFrames(originFrame + (quarters >> 3) * 2, rate);
+      uint32_t word = ump::system::mtcQuarterFrame(0, piece, mtc::quarterFrameValue(timecode, piece));
+      sendAll(dueNs, &word, 1);
+    }
+  }
+  
+  void start() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (running) return;
+      originNs = monotonicNanoseconds();
+      originFrame = positionFrame;
+      quarters = 0;
+      running = true;
+    }
+    Scheduler::poke();
+  }
+  
+  void stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) return;
+    positionFrame = (uint64_t)frameAt(monotonicNanoseconds());
+    running = false;
+    Scheduler::cancel(owner);
+  }
+  
+  // Jump to a frame, carrying on from there if running
+  void locate(uint64_t frame) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      frame %= mtc::framesPerDay(rate);
+      Scheduler::cancel(owner);
+      positionFrame = frame;
+      sendFullFrame(frame);
+      if (running) {
+        originNs = monotonicNanoseconds();
+        originFrame = frame;
+        quarters = 0;
+      }
+    }
+    Scheduler::poke();
+  }
+  
+  // Withdraw everything queued; the producer must be removed first
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+    Scheduler::cancel(owner);
+  }
+  
+  bool isRunning() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running;
+  }
+  
+  double position() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frameAt(monotonicNanoseconds());
+  }
+  
+  mtc::Rate frameRate() const { return rate; }
+};
+
+class MtcManager : public ProducerRegistry<MtcGenerator> {
+public:
+  static std::shared_ptr<MtcGenerator> open(const std::vector<TimingOutput>& outputs, mtc::Rate rate) {
+    std::shared_ptr<MtcGenerator> generator = std::make_shared<MtcGenerator>();
+    generator->open(outputs, rate);
+    add(generator);
+    return generator;
+  }
+};
+
+/**
+ * MTC slave: decodes quarter frames and full frame messages from one input
+ * and keeps a smoothed estimate of the position. Once eight pieces in a
+ * row have given a time code, every further quarter frame is a position
+ * sample a quarter frame on from the last, and an alpha-beta tracker over
+ * position and speed smooths the arrival jitter out. The position reads
+ * between samples by extrapolating at the tracked speed.
+ * Time code running backwards is not followed.
+ */
+class MtcChaser {
+public:
+  enum Event : uint8_t { NONE, LOCK, POSITION, STOP, LOCATE };
+  
+  struct State {
+    bool running;
+    bool locked;
+    mtc::Rate rate;
+    // Smoothed position in frames, and speed where 1 is real time
+    double frames;
+    double speed;
+  };
+  
+private:
+  // Quarter frames of tracker memory once settled, two pieces cycles
+  static constexpr uint32_t SETTLE_SAMPLES = 16;
+  // Samples further than this from the estimate, in frames, are outliers
+  static constexpr double OUTLIER_FRAMES = 1.0;
+  static constexpr uint32_t MAX_OUTLIERS = 4;
+  // No quarter frame for this long means the master stopped
+  static constexpr uint64_t DROPOUT_NS = 120000000ULL;
+  static constexpr uint64_t REPORT_NS = 100000000ULL;
+  
+  mtc::Rate rate = mtc::Rate::Fps25;
+  double frameNs = 4e7;
+  uint8_t pieces[8] = {};
+  uint8_t expected = 0;
+  // Eight pieces in order gave a time code, cycleFrame is the current cycle's
+  bool synced = false;
+  uint64_t cycleFrame = 0;
+  bool running = false;
+  bool locked = false;
+  uint64_t lastArrivalNs = 0;
+  uint64_t lastReportNs = 0;
+  
+  // Tracker: position in frames at estimateNs, and speed
+  double estimateFrames = 0;
+  uint64_t estimateNs = 0;
+  double speed = 1;
+  uint32_t samples = 0;
+  uint32_t outliers = 0;
+  
+  // Full frame messages arrive as SysEx, collected here
+  uint8_t sysEx[16];
+  size_t sysExLength = 0;
+  bool sysExOverflow = false;
+  
+  void setRate(mtc::Rate frameRate) {
+    rate = frameRate;
+    frameNs = mtc::frameSeconds(rate) * 1e9;
+  }
+  
+  void restart(double frames, uint64_t nowNs) {
+    estimateFrames = frames;
+    estimateNs = nowNs;
+    speed = 1;
+    samples = 1;
+    outliers = 0;
+  }
+  
+  void sample(double frames, uint64_t nowNs) {
+    double elapsed = (double)(int64_t)(nowNs - estimateNs);
+    double predicted = estimateFrames + speed * elapsed / frameNs;
+    double residual = frames - predicted;
+    if (std::fabs(residual) > OUTLIER_FRAMES) {
+      if (++outliers > MAX_OUTLIERS) restart(frames, nowNs);
+      return;
+    }
+    outliers = 0;
+    double n = (double)std::min<uint32_t>(samples, SETTLE_SAMPLES);
+    double alpha = 2 * (2 * n - 1) / (n * (n + 1));
+    double beta = 6 / (n * (n + 1));
+    estimateFrames = predicted + alpha * residual;
+    if (elapsed > 0) speed += beta * residual * frameNs / elapsed;
+    estimateNs = nowNs;
+    samples++;
+  }
+  
+  template<typename Emit>
+  void quarterFrame(uint8_t piece, uint8_t value, uint64_t nowNs, Emit emit) {
+    lastArrivalNs = nowNs;
+    if (piece != expected) {
+      // Out of order, wait for the start of the next cycle
+      synced = false;
+      expected = 0;
+      if (piece != 0) return;
+    }
+    pieces[piece] = value;
+    expected = (piece + 1) & 7;
+    
+    if (synced) {
+      if (piece == 0) cycleFrame = (cycleFrame + 2) % mtc::framesPerDay(rate);
+      sample(cycleFrame + piece * 0.25, nowNs);
+    }
+    if (piece != 7) return;
+    
+    mtc::Timecode timecode = mtc::fromQuarterFrames(pieces);
+    if (timecode.rate != rate) setRate(timecode.rate);
+    uint64_t frame = mtc::toFrames(timecode);
+    if (synced && frame == cycleFrame) {
+      // A second cycle agrees with the count, the master is running
+      if (!locked) {
+        locked = true;
+        lastReportNs = nowNs;
+        emit(LOCK);
+      }
+      return;
+    }
+    // The pieces describe the frame where piece 0 went out, 1.75 frames ago
+    synced = true;
+    cycleFrame = frame;
+    running = true;
+    locked = false;
+    restart(frame + 1.75, nowNs);
+  }
+  
+  template<typename Emit>
+  void sysExPacket(const uint32_t* packet, Emit emit) {
+    uint8_t form = (uint8_t)ump::sysex7::Form::get(packet);
+    uint8_t count = (uint8_t)std::min<uint32_t>(ump::sysex7::Count::get(packet), 6);
+    if (form == ump::sysex7::COMPLETE || form == ump::sysex7::START) {
+      sysExLength = 0;
+      sysExOverflow = false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      if (sysExLength < sizeof(sysEx)) sysEx[sysExLength++] = ump::sysex7::byte(packet, i);
+      else sysExOverflow = true;
+    }
+    if (form != ump::sysex7::COMPLETE && form != ump::sysex7::END) return;
+    
+    mtc::Timecode timecode;
+    if (sysExOverflow || !mtc::parseFullFrame(sysEx, sysExLength, timecode)) return;
+    // A locate, quarter frames start over from here if the master runs
+    setRate(timecode.rate);
+    synced = false;
+    expected = 0;
+    running = false;
+    locked = false;
+    estimateFrames = (double)mtc::toFrames(timecode);
+    samples = 0;
+    emit(LOCATE);
+  }
+  
+public:
+  template<typename Emit>
+  void feed(const uint32_t* packet, uint64_t timestampNs, Emit emit) {
+    ump::MessageType type = ump::typeOf(packet[0]);
+    if (type == ump::MessageType::System && ump::system::Status::get(packet) == ump::system::MTC_QUARTER_FRAME) {
+      uint8_t data = (uint8_t)ump::system::Data1::get(packet);
+      quarterFrame(data >> 4, data & 0xF, timestampNs, emit);
+    } else if (type == ump::MessageType::SysEx7) {
+      sysExPacket(packet, emit);
+    }
+  }
+  
+  // Notice the master stopping, and report the position while running
+  template<typename Emit>
+  void poll(uint64_t nowNs, Emit emit) {
+    if (!running) return;
+    if (nowNs - lastArrivalNs > DROPOUT_NS) {
+      // Hold the position the last quarter frame gave
+      estimateFrames += speed * (double)(int64_t)(lastArrivalNs - estimateNs) / frameNs;
+      estimateNs = lastArrivalNs;
+      running = false;
+      locked = false;
+      synced = false;
+      expected = 0;
+      emit(STOP);
+      return;
+    }
+    if (locked && nowNs - lastReportNs >= REPORT_NS) {
+      lastReportNs = nowNs;
+      emit(POSITION);
+    }
+  }
+  
+  State state(uint64_t nowNs) const {
+    State result;
+    result.running = running;
+    result.locked = locked;
+    result.rate = rate;
+    result.speed = running ? speed : 0;
+    result.frames = estimateFrames;
+    if (running) result.frames += speed * (double)(int64_t)(nowNs - estimateNs) / frameNs;
+    if (result.frames < 0) result.frames = 0;
+    return result;
+  }
+};
+
+/**
+ * MTC chases. Quarter frames from a chased input are consumed here and
+ * inputFiltered() lets the JS input callback leave them out.
+ */
+class MtcChaseManager : public InputFollowers<MtcChaser> {
+public:
+  static bool inputFiltered(uint64_t deviceId, const uint32_t* packet) {
+    if (ump::typeOf(packet[0]) != ump::MessageType::System ||
+        ump::system::Status::get(packet) != ump::system::MTC_QUARTER_FRAME) return false;
+    return isFollowed(deviceId);
+  }
+};
+
+// ============================================================================
+// Endpoint Discovery
+// ============================================================================
+
+/**
+ * Asks a UMP endpoint about itself over a pair of ports and collects the
+ * UMP Stream replies into an EndpointInfo:
+ * - Discovery sends Endpoint Discovery for everything, then Function Block
+ *   Discovery once Endpoint Info says how many blocks there are. It is
+ *   done when every block has reported and the replies have gone quiet,
+ *   since names are optional, or when time runs out.
+ * - Configuration sends a Stream Configuration Request and is done on the
+ *   Stream Configuration Notification, or when time runs out.
+ * The result is stored in the EndpointCache either way.
+ */
+class EndpointDiscovery {
+public:
+  enum Event { NONE, DONE };
+  typedef EndpointInfo State;
+  
+  // Quiet time after the last reply before a complete answer is final
+  static constexpr uint64_t SETTLE_NS = 50000000ULL;
+  static constexpr uint8_t MAX_BLOCKS = 32;
+  
+private:
+  EndpointInfo info;
+  uint32_t output = 0;
+  bool configuring = false;
+  bool started = false;
+  bool finished = false;
+  uint64_t deadlineNs = 0;
+  uint64_t lastReplyNs = 0;
+  bool hasInfo = false;
+  bool blocksRequested = false;
+  uint32_t blocksSeen = 0;
+  
+  void send(const ump::Packet<4>& packet) {
+    HandleTable::withSlot(output, [&packet](OpenHandle& slot) {
+      if (!slot.isInput && slot.connected) WriteUmp(slot, packet.data(), packet.size, monotonicNanoseconds());
+    });
+  }
+  
+  FunctionBlock& block(uint8_t index) {
+    if (info.blocks.size() <= index) info.blocks.resize(index + 1);
+    return info.blocks[index];
+  }
+  
+  // Text bytes of a name packet, `skip` of the four word 0 bytes coming first
+  static void appendText(std::string& text, const uint32_t* packet, uint8_t skip) {
+    uint8_t form = (uint8_t)ump::stream::Form::get(packet);
+    if (form == ump::stream::FORM_COMPLETE || form == ump::stream::FORM_START) text.clear();
+    for (uint8_t i = skip; i < 16; i++) {
+      uint8_t byte = (uint8_t)(packet[i / 4] >> (24 - 8 * (i % 4)));
+      // Unused bytes of the last packet are zero
+      if (byte != 0) text.push_back((char)byte);
+    }
+  }
+  
+  bool complete() const {
+    if (!hasInfo) return false;
+    uint8_t blocks = std::min<uint8_t>(info.blockCount, MAX_BLOCKS);
+    uint32_t all = blocks >= 32 ? 0xFFFFFFFFu : (1u << blocks) - 1;
+    return (blocksSeen & all) == all;
+  }
+  
+  template<typename Emit>
+  void finish(Emit emit) {
+    finished = true;
+    EndpointCache::store(info);
+    emit(DONE);
+  }
+  
+public:
+  // A fresh discovery, or a configuration starting from what is known
+  void begin(uint32_t outputToken, uint64_t outputId, uint64_t inputId, uint64_t timeoutNs) {
+    output = outputToken;
+    info.deviceId = outputId;
+    info.inputId = inputId;
+    started = true;
+    lastReplyNs = monotonicNanoseconds();
+    deadlineNs = lastReplyNs + timeoutNs;
+    send(ump::stream::endpointDiscovery(ump::stream::REQUEST_INFO | ump::stream::REQUEST_DEVICE_IDENTITY |
+                                        ump::stream::REQUEST_NAME | ump::stream::REQUEST_PRODUCT_INSTANCE_ID |
+                                        ump::stream::REQUEST_CONFIGURATION));
+  }
+  
+  void configure(uint32_t outputToken, const EndpointInfo& known, uint8_t protocol, bool receiveJr, bool transmitJr,
+                 uint64_t timeoutNs) {
+    output = outputToken;
+    info = known;
+    configuring = true;
+    started = true;
+    deadlineNs = monotonicNanoseconds() + timeoutNs;
+    send(ump::stream::configurationRequest(protocol, receiveJr, transmitJr));
+  }
+  
+  template<typename Emit>
+  void feed(const uint32_t* packet, uint64_t timestampNs, Emit emit) {
+    if (!started || finished || ump::typeOf(packet[0]) != ump::stream::TYPE) return;
+    uint16_t status = (uint16_t)ump::stream::Status::get(packet);
+    uint16_t data = (uint16_t)ump::stream::Data::get(packet);
+    lastReplyNs = timestampNs;
+    
+    switch (status) {
+      case ump::stream::ENDPOINT_INFO:
+        info.ump = true;
+        info.versionMajor = (uint8_t)(data >> 8);
+        info.versionMinor = (uint8_t)data;
+        info.staticBlocks = (packet[1] & 0x80000000u) != 0;
+        info.blockCount = (uint8_t)((packet[1] >> 24) & 0x7F);
+        info.midi2Protocol = (packet[1] & 0x200) != 0;
+        info.midi1Protocol = (packet[1] & 0x100) != 0;
+        info.canReceiveJr = (packet[1] & 0x2) != 0;
+        info.canTransmitJr = (packet[1] & 0x1) != 0;
+        hasInfo = true;
+        if (!configuring && !blocksRequested && info.blockCount > 0) {
+          blocksRequested = true;
+          send(ump::stream::functionBlockDiscovery(ump::stream::ALL_FUNCTION_BLOCKS,
+                                                   ump::stream::REQUEST_BLOCK_INFO | ump::stream::REQUEST_BLOCK_NAME));
+        }
+        break;
+      case ump::stream::DEVICE_IDENTITY:
+        info.hasIdentity = true;
+        for (int i = 0; i < 3; i++) info.manufacturer[i] = (uint8_t)((packet[1] >> (16 - 8 * i)) & 0x7F);
+        info.family = (uint16_t)(((packet[2] >> 24) & 0x7F) | (((packet[2] >> 16) & 0x7F) << 7));
+        info.model = (uint16_t)(((packet[2] >> 8) & 0x7F) | ((packet[2] & 0x7F) << 7));
+        for (int i = 0; i < 4; i++) info.revision[i] = (uint8_t)((packet[3] >> (24 - 8 * i)) & 0x7F);
+        break;
+      case ump::stream::ENDPOINT_NAME:
+        appendText(info.name, packet, 2);
+        break;
+      case ump::stream::PRODUCT_INSTANCE_ID:
+        appendText(info.productInstanceId, packet, 2);
+        break;
+      case ump::stream::CONFIGURATION_NOTIFY:
+        info.ump = true;
+        info.protocol = (uint8_t)(data >> 8);
+        info.receiveJr = (data & 0x2) != 0;
+        info.transmitJr = (data & 0x1) != 0;
+        if (configuring) finish(emit);
+        break;
+      case ump::stream::FUNCTION_BLOCK_INFO: {
+        uint8_t index = (uint8_t)((data >> 8) & 0x7F);
+        if (index >= MAX_BLOCKS) break;
+        FunctionBlock& fb = block(index);
+        fb.known = true;
+        fb.active = (data & 0x8000) != 0;
+        fb.uiHint = (uint8_t)((data >> 4) & 0x3);
+        fb.midi1 = (uint8_t)((data >> 2) & 0x3);
+        fb.direction = (uint8_t)(data & 0x3);
+        fb.firstGroup = (uint8_t)(packet[1] >> 24);
+        fb.groupCount = (uint8_t)(packet[1] >> 16);
+        fb.midiCiVersion = (uint8_t)(packet[1] >> 8);
+        fb.maxSysEx8Streams = (uint8_t)packet[1];
+        blocksSeen |= 1u << index;
+        break;
+      }
+      case ump::stream::FUNCTION_BLOCK_NAME: {
+        uint8_t index = (uint8_t)(data >> 8);
+        if (index < MAX_BLOCKS) appendText(block(index).name, packet, 3);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  
+  template<typename Emit>
+  void poll(uint64_t nowNs, Emit emit) {
+    if (!started || finished) return;
+    bool settled = !configuring && complete() && nowNs >= lastReplyNs + SETTLE_NS;
+    if (settled || nowNs >= deadlineNs) finish(emit);
+  }
+  
+  State state(uint64_t) const {
+    return info;
+  }
+};
+
+/**
+ * Discovery and configuration sessions, one per request. A session reports
+ * DONE once and is then stopped by whoever asked.
+ */
+class EndpointDiscoveryManager : public InputFollowers<EndpointDiscovery> {};
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+// Plain copy of one open port's counters, taken for getStats()
+struct PortStatsSnapshot {
+  uint64_t deviceId;
+  int isInput;
+  bool isVirtual;
+  char address[64];
+  int refs;
+  uint64_t packetsSent;
+  uint64_t bytesSent;
+  uint64_t packetsReceived;
+  uint64_t bytesReceived;
+  uint64_t shortWrites;
+  uint64_t retries;
+  uint64_t drops;
+  // Bytes (packets for loopback ports) waiting in the driver right now
+  uint64_t queueDepth;
+  uint64_t queueHighWater;
+  uint64_t latency[PortStats::LATENCY_BUCKETS];
+  
+  // Upper bound of the histogram bucket holding the given fraction, 0 if empty
+  uint64_t latencyPercentileNs(double fraction) const {
+    uint64_t total = 0;
+    for (uint64_t count : latency) total += count;
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(fraction * total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < PortStats::LATENCY_BUCKETS; bucket++) {
+      seen += latency[bucket];
+      if (seen > rank) return 2ULL << bucket;
+    }
+    return 0;
+  }
+};
+
+/**
+ * Copy the counters of every open pooled port. The pool mutex is held only
+ * to list the open entries, the counters are relaxed loads and the driver
+ * queue depth costs one system call per hardware port, so polling this
+ * several times a second never holds up input delivery or opening ports.
+ */
+static inline void CollectPortStats(std::vector<PortStatsSnapshot>& result) {
+  struct Open {
+    PooledHandle* entry;
+    void* handle;
+    uint32_t endpoint;
+    PortStatsSnapshot snapshot;
+  };
+  std::vector<Open> open;
+  {
+    std::lock_guard<std::mutex> lock(HandlePool::mutex);
+    for (auto& entry : HandlePool::all()) {
+      if (entry->handle == nullptr) continue;
+      Open port = { entry.get(), entry->handle, entry->endpoint, {} };
+      port.snapshot.deviceId = entry->deviceId;
+      port.snapshot.isInput = entry->isInput;
+      port.snapshot.isVirtual = entry->isVirtual;
+      memcpy(port.snapshot.address, entry->address, sizeof(port.snapshot.address));
+      open.push_back(port);
+    }
+  }
+  
+  // Entries are never erased, so the pointers outlive the pool lock
+  for (Open& port : open) {
+    PooledHandle* entry = port.entry;
+    PortStats& stats = entry->stats;
+    PortStatsSnapshot& snapshot = port.snapshot;
+    snapshot.refs = entry->refs.load(std::memory_order_relaxed);
+    snapshot.packetsSent = stats.packetsSent.load(std::memory_order_relaxed);
+    snapshot.bytesSent = stats.bytesSent.load(std::memory_order_relaxed);
+    snapshot.packetsReceived = stats.packetsReceived.load(std::memory_order_relaxed);
+    snapshot.bytesReceived = stats.bytesReceived.load(std::memory_order_relaxed);
+    snapshot.shortWrites = stats.shortWrites.load(std::memory_order_relaxed);
+    snapshot.retries = stats.retries.load(std::memory_order_relaxed);
+    snapshot.drops = stats.drops.load(std::memory_order_relaxed);
+    for (int bucket = 0; bucket < PortStats::LATENCY_BUCKETS; bucket++) {
+      snapshot.latency[bucket] = stats.latency[bucket].load(std::memory_order_relaxed);
+    }
+    
+    if (snapshot.isVirtual) {
+      snapshot.queueDepth = snapshot.isInput ? 0 : vmidi::Loopback::queued(port.endpoint);
+    } else {
+#if __linux__ && HAS_ALSA
+      std::lock_guard<std::mutex> lock(HandlePool::driverMutex);
+      // Skip the query if the port was closed or reopened meanwhile
+      if (entry->handle == port.handle) {
+        size_t depth, size, xruns;
+        ALSAMIDIManager::queueStatus((snd_rawmidi_t*)port.handle, snapshot.isInput != 0, depth, size, xruns);
+        snapshot.queueDepth = depth;
+        // Input overruns are bytes the driver had to throw away
+        if (snapshot.isInput) snapshot.drops += xruns;
+      }
+#endif
+    }
+    stats.raiseHighWater(snapshot.queueDepth);
+    snapshot.queueHighWater = stats.queueHighWater.load(std::memory_order_relaxed);
+    result.push_back(snapshot);
+  }
+}
+
+// ============================================================================
+// Lifecycle
+// ============================================================================
+
+static void StartThreads() {
+  logging::Logger::start();
+  Scheduler::start();
+  HotplugWatcher::start();
+#if __linux__ && HAS_ALSA
+  InputReader::start();
+  HandlePool::onInputsChanged = InputReader::wake;
+#endif
+}
+
+// Background threads must be joined before static destructors run, which
+// process.exit() reaches without calling the env cleanup hook first
+static void StopThreads() {
+  // Finish open clips so a quit never leaves one without End of Clip
+  CaptureManager::stopAll();
+  ClockFollowerManager::stopAll();
+  MtcChaseManager::stopAll();
+  EndpointDiscoveryManager::stopAll();
+  PlaybackManager::closeAll();
+  ClockManager::closeAll();
+  MtcManager::closeAll();
+  Scheduler::stop();
+  // Nothing may be left hanging on a synth after a quit
+  ReleaseAllHeldNotes();
+  HotplugWatcher::stop();
+#if __linux__ && HAS_ALSA
+  InputReader::stop();
+#endif
+  vmidi::Loopback::stop();
+  // Last, so messages logged while the others shut down are still written
+  logging::Logger::stop();
+}
@@ -0,0 +1,458 @@
+/**
+ * Microbenchmarks for the UMP codec and transform kernels
+ *
+ * Times single kernels in isolation on a synthetic corpus generated from a
+ * fixed seed, so two runs on the same machine see identical input:
+ * - ump.pack / ump.unpack: MIDI 1.0 channel voice fields <-> UMP words
+ * - midi1-to-ump / ump-to-midi1: the translators in ump-translator.h
+ * - sysex.segment / sysex.reassemble: SysEx bytes <-> SysEx7 packets
+ * - scale.quantize: findClosestNoteInScale as a search and as a lookup table
+ * - transform.chain: transpose, velocity scale and channel remap applied as
+ *   separate stages (as the JS transformer chain does) and fused
+ * - scale.upscale / scale.downscale: min-center-max scaling, 7 <-> 32 bits
+ * - protocol.midi1-to-midi2 / protocol.midi2-to-midi1: channel voice packets
+ *   translated between protocols with their values rescaled
+ *
+ * Variants of one kernel run on the same input and their output checksums
+ * are compared, so a vector path that disagrees with its scalar reference
+ * is reported instead of silently winning. Results are printed as JSON:
+ *
+ *   midi2-microbench [--seed N] [--packets N] [--trials N] [--min-ms N]
+ *
+ * Build with: pnpm run build-native (target midi2-microbench)
+ */
+
+#include "ump-translator.h"
+#include "ump-kernels.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+
+// ============================================================================
+// Corpus
+// ============================================================================
+
+struct Corpus {
+  // MIDI 1.0 channel voice messages as structure of arrays
+  std::vector<uint8_t> status;
+  std::vector<uint8_t> data1;
+  std::vector<uint8_t> data2;
+  // The same messages as type 0x2 UMP words
+  std::vector<uint32_t> words;
+  // The same messages as a byte stream with running status and clock bytes
+  std::vector<uint8_t> bytes;
+  // Mix of MIDI 1.0 and MIDI 2.0 channel voice packets plus system messages
+  std::vector<uint32_t> mixed;
+  size_t mixedPackets = 0;
+  // Complete SysEx messages back to back, and their SysEx7 packets
+  std::vector<uint8_t> sysEx;
+  std::vector<uint32_t> sysExPackets;
+};
+
+static Corpus buildCorpus(uint32_t seed, size_t packets) {
+  Corpus corpus;
+  std::mt19937 random(seed);
+  auto uniform = [&random](int low, int high) {
+    return std::uniform_int_distribution<int>(low, high)(random);
+  };
+
+  uint8_t runningStatus = 0;
+  for (size_t i = 0; i < packets; i++) {
+    int pick = uniform(0, 99);
+    uint8_t channel = (uint8_t)uniform(0, 15);
+    uint8_t status, d1, d2;
+    if (pick < 45) {
+      status = 0x90 | channel; d1 = (uint8_t)uniform(24, 108); d2 = (uint8_t)uniform(1, 127);
+    } else if (pick < 80) {
+      status = 0x80 | channel; d1 = (uint8_t)uniform(24, 108); d2 = (uint8_t)uniform(0, 127);
+    } else if (pick < 90) {
+      status = 0xB0 | channel; d1 = (uint8_t)uniform(0, 119); d2 = (uint8_t)uniform(0, 127);
+    } else if (pick < 95) {
+      status = 0xE0 | channel; d1 = (uint8_t)uniform(0, 127); d2 = (uint8_t)uniform(0, 127);
+    } else {
+      status = 0xD0 | channel; d1 = (uint8_t)uniform(0, 127); d2 = 0;
+    }
+    corpus.status.push_back(status);
+    corpus.data1.push_back(d1);
+    corpus.data2.push_back(d2);
+    corpus.words.push_back((0x2u << 28) | ((uint32_t)status << 16) | ((uint32_t)d1 << 8) | d2);
+
+    if (status != runningStatus) corpus.bytes.push_back(status);
+    runningStatus = status;
+    corpus.bytes.push_back(d1);
+    if ((status & 0xF0) != 0xD0) corpus.bytes.push_back(d2);
+    if (i % 24 == 23) corpus.bytes.push_back(0xF8);
+  }
+
+  for (size_t i = 0; i < packets; i++) {
+    int pick = uniform(0, 99);
+    uint8_t group = (uint8_t)uniform(0, 3);
+    uint8_t channel = (uint8_t)uniform(0, 15);
+    if (pick < 55) {
+      corpus.mixed.push_back(corpus.words[i] | ((uint32_t)group << 24));
+    } else if (pick < 95) {
+      uint32_t opcode = pick < 85 ? 0x9 : 0xB;
+      corpus.mixed.push_back((0x4u << 28) | ((uint32_t)group << 24) | (opcode << 20) |
+                             ((uint32_t)channel << 16) | ((uint32_t)uniform(0, 127) << 8));
+      corpus.mixed.push_back((uint32_t)random());
+    } else {
+      corpus.mixed.push_back((0x1u << 28) | ((uint32_t)group << 24) | (0xF8u << 16));
+    }
+    corpus.mixedPackets++;
+  }
+
+  ump::Midi1ToUmpParser parser;
+  for (size_t message = 0; message < packets / 16 + 1; message++) {
+    size_t start = corpus.sysEx.size();
+    corpus.sysEx.push_back(0xF0);
+    int length = uniform(1, 256);
+    for (int i = 0; i < length; i++) corpus.sysEx.push_back((uint8_t)uniform(0, 127));
+    corpus.sysEx.push_back(0xF7);
+    parser.feed(corpus.sysEx.data() + start, corpus.sysEx.size() - start, [&corpus](const uint32_t* words, size_t count) {
+      corpus.sysExPackets.insert(corpus.sysExPackets.end(), words, words + count);
+    });
+  }
+
+  return corpus;
+}
+
+// ============================================================================
+// Timing
+// ============================================================================
+
+struct BenchOptions {
+  uint32_t seed = 20240601;
+  size_t packets = 65536;
+  int trials = 7;
+  double minMs = 50.0;
+};
+
+struct Result {
+  std::string kernel;
+  std::string variant;
+  size_t packets;
+  size_t bytes;
+  double nsPerPacket;
+  double bytesPerSecond;
+  uint64_t checksum;
+};
+
+static uint64_t checksumWords(const uint32_t* words, size_t count) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < count; i++) {
+    hash ^= words[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t checksumBytes(const uint8_t* bytes, size_t count) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < count; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/**
+ * Runs `pass` (one pass over the input) enough times per trial to exceed
+ * minMs and keeps the median trial. `digest` checksums the output of a
+ * pass and is kept out of the timing.
+ */
+static Result measure(const BenchOptions& options, const char* kernel, const char* variant,
+                      size_t packets, size_t bytes, const std::function<void()>& pass,
+                      const std::function<uint64_t()>& digest) {
+  pass();
+  uint64_t checksum = digest();
+
+  std::vector<double> trials;
+  for (int trial = 0; trial < options.trials; trial++) {
+    size_t passes = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsedNs = 0.0;
+    do {
+      pass();
+      passes++;
+      elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    } while (elapsedNs < options.minMs * 1e6);
+    trials.push_back(elapsedNs / passes);
+  }
+  std::sort(trials.begin(), trials.end());
+  double passNs = trials[trials.size() / 2];
+
+  Result result;
+  result.kernel = kernel;
+  result.variant = variant;
+  result.packets = packets;
+  result.bytes = bytes;
+  result.nsPerPacket = passNs / packets;
+  result.bytesPerSecond = bytes / (passNs / 1e9);
+  result.checksum = checksum;
+  return result;
+}
+
+// ============================================================================
+// Kernels
+// ============================================================================
+
+static void runKernels(const Corpus& corpus, const BenchOptions& options, std::vector<Result>& results) {
+  const size_t count = corpus.words.size();
+  std::vector<uint32_t> words(count);
+  std::vector<uint8_t> status(count), data1(count), data2(count);
+
+  // Packing
+  results.push_back(measure(options, "ump.pack", "scalar", count, count * 3, [&]() {
+    ump::kernels::packMidi1Scalar(corpus.status.data(), corpus.data1.data(), corpus.data2.data(), count, 0, words.data());
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+#if UMP_KERNELS_SSE2
+  results.push_back(measure(options, "ump.pack", "sse2", count, count * 3, [&]() {
+    ump::kernels::packMidi1Sse2(corpus.status.data(), corpus.data1.data(), corpus.data2.data(), count, 0, words.data());
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+#endif
+
+  results.push_back(measure(options, "ump.unpack", "scalar", count, count * 4, [&]() {
+    ump::kernels::unpackMidi1Scalar(corpus.words.data(), count, status.data(), data1.data(), data2.data());
+  }, [&]() {
+    return checksumBytes(status.data(), count) ^ checksumBytes(data1.data(), count) ^ checksumBytes(data2.data(), count);
+  }));
+#if UMP_KERNELS_SSE2
+  results.push_back(measure(options, "ump.unpack", "sse2", count, count * 4, [&]() {
+    ump::kernels::unpackMidi1Sse2(corpus.words.data(), count, status.data(), data1.data(), data2.data());
+  }, [&]() {
+    return checksumBytes(status.data(), count) ^ checksumBytes(data1.data(), count) ^ checksumBytes(data2.data(), count);
+  }));
+#endif
+
+  // Translators
+  std::vector<uint32_t> translatedWords;
+  translatedWords.reserve(count * 2);
+  results.push_back(measure(options, "midi1-to-ump", "scalar", count, corpus.bytes.size(), [&]() {
+    ump::Midi1ToUmpParser parser;
+    translatedWords.clear();
+    parser.feed(corpus.bytes.data(), corpus.bytes.size(), [&](const uint32_t* packet, size_t length) {
+      translatedWords.insert(translatedWords.end(), packet, packet + length);
+    });
+  }, [&]() {
+    return checksumWords(translatedWords.data(), translatedWords.size());
+  }));
+
+  std::vector<uint8_t> translatedBytes;
+  translatedBytes.reserve(count * 12);
+  results.push_back(measure(options, "ump-to-midi1", "scalar", corpus.mixedPackets, corpus.mixed.size() * 4, [&]() {
+    ump::UmpToMidi1Translator translator;
+    translatedBytes.clear();
+    translator.feed(corpus.mixed.data(), corpus.mixed.size(), [&](uint8_t, const uint8_t* bytes, size_t length) {
+      translatedBytes.insert(translatedBytes.end(), bytes, bytes + length);
+    });
+  }, [&]() {
+    return checksumBytes(translatedBytes.data(), translatedBytes.size());
+  }));
+
+  // SysEx
+  size_t sysExPackets = corpus.sysExPackets.size() / 2;
+  results.push_back(measure(options, "sysex.segment", "scalar", sysExPackets, corpus.sysEx.size(), [&]() {
+    ump::Midi1ToUmpParser parser;
+    translatedWords.clear();
+    parser.feed(corpus.sysEx.data(), corpus.sysEx.size(), [&](const uint32_t* packet, size_t length) {
+      translatedWords.insert(translatedWords.end(), packet, packet + length);
+    });
+  }, [&]() {
+    return checksumWords(translatedWords.data(), translatedWords.size());
+  }));
+  results.push_back(measure(options, "sysex.reassemble", "scalar", sysExPackets, corpus.sysExPackets.size() * 4, [&]() {
+    ump::UmpToMidi1Translator translator;
+    translatedBytes.clear();
+    translator.feed(corpus.sysExPackets.data(), corpus.sysExPackets.size(), [&](uint8_t, const uint8_t* bytes, size_t length) {
+      translatedBytes.insert(translatedBytes.end(), bytes, bytes + length);
+    });
+  }, [&]() {
+    return checksumBytes(translatedBytes.data(), translatedBytes.size());
+  }));
+
+  // Scale quantisation, C major
+  bool inScale[128] = {};
+  const int major[7] = { 0, 2, 4, 5, 7, 9, 11 };
+  for (int octave = 0; octave < 11; octave++) {
+    for (int interval : major) {
+      int note = octave * 12 + interval;
+      if (note < 128) inScale[note] = true;
+    }
+  }
+  uint8_t table[128];
+  ump::kernels::buildQuantizeTable(inScale, table);
+
+  results.push_back(measure(options, "scale.quantize", "search", count, count * 4, [&]() {
+    ump::kernels::quantizeNotesSearch(corpus.words.data(), words.data(), count, inScale);
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+  results.push_back(measure(options, "scale.quantize", "table", count, count * 4, [&]() {
+    ump::kernels::quantizeNotesTable(corpus.words.data(), words.data(), count, table);
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+
+  // Transform chain
+  ump::kernels::NoteTransform transform;
+  transform.transpose = 7;
+  transform.velocityScale = 96;
+  for (uint8_t channel = 0; channel < 16; channel++) transform.channelMap[channel] = (channel + 1) & 0x0F;
+
+  // One stage per transformer, each sees every message, as in the JS chain
+  std::vector<std::function<uint32_t(uint32_t)>> stages;
+  ump::kernels::NoteTransform transposeOnly, velocityOnly, channelOnly;
+  transposeOnly.transpose = transform.transpose;
+  velocityOnly.velocityScale = transform.velocityScale;
+  memcpy(channelOnly.channelMap, transform.channelMap, sizeof(channelOnly.channelMap));
+  for (const ump::kernels::NoteTransform* stage : { &transposeOnly, &velocityOnly, &channelOnly }) {
+    stages.push_back([stage](uint32_t word) { return ump::kernels::transformNote(word, *stage); });
+  }
+
+  results.push_back(measure(options, "transform.chain", "staged", count, count * 4, [&]() {
+    for (size_t i = 0; i < count; i++) {
+      uint32_t word = corpus.words[i];
+      for (const auto& stage : stages) word = stage(word);
+      words[i] = word;
+    }
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+  results.push_back(measure(options, "transform.chain", "fused", count, count * 4, [&]() {
+    ump::kernels::transformNotesScalar(corpus.words.data(), words.data(), count, transform);
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+#if UMP_KERNELS_SSE2
+  results.push_back(measure(options, "transform.chain", "fused-sse2", count, count * 4, [&]() {
+    ump::kernels::transformNotesSse2(corpus.words.data(), words.data(), count, transform);
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+#endif
+
+  // Value scaling, 7-bit data bytes to 32 bits and back
+  std::vector<uint32_t> values(corpus.data2.begin(), corpus.data2.end());
+  std::vector<uint32_t> scaled(count), unscaled(count);
+  ump::kernels::upscaleValuesScalar(values.data(), scaled.data(), count, 7, 32);
+  results.push_back(measure(options, "scale.upscale", "scalar", count, count * 4, [&]() {
+    ump::kernels::upscaleValuesScalar(values.data(), words.data(), count, 7, 32);
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+#if UMP_KERNELS_SSE2
+  results.push_back(measure(options, "scale.upscale", "sse2", count, count * 4, [&]() {
+    ump::kernels::upscaleValuesSse2(values.data(), words.data(), count, 7, 32);
+  }, [&]() {
+    return checksumWords(words.data(), count);
+  }));
+#endif
+  results.push_back(measure(options, "scale.downscale", "scalar", count, count * 4, [&]() {
+    ump::kernels::downscaleValuesScalar(scaled.data(), unscaled.data(), count, 32, 7);
+  }, [&]() {
+    return checksumWords(unscaled.data(), count);
+  }));
+
+  // Protocol translation of the MIDI 1.0 packets and back
+  std::vector<uint32_t> midi2Words(count * 2), midi1Words(count * 4);
+  size_t midi2Count = ump::kernels::midi1ToMidi2Scalar(corpus.words.data(), count, midi2Words.data());
+  size_t midi1Count = 0;
+  results.push_back(measure(options, "protocol.midi1-to-midi2", "scalar", count, count * 4, [&]() {
+    midi2Count = ump::kernels::midi1ToMidi2Scalar(corpus.words.data(), count, midi2Words.data());
+  }, [&]() {
+    return checksumWords(midi2Words.data(), midi2Count);
+  }));
+#if UMP_KERNELS_SSE2
+  results.push_back(measure(options, "protocol.midi1-to-midi2", "sse2", count, count * 4, [&]() {
+    midi2Count = ump::kernels::midi1ToMidi2Sse2(corpus.words.data(), count, midi2Words.data());
+  }, [&]() {
+    return checksumWords(midi2Words.data(), midi2Count);
+  }));
+#endif
+  results.push_back(measure(options, "protocol.midi2-to-midi1", "scalar", count, midi2Count * 4, [&]() {
+    midi1Count = ump::kernels::midi2ToMidi1Scalar(midi2Words.data(), midi2Count, midi1Words.data());
+  }, [&]() {
+    return checksumWords(midi1Words.data(), midi1Count);
+  }));
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "[MIDI2] Missing value for " << flag << std::endl;
+      return false;
+    }
+    const char* value = argv[++i];
+    if (flag == "--seed") options.seed = (uint32_t)strtoul(value, nullptr, 10);
+    else if (flag == "--packets") options.packets = (size_t)strtoul(value, nullptr, 10);
+    else if (flag == "--trials") options.trials = atoi(value);
+    else if (flag == "--min-ms") options.minMs = atof(value);
+    else {
+      std::cerr << "[MIDI2] Unknown option " << flag << std::endl;
+      return false;
+    }
+  }
+  if (options.packets == 0 || options.trials < 1) {
+    std::cerr << "[MIDI2] --packets and --trials must be positive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) return 1;
+
+  Corpus corpus = buildCorpus(options.seed, options.packets);
+  std::vector<Result> results;
+  runKernels(corpus, options, results);
+
+  printf("{\n  \"benchmark\": \"midi2-microbench\",\n");
+  printf("  \"options\": {\"seed\": %u, \"packets\": %zu, \"trials\": %d, \"minMs\": %.1f, \"sse2\": %s},\n",
+         options.seed, options.packets, options.trials, options.minMs, UMP_KERNELS_SSE2 ? "true" : "false");
+  printf("  \"results\": [");
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& result = results[i];
+    // Every variant must reproduce the first variant's output
+    const Result* reference = &result;
+    for (const Result& other : results) {
+      if (other.kernel == result.kernel) {
+        reference = &other;
+        break;
+      }
+    }
+    printf("%s\n    {\"kernel\": \"%s\", \"variant\": \"%s\", \"packets\": %zu, \"bytes\": %zu, "
+           "\"nsPerPacket\": %.3f, \"bytesPerSecond\": %.0f, \"speedup\": %.2f, \"matchesReference\": %s}",
+           i == 0 ? "" : ",", result.kernel.c_str(), result.variant.c_str(), result.packets, result.bytes,
+           result.nsPerPacket, result.bytesPerSecond, reference->nsPerPacket / result.nsPerPacket,
+           result.checksum == reference->checksum ? "true" : "false");
+  }
+  printf("\n  ]\n}\n");
+
+  // A mismatching variant fails the run so scripts notice
+  for (const Result& result : results) {
+    for (const Result& other : results) {
+      if (other.kernel == result.kernel && other.checksum != result.checksum) return 2;
+    }
+  }
+  return 0;
+}
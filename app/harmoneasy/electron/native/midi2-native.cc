@@ -15,596 +15,3045 @@
  */
 
 #include <node_api.h>
-#include <iostream>
-#include <vector>
-#include <map>
-#include <cstring>
-#include <memory>
-
-#ifdef _WIN32
-  #include <windows.h>
-  #include <mmsystem.h>
-  #pragma comment(lib, "winmm.lib")
-  #pragma comment(lib, "ole32.lib")
-  #pragma comment(lib, "runtimeobject.lib")
-  
-  // Windows MIDI Services SDK (Windows 11+ with SDK runtime)
-  // See: https://aka.ms/midi
-  // The SDK headers are installed via the Windows MIDI Services App SDK Runtime
-  // which can be downloaded from the official releases
-  #if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0A00
-    // Future: Include official Microsoft.Windows.Devices.Midi2 headers when
-    // available in build environment. For now, use WinRT projection headers.
-    // This requires Windows MIDI Services SDK runtime to be installed:
-    // - Microsoft.Windows.Devices.Midi2.Initialization.hpp
-    // - Microsoft.Windows.Devices.Midi2.Messages.hpp
-    // - Microsoft.Windows.Devices.Midi2.Diagnostics.hpp
-    #define WINDOWS_MIDI_SERVICES_AVAILABLE 1
-  #else
-    #define WINDOWS_MIDI_SERVICES_AVAILABLE 0
-  #endif
-#elif __APPLE__
-  #include <CoreMIDI/CoreMIDI.h>
-  #include <CoreFoundation/CoreFoundation.h>
-#elif __linux__
-  #if __has_include(<alsa/asoundlib.h>)
-    #include <alsa/asoundlib.h>
-    #define HAS_ALSA 1
-  #else
-    #define HAS_ALSA 0
-  #endif
-#endif
+
+#include "midi2-core.h"
 
 // ============================================================================
-// MIDI 2.0 UMP Packet Utilities
+// NAPI Implementations
 // ============================================================================
 
-struct MIDIDevice {
-  uint32_t index;
-  char name[256];
-  int isInput;
-  void* handle;
+static napi_threadsafe_function deviceChangeCallback = nullptr;
+
+static void CallDeviceChange(napi_env env, napi_value callback, void* context, void* data) {
+  DeviceChange* change = (DeviceChange*)data;
+  
+  if (env != nullptr && callback != nullptr) {
+    napi_value event;
+    napi_create_object(env, &event);
+    
+    napi_value index;
+    napi_create_uint32(env, change->device.index, &index);
+    napi_set_named_property(env, event, "deviceIndex", index);
+    
+    char idBuffer[24];
+    formatDeviceId(change->device.id, idBuffer, sizeof(idBuffer));
+    napi_value id;
+    napi_create_string_utf8(env, idBuffer, NAPI_AUTO_LENGTH, &id);
+    napi_set_named_property(env, event, "deviceId", id);
+    
+    napi_value name;
+    napi_create_string_utf8(env, change->device.name, NAPI_AUTO_LENGTH, &name);
+    napi_set_named_property(env, event, "name", name);
+    
+    napi_value direction;
+    napi_create_string_utf8(env, change->device.isInput ? "input" : "output", NAPI_AUTO_LENGTH, &direction);
+    napi_set_named_property(env, event, "direction", direction);
+    
+    napi_value changeType;
+    napi_create_string_utf8(env, change->connected ? "connected" : "disconnected", NAPI_AUTO_LENGTH, &changeType);
+    napi_set_named_property(env, event, "changeType", changeType);
+    
+    napi_value global;
+    napi_get_global(env, &global);
+    napi_call_function(env, global, callback, 1, &event, nullptr);
+  }
+  
+  delete change;
+}
+
+static napi_value DevicesToArray(napi_env env, const std::vector<MIDIDevice>& devices) {
+  napi_value result;
+  napi_create_array(env, &result);
+  
+  for (size_t i = 0; i < devices.size(); i++) {
+    napi_value device;
+    napi_create_object(env, &device);
+    
+    napi_value index;
+    napi_create_uint32(env, devices[i].index, &index);
+    napi_set_named_property(env, device, "index", index);
+    
+    // 64-bit ids travel as hex strings so they survive JSON transport
+    char idBuffer[24];
+    formatDeviceId(devices[i].id, idBuffer, sizeof(idBuffer));
+    napi_value id;
+    napi_create_string_utf8(env, idBuffer, NAPI_AUTO_LENGTH, &id);
+    napi_set_named_property(env, device, "id", id);
+    
+    napi_value name;
+    napi_create_string_utf8(env, devices[i].name, NAPI_AUTO_LENGTH, &name);
+    napi_set_named_property(env, device, "name", name);
+    
+    // Ports of one multi-port interface share a subdeviceCount above 1
+    napi_value subdevice;
+    napi_create_int32(env, devices[i].subdevice < 0 ? 0 : devices[i].subdevice, &subdevice);
+    napi_set_named_property(env, device, "subdevice", subdevice);
+    
+    napi_value subdeviceCount;
+    napi_create_int32(env, devices[i].subdeviceCount, &subdeviceCount);
+    napi_set_named_property(env, device, "subdeviceCount", subdeviceCount);
+    
+    napi_set_element(env, result, i, device);
+  }
+  
+  return result;
+}
+
+napi_value GetUmpOutputs(napi_env env, napi_callback_info info) {
+  std::lock_guard<std::mutex> lock(DeviceRegistry::mutex);
+  DeviceRegistry::ensurePopulated();
+  return DevicesToArray(env, midiOutputs);
+}
+
+napi_value GetUmpInputs(napi_env env, napi_callback_info info) {
+  std::lock_guard<std::mutex> lock(DeviceRegistry::mutex);
+  DeviceRegistry::ensurePopulated();
+  return DevicesToArray(env, midiInputs);
+}
+
+struct EnumerationWork {
+  napi_async_work work;
+  napi_deferred deferred;
+  std::vector<MIDIDevice> outputs;
+  std::vector<MIDIDevice> inputs;
+  double durationMs;
 };
 
-static std::vector<MIDIDevice> midiOutputs;
-static std::vector<MIDIDevice> midiInputs;
+static void ExecuteEnumeration(napi_env env, void* data) {
+  EnumerationWork* enumeration = (EnumerationWork*)data;
+  auto start = std::chrono::steady_clock::now();
+  
+  // A full rescan also refreshes the cache and reports any changes
+  DeviceRegistry::rescan();
+  DeviceRegistry::snapshot(enumeration->outputs, enumeration->inputs);
+  
+  enumeration->durationMs = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+}
 
-// ============================================================================
-// Platform-Specific Implementations
-// ============================================================================
+static void CompleteEnumeration(napi_env env, napi_status status, void* data) {
+  EnumerationWork* enumeration = (EnumerationWork*)data;
+  
+  if (status == napi_ok) {
+    napi_value result;
+    napi_create_object(env, &result);
+    napi_set_named_property(env, result, "outputs", DevicesToArray(env, enumeration->outputs));
+    napi_set_named_property(env, result, "inputs", DevicesToArray(env, enumeration->inputs));
+    
+    napi_value duration;
+    napi_create_double(env, enumeration->durationMs, &duration);
+    napi_set_named_property(env, result, "durationMs", duration);
+    
+    napi_resolve_deferred(env, enumeration->deferred, result);
+  } else {
+    napi_value message, error;
+    napi_create_string_utf8(env, "Device enumeration failed", NAPI_AUTO_LENGTH, &message);
+    napi_create_error(env, nullptr, message, &error);
+    napi_reject_deferred(env, enumeration->deferred, error);
+  }
+  
+  napi_delete_async_work(env, enumeration->work);
+  delete enumeration;
+}
 
-#ifdef _WIN32
-
-// Windows MIDI 2.0 Implementation (Windows 11+) with WinMM fallback
-class WindowsMIDIManager {
-private:
-  static bool useWindowsMIDIServices;
-  static void* windowsMIDISession;
-  static std::map<uint32_t, HMIDIOUT> openHandles;
-  
-public:
-  static bool detectWindowsMIDIServices() {
-    #if WINDOWS_MIDI_SERVICES_AVAILABLE
-      try {
-        // Check if Windows MIDI Services runtime is available by checking registry
-        // or attempting CoCreateInstance on MIDI service class
-        std::cout << "[MIDI2] Windows MIDI Services support detected" << std::endl;
-        return true;
-      } catch (...) {
-        std::cout << "[MIDI2] Windows MIDI Services not available, using WinMM" << std::endl;
-        return false;
-      }
-    #else
-      std::cout << "[MIDI2] Using WinMM API (Windows MIDI Services requires Windows 11+)" << std::endl;
-      return false;
-    #endif
+/**
+ * Enumerate inputs and outputs on a worker thread.
+ * Resolves to { outputs, inputs, durationMs }.
+ */
+napi_value GetUmpDevicesAsync(napi_env env, napi_callback_info info) {
+  EnumerationWork* enumeration = new EnumerationWork();
+  
+  napi_value promise;
+  napi_create_promise(env, &enumeration->deferred, &promise);
+  
+  napi_value resourceName;
+  napi_create_string_utf8(env, "midi2:enumerate", NAPI_AUTO_LENGTH, &resourceName);
+  napi_create_async_work(env, nullptr, resourceName, ExecuteEnumeration, CompleteEnumeration,
+                         enumeration, &enumeration->work);
+  napi_queue_async_work(env, enumeration->work);
+  
+  return promise;
+}
+
+/**
+ * Resolve a device argument, either a stable id string from getUmpOutputs()
+ * or (for older callers) a position in the current listing.
+ * Must be called with the registry mutex held.
+ */
+static const MIDIDevice* ResolveDevice(napi_env env, napi_value arg, const std::vector<MIDIDevice>& devices) {
+  napi_valuetype type;
+  napi_typeof(env, arg, &type);
+  
+  if (type == napi_string) {
+    char buffer[24];
+    size_t length = 0;
+    napi_get_value_string_utf8(env, arg, buffer, sizeof(buffer), &length);
+    char* end = nullptr;
+    uint64_t id = strtoull(buffer, &end, 16);
+    if (length == 0 || *end != '\0') return nullptr;
+    return DeviceRegistry::findById(devices, id);
   }
   
-  static void enumerateOutputs() {
-    midiOutputs.clear();
-    
-    // Prefer Windows MIDI Services if available
-    if (useWindowsMIDIServices && WINDOWS_MIDI_SERVICES_AVAILABLE) {
-      try {
-        #if WINDOWS_MIDI_SERVICES_AVAILABLE
-        // Windows MIDI Services enumeration would go here
-        // For now, fall back to WinMM as WinRT integration requires event loop
-        #endif
-      } catch (...) {
-        useWindowsMIDIServices = false;
+  uint32_t deviceIndex = 0;
+  if (napi_get_value_uint32(env, arg, &deviceIndex) != napi_ok || deviceIndex >= devices.size()) {
+    return nullptr;
+  }
+  return &devices[deviceIndex];
+}
+
+static bool GetToken(napi_env env, napi_value arg, uint32_t& token) {
+  return napi_get_value_uint32(env, arg, &token) == napi_ok;
+}
+
+/**
+ * Shared by openUmpOutput and openUmpInput: takes a pooled handle on the
+ * device and returns { handle, deviceId, deviceIndex, deviceName,
+ * jitterReduction }.
+ * With { multiPort: true } every subdevice of the device's interface is
+ * opened behind the one handle and UMP group N is written to subdevice N.
+ * With { jitterReduction: true } an output puts a JR Timestamp of each
+ * message's intended send time in front of it and keeps JR Clocks going,
+ * and an input takes received JR Timestamps out of the stream and reports
+ * the messages after them at the sender's time, mapped onto ours. Only
+ * ports that carry UMP as is can take it, today the loopback ports; on any
+ * other port it throws UNSUPPORTED rather than opening without it.
+ */
+static napi_value OpenDevice(napi_env env, napi_callback_info info, int isInput) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  if (argc < 1) {
+    napi_throw_error(env, "INVALID_ARGS", "Device id required");
+    return nullptr;
+  }
+  
+  bool multiPort = false;
+  bool jitterReduction = false;
+  if (argc >= 2) {
+    napi_valuetype optionsType;
+    napi_typeof(env, argv[1], &optionsType);
+    if (optionsType == napi_object) {
+      napi_value value;
+      if (napi_get_named_property(env, argv[1], "multiPort", &value) == napi_ok) {
+        napi_get_value_bool(env, value, &multiPort);
       }
-    }
-    
-    // Fall back to WinMM API
-    UINT numDevices = midiOutGetNumDevs();
-    
-    for (UINT i = 0; i < numDevices; i++) {
-      MIDIOUTCAPS caps;
-      if (midiOutGetDevCaps(i, &caps, sizeof(caps)) == MMSYSERR_NOERROR) {
-        MIDIDevice device;
-        device.index = i;
-        device.isInput = 0;
-        strncpy_s(device.name, sizeof(device.name), caps.szPname, _TRUNCATE);
-        device.handle = nullptr;
-        midiOutputs.push_back(device);
+      if (napi_get_named_property(env, argv[1], "jitterReduction", &value) == napi_ok) {
+        napi_get_value_bool(env, value, &jitterReduction);
       }
     }
   }
   
-  static void enumerateInputs() {
-    midiInputs.clear();
-    
-    // Prefer Windows MIDI Services if available
-    if (useWindowsMIDIServices && WINDOWS_MIDI_SERVICES_AVAILABLE) {
-      try {
-        #if WINDOWS_MIDI_SERVICES_AVAILABLE
-        // Windows MIDI Services enumeration would go here
-        #endif
-      } catch (...) {
-        useWindowsMIDIServices = false;
-      }
+  MIDIDevice device;
+  std::vector<MIDIDevice> ports;
+  {
+    std::lock_guard<std::mutex> lock(DeviceRegistry::mutex);
+    DeviceRegistry::ensurePopulated();
+    const std::vector<MIDIDevice>& devices = isInput ? midiInputs : midiOutputs;
+    const MIDIDevice* found = ResolveDevice(env, argv[0], devices);
+    if (found == nullptr) {
+      napi_throw_error(env, "INVALID_DEVICE", isInput ? "Unknown MIDI input device" : "Unknown MIDI output device");
+      return nullptr;
     }
+    device = *found;
     
-    // Fall back to WinMM API
-    UINT numDevices = midiInGetNumDevs();
-    
-    for (UINT i = 0; i < numDevices; i++) {
-      MIDIINCAPS caps;
-      if (midiInGetDevCaps(i, &caps, sizeof(caps)) == MMSYSERR_NOERROR) {
-        MIDIDevice device;
-        device.index = i;
-        device.isInput = 1;
-        strncpy_s(device.name, sizeof(device.name), caps.szPname, _TRUNCATE);
-        device.handle = nullptr;
-        midiInputs.push_back(device);
+    // Subdevices are listed in order, so ports[N] is subdevice N
+    if (multiPort && !isInput && device.card >= 0) {
+      for (const MIDIDevice& other : devices) {
+        if (other.card == device.card && other.device == device.device &&
+            ports.size() < OpenHandle::MAX_TARGETS) {
+          ports.push_back(other);
+        }
       }
     }
+    if (ports.empty()) ports.push_back(device);
+  }
+  
+  // Hardware ports are written as MIDI 1.0 bytes, which have no room for JR
+  if (jitterReduction && !device.isVirtual) {
+    napi_throw_error(env, "UNSUPPORTED", "Jitter Reduction needs a port that carries UMP, such as a loopback port");
+    return nullptr;
   }
   
-  static MMRESULT openOutput(uint32_t deviceIndex, HMIDIOUT& handle) {
-    return midiOutOpen(&handle, deviceIndex, 0, 0, CALLBACK_NULL);
+  PooledHandle* targets[OpenHandle::MAX_TARGETS];
+  uint8_t groupTarget[16];
+  uint8_t targetCount = 0;
+  for (uint8_t group = 0; group < 16; group++) {
+    groupTarget[group] = ports.size() > 1 ? OpenHandle::NO_TARGET : 0;
   }
   
-  static MMRESULT sendData(HMIDIOUT handle, const uint8_t* data, size_t length) {
-    if (length == 4) {
-      // MIDI 2.0 UMP packet (4 bytes) - 32-bit word
-      // Format: byte0 byte1 byte2 byte3
-      // Interpreted as little-endian 32-bit value for WinMM
-      uint32_t msg = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
-      MMRESULT result = midiOutShortMsg(handle, msg);
-      if (result == MMSYSERR_NOERROR) {
-        std::cout << "[MIDI2] Sent UMP (32-bit): 0x" << std::hex << msg << std::endl;
-      }
-      return result;
-    } else if (length == 3) {
-      // Legacy MIDI 1.0 message (3 bytes) - compatible mode
-      uint32_t msg = data[0] | (data[1] << 8) | (data[2] << 16);
-      MMRESULT result = midiOutShortMsg(handle, msg);
-      if (result == MMSYSERR_NOERROR) {
-        std::cout << "[MIDI2] Sent MIDI 1.0: 0x" << std::hex << msg << std::endl;
-      }
-      return result;
+  for (const MIDIDevice& port : ports) {
+    PooledHandle* pooled = nullptr;
+    int error = HandlePool::acquire(port, pooled);
+    if (error < 0) {
+#if __linux__ && HAS_ALSA
+      MIDI2_LOG_ERROR("Failed to open %s: %s", port.address, snd_strerror(error));
+#else
+      MIDI2_LOG_ERROR("Failed to open %s. Error: %d", port.name, -error);
+#endif
+      for (uint8_t i = 0; i < targetCount; i++) HandlePool::release(targets[i]);
+      napi_throw_error(env, "OPEN_FAILED", isInput ? "Failed to open MIDI input device" : "Failed to open MIDI output device");
+      return nullptr;
     }
-    return MMSYSERR_ERROR;
+    if (ports.size() > 1 && port.subdevice >= 0 && port.subdevice < 16) {
+      groupTarget[port.subdevice] = targetCount;
+    }
+    targets[targetCount++] = pooled;
   }
-};
+  
+  uint32_t token = HandleTable::allocate(targets, targetCount, groupTarget, jitterReduction);
+  if (token == 0) {
+    for (uint8_t i = 0; i < targetCount; i++) HandlePool::release(targets[i]);
+    napi_throw_error(env, "TOO_MANY_HANDLES", "Too many open MIDI devices");
+    return nullptr;
+  }
+  
+  napi_value resultObj;
+  napi_create_object(env, &resultObj);
+  
+  napi_value handleValue;
+  napi_create_uint32(env, token, &handleValue);
+  napi_set_named_property(env, resultObj, "handle", handleValue);
+  
+  char idBuffer[24];
+  formatDeviceId(device.id, idBuffer, sizeof(idBuffer));
+  napi_value id;
+  napi_create_string_utf8(env, idBuffer, NAPI_AUTO_LENGTH, &id);
+  napi_set_named_property(env, resultObj, "deviceId", id);
+  
+  napi_value idx;
+  napi_create_uint32(env, device.index, &idx);
+  napi_set_named_property(env, resultObj, "deviceIndex", idx);
+  
+  napi_value name;
+  napi_create_string_utf8(env, device.name, NAPI_AUTO_LENGTH, &name);
+  napi_set_named_property(env, resultObj, "deviceName", name);
+  
+  napi_value jitterReduced;
+  napi_get_boolean(env, HandleTable::resolve(token)->jitterReduction, &jitterReduced);
+  napi_set_named_property(env, resultObj, "jitterReduction", jitterReduced);
+  
+  return resultObj;
+}
+
+static napi_value CloseDevice(napi_env env, napi_callback_info info, int isInput) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint32_t token;
+  if (argc < 1 || !GetToken(env, argv[0], token)) return nullptr;
+  
+  OpenHandle* slot = HandleTable::resolve(token);
+  if (slot == nullptr || slot->isInput != isInput) return nullptr;
+  
+  // Notes still down would hang on the synth once nothing can release them
+  if (!isInput) HandleTable::withSlot(token, ReleaseHeldNotes);
+  HandleTable::release(token);
+  return nullptr;
+}
+
+napi_value OpenUmpOutput(napi_env env, napi_callback_info info) {
+  return OpenDevice(env, info, 0);
+}
+
+napi_value CloseUmpOutput(napi_env env, napi_callback_info info) {
+  return CloseDevice(env, info, 0);
+}
+
+napi_value OpenUmpInput(napi_env env, napi_callback_info info) {
+  return OpenDevice(env, info, 1);
+}
 
-// Static member initialization
-bool WindowsMIDIManager::useWindowsMIDIServices = WindowsMIDIManager::detectWindowsMIDIServices();
-void* WindowsMIDIManager::windowsMIDISession = nullptr;
-std::map<uint32_t, HMIDIOUT> WindowsMIDIManager::openHandles;
+napi_value CloseUmpInput(napi_env env, napi_callback_info info) {
+  return CloseDevice(env, info, 1);
+}
 
-#elif __APPLE__
+/**
+ * Set how long an unreferenced device handle stays open before it is closed
+ */
+napi_value SetHandleIdleTimeout(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  int64_t milliseconds;
+  if (argc < 1 || napi_get_value_int64(env, argv[0], &milliseconds) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Timeout in milliseconds required");
+    return nullptr;
+  }
+  
+  HandlePool::setIdleTimeout(milliseconds);
+  return nullptr;
+}
 
-// CoreMIDI Implementation for macOS
-class MacMIDIManager {
-private:
-  static MIDIClientRef midiClient;
-  static MIDIPortRef outputPort;
-  static bool initialized;
+/**
+ * Create, reconfigure or (with ports: 0) remove the in-process loopback
+ * ports: configureVirtualPorts({ ports, latencyMs, jitterMs, baudRate,
+ * seed, exclusive }). Listings update immediately and device change
+ * listeners are notified as for hotplug.
+ */
+napi_value ConfigureVirtualPorts(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
   
-  static bool ensureInitialized() {
-    if (initialized) return midiClient != 0;
-    
-    OSStatus status = MIDIClientCreate(
-      CFSTR("HarmonEasy MIDI Client"),
-      nullptr,  // notifyProc
-      nullptr,  // notifyRefCon
-      &midiClient
-    );
-    
-    if (status != noErr) {
-      std::cerr << "Failed to create MIDI client: " << status << std::endl;
-      return false;
+  napi_valuetype type = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &type);
+  if (type != napi_object) {
+    napi_throw_error(env, "INVALID_ARGS", "Options object required");
+    return nullptr;
+  }
+  
+  auto getNumber = [&](const char* key, double fallback) {
+    bool has = false;
+    napi_has_named_property(env, argv[0], key, &has);
+    if (!has) return fallback;
+    napi_value value;
+    double number = fallback;
+    napi_get_named_property(env, argv[0], key, &value);
+    if (napi_get_value_double(env, value, &number) != napi_ok) return fallback;
+    return number;
+  };
+  
+  vmidi::LoopbackConfig config;
+  double ports = getNumber("ports", 1);
+  if (ports < 0 || ports > 64) {
+    napi_throw_error(env, "INVALID_ARGS", "ports must be between 0 and 64");
+    return nullptr;
+  }
+  config.ports = (uint32_t)ports;
+  config.latencyMs = std::max(0.0, getNumber("latencyMs", 0));
+  config.jitterMs = std::max(0.0, getNumber("jitterMs", 0));
+  config.baudRate = (uint32_t)std::max(0.0, getNumber("baudRate", 0));
+  config.seed = (uint32_t)getNumber("seed", 1);
+  
+  bool hasExclusive = false;
+  napi_has_named_property(env, argv[0], "exclusive", &hasExclusive);
+  if (hasExclusive) {
+    napi_value value;
+    napi_get_named_property(env, argv[0], "exclusive", &value);
+    napi_get_value_bool(env, value, &config.exclusive);
+  }
+  
+  vmidi::Loopback::configure(config, VirtualMIDIManager::deliver);
+  DeviceRegistry::rescan();
+  return nullptr;
+}
+
+// Resolves an output token for the send functions, throwing when unusable
+static OpenHandle* ResolveOutput(napi_env env, uint32_t token) {
+  OpenHandle* slot = HandleTable::resolve(token);
+  if (slot == nullptr || slot->isInput) {
+    napi_throw_error(env, "DEVICE_NOT_OPEN", "Device not open. Call openUmpOutput first.");
+    return nullptr;
+  }
+  
+  if (!slot->connected) {
+    napi_throw_error(env, "DEVICE_DISCONNECTED", "Device has been disconnected");
+    return nullptr;
+  }
+  return slot;
+}
+
+napi_value SendUmp(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  if (argc < 2) {
+    napi_throw_error(env, "INVALID_ARGS", "Device handle and UMP packet required");
+    return nullptr;
+  }
+  
+  uint64_t enqueueNs = monotonicNanoseconds();
+  uint32_t token, packet;
+  napi_get_value_uint32(env, argv[0], &token);
+  napi_get_value_uint32(env, argv[1], &packet);
+  
+  OpenHandle* slot = ResolveOutput(env, token);
+  if (slot == nullptr) return nullptr;
+  
+  if (!WriteUmp(*slot, &packet, 1, enqueueNs)) {
+    napi_throw_error(env, "SEND_FAILED", "Failed to send MIDI message");
+  }
+  
+  return nullptr;
+}
+
+/**
+ * Send a run of UMP words (Uint32Array or array of numbers) in one call.
+ * On a multi-port handle each group goes to its subdevice and every port
+ * receives a single write for the whole batch.
+ */
+napi_value SendUmpBatch(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint64_t enqueueNs = monotonicNanoseconds();
+  uint32_t token;
+  if (argc < 2 || !GetToken(env, argv[0], token)) {
+    napi_throw_error(env, "INVALID_ARGS", "Device handle and UMP words required");
+    return nullptr;
+  }
+  
+  std::vector<uint32_t> copied;
+  const uint32_t* words = nullptr;
+  size_t count = 0;
+  
+  bool isTypedArray = false;
+  napi_is_typedarray(env, argv[1], &isTypedArray);
+  if (isTypedArray) {
+    napi_typedarray_type type;
+    void* data = nullptr;
+    napi_get_typedarray_info(env, argv[1], &type, &count, &data, nullptr, nullptr);
+    if (type != napi_uint32_array) {
+      napi_throw_error(env, "INVALID_ARGS", "UMP words must be a Uint32Array");
+      return nullptr;
+    }
+    words = (const uint32_t*)data;
+  } else {
+    bool isArray = false;
+    napi_is_array(env, argv[1], &isArray);
+    if (!isArray) {
+      napi_throw_error(env, "INVALID_ARGS", "UMP words must be a Uint32Array or an array");
+      return nullptr;
+    }
+    uint32_t length = 0;
+    napi_get_array_length(env, argv[1], &length);
+    copied.resize(length);
+    for (uint32_t i = 0; i < length; i++) {
+      napi_value element;
+      napi_get_element(env, argv[1], i, &element);
+      napi_get_value_uint32(env, element, &copied[i]);
+    }
+    words = copied.data();
+    count = copied.size();
+  }
+  
+  OpenHandle* slot = ResolveOutput(env, token);
+  if (slot == nullptr) return nullptr;
+  
+  if (count > 0 && !WriteUmp(*slot, words, count, enqueueNs)) {
+    napi_throw_error(env, "SEND_FAILED", "Failed to send MIDI messages");
+  }
+  
+  return nullptr;
+}
+
+/**
+ * Build note on/off packets for a whole array of note descriptors in one
+ * call, ready for sendUmpBatch():
+ *   encodeNotes([{ note, velocity, channel = 0, group, off = false }, ...],
+ *               { protocol: 'midi1' | 'midi2' = 'midi2', group = 0 }) -> Uint32Array
+ * Velocity is 0-127 for MIDI 1.0 packets and 0-65535 for MIDI 2.0 packets.
+ */
+napi_value EncodeNotes(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  bool isArray = false;
+  if (argc >= 1) napi_is_array(env, argv[0], &isArray);
+  if (!isArray) {
+    napi_throw_error(env, "INVALID_ARGS", "Array of note descriptors required");
+    return nullptr;
+  }
+  
+  bool midi2 = true;
+  uint32_t defaultGroup = 0;
+  napi_valuetype optionsType = napi_undefined;
+  if (argc >= 2) napi_typeof(env, argv[1], &optionsType);
+  if (optionsType == napi_object) {
+    napi_value value;
+    char protocol[8] = "";
+    if (napi_get_named_property(env, argv[1], "protocol", &value) == napi_ok &&
+        napi_get_value_string_utf8(env, value, protocol, sizeof(protocol), nullptr) == napi_ok) {
+      midi2 = strcmp(protocol, "midi1") != 0;
     }
+    if (napi_get_named_property(env, argv[1], "group", &value) == napi_ok) napi_get_value_uint32(env, value, &defaultGroup);
+  }
+  
+  // Property keys are created once rather than once per note
+  napi_value keyNote, keyVelocity, keyChannel, keyGroup, keyOff;
+  napi_create_string_utf8(env, "note", NAPI_AUTO_LENGTH, &keyNote);
+  napi_create_string_utf8(env, "velocity", NAPI_AUTO_LENGTH, &keyVelocity);
+  napi_create_string_utf8(env, "channel", NAPI_AUTO_LENGTH, &keyChannel);
+  napi_create_string_utf8(env, "group", NAPI_AUTO_LENGTH, &keyGroup);
+  napi_create_string_utf8(env, "off", NAPI_AUTO_LENGTH, &keyOff);
+  
+  auto getUint = [env](napi_value object, napi_value key, uint32_t fallback) {
+    napi_value value;
+    uint32_t result = fallback;
+    if (napi_get_property(env, object, key, &value) != napi_ok) return fallback;
+    if (napi_get_value_uint32(env, value, &result) != napi_ok) return fallback;
+    return result;
+  };
+  
+  uint32_t length = 0;
+  napi_get_array_length(env, argv[0], &length);
+  size_t wordsPerNote = midi2 ? 2 : 1;
+  
+  void* data = nullptr;
+  napi_value arrayBuffer, result;
+  napi_create_arraybuffer(env, length * wordsPerNote * sizeof(uint32_t), &data, &arrayBuffer);
+  uint32_t* words = (uint32_t*)data;
+  
+  for (uint32_t i = 0; i < length; i++) {
+    napi_value descriptor;
+    napi_get_element(env, argv[0], i, &descriptor);
     
-    status = MIDIOutputPortCreate(
-      midiClient,
-      CFSTR("HarmonEasy Output"),
-      &outputPort
-    );
+    uint8_t note = (uint8_t)std::min<uint32_t>(getUint(descriptor, keyNote, 60), 127);
+    uint8_t channel = (uint8_t)(getUint(descriptor, keyChannel, 0) & 0xF);
+    uint8_t group = (uint8_t)(getUint(descriptor, keyGroup, defaultGroup) & 0xF);
+    uint32_t velocity = getUint(descriptor, keyVelocity, midi2 ? 0xFFFF : 127);
+    bool off = false;
+    napi_value offValue;
+    if (napi_get_property(env, descriptor, keyOff, &offValue) == napi_ok) napi_get_value_bool(env, offValue, &off);
     
-    if (status != noErr) {
-      std::cerr << "Failed to create output port: " << status << std::endl;
-      return false;
+    if (midi2) {
+      uint16_t velocity16 = (uint16_t)std::min<uint32_t>(velocity, 0xFFFF);
+      ump::Packet<2> packet = off ? ump::midi2::noteOff(group, channel, note, velocity16)
+                                  : ump::midi2::noteOn(group, channel, note, velocity16);
+      words[i * 2] = packet[0];
+      words[i * 2 + 1] = packet[1];
+    } else {
+      uint8_t velocity7 = (uint8_t)std::min<uint32_t>(velocity, 127);
+      words[i] = off ? ump::midi1::noteOff(group, channel, note, velocity7)
+                     : ump::midi1::noteOn(group, channel, note, velocity7);
     }
-    
-    initialized = true;
-    return true;
   }
   
-public:
-  static void cleanup() {
-    if (midiClient != 0) {
-      MIDIClientDispose(midiClient);
-      midiClient = 0;
-    }
-    initialized = false;
-  }
+  napi_create_typedarray(env, napi_uint32_array, length * wordsPerNote, arrayBuffer, 0, &result);
+  return result;
+}
+
+/**
+ * Play an array of notes with their note-offs scheduled natively:
+ *   playNotes(device, Uint32Array notes, Float64Array durations, Float64Array offsets?)
+ * `notes` holds MIDI 1.0 or 2.0 channel voice packets, e.g. from
+ * encodeNotes(). Each note-on sounds `offsets[i]` ms from now (a strum,
+ * 0 when omitted) for `durations[i]` ms, indexes counting packets. Other
+ * packets go out at their offset as they are. A note still held when it
+ * is struck again is released just before the new note-on, and the older
+ * note's pending note-off is dropped.
+ */
+napi_value PlayNotes(napi_env env, napi_callback_info info) {
+  size_t argc = 4;
+  napi_value argv[4];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint64_t nowNs = monotonicNanoseconds();
+  uint32_t token;
+  if (argc < 3 || !GetToken(env, argv[0], token)) {
+    napi_throw_error(env, "INVALID_ARGS", "Device handle, notes and durations required");
+    return nullptr;
+  }
+  
+  auto getArray = [env](napi_value value, napi_typedarray_type expected, size_t& length) -> void* {
+    bool isTypedArray = false;
+    napi_is_typedarray(env, value, &isTypedArray);
+    if (!isTypedArray) return nullptr;
+    napi_typedarray_type type;
+    void* data = nullptr;
+    napi_get_typedarray_info(env, value, &type, &length, &data, nullptr, nullptr);
+    return type == expected ? data : nullptr;
+  };
+  
+  size_t wordCount = 0, durationCount = 0, offsetCount = 0;
+  const uint32_t* words = (const uint32_t*)getArray(argv[1], napi_uint32_array, wordCount);
+  const double* durations = (const double*)getArray(argv[2], napi_float64_array, durationCount);
+  const double* offsets = nullptr;
+  napi_valuetype offsetsType = napi_undefined;
+  if (argc >= 4) napi_typeof(env, argv[3], &offsetsType);
+  if (offsetsType != napi_undefined && offsetsType != napi_null) {
+    offsets = (const double*)getArray(argv[3], napi_float64_array, offsetCount);
+    if (offsets == nullptr) {
+      napi_throw_error(env, "INVALID_ARGS", "Offsets must be a Float64Array");
+      return nullptr;
+    }
+  }
+  if (words == nullptr || durations == nullptr) {
+    napi_throw_error(env, "INVALID_ARGS", "Notes must be a Uint32Array and durations a Float64Array");
+    return nullptr;
+  }
+  
+  size_t packets = 0;
+  for (size_t i = 0; i < wordCount; i += ump::packetWordsOf(words[i])) packets++;
+  if (durationCount < packets || (offsets != nullptr && offsetCount < packets)) {
+    napi_throw_error(env, "INVALID_ARGS", "Durations and offsets need one entry per packet");
+    return nullptr;
+  }
+  
+  if (ResolveOutput(env, token) == nullptr) return nullptr;
+  
+  auto toNs = [](double ms) { return ms > 0 && std::isfinite(ms) ? (uint64_t)(ms * 1e6) : 0; };
+  size_t index = 0;
+  for (size_t i = 0; i < wordCount; index++) {
+    uint8_t size = ump::packetWordsOf(words[i]);
+    if (i + size > wordCount) break;
+    uint64_t onNs = nowNs + toNs(offsets != nullptr ? offsets[index] : 0);
+    // Owner 0 is never cancelled, a note-off is always left to release its
+    // note; panic() drops the note-ons alone through cancelNotes()
+    Scheduler::scheduleNote(0, token, onNs, onNs + toNs(durations[index]), words + i, size);
+    i += size;
+  }
+  
+  napi_value result;
+  napi_create_uint32(env, (uint32_t)index, &result);
+  return result;
+}
+
+/**
+ * Release the notes and sustain pedals held on one output, or on every open
+ * output when called without a handle:
+ *   panic(device?) -> number of messages sent
+ * Note-ons still queued by playNotes() are dropped first, so a strum under
+ * way stops too. Only what is actually down is released, one note-off per
+ * held note and a pedal release per held pedal, in a single write per output.
+ */
+napi_value Panic(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype type = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &type);
+  
+  size_t released = 0;
+  if (type == napi_undefined || type == napi_null) {
+    Scheduler::cancelNotes(0);
+    released = ReleaseAllHeldNotes();
+  } else {
+    uint32_t token;
+    if (!GetToken(env, argv[0], token)) {
+      napi_throw_error(env, "INVALID_ARGS", "Device handle required");
+      return nullptr;
+    }
+    if (ResolveOutput(env, token) == nullptr) return nullptr;
+    Scheduler::cancelNotes(token);
+    HandleTable::withSlot(token, [&released](OpenHandle& slot) {
+      released = ReleaseHeldNotes(slot);
+    });
+  }
+  
+  napi_value result;
+  napi_create_uint32(env, (uint32_t)released, &result);
+  return result;
+}
+
+/**
+ * Runtime counters of every open port: traffic in both directions, short
+ * writes, EAGAIN retries, drops, driver queue depth and its high-water mark,
+ * and a log2 histogram of send latency from the JS call to the driver write.
+ * Counters are cumulative, callers diff successive snapshots for rates.
+ */
+napi_value GetStats(napi_env env, napi_callback_info info) {
+  std::vector<PortStatsSnapshot> ports;
+  CollectPortStats(ports);
+  
+  std::vector<MIDIDevice> outputs, inputs;
+  DeviceRegistry::snapshot(outputs, inputs);
+  
+  napi_value result;
+  napi_create_array(env, &result);
+  
+  for (size_t i = 0; i < ports.size(); i++) {
+    const PortStatsSnapshot& port = ports[i];
+    napi_value entry;
+    napi_create_object(env, &entry);
+    
+    auto setNumber = [&](const char* key, double number) {
+      napi_value value;
+      napi_create_double(env, number, &value);
+      napi_set_named_property(env, entry, key, value);
+    };
+    auto setString = [&](const char* key, const char* text) {
+      napi_value value;
+      napi_create_string_utf8(env, text, NAPI_AUTO_LENGTH, &value);
+      napi_set_named_property(env, entry, key, value);
+    };
+    
+    char idBuffer[24];
+    formatDeviceId(port.deviceId, idBuffer, sizeof(idBuffer));
+    setString("id", idBuffer);
+    const MIDIDevice* device = DeviceRegistry::findById(port.isInput ? inputs : outputs, port.deviceId);
+    setString("name", device != nullptr ? device->name : "");
+    setString("direction", port.isInput ? "input" : "output");
+    setString("address", port.address);
+    
+    napi_value isVirtual;
+    napi_get_boolean(env, port.isVirtual, &isVirtual);
+    napi_set_named_property(env, entry, "virtual", isVirtual);
+    
+    setNumber("refs", port.refs);
+    setNumber("packetsSent", (double)port.packetsSent);
+    setNumber("bytesSent", (double)port.bytesSent);
+    setNumber("packetsReceived", (double)port.packetsReceived);
+    setNumber("bytesReceived", (double)port.bytesReceived);
+    setNumber("shortWrites", (double)port.shortWrites);
+    setNumber("retries", (double)port.retries);
+    setNumber("drops", (double)port.drops);
+    setNumber("queueDepth", (double)port.queueDepth);
+    setNumber("queueHighWater", (double)port.queueHighWater);
+    setNumber("latencyP50Us", port.latencyPercentileNs(0.5) / 1000.0);
+    setNumber("latencyP99Us", port.latencyPercentileNs(0.99) / 1000.0);
+    
+    // Bucket N counts latencies from 2^N up to 2^(N+1) nanoseconds
+    napi_value histogram;
+    napi_create_array_with_length(env, PortStats::LATENCY_BUCKETS, &histogram);
+    for (int bucket = 0; bucket < PortStats::LATENCY_BUCKETS; bucket++) {
+      napi_value count;
+      napi_create_double(env, (double)port.latency[bucket], &count);
+      napi_set_element(env, histogram, bucket, count);
+    }
+    napi_set_named_property(env, entry, "latencyHistogram", histogram);
+    
+    napi_set_element(env, result, i, entry);
+  }
+  
+  return result;
+}
+
+/**
+ * Record inputs and outputs into a MIDI Clip File:
+ *   startCapture(path, { sources: [{ id, direction: 'input' | 'output', group }],
+ *                        ticksPerQuarterNote = 960, tempo = 120 })
+ * Returns a capture id for stopCapture(). Writing happens on a background
+ * thread and memory use does not grow with the length of the recording.
+ */
+napi_value StartCapture(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype pathType = napi_undefined, optionsType = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &pathType);
+  if (argc >= 2) napi_typeof(env, argv[1], &optionsType);
+  if (pathType != napi_string || optionsType != napi_object) {
+    napi_throw_error(env, "INVALID_ARGS", "File path and capture options required");
+    return nullptr;
+  }
+  
+  size_t pathLength = 0;
+  napi_get_value_string_utf8(env, argv[0], nullptr, 0, &pathLength);
+  std::string path(pathLength, '\0');
+  napi_get_value_string_utf8(env, argv[0], &path[0], pathLength + 1, &pathLength);
+  
+  auto getNumber = [&](napi_value object, const char* key, double fallback) {
+    bool has = false;
+    napi_has_named_property(env, object, key, &has);
+    if (!has) return fallback;
+    napi_value value;
+    double number = fallback;
+    napi_get_named_property(env, object, key, &value);
+    napi_get_value_double(env, value, &number);
+    return number;
+  };
+  
+  double ticksPerQuarter = getNumber(argv[1], "ticksPerQuarterNote", 960);
+  double tempo = getNumber(argv[1], "tempo", 120);
+  if (ticksPerQuarter < 1 || ticksPerQuarter > 65535 || tempo <= 0 || tempo > 1000) {
+    napi_throw_error(env, "INVALID_ARGS", "ticksPerQuarterNote must be 1-65535 and tempo 0-1000 BPM");
+    return nullptr;
+  }
+  
+  napi_value sourceArray;
+  bool isArray = false;
+  napi_get_named_property(env, argv[1], "sources", &sourceArray);
+  napi_is_array(env, sourceArray, &isArray);
+  uint32_t sourceCount = 0;
+  if (isArray) napi_get_array_length(env, sourceArray, &sourceCount);
+  if (sourceCount == 0) {
+    napi_throw_error(env, "INVALID_ARGS", "At least one capture source required");
+    return nullptr;
+  }
+  
+  std::vector<CaptureSource> sources;
+  {
+    std::lock_guard<std::mutex> lock(DeviceRegistry::mutex);
+    DeviceRegistry::ensurePopulated();
+    for (uint32_t i = 0; i < sourceCount; i++) {
+      napi_value entry, idValue, directionValue;
+      napi_get_element(env, sourceArray, i, &entry);
+      napi_get_named_property(env, entry, "id", &idValue);
+      napi_get_named_property(env, entry, "direction", &directionValue);
+      
+      char direction[8] = "";
+      size_t length = 0;
+      napi_get_value_string_utf8(env, directionValue, direction, sizeof(direction), &length);
+      int isInput = strcmp(direction, "input") == 0 ? 1 : 0;
+      
+      const MIDIDevice* device = ResolveDevice(env, idValue, isInput ? midiInputs : midiOutputs);
+      if (device == nullptr) {
+        napi_throw_error(env, "INVALID_DEVICE", "Unknown capture source");
+        return nullptr;
+      }
+      
+      CaptureSource source;
+      source.deviceId = device->id;
+      source.isInput = isInput;
+      source.group = (int)getNumber(entry, "group", -1);
+      if (source.group > 15) source.group = -1;
+      sources.push_back(source);
+    }
+  }
+  
+  std::string error;
+  uint32_t id = CaptureManager::start(path, sources, (uint16_t)ticksPerQuarter, tempo, error);
+  if (id == 0) {
+    napi_throw_error(env, "CAPTURE_FAILED", error.c_str());
+    return nullptr;
+  }
+  
+  napi_value result;
+  napi_create_uint32(env, id, &result);
+  return result;
+}
+
+/**
+ * Finish a capture started with startCapture(). Resolves the clip with End
+ * of Clip and returns { path, events, dropped, bytes, durationMs }.
+ */
+napi_value StopCapture(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint32_t id = 0;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &id) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Capture id required");
+    return nullptr;
+  }
+  
+  CaptureManager::Summary summary;
+  std::string error;
+  if (!CaptureManager::stop(id, summary, error)) {
+    napi_throw_error(env, "CAPTURE_FAILED", error.c_str());
+    return nullptr;
+  }
+  
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_create_string_utf8(env, summary.path.c_str(), summary.path.size(), &value);
+  napi_set_named_property(env, result, "path", value);
+  napi_create_double(env, (double)summary.events, &value);
+  napi_set_named_property(env, result, "events", value);
+  napi_create_double(env, (double)summary.dropped, &value);
+  napi_set_named_property(env, result, "dropped", value);
+  napi_create_double(env, (double)summary.bytes, &value);
+  napi_set_named_property(env, result, "bytes", value);
+  napi_create_double(env, summary.durationMs, &value);
+  napi_set_named_property(env, result, "durationMs", value);
+  return result;
+}
+
+/**
+ * Open a Standard MIDI File or MIDI Clip File for playback on an output.
+ * The file is memory-mapped and streamed to the native scheduler a short
+ * lookahead at a time, so timing does not depend on the JS event loop.
+ * Returns { player, format: 'smf' | 'clip', tracks, durationMs }.
+ */
+napi_value OpenPlayer(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype pathType = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &pathType);
+  uint32_t token = 0;
+  if (pathType != napi_string || argc < 2 || napi_get_value_uint32(env, argv[1], &token) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "File path and output handle required");
+    return nullptr;
+  }
+  if (ResolveOutput(env, token) == nullptr) return nullptr;
+  
+  size_t pathLength = 0;
+  napi_get_value_string_utf8(env, argv[0], nullptr, 0, &pathLength);
+  std::string path(pathLength, '\0');
+  napi_get_value_string_utf8(env, argv[0], &path[0], pathLength + 1, &pathLength);
+  
+  std::string error;
+  std::shared_ptr<Player> player = PlaybackManager::open(path, token, error);
+  if (!player) {
+    napi_throw_error(env, "PLAYER_FAILED", error.c_str());
+    return nullptr;
+  }
+  
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_create_uint32(env, player->id, &value);
+  napi_set_named_property(env, result, "player", value);
+  napi_create_string_utf8(env, player->format() == midifile::Format::Clip ? "clip" : "smf", NAPI_AUTO_LENGTH, &value);
+  napi_set_named_property(env, result, "format", value);
+  napi_create_uint32(env, (uint32_t)player->trackCount(), &value);
+  napi_set_named_property(env, result, "tracks", value);
+  napi_create_double(env, player->duration() / 1e6, &value);
+  napi_set_named_property(env, result, "durationMs", value);
+  return result;
+}
+
+// Resolve argv[0] as a player id, throwing if it is not open
+static std::shared_ptr<Player> ResolvePlayer(napi_env env, size_t argc, napi_value* argv) {
+  uint32_t id = 0;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &id) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Player id required");
+    return nullptr;
+  }
+  std::shared_ptr<Player> player = PlaybackManager::find(id);
+  if (!player) napi_throw_error(env, "INVALID_PLAYER", "Player is not open");
+  return player;
+}
+
+napi_value PlayPlayer(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<Player> player = ResolvePlayer(env, argc, argv);
+  if (player) player->play();
+  return nullptr;
+}
+
+// Stop where it is; notes it left sounding get their note-offs and the pedal is lifted
+napi_value PausePlayer(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<Player> player = ResolvePlayer(env, argc, argv);
+  if (player) player->pause();
+  return nullptr;
+}
+
+// seekPlayer(player, positionMs), keeps playing if it was
+napi_value SeekPlayer(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<Player> player = ResolvePlayer(env, argc, argv);
+  if (!player) return nullptr;
+  
+  double positionMs = 0;
+  if (argc < 2 || napi_get_value_double(env, argv[1], &positionMs) != napi_ok || positionMs < 0) {
+    napi_throw_error(env, "INVALID_ARGS", "Position in milliseconds required");
+    return nullptr;
+  }
+  player->seek((uint64_t)(positionMs * 1e6));
+  return nullptr;
+}
+
+// setPlayerLoop(player, startMs, endMs), an end at or before the start clears the loop
+napi_value SetPlayerLoop(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<Player> player = ResolvePlayer(env, argc, argv);
+  if (!player) return nullptr;
+  
+  double startMs = 0, endMs = 0;
+  if (argc < 3 || napi_get_value_double(env, argv[1], &startMs) != napi_ok ||
+      napi_get_value_double(env, argv[2], &endMs) != napi_ok || startMs < 0 || endMs < 0) {
+    napi_throw_error(env, "INVALID_ARGS", "Loop start and end in milliseconds required");
+    return nullptr;
+  }
+  player->setLoop((uint64_t)(startMs * 1e6), (uint64_t)(endMs * 1e6));
+  return nullptr;
+}
+
+// Returns { playing, positionMs }
+napi_value GetPlayerState(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<Player> player = ResolvePlayer(env, argc, argv);
+  if (!player) return nullptr;
+  
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_get_boolean(env, player->isPlaying(), &value);
+  napi_set_named_property(env, result, "playing", value);
+  napi_create_double(env, player->position() / 1e6, &value);
+  napi_set_named_property(env, result, "positionMs", value);
+  return result;
+}
+
+napi_value ClosePlayer(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint32_t id = 0;
+  if (argc >= 1 && napi_get_value_uint32(env, argv[0], &id) == napi_ok) PlaybackManager::close(id);
+  return nullptr;
+}
+
+/**
+ * Read the outputs of a timing source: handles from openUmpOutput() or
+ * { device, offsetMs = 0, group = 0 }. Throws and returns false when one
+ * is not an open output.
+ */
+static bool GetTimingOutputs(napi_env env, napi_value array, std::vector<TimingOutput>& outputs) {
+  bool isArray = false;
+  if (array != nullptr) napi_is_array(env, array, &isArray);
+  if (!isArray) {
+    napi_throw_error(env, "INVALID_ARGS", "Array of output handles required");
+    return false;
+  }
+  
+  uint32_t length = 0;
+  napi_get_array_length(env, array, &length);
+  for (uint32_t i = 0; i < length; i++) {
+    napi_value element, value;
+    napi_get_element(env, array, i, &element);
+    
+    TimingOutput output = {};
+    napi_valuetype type = napi_undefined;
+    napi_typeof(env, element, &type);
+    napi_value device = element;
+    if (type == napi_object) {
+      napi_get_named_property(env, element, "device", &device);
+      double offsetMs = 0;
+      uint32_t group = 0;
+      if (napi_get_named_property(env, element, "offsetMs", &value) == napi_ok &&
+          napi_get_value_double(env, value, &offsetMs) == napi_ok && std::isfinite(offsetMs)) {
+        output.offsetNs = (int64_t)(offsetMs * 1e6);
+      }
+      if (napi_get_named_property(env, element, "group", &value) == napi_ok &&
+          napi_get_value_uint32(env, value, &group) == napi_ok) {
+        output.group = (uint8_t)(group & 0xF);
+      }
+    }
+    if (!GetToken(env, device, output.token)) {
+      napi_throw_error(env, "INVALID_ARGS", "Output handle required");
+      return false;
+    }
+    if (ResolveOutput(env, output.token) == nullptr) return false;
+    outputs.push_back(output);
+  }
+  return true;
+}
+
+/**
+ * Open a MIDI clock master on a set of outputs. Each output is a handle
+ * from openUmpOutput() or { device, offsetMs = 0, group = 0 }:
+ *   openClock(outputs, { bpm = 120, swing = 0.5 }) -> { clock }
+ * Clock, Start, Stop, Continue and Song Position are generated on the
+ * native scheduler, with every tick timed from the tempo map rather than
+ * from the previous tick.
+ */
+napi_value OpenClock(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::vector<TimingOutput> outputs;
+  if (!GetTimingOutputs(env, argc >= 1 ? argv[0] : nullptr, outputs)) return nullptr;
+  
+  double bpm = 120, swing = 0.5;
+  napi_valuetype optionsType = napi_undefined;
+  if (argc >= 2) napi_typeof(env, argv[1], &optionsType);
+  if (optionsType == napi_object) {
+    napi_value value;
+    if (napi_get_named_property(env, argv[1], "bpm", &value) == napi_ok) napi_get_value_double(env, value, &bpm);
+    if (napi_get_named_property(env, argv[1], "swing", &value) == napi_ok) napi_get_value_double(env, value, &swing);
+  }
+  if (!std::isfinite(bpm)) bpm = 120;
+  if (!std::isfinite(swing)) swing = 0.5;
+  
+  std::shared_ptr<ClockGenerator> clock = ClockManager::open(outputs, bpm, swing);
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_create_uint32(env, clock->id, &value);
+  napi_set_named_property(env, result, "clock", value);
+  return result;
+}
+
+// Resolve argv[0] as a clock id, throwing if it is not open
+static std::shared_ptr<ClockGenerator> ResolveClock(napi_env env, size_t argc, napi_value* argv) {
+  uint32_t id = 0;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &id) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Clock id required");
+    return nullptr;
+  }
+  std::shared_ptr<ClockGenerator> clock = ClockManager::find(id);
+  if (!clock) napi_throw_error(env, "INVALID_CLOCK", "Clock is not open");
+  return clock;
+}
+
+// Start from song position 0
+napi_value StartClock(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<ClockGenerator> clock = ResolveClock(env, argc, argv);
+  if (clock) clock->start();
+  return nullptr;
+}
+
+// Continue from where the clock stopped, or from setClockPosition()
+napi_value ContinueClock(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<ClockGenerator> clock = ResolveClock(env, argc, argv);
+  if (clock) clock->resume();
+  return nullptr;
+}
+
+napi_value StopClock(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<ClockGenerator> clock = ResolveClock(env, argc, argv);
+  if (clock) clock->stop();
+  return nullptr;
+}
+
+// setClockTempo(clock, bpm, rampMs = 0), a ramp moves linearly to the new tempo
+napi_value SetClockTempo(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<ClockGenerator> clock = ResolveClock(env, argc, argv);
+  if (!clock) return nullptr;
+  
+  double bpm = 0, rampMs = 0;
+  if (argc < 2 || napi_get_value_double(env, argv[1], &bpm) != napi_ok || !std::isfinite(bpm) || bpm <= 0) {
+    napi_throw_error(env, "INVALID_ARGS", "Tempo in BPM required");
+    return nullptr;
+  }
+  if (argc >= 3) napi_get_value_double(env, argv[2], &rampMs);
+  clock->setTempo(bpm, rampMs);
+  return nullptr;
+}
+
+// setClockSwing(clock, amount), 0.5 straight to 0.75
+napi_value SetClockSwing(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<ClockGenerator> clock = ResolveClock(env, argc, argv);
+  if (!clock) return nullptr;
+  
+  double amount = 0.5;
+  if (argc < 2 || napi_get_value_double(env, argv[1], &amount) != napi_ok || !std::isfinite(amount)) {
+    napi_throw_error(env, "INVALID_ARGS", "Swing amount required");
+    return nullptr;
+  }
+  clock->setSwing(amount);
+  return nullptr;
+}
+
+// setClockPosition(clock, sixteenths), sends Song Position Pointer; stopped clocks only
+napi_value SetClockPosition(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<ClockGenerator> clock = ResolveClock(env, argc, argv);
+  if (!clock) return nullptr;
+  
+  uint32_t sixteenths = 0;
+  if (argc < 2 || napi_get_value_uint32(env, argv[1], &sixteenths) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Position in sixteenth notes required");
+    return nullptr;
+  }
+  if (!clock->setPosition(sixteenths)) {
+    napi_throw_error(env, "CLOCK_RUNNING", "Stop the clock before moving its position");
+  }
+  return nullptr;
+}
+
+// Returns { running, bpm, swing, ticks } with ticks at 24 per quarter note
+napi_value GetClockState(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<ClockGenerator> clock = ResolveClock(env, argc, argv);
+  if (!clock) return nullptr;
+  
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_get_boolean(env, clock->isRunning(), &value);
+  napi_set_named_property(env, result, "running", value);
+  napi_create_double(env, clock->tempo(), &value);
+  napi_set_named_property(env, result, "bpm", value);
+  napi_create_double(env, clock->swingAmount(), &value);
+  napi_set_named_property(env, result, "swing", value);
+  napi_create_double(env, (double)clock->position(), &value);
+  napi_set_named_property(env, result, "ticks", value);
+  return result;
+}
+
+// Sends Stop if running
+napi_value CloseClock(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint32_t id = 0;
+  if (argc >= 1 && napi_get_value_uint32(env, argv[0], &id) == napi_ok) ClockManager::close(id);
+  return nullptr;
+}
+
+// Sets { seconds, timecode, fps } on `object` for a position in frames
+static void SetTimecodeProperties(napi_env env, napi_value object, double frames, mtc::Rate rate) {
+  char timecode[16];
+  mtc::format(mtc::fromFrames((uint64_t)frames, rate), timecode, sizeof(timecode));
+  napi_value value;
+  napi_create_double(env, frames * mtc::frameSeconds(rate), &value);
+  napi_set_named_property(env, object, "seconds", value);
+  napi_create_string_utf8(env, timecode, NAPI_AUTO_LENGTH, &value);
+  napi_set_named_property(env, object, "timecode", value);
+  napi_create_double(env, mtc::framesPerSecond(rate), &value);
+  napi_set_named_property(env, object, "fps", value);
+}
+
+/**
+ * Open an MTC master on a set of outputs, given as for openClock():
+ *   openMtc(outputs, { fps: 24 | 25 | 29.97 | 30 = 25 }) -> { mtc }
+ * 29.97 is drop-frame. Quarter frames are generated on the native
+ * scheduler while running.
+ */
+napi_value OpenMtc(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::vector<TimingOutput> outputs;
+  if (!GetTimingOutputs(env, argc >= 1 ? argv[0] : nullptr, outputs)) return nullptr;
+  
+  double fps = 25;
+  napi_valuetype optionsType = napi_undefined;
+  if (argc >= 2) napi_typeof(env, argv[1], &optionsType);
+  if (optionsType == napi_object) {
+    napi_value value;
+    if (napi_get_named_property(env, argv[1], "fps", &value) == napi_ok) napi_get_value_double(env, value, &fps);
+  }
+  mtc::Rate rate;
+  if (fps == 24) rate = mtc::Rate::Fps24;
+  else if (fps == 25) rate = mtc::Rate::Fps25;
+  else if (fps == 30) rate = mtc::Rate::Fps30;
+  else if (std::fabs(fps - 29.97) < 0.01) rate = mtc::Rate::Fps2997Drop;
+  else {
+    napi_throw_error(env, "INVALID_ARGS", "fps must be 24, 25, 29.97 or 30");
+    return nullptr;
+  }
+  
+  std::shared_ptr<MtcGenerator> generator = MtcManager::open(outputs, rate);
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_create_uint32(env, generator->id, &value);
+  napi_set_named_property(env, result, "mtc", value);
+  return result;
+}
+
+// Resolve argv[0] as an MTC generator id, throwing if it is not open
+static std::shared_ptr<MtcGenerator> ResolveMtc(napi_env env, size_t argc, napi_value* argv) {
+  uint32_t id = 0;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &id) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "MTC generator id required");
+    return nullptr;
+  }
+  std::shared_ptr<MtcGenerator> generator = MtcManager::find(id);
+  if (!generator) napi_throw_error(env, "INVALID_MTC", "MTC generator is not open");
+  return generator;
+}
+
+napi_value StartMtc(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<MtcGenerator> generator = ResolveMtc(env, argc, argv);
+  if (generator) generator->start();
+  return nullptr;
+}
+
+napi_value StopMtc(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<MtcGenerator> generator = ResolveMtc(env, argc, argv);
+  if (generator) generator->stop();
+  return nullptr;
+}
+
+// locateMtc(mtc, seconds), sends a full frame message and carries on from there if running
+napi_value LocateMtc(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<MtcGenerator> generator = ResolveMtc(env, argc, argv);
+  if (!generator) return nullptr;
+  
+  double seconds = 0;
+  if (argc < 2 || napi_get_value_double(env, argv[1], &seconds) != napi_ok || !std::isfinite(seconds) || seconds < 0) {
+    napi_throw_error(env, "INVALID_ARGS", "Position in seconds required");
+    return nullptr;
+  }
+  generator->locate((uint64_t)(seconds * mtc::framesPerSecond(generator->frameRate()) + 1e-6));
+  return nullptr;
+}
+
+// Returns { running, seconds, timecode, fps }
+napi_value GetMtcState(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::shared_ptr<MtcGenerator> generator = ResolveMtc(env, argc, argv);
+  if (!generator) return nullptr;
+  
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_get_boolean(env, generator->isRunning(), &value);
+  napi_set_named_property(env, result, "running", value);
+  SetTimecodeProperties(env, result, generator->position(), generator->frameRate());
+  return result;
+}
+
+napi_value CloseMtc(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint32_t id = 0;
+  if (argc >= 1 && napi_get_value_uint32(env, argv[0], &id) == napi_ok) MtcManager::close(id);
+  return nullptr;
+}
+
+// Bytes of an ArrayBuffer, Buffer or any typed array, without copying
+static bool GetBytes(napi_env env, napi_value value, const uint8_t*& bytes, size_t& length) {
+  bool is = false;
+  void* data = nullptr;
+  napi_is_arraybuffer(env, value, &is);
+  if (is) {
+    napi_get_arraybuffer_info(env, value, &data, &length);
+    bytes = (const uint8_t*)data;
+    return true;
+  }
+  napi_is_typedarray(env, value, &is);
+  if (is) {
+    napi_typedarray_type type;
+    size_t elements = 0;
+    napi_value arrayBuffer;
+    size_t offset = 0;
+    napi_get_typedarray_info(env, value, &type, &elements, &data, &arrayBuffer, &offset);
+    static const size_t elementBytes[] = { 1, 1, 1, 2, 2, 4, 4, 4, 8, 8, 8 };
+    length = elements * ((size_t)type < sizeof(elementBytes) / sizeof(elementBytes[0]) ? elementBytes[type] : 1);
+    bytes = (const uint8_t*)data;
+    return true;
+  }
+  return false;
+}
+
+// A typed array of `type` holding a copy of `count` elements
+template<typename T>
+static napi_value CreateTypedArray(napi_env env, napi_typedarray_type type, const std::vector<T>& values) {
+  void* data = nullptr;
+  napi_value arrayBuffer, result;
+  napi_create_arraybuffer(env, values.size() * sizeof(T), &data, &arrayBuffer);
+  if (!values.empty()) memcpy(data, values.data(), values.size() * sizeof(T));
+  napi_create_typedarray(env, type, values.size(), arrayBuffer, 0, &result);
+  return result;
+}
+
+// Elements of a Uint32Array, without copying
+static bool GetUint32Array(napi_env env, napi_value value, const uint32_t*& words, size_t& count) {
+  bool isTypedArray = false;
+  napi_is_typedarray(env, value, &isTypedArray);
+  if (!isTypedArray) return false;
+  napi_typedarray_type type;
+  void* data = nullptr;
+  napi_get_typedarray_info(env, value, &type, &count, &data, nullptr, nullptr);
+  words = (const uint32_t*)data;
+  return type == napi_uint32_array;
+}
+
+// Shared argument handling of upscaleValues() and downscaleValues()
+static napi_value ScaleValues(napi_env env, napi_callback_info info, bool up) {
+  size_t argc = 3;
+  napi_value argv[3];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  const uint32_t* values = nullptr;
+  size_t count = 0;
+  uint32_t sourceBits = 0, targetBits = 0;
+  if (argc < 3 || !GetUint32Array(env, argv[0], values, count) ||
+      napi_get_value_uint32(env, argv[1], &sourceBits) != napi_ok ||
+      napi_get_value_uint32(env, argv[2], &targetBits) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Uint32Array values, source bits and target bits required");
+    return nullptr;
+  }
+  uint32_t narrow = up ? sourceBits : targetBits;
+  uint32_t wide = up ? targetBits : sourceBits;
+  if (narrow < (up ? 2u : 1u) || wide > 32 || narrow > wide) {
+    napi_throw_error(env, "INVALID_ARGS", up ? "Upscaling needs 2 <= source bits <= target bits <= 32"
+                                             : "Downscaling needs 1 <= target bits <= source bits <= 32");
+    return nullptr;
+  }
+  
+  std::vector<uint32_t> scaled(count);
+  if (up) ump::kernels::upscaleValues(values, scaled.data(), count, (uint8_t)sourceBits, (uint8_t)targetBits);
+  else ump::kernels::downscaleValues(values, scaled.data(), count, (uint8_t)sourceBits, (uint8_t)targetBits);
+  return CreateTypedArray(env, napi_uint32_array, scaled);
+}
+
+/**
+ * Min-center-max scaling of MIDI values to a wider resolution, as the
+ * MIDI 1.0 to MIDI 2.0 translation does it:
+ *   upscaleValues(Uint32Array values, sourceBits, targetBits) -> Uint32Array
+ * 7 to 16 bits gives note velocities, 7 to 32 controllers and pressure,
+ * 14 to 32 pitch bend. 0, the centre and the maximum map exactly.
+ */
+napi_value UpscaleValues(napi_env env, napi_callback_info info) {
+  return ScaleValues(env, info, true);
+}
+
+// downscaleValues(values, sourceBits, targetBits), keeping the high bits
+napi_value DownscaleValues(napi_env env, napi_callback_info info) {
+  return ScaleValues(env, info, false);
+}
+
+/**
+ * Translate the channel voice packets of a UMP stream between protocols:
+ *   translateProtocol(Uint32Array words, 'midi2' | 'midi1') -> Uint32Array
+ * To 'midi2', MIDI 1.0 packets become MIDI 2.0 packets with upscaled
+ * values; to 'midi1', MIDI 2.0 packets become MIDI 1.0 ones, bank select
+ * and RPN/NRPN as control change sequences, per-note controllers dropped.
+ * Other packets are copied.
+ */
+napi_value TranslateProtocol(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  const uint32_t* words = nullptr;
+  size_t count = 0;
+  char protocol[8] = "";
+  size_t length = 0;
+  if (argc < 2 || !GetUint32Array(env, argv[0], words, count) ||
+      napi_get_value_string_utf8(env, argv[1], protocol, sizeof(protocol), &length) != napi_ok ||
+      (strcmp(protocol, "midi1") != 0 && strcmp(protocol, "midi2") != 0)) {
+    napi_throw_error(env, "INVALID_ARGS", "Uint32Array words and 'midi1' or 'midi2' required");
+    return nullptr;
+  }
+  
+  std::vector<uint32_t> translated(count * 2);
+  size_t written;
+  if (strcmp(protocol, "midi2") == 0) {
+#if UMP_KERNELS_SSE2
+    written = ump::kernels::midi1ToMidi2Sse2(words, count, translated.data());
+#else
+    written = ump::kernels::midi1ToMidi2Scalar(words, count, translated.data());
+#endif
+  } else {
+    written = ump::kernels::midi2ToMidi1Scalar(words, count, translated.data());
+  }
+  translated.resize(written);
+  return CreateTypedArray(env, napi_uint32_array, translated);
+}
+
+/**
+ * Decode a Standard MIDI File into columns, one row per channel voice
+ * message in playback order, with no per-event JS objects:
+ * { format, ticksPerQuarterNote, tracks, count, time: Float64Array (seconds),
+ *   tick: Uint32Array, track: Uint16Array, type, channel, data1, data2: Uint8Array }
+ * type is the status nibble, 0x9 with data2 0 is a note off as in the file.
+ */
+napi_value DecodeMidiFile(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  const uint8_t* bytes = nullptr;
+  size_t length = 0;
+  if (argc < 1 || !GetBytes(env, argv[0], bytes, length)) {
+    napi_throw_error(env, "INVALID_ARGS", "MIDI file bytes required as an ArrayBuffer or typed array");
+    return nullptr;
+  }
+  
+  midifile::SmfReader reader;
+  midifile::Columns columns;
+  std::string error;
+  if (!midifile::decodeColumns(bytes, length, columns, reader, error)) {
+    napi_throw_error(env, "INVALID_MIDI_FILE", error.c_str());
+    return nullptr;
+  }
+  
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_create_uint32(env, reader.formatType(), &value);
+  napi_set_named_property(env, result, "format", value);
+  napi_create_uint32(env, reader.timeDivision(), &value);
+  napi_set_named_property(env, result, "ticksPerQuarterNote", value);
+  napi_create_uint32(env, (uint32_t)reader.trackCount(), &value);
+  napi_set_named_property(env, result, "tracks", value);
+  napi_create_uint32(env, (uint32_t)columns.size(), &value);
+  napi_set_named_property(env, result, "count", value);
+  napi_set_named_property(env, result, "time", CreateTypedArray(env, napi_float64_array, columns.time));
+  napi_set_named_property(env, result, "tick", CreateTypedArray(env, napi_uint32_array, columns.tick));
+  napi_set_named_property(env, result, "track", CreateTypedArray(env, napi_uint16_array, columns.track));
+  napi_set_named_property(env, result, "type", CreateTypedArray(env, napi_uint8_array, columns.type));
+  napi_set_named_property(env, result, "channel", CreateTypedArray(env, napi_uint8_array, columns.channel));
+  napi_set_named_property(env, result, "data1", CreateTypedArray(env, napi_uint8_array, columns.data1));
+  napi_set_named_property(env, result, "data2", CreateTypedArray(env, napi_uint8_array, columns.data2));
+  return result;
+}
+
+/**
+ * Encode columns in the layout decodeMidiFile() returns as a format 0 file.
+ * Rows are timed by `tick` (Uint32Array) when given, otherwise by `time`
+ * (Float64Array, seconds) at the tempo in options.
+ * encodeMidiFile(columns, { ticksPerQuarterNote = 480, tempo = 120 }) -> Buffer
+ */
+napi_value EncodeMidiFile(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype columnsType = napi_undefined, optionsType = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &columnsType);
+  if (argc >= 2) napi_typeof(env, argv[1], &optionsType);
+  if (columnsType != napi_object) {
+    napi_throw_error(env, "INVALID_ARGS", "Columns object required");
+    return nullptr;
+  }
+  
+  double ticksPerQuarter = 480, tempo = 120;
+  if (optionsType == napi_object) {
+    bool has = false;
+    napi_value value;
+    napi_has_named_property(env, argv[1], "ticksPerQuarterNote", &has);
+    if (has && napi_get_named_property(env, argv[1], "ticksPerQuarterNote", &value) == napi_ok) napi_get_value_double(env, value, &ticksPerQuarter);
+    napi_has_named_property(env, argv[1], "tempo", &has);
+    if (has && napi_get_named_property(env, argv[1], "tempo", &value) == napi_ok) napi_get_value_double(env, value, &tempo);
+  }
+  if (ticksPerQuarter < 1 || ticksPerQuarter > 0x7FFF || tempo < 4 || tempo > 1000) {
+    napi_throw_error(env, "INVALID_ARGS", "ticksPerQuarterNote must be 1-32767 and tempo 4-1000 BPM");
+    return nullptr;
+  }
+  
+  // Looks up a typed array column of the expected type, rows is the shortest seen
+  size_t rows = SIZE_MAX;
+  auto getColumn = [&](const char* name, napi_typedarray_type expected) -> const void* {
+    bool has = false;
+    napi_has_named_property(env, argv[0], name, &has);
+    if (!has) return nullptr;
+    napi_value column;
+    bool isTypedArray = false;
+    napi_get_named_property(env, argv[0], name, &column);
+    napi_is_typedarray(env, column, &isTypedArray);
+    if (!isTypedArray) return nullptr;
+    napi_typedarray_type type;
+    size_t length = 0;
+    void* data = nullptr;
+    napi_get_typedarray_info(env, column, &type, &length, &data, nullptr, nullptr);
+    if (type != expected) return nullptr;
+    if (length < rows) rows = length;
+    // Zero-length columns have no data pointer but are still valid
+    return data != nullptr ? data : (const void*)"";
+  };
+  
+  const uint8_t* types = (const uint8_t*)getColumn("type", napi_uint8_array);
+  const uint8_t* channels = (const uint8_t*)getColumn("channel", napi_uint8_array);
+  const uint8_t* data1 = (const uint8_t*)getColumn("data1", napi_uint8_array);
+  const uint8_t* data2 = (const uint8_t*)getColumn("data2", napi_uint8_array);
+  const uint32_t* ticks = (const uint32_t*)getColumn("tick", napi_uint32_array);
+  const double* times = ticks == nullptr ? (const double*)getColumn("time", napi_float64_array) : nullptr;
+  if (types == nullptr || channels == nullptr || data1 == nullptr || data2 == nullptr || (ticks == nullptr && times == nullptr)) {
+    napi_throw_error(env, "INVALID_ARGS", "type, channel, data1 and data2 must be Uint8Arrays, with tick as a Uint32Array or time as a Float64Array");
+    return nullptr;
+  }
+  
+  std::vector<uint32_t> converted;
+  if (ticks == nullptr) {
+    double ticksPerSecond = ticksPerQuarter * tempo / 60.0;
+    converted.resize(rows);
+    for (size_t i = 0; i < rows; i++) {
+      double tick = times[i] * ticksPerSecond + 0.5;
+      converted[i] = tick <= 0 ? 0 : tick >= 4294967295.0 ? 0xFFFFFFFFu : (uint32_t)tick;
+    }
+    ticks = converted.data();
+  }
+  
+  std::vector<uint8_t> file;
+  midifile::SmfWriter::encode(ticks, types, channels, data1, data2, rows, (uint16_t)ticksPerQuarter,
+                              (uint32_t)(60000000.0 / tempo + 0.5), file);
+  
+  napi_value result;
+  napi_create_buffer_copy(env, file.size(), file.data(), nullptr, &result);
+  return result;
+}
+
+struct ConversionWork {
+  napi_async_work work;
+  napi_deferred deferred;
+  std::string input;
+  std::string output;
+  convert::Target target;
+  unsigned threads;
+  std::vector<convert::Result> results;
+  std::string error;
+  double durationMs;
+};
+
+static void ExecuteConversion(napi_env env, void* data) {
+  ConversionWork* conversion = (ConversionWork*)data;
+  auto start = std::chrono::steady_clock::now();
+  
+  std::vector<convert::Job> jobs;
+  if (convert::collectJobs(conversion->input, conversion->output, conversion->target, jobs, conversion->error)) {
+    if (conversion->threads == 0) conversion->threads = std::max<unsigned>(1, std::thread::hardware_concurrency());
+    conversion->results = convert::run(jobs, conversion->threads);
+  }
+  
+  conversion->durationMs = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+static void CompleteConversion(napi_env env, napi_status status, void* data) {
+  ConversionWork* conversion = (ConversionWork*)data;
+  
+  if (status == napi_ok && conversion->error.empty()) {
+    napi_value result, files, value;
+    napi_create_object(env, &result);
+    napi_create_array_with_length(env, conversion->results.size(), &files);
+    for (size_t i = 0; i < conversion->results.size(); i++) {
+      const convert::Result& converted = conversion->results[i];
+      napi_value file;
+      napi_create_object(env, &file);
+      napi_create_string_utf8(env, converted.input.c_str(), converted.input.size(), &value);
+      napi_set_named_property(env, file, "input", value);
+      napi_create_string_utf8(env, converted.output.c_str(), converted.output.size(), &value);
+      napi_set_named_property(env, file, "output", value);
+      napi_create_double(env, (double)converted.events, &value);
+      napi_set_named_property(env, file, "events", value);
+      napi_create_double(env, converted.milliseconds, &value);
+      napi_set_named_property(env, file, "durationMs", value);
+      if (!converted.error.empty()) {
+        napi_create_string_utf8(env, converted.error.c_str(), converted.error.size(), &value);
+        napi_set_named_property(env, file, "error", value);
+      }
+      napi_set_element(env, files, (uint32_t)i, file);
+    }
+    napi_set_named_property(env, result, "files", files);
+    napi_create_uint32(env, conversion->threads, &value);
+    napi_set_named_property(env, result, "threads", value);
+    napi_create_double(env, conversion->durationMs, &value);
+    napi_set_named_property(env, result, "durationMs", value);
+    napi_resolve_deferred(env, conversion->deferred, result);
+  } else {
+    napi_value message, error;
+    const char* text = conversion->error.empty() ? "MIDI file conversion failed" : conversion->error.c_str();
+    napi_create_string_utf8(env, text, NAPI_AUTO_LENGTH, &message);
+    napi_create_error(env, nullptr, message, &error);
+    napi_reject_deferred(env, conversion->deferred, error);
+  }
+  
+  napi_delete_async_work(env, conversion->work);
+  delete conversion;
+}
+
+/**
+ * Convert a file or a directory tree between SMF and MIDI Clip File on a
+ * pool of worker threads, off the JS thread.
+ * convertMidiFiles(input, outputDirectory, { to: 'clip' | 'smf', threads })
+ * resolves to { files: [{ input, output, events, durationMs, error? }], threads, durationMs }.
+ * A file that fails is reported with its error, the others still convert.
+ */
+napi_value ConvertMidiFiles(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype inputType = napi_undefined, outputType = napi_undefined, optionsType = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &inputType);
+  if (argc >= 2) napi_typeof(env, argv[1], &outputType);
+  if (argc >= 3) napi_typeof(env, argv[2], &optionsType);
+  if (inputType != napi_string || outputType != napi_string || optionsType != napi_object) {
+    napi_throw_error(env, "INVALID_ARGS", "Input path, output directory and options required");
+    return nullptr;
+  }
+  
+  char to[8] = "";
+  bool has = false;
+  napi_value value;
+  napi_has_named_property(env, argv[2], "to", &has);
+  if (has) {
+    napi_get_named_property(env, argv[2], "to", &value);
+    napi_get_value_string_utf8(env, value, to, sizeof(to), nullptr);
+  }
+  if (strcmp(to, "clip") != 0 && strcmp(to, "smf") != 0) {
+    napi_throw_error(env, "INVALID_ARGS", "options.to must be 'clip' or 'smf'");
+    return nullptr;
+  }
+  
+  ConversionWork* conversion = new ConversionWork();
+  conversion->target = strcmp(to, "clip") == 0 ? convert::Target::Clip : convert::Target::Smf;
+  conversion->threads = 0;
+  napi_has_named_property(env, argv[2], "threads", &has);
+  if (has) {
+    napi_get_named_property(env, argv[2], "threads", &value);
+    napi_get_value_uint32(env, value, &conversion->threads);
+  }
+  
+  size_t length = 0;
+  napi_get_value_string_utf8(env, argv[0], nullptr, 0, &length);
+  conversion->input.resize(length);
+  napi_get_value_string_utf8(env, argv[0], &conversion->input[0], length + 1, &length);
+  napi_get_value_string_utf8(env, argv[1], nullptr, 0, &length);
+  conversion->output.resize(length);
+  napi_get_value_string_utf8(env, argv[1], &conversion->output[0], length + 1, &length);
+  
+  napi_value promise;
+  napi_create_promise(env, &conversion->deferred, &promise);
+  
+  napi_value resourceName;
+  napi_create_string_utf8(env, "midi2:convert", NAPI_AUTO_LENGTH, &resourceName);
+  napi_create_async_work(env, nullptr, resourceName, ExecuteConversion, CompleteConversion,
+                         conversion, &conversion->work);
+  napi_queue_async_work(env, conversion->work);
+  
+  return promise;
+}
+
+/**
+ * Start or stop recording trace events. Returns false when the module was
+ * built without MIDI2_TRACE, in which case nothing is ever recorded.
+ */
+napi_value SetTraceEnabled(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  bool enabled = false;
+  if (argc >= 1) napi_get_value_bool(env, argv[0], &enabled);
+  
+#if MIDI2_TRACE
+  trace::Tracer::setEnabled(enabled);
+#endif
+  
+  napi_value result;
+  napi_get_boolean(env, MIDI2_TRACE != 0, &result);
+  return result;
+}
+
+/**
+ * Recorded trace events as Chrome trace JSON, ready to save as a .json file
+ * and open in chrome://tracing or ui.perfetto.dev. Pass { clear: true } to
+ * start the next dump from an empty buffer.
+ */
+napi_value GetTrace(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  bool clear = false;
+  napi_valuetype type = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &type);
+  if (type == napi_object) {
+    bool hasClear = false;
+    napi_has_named_property(env, argv[0], "clear", &hasClear);
+    if (hasClear) {
+      napi_value value;
+      napi_get_named_property(env, argv[0], "clear", &value);
+      napi_get_value_bool(env, value, &clear);
+    }
+  }
+  
+#if MIDI2_TRACE
+  std::string json = trace::Tracer::toChromeJson();
+  if (clear) trace::Tracer::clear();
+#else
+  std::string json = "{\"traceEvents\":[]}";
+#endif
+  
+  napi_value result;
+  napi_create_string_utf8(env, json.c_str(), json.size(), &result);
+  return result;
+}
+
+napi_value OnDeviceChange(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype type = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &type);
+  
+  if (deviceChangeCallback != nullptr) {
+    DeviceRegistry::setChangeListener(nullptr);
+    napi_release_threadsafe_function(deviceChangeCallback, napi_tsfn_abort);
+    deviceChangeCallback = nullptr;
+  }
+  
+  // Passing anything but a function unsubscribes
+  if (type != napi_function) return nullptr;
+  
+  napi_value resourceName;
+  napi_create_string_utf8(env, "midi2:device-change", NAPI_AUTO_LENGTH, &resourceName);
+  napi_create_threadsafe_function(env, argv[0], nullptr, resourceName, 0, 1,
+                                  nullptr, nullptr, nullptr, CallDeviceChange, &deviceChangeCallback);
+  // Listening for hotplug events must not keep the process alive
+  napi_unref_threadsafe_function(env, deviceChangeCallback);
+  
+  napi_threadsafe_function callback = deviceChangeCallback;
+  DeviceRegistry::setChangeListener([callback](const DeviceChange& change) {
+    napi_call_threadsafe_function(callback, new DeviceChange(change), napi_tsfn_nonblocking);
+  });
+  
+  return nullptr;
+}
+
+struct InputEvent {
+  uint64_t deviceId;
+  uint64_t timestampNs;
+  std::vector<uint32_t> words;
+};
+
+static std::map<uint32_t, napi_threadsafe_function> inputCallbacks;
+
+static void CallUmpInput(napi_env env, napi_value callback, void* context, void* data) {
+  InputEvent* event = (InputEvent*)data;
+  
+  if (env != nullptr && callback != nullptr) {
+    char idBuffer[24];
+    formatDeviceId(event->deviceId, idBuffer, sizeof(idBuffer));
+    
+    napi_value argv[3];
+    napi_create_string_utf8(env, idBuffer, NAPI_AUTO_LENGTH, &argv[0]);
+    napi_create_double(env, event->timestampNs / 1e6, &argv[2]);
+    
+    napi_value global;
+    napi_get_global(env, &global);
+    for (uint32_t word : event->words) {
+      napi_create_uint32(env, word, &argv[1]);
+      napi_call_function(env, global, callback, 3, argv, nullptr);
+    }
+  }
+  
+  delete event;
+}
+
+/**
+ * Subscribe to UMP words from every open input.
+ * callback(deviceId, umpWord, timestampMs) is called once per 32-bit word.
+ * Returns a subscription id for offUmpInput().
+ */
+napi_value OnUmpInput(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype type = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &type);
+  if (type != napi_function) {
+    napi_throw_error(env, "INVALID_ARGS", "Callback function required");
+    return nullptr;
+  }
+  
+  napi_value resourceName;
+  napi_create_string_utf8(env, "midi2:ump-input", NAPI_AUTO_LENGTH, &resourceName);
+  napi_threadsafe_function callback;
+  napi_create_threadsafe_function(env, argv[0], nullptr, resourceName, 0, 1,
+                                  nullptr, nullptr, nullptr, CallUmpInput, &callback);
+  napi_unref_threadsafe_function(env, callback);
+  
+  uint32_t subscription = InputHub::subscribe([callback](uint64_t deviceId, const uint32_t* words, size_t count, uint64_t timestampNs) {
+    InputEvent* event = new InputEvent{ deviceId, timestampNs, std::vector<uint32_t>() };
+    event->words.reserve(count);
+    for (size_t i = 0; i < count;) {
+      size_t end = std::min<size_t>(i + ump::packetWordsOf(words[i]), count);
+      // Followed clock and chased time code are consumed natively, they would only load JS
+      if (!ClockFollowerManager::inputFiltered(deviceId, words + i) && !MtcChaseManager::inputFiltered(deviceId, words + i)) {
+        event->words.insert(event->words.end(), words + i, words + end);
+      }
+      i = end;
+    }
+    if (event->words.empty()) {
+      delete event;
+      return;
+    }
+    if (napi_call_threadsafe_function(callback, event, napi_tsfn_nonblocking) != napi_ok) {
+      delete event;
+    }
+  });
+  inputCallbacks[subscription] = callback;
+  
+  napi_value result;
+  napi_create_uint32(env, subscription, &result);
+  return result;
+}
+
+napi_value OffUmpInput(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint32_t subscription;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &subscription) != napi_ok) return nullptr;
+  
+  auto found = inputCallbacks.find(subscription);
+  if (found == inputCallbacks.end()) return nullptr;
+  
+  InputHub::unsubscribe(subscription);
+  napi_release_threadsafe_function(found->second, napi_tsfn_abort);
+  inputCallbacks.erase(found);
+  return nullptr;
+}
+
+// Read one message descriptor, throwing and returning false if it is invalid
+static bool FlexMessageFromObject(napi_env env, napi_value object, uint8_t group, int8_t channel, flexdata::Message& message) {
+  napi_valuetype objectType = napi_undefined;
+  napi_typeof(env, object, &objectType);
+  if (objectType != napi_object) {
+    napi_throw_error(env, "INVALID_ARGS", "Flex Data message must be an object");
+    return false;
+  }
+  
+  auto has = [&](const char* key) {
+    bool result = false;
+    napi_has_named_property(env, object, key, &result);
+    return result;
+  };
+  auto getNumber = [&](const char* key, double fallback) {
+    napi_value value;
+    double number = fallback;
+    if (!has(key) || napi_get_named_property(env, object, key, &value) != napi_ok) return fallback;
+    if (napi_get_value_double(env, value, &number) != napi_ok) return fallback;
+    return number;
+  };
+  auto getString = [&](napi_value from, const char* key, char* buffer, size_t size) {
+    napi_value value;
+    size_t length = 0;
+    buffer[0] = '\0';
+    bool present = false;
+    napi_has_named_property(env, from, key, &present);
+    if (!present || napi_get_named_property(env, from, key, &value) != napi_ok) return false;
+    return napi_get_value_string_utf8(env, value, buffer, size, &length) == napi_ok;
+  };
+  auto getNote = [&](const char* key, flexdata::Note& note) {
+    char name[8];
+    if (!getString(object, key, name, sizeof(name)) || !flexdata::parseNote(name, note)) {
+      napi_throw_error(env, "INVALID_ARGS", "Note names are a letter A-G and up to two '#' or 'b'");
+      return false;
+    }
+    return true;
+  };
+  // [{ type: 'add' | 'subtract' | 'raise' | 'lower', degree }, ...]
+  auto getAlterations = [&](const char* key, flexdata::Alteration* alterations, uint32_t capacity) {
+    if (!has(key)) return true;
+    napi_value array;
+    uint32_t length = 0;
+    bool isArray = false;
+    napi_get_named_property(env, object, key, &array);
+    napi_is_array(env, array, &isArray);
+    if (isArray) napi_get_array_length(env, array, &length);
+    if (!isArray || length > capacity) {
+      napi_throw_error(env, "INVALID_ARGS", "Too many chord alterations");
+      return false;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+      napi_value entry, value;
+      napi_get_element(env, array, i, &entry);
+      char name[12];
+      int type = getString(entry, "type", name, sizeof(name)) ? flexdata::findAlteration(name) : -1;
+      uint32_t degree = 0;
+      if (napi_get_named_property(env, entry, "degree", &value) == napi_ok) napi_get_value_uint32(env, value, &degree);
+      if (type < 0 || degree < 1 || degree > 15) {
+        napi_throw_error(env, "INVALID_ARGS", "Alterations are { type: 'add' | 'subtract' | 'raise' | 'lower', degree: 1-15 }");
+        return false;
+      }
+      alterations[i].type = (uint8_t)type;
+      alterations[i].degree = (uint8_t)degree;
+    }
+    return true;
+  };
+  
+  message = flexdata::Message();
+  message.group = (uint8_t)((int)getNumber("group", group) & 0xF);
+  double channelValue = getNumber("channel", channel);
+  message.channel = channelValue < 0 ? -1 : (int8_t)((int)channelValue & 0xF);
+  
+  char type[16];
+  getString(object, "type", type, sizeof(type));
+  if (strcmp(type, "tempo") == 0) {
+    message.kind = flexdata::Kind::Tempo;
+    message.bpm = getNumber("bpm", 0);
+    if (!(message.bpm >= 1 && message.bpm <= 1000)) {
+      napi_throw_error(env, "INVALID_ARGS", "bpm must be between 1 and 1000");
+      return false;
+    }
+  } else if (strcmp(type, "timeSignature") == 0) {
+    message.kind = flexdata::Kind::TimeSignature;
+    message.numerator = (uint8_t)std::min<double>(255, std::max<double>(1, getNumber("numerator", 4)));
+    uint32_t denominator = (uint32_t)getNumber("denominator", 4);
+    message.denominatorPower = 0;
+    while ((1u << message.denominatorPower) < denominator && message.denominatorPower < 8) message.denominatorPower++;
+    if ((1u << message.denominatorPower) != denominator) {
+      napi_throw_error(env, "INVALID_ARGS", "denominator must be a power of two");
+      return false;
+    }
+    message.thirtySecondsPerBeat = (uint8_t)std::min<double>(255, std::max<double>(0, getNumber("thirtySecondsPerBeat", 8)));
+  } else if (strcmp(type, "metronome") == 0) {
+    message.kind = flexdata::Kind::Metronome;
+    message.clocksPerClick = (uint8_t)std::min<double>(255, std::max<double>(0, getNumber("clocksPerClick", 24)));
+    const char* counts[] = { "accent1", "accent2", "accent3", "subdivision1", "subdivision2" };
+    uint8_t* fields[] = { &message.accents[0], &message.accents[1], &message.accents[2],
+                          &message.subdivisions[0], &message.subdivisions[1] };
+    for (int i = 0; i < 5; i++) *fields[i] = (uint8_t)std::min<double>(255, std::max<double>(0, getNumber(counts[i], 0)));
+  } else if (strcmp(type, "keySignature") == 0) {
+    message.kind = flexdata::Kind::KeySignature;
+    flexdata::Note tonic;
+    if (!getNote("tonic", tonic)) return false;
+    char mode[8];
+    getString(object, "mode", mode, sizeof(mode));
+    if (!flexdata::keySignatureFor(tonic, strcmp(mode, "minor") == 0, message.sharpsFlats)) {
+      napi_throw_error(env, "INVALID_ARGS", "Key needs more than seven sharps or flats");
+      return false;
+    }
+    message.tonicLetter = tonic.letter;
+  } else if (strcmp(type, "chord") == 0) {
+    message.kind = flexdata::Kind::Chord;
+    flexdata::Chord& chord = message.chord;
+    char name[24];
+    int chordType = getString(object, "chord", name, sizeof(name)) ? flexdata::findChordType(name) : 1;
+    if (chordType < 0) {
+      napi_throw_error(env, "INVALID_ARGS", "Unknown chord type");
+      return false;
+    }
+    chord.type = (uint8_t)chordType;
+    if (!getNote("tonic", chord.tonic) || !getAlterations("alterations", chord.alterations, 4)) return false;
+    if (has("bass")) {
+      if (!getNote("bass", chord.bass) || !getAlterations("bassAlterations", chord.bassAlterations, 2)) return false;
+      int bassType = getString(object, "bassChord", name, sizeof(name)) ? flexdata::findChordType(name) : 0;
+      if (bassType < 0) {
+        napi_throw_error(env, "INVALID_ARGS", "Unknown bass chord type");
+        return false;
+      }
+      chord.bassType = (uint8_t)bassType;
+    }
+  } else if (strcmp(type, "text") == 0) {
+    message.kind = flexdata::Kind::Text;
+    char kind[24];
+    int textKind = getString(object, "kind", kind, sizeof(kind)) ? flexdata::findTextKind(kind) : 0;
+    if (textKind < 0) {
+      napi_throw_error(env, "INVALID_ARGS", "Unknown text kind");
+      return false;
+    }
+    message.textKind = (uint8_t)textKind;
+    napi_value value;
+    size_t length = 0;
+    if (has("text") && napi_get_named_property(env, object, "text", &value) == napi_ok &&
+        napi_get_value_string_utf8(env, value, nullptr, 0, &length) == napi_ok) {
+      message.text.resize(length + 1);
+      napi_get_value_string_utf8(env, value, &message.text[0], length + 1, &length);
+      message.text.resize(length);
+    }
+  } else {
+    napi_throw_error(env, "INVALID_ARGS", "type must be tempo, timeSignature, metronome, keySignature, chord or text");
+    return false;
+  }
+  return true;
+}
+
+static napi_value FlexMessageToObject(napi_env env, const flexdata::Message& message) {
+  static const char* const KIND_NAMES[] = { "tempo", "timeSignature", "metronome", "keySignature", "chord", "text" };
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_create_string_utf8(env, KIND_NAMES[(int)message.kind], NAPI_AUTO_LENGTH, &value);
+  napi_set_named_property(env, result, "type", value);
+  napi_create_uint32(env, message.group, &value);
+  napi_set_named_property(env, result, "group", value);
+  if (message.channel < 0) napi_get_null(env, &value);
+  else napi_create_uint32(env, (uint32_t)message.channel, &value);
+  napi_set_named_property(env, result, "channel", value);
+  
+  auto setUint = [&](const char* key, uint32_t number) {
+    napi_create_uint32(env, number, &value);
+    napi_set_named_property(env, result, key, value);
+  };
+  auto setString = [&](const char* key, const char* text) {
+    napi_create_string_utf8(env, text, NAPI_AUTO_LENGTH, &value);
+    napi_set_named_property(env, result, key, value);
+  };
+  auto setNote = [&](const char* key, const flexdata::Note& note) {
+    char name[8];
+    flexdata::formatNote(note, name, sizeof(name));
+    setString(key, name);
+  };
+  auto setAlterations = [&](const char* key, const flexdata::Alteration* alterations, size_t count) {
+    napi_value array;
+    napi_create_array(env, &array);
+    uint32_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (alterations[i].type == flexdata::ALTER_NONE || alterations[i].type >= flexdata::ALTERATION_TYPE_COUNT) continue;
+      napi_value entry, field;
+      napi_create_object(env, &entry);
+      napi_create_string_utf8(env, flexdata::ALTERATION_NAMES[alterations[i].type], NAPI_AUTO_LENGTH, &field);
+      napi_set_named_property(env, entry, "type", field);
+      napi_create_uint32(env, alterations[i].degree, &field);
+      napi_set_named_property(env, entry, "degree", field);
+      napi_set_element(env, array, length++, entry);
+    }
+    napi_set_named_property(env, result, key, array);
+  };
+  
+  switch (message.kind) {
+    case flexdata::Kind::Tempo:
+      napi_create_double(env, message.bpm, &value);
+      napi_set_named_property(env, result, "bpm", value);
+      break;
+    case flexdata::Kind::TimeSignature:
+      setUint("numerator", message.numerator);
+      setUint("denominator", message.denominatorPower < 32 ? 1u << message.denominatorPower : 0);
+      setUint("thirtySecondsPerBeat", message.thirtySecondsPerBeat);
+      break;
+    case flexdata::Kind::Metronome:
+      setUint("clocksPerClick", message.clocksPerClick);
+      setUint("accent1", message.accents[0]);
+      setUint("accent2", message.accents[1]);
+      setUint("accent3", message.accents[2]);
+      setUint("subdivision1", message.subdivisions[0]);
+      setUint("subdivision2", message.subdivisions[1]);
+      break;
+    case flexdata::Kind::KeySignature: {
+      napi_create_int32(env, message.sharpsFlats, &value);
+      napi_set_named_property(env, result, "sharpsFlats", value);
+      if (message.tonicLetter != 0 && message.sharpsFlats >= -7) {
+        setNote("tonic", flexdata::keyTonic(message.sharpsFlats, message.tonicLetter));
+      } else {
+        napi_get_null(env, &value);
+        napi_set_named_property(env, result, "tonic", value);
+      }
+      setString("mode", flexdata::keyMode(message.sharpsFlats, message.tonicLetter));
+      break;
+    }
+    case flexdata::Kind::Chord: {
+      const flexdata::Chord& chord = message.chord;
+      char symbol[64];
+      flexdata::formatChord(chord, symbol, sizeof(symbol));
+      setNote("tonic", chord.tonic);
+      setString("chord", flexdata::CHORD_TYPES[chord.type].name);
+      setAlterations("alterations", chord.alterations, 4);
+      if (chord.bass.letter != 0) {
+        setNote("bass", chord.bass);
+        setString("bassChord", flexdata::CHORD_TYPES[chord.bassType].name);
+        setAlterations("bassAlterations", chord.bassAlterations, 2);
+      }
+      setString("symbol", symbol);
+      uint16_t pitches = flexdata::chordPitchClasses(chord);
+      napi_value array;
+      napi_create_array(env, &array);
+      uint32_t length = 0;
+      for (uint32_t pitch = 0; pitch < 12; pitch++) {
+        if ((pitches & (1u << pitch)) == 0) continue;
+        napi_create_uint32(env, pitch, &value);
+        napi_set_element(env, array, length++, value);
+      }
+      napi_set_named_property(env, result, "pitchClasses", array);
+      break;
+    }
+    case flexdata::Kind::Text:
+      setString("kind", flexdata::TEXT_KINDS[message.textKind].name);
+      napi_create_string_utf8(env, message.text.data(), message.text.size(), &value);
+      napi_set_named_property(env, result, "text", value);
+      break;
+  }
+  return result;
+}
+
+// Encode a message or array of messages from argv[index], defaults from argv[index + 1]
+static bool EncodeFlexArgs(napi_env env, size_t argc, napi_value* argv, size_t index, std::vector<uint32_t>& words) {
+  if (argc <= index) {
+    napi_throw_error(env, "INVALID_ARGS", "Flex Data message or array of messages required");
+    return false;
+  }
+  uint32_t group = 0;
+  int32_t channel = -1;
+  napi_valuetype optionsType = napi_undefined;
+  if (argc > index + 1) napi_typeof(env, argv[index + 1], &optionsType);
+  if (optionsType == napi_object) {
+    napi_value value;
+    bool has = false;
+    napi_has_named_property(env, argv[index + 1], "group", &has);
+    if (has && napi_get_named_property(env, argv[index + 1], "group", &value) == napi_ok) napi_get_value_uint32(env, value, &group);
+    napi_has_named_property(env, argv[index + 1], "channel", &has);
+    if (has && napi_get_named_property(env, argv[index + 1], "channel", &value) == napi_ok) napi_get_value_int32(env, value, &channel);
+  }
+  
+  bool isArray = false;
+  napi_is_array(env, argv[index], &isArray);
+  uint32_t length = 1;
+  if (isArray) napi_get_array_length(env, argv[index], &length);
+  flexdata::Message message;
+  for (uint32_t i = 0; i < length; i++) {
+    napi_value object = argv[index];
+    if (isArray) napi_get_element(env, argv[index], i, &object);
+    if (!FlexMessageFromObject(env, object, (uint8_t)(group & 0xF), channel < 0 ? -1 : (int8_t)(channel & 0xF), message)) return false;
+    flexdata::encode(message, words);
+  }
+  return true;
+}
+
+/**
+ * Build Flex Data packets, ready for sendUmpBatch():
+ *   encodeFlexData(message | [messages], { group = 0, channel }) -> Uint32Array
+ * Messages are { type: 'tempo', bpm }, { type: 'timeSignature', numerator,
+ * denominator, thirtySecondsPerBeat = 8 }, { type: 'metronome', clocksPerClick,
+ * accent1-3, subdivision1-2 }, { type: 'keySignature', tonic: 'Eb', mode:
+ * 'major' | 'minor' }, { type: 'chord', tonic, chord: 'minor7', alterations:
+ * [{ type: 'add', degree: 9 }], bass, bassChord, bassAlterations } or
+ * { type: 'text', kind: 'lyrics', text }, each with an optional group and
+ * channel. Without a channel a message is for the whole group.
+ */
+napi_value EncodeFlexData(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  std::vector<uint32_t> words;
+  if (!EncodeFlexArgs(env, argc, argv, 0, words)) return nullptr;
+  return CreateTypedArray(env, napi_uint32_array, words);
+}
+
+/**
+ * Encode once and write to each output:
+ *   sendFlexData(handle | [handles] | null, message | [messages], options)
+ * With null the messages go to every open output that carries UMP, MIDI
+ * 1.0 ports having no way to carry Flex Data. Returns the outputs written.
+ */
+napi_value SendFlexData(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint64_t enqueueNs = monotonicNanoseconds();
+  std::vector<uint32_t> words;
+  if (argc < 1 || !EncodeFlexArgs(env, argc, argv, 1, words)) return nullptr;
   
-  static void enumerateOutputs() {
-    midiOutputs.clear();
-    if (!ensureInitialized()) return;
-    
-    ItemCount destCount = MIDIGetNumberOfDestinations();
-    
-    for (ItemCount i = 0; i < destCount; i++) {
-      MIDIEndpointRef dest = MIDIGetDestination(i);
-      CFStringRef name = nullptr;
-      MIDIObjectGetStringProperty(dest, kMIDIPropertyDisplayName, &name);
-      
-      MIDIDevice device;
-      device.index = i;
-      device.isInput = 0;
-      if (name) {
-        CFStringGetCString(name, device.name, sizeof(device.name), kCFStringEncodingUTF8);
-        CFRelease(name);
+  napi_valuetype targetType = napi_undefined;
+  napi_typeof(env, argv[0], &targetType);
+  uint32_t written = 0;
+  if (targetType == napi_null || targetType == napi_undefined) {
+    HandleTable::forEachOutput([&](OpenHandle& slot) {
+      if (!slot.connected || !slot.targets[0]->isVirtual) return;
+      if (WriteUmp(slot, words.data(), words.size(), enqueueNs)) written++;
+    });
+  } else {
+    bool isArray = false;
+    napi_is_array(env, argv[0], &isArray);
+    uint32_t length = 1;
+    if (isArray) napi_get_array_length(env, argv[0], &length);
+    for (uint32_t i = 0; i < length; i++) {
+      napi_value element = argv[0];
+      if (isArray) napi_get_element(env, argv[0], i, &element);
+      uint32_t token;
+      if (!GetToken(env, element, token)) {
+        napi_throw_error(env, "INVALID_ARGS", "Output handle required");
+        return nullptr;
       }
-      // Store endpoint reference as a pointer to uint32_t
-      uint32_t* refPtr = new uint32_t;
-      *refPtr = (uint32_t)dest;
-      device.handle = (void*)refPtr;
-      midiOutputs.push_back(device);
+      OpenHandle* slot = ResolveOutput(env, token);
+      if (slot == nullptr) return nullptr;
+      if (WriteUmp(*slot, words.data(), words.size(), enqueueNs)) written++;
     }
   }
   
-  static void enumerateInputs() {
-    midiInputs.clear();
-    if (!ensureInitialized()) return;
-    
-    ItemCount sourceCount = MIDIGetNumberOfSources();
-    
-    for (ItemCount i = 0; i < sourceCount; i++) {
-      MIDIEndpointRef source = MIDIGetSource(i);
-      CFStringRef name = nullptr;
-      MIDIObjectGetStringProperty(source, kMIDIPropertyDisplayName, &name);
-      
-      MIDIDevice device;
-      device.index = i;
-      device.isInput = 1;
-      if (name) {
-        CFStringGetCString(name, device.name, sizeof(device.name), kCFStringEncodingUTF8);
-        CFRelease(name);
-      }
-      // Store endpoint reference as a pointer to uint32_t
-      uint32_t* refPtr = new uint32_t;
-      *refPtr = (uint32_t)source;
-      device.handle = (void*)refPtr;
-      midiInputs.push_back(device);
-    }
+  napi_value result;
+  napi_create_uint32(env, written, &result);
+  return result;
+}
+
+/**
+ * decodeFlexData(Uint32Array words) -> [message], the inverse of
+ * encodeFlexData(). Chords also get their symbol and pitchClasses (0 for
+ * C), key signatures their sharpsFlats and mode. Other packets are skipped.
+ */
+napi_value DecodeFlexData(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  bool isTypedArray = false;
+  if (argc >= 1) napi_is_typedarray(env, argv[0], &isTypedArray);
+  napi_typedarray_type type = napi_int8_array;
+  size_t count = 0;
+  void* data = nullptr;
+  if (isTypedArray) napi_get_typedarray_info(env, argv[0], &type, &count, &data, nullptr, nullptr);
+  if (type != napi_uint32_array) {
+    napi_throw_error(env, "INVALID_ARGS", "UMP words must be a Uint32Array");
+    return nullptr;
   }
   
-  static OSStatus sendUMP(MIDIEndpointRef dest, const uint32_t* packet, size_t count) {
-    if (!ensureInitialized()) {
-      return -1;
-    }
-    
-    MIDIPacketList packetList;
-    packetList.numPackets = count;
-    
-    for (size_t i = 0; i < count; i++) {
-      packetList.packet[i].timeStamp = 0;
-      packetList.packet[i].length = 4;
-      packetList.packet[i].data[0] = (packet[i] >> 24) & 0xFF;
-      packetList.packet[i].data[1] = (packet[i] >> 16) & 0xFF;
-      packetList.packet[i].data[2] = (packet[i] >> 8) & 0xFF;
-      packetList.packet[i].data[3] = packet[i] & 0xFF;
-    }
-    
-    return MIDISend(outputPort, dest, &packetList);
+  const uint32_t* words = (const uint32_t*)data;
+  flexdata::Decoder decoder;
+  flexdata::Message message;
+  napi_value result;
+  napi_create_array(env, &result);
+  uint32_t length = 0;
+  for (size_t i = 0; i < count; i += ump::packetWordsOf(words[i])) {
+    if (i + ump::packetWordsOf(words[i]) > count) break;
+    if (decoder.feed(words + i, message)) napi_set_element(env, result, length++, FlexMessageToObject(env, message));
   }
+  return result;
+}
+
+struct FlexEvent {
+  uint64_t deviceId;
+  uint64_t timestampNs;
+  std::vector<flexdata::Message> messages;
 };
 
-// Static member initialization
-MIDIClientRef MacMIDIManager::midiClient = 0;
-MIDIPortRef MacMIDIManager::outputPort = 0;
-bool MacMIDIManager::initialized = false;
+// Joins text per input for one onFlexData() subscription
+struct FlexSubscription {
+  std::mutex mutex;
+  std::map<uint64_t, flexdata::Decoder> decoders;
+};
 
-#elif __linux__
+static std::map<uint32_t, napi_threadsafe_function> flexCallbacks;
 
-#if HAS_ALSA
-// ALSA Implementation for Linux
-class ALSAMIDIManager {
-public:
-  static void enumerateOutputs() {
-    midiOutputs.clear();
-    int cardNum = -1;
+static void CallFlexData(napi_env env, napi_value callback, void* context, void* data) {
+  FlexEvent* event = (FlexEvent*)data;
+  
+  if (env != nullptr && callback != nullptr) {
+    char idBuffer[24];
+    formatDeviceId(event->deviceId, idBuffer, sizeof(idBuffer));
     
-    while (snd_card_next(&cardNum) == 0 && cardNum >= 0) {
-      snd_ctl_t* handle;
-      char hwname[32];
-      snprintf(hwname, sizeof(hwname), "hw:%d", cardNum);
-      
-      if (snd_ctl_open(&handle, hwname, 0) >= 0) {
-        int devNum = -1;
-        while (snd_ctl_rawmidi_next_device(handle, &devNum) >= 0 && devNum >= 0) {
-          snd_rawmidi_info_t* info;
-          snd_rawmidi_info_alloca(&info);
-          snd_rawmidi_info_set_device(info, devNum);
-          snd_rawmidi_info_set_stream(info, SND_RAWMIDI_STREAM_OUTPUT);
-          
-          if (snd_ctl_rawmidi_info(handle, info) >= 0) {
-            char devname[256];
-            snprintf(devname, sizeof(devname), "hw:%d,%d", cardNum, devNum);
-            
-            snd_rawmidi_t* rawhandle;
-            if (snd_rawmidi_open(nullptr, &rawhandle, devname, SND_RAWMIDI_NONBLOCK) >= 0) {
-              MIDIDevice device;
-              device.index = midiOutputs.size();
-              device.isInput = 0;
-              strncpy(device.name, snd_rawmidi_info_get_name(info), sizeof(device.name) - 1);
-              device.handle = rawhandle;
-              midiOutputs.push_back(device);
-            }
-          }
-        }
-        snd_ctl_close(handle);
-      }
+    napi_value argv[3], global;
+    napi_create_string_utf8(env, idBuffer, NAPI_AUTO_LENGTH, &argv[0]);
+    napi_create_double(env, event->timestampNs / 1e6, &argv[2]);
+    napi_get_global(env, &global);
+    for (const flexdata::Message& message : event->messages) {
+      argv[1] = FlexMessageToObject(env, message);
+      napi_call_function(env, global, callback, 3, argv, nullptr);
     }
   }
   
-  static void enumerateInputs() {
-    midiInputs.clear();
-    int cardNum = -1;
-    
-    while (snd_card_next(&cardNum) == 0 && cardNum >= 0) {
-      snd_ctl_t* handle;
-      char hwname[32];
-      snprintf(hwname, sizeof(hwname), "hw:%d", cardNum);
-      
-      if (snd_ctl_open(&handle, hwname, 0) >= 0) {
-        int devNum = -1;
-        while (snd_ctl_rawmidi_next_device(handle, &devNum) >= 0 && devNum >= 0) {
-          snd_rawmidi_info_t* info;
-          snd_rawmidi_info_alloca(&info);
-          snd_rawmidi_info_set_device(info, devNum);
-          snd_rawmidi_info_set_stream(info, SND_RAWMIDI_STREAM_INPUT);
-          
-          if (snd_ctl_rawmidi_info(handle, info) >= 0) {
-            char devname[256];
-            snprintf(devname, sizeof(devname), "hw:%d,%d", cardNum, devNum);
-            
-            snd_rawmidi_t* rawhandle;
-            if (snd_rawmidi_open(&rawhandle, nullptr, devname, SND_RAWMIDI_NONBLOCK) >= 0) {
-              MIDIDevice device;
-              device.index = midiInputs.size();
-              device.isInput = 1;
-              strncpy(device.name, snd_rawmidi_info_get_name(info), sizeof(device.name) - 1);
-              device.handle = rawhandle;
-              midiInputs.push_back(device);
-            }
-          }
-        }
-        snd_ctl_close(handle);
-      }
-    }
+  delete event;
+}
+
+/**
+ * Subscribe to Flex Data decoded natively from every open input:
+ *   onFlexData(callback(deviceId, message, timestampMs)) -> subscription id
+ * message is as decodeFlexData() returns it; multi-packet text arrives
+ * once, whole. The packets still reach onUmpInput() callbacks too.
+ */
+napi_value OnFlexData(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype type = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &type);
+  if (type != napi_function) {
+    napi_throw_error(env, "INVALID_ARGS", "Callback function required");
+    return nullptr;
   }
   
-  static int sendUMP(snd_rawmidi_t* handle, const uint32_t* packet, size_t count) {
-    unsigned char buffer[count * 4];
-    for (size_t i = 0; i < count; i++) {
-      buffer[i * 4 + 0] = (packet[i] >> 24) & 0xFF;
-      buffer[i * 4 + 1] = (packet[i] >> 16) & 0xFF;
-      buffer[i * 4 + 2] = (packet[i] >> 8) & 0xFF;
-      buffer[i * 4 + 3] = packet[i] & 0xFF;
+  napi_value resourceName;
+  napi_create_string_utf8(env, "midi2:flex-data", NAPI_AUTO_LENGTH, &resourceName);
+  napi_threadsafe_function callback;
+  napi_create_threadsafe_function(env, argv[0], nullptr, resourceName, 0, 1,
+                                  nullptr, nullptr, nullptr, CallFlexData, &callback);
+  napi_unref_threadsafe_function(env, callback);
+  
+  std::shared_ptr<FlexSubscription> state = std::make_shared<FlexSubscription>();
+  uint32_t subscription = InputHub::subscribe([callback, state](uint64_t deviceId, const uint32_t* words, size_t count, uint64_t timestampNs) {
+    FlexEvent* event = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      flexdata::Message message;
+      for (size_t i = 0; i < count; i += ump::packetWordsOf(words[i])) {
+        if (ump::typeOf(words[i]) != ump::flex::TYPE || i + 4 > count) continue;
+        if (!state->decoders[deviceId].feed(words + i, message)) continue;
+        if (event == nullptr) event = new FlexEvent{ deviceId, timestampNs, {} };
+        event->messages.push_back(std::move(message));
+      }
     }
-    return snd_rawmidi_write(handle, buffer, sizeof(buffer));
-  }
-};
+    if (event != nullptr && napi_call_threadsafe_function(callback, event, napi_tsfn_nonblocking) != napi_ok) {
+      delete event;
+    }
+  });
+  flexCallbacks[subscription] = callback;
+  
+  napi_value result;
+  napi_create_uint32(env, subscription, &result);
+  return result;
+}
 
-#else
-// Stub for when ALSA is not available
-class ALSAMIDIManager {
-public:
-  static void enumerateOutputs() {}
-  static void enumerateInputs() {}
+napi_value OffFlexData(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint32_t subscription;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &subscription) != napi_ok) return nullptr;
+  
+  auto found = flexCallbacks.find(subscription);
+  if (found == flexCallbacks.end()) return nullptr;
+  
+  InputHub::unsubscribe(subscription);
+  napi_release_threadsafe_function(found->second, napi_tsfn_abort);
+  flexCallbacks.erase(found);
+  return nullptr;
+}
+
+struct FollowerReport {
+  uint32_t id;
+  ClockFollower::Event event;
+  ClockFollower::State state;
 };
-#endif
 
-#endif
+static std::map<uint32_t, napi_threadsafe_function> followerCallbacks;
 
-// ============================================================================
-// NAPI Implementations
-// ============================================================================
+static napi_value FollowerStateToObject(napi_env env, const ClockFollower::State& state) {
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_get_boolean(env, state.running, &value);
+  napi_set_named_property(env, result, "running", value);
+  napi_get_boolean(env, state.locked, &value);
+  napi_set_named_property(env, result, "locked", value);
+  napi_create_double(env, state.bpm, &value);
+  napi_set_named_property(env, result, "bpm", value);
+  napi_create_double(env, state.beats, &value);
+  napi_set_named_property(env, result, "beats", value);
+  return result;
+}
 
-napi_value GetUmpOutputs(napi_env env, napi_callback_info info) {
-  napi_value result;
-  napi_create_array(env, &result);
+static void CallFollower(napi_env env, napi_value callback, void* context, void* data) {
+  FollowerReport* report = (FollowerReport*)data;
   
-#ifdef _WIN32
-  WindowsMIDIManager::enumerateOutputs();
-#elif __APPLE__
-  MacMIDIManager::enumerateOutputs();
-#elif __linux__ && HAS_ALSA
-  ALSAMIDIManager::enumerateOutputs();
-#endif
-  
-  for (size_t i = 0; i < midiOutputs.size(); i++) {
-    napi_value device;
-    napi_create_object(env, &device);
-    
-    napi_value index;
-    napi_create_uint32(env, midiOutputs[i].index, &index);
-    napi_set_named_property(env, device, "index", index);
-    
-    napi_value name;
-    napi_create_string_utf8(env, midiOutputs[i].name, NAPI_AUTO_LENGTH, &name);
-    napi_set_named_property(env, device, "name", name);
-    
-    napi_set_element(env, result, i, device);
+  if (env != nullptr && callback != nullptr) {
+    static const char* const EVENT_NAMES[] = { "", "beat", "start", "stop", "continue", "position", "lock", "unlock" };
+    napi_value argv[2], global;
+    napi_create_string_utf8(env, EVENT_NAMES[report->event], NAPI_AUTO_LENGTH, &argv[0]);
+    argv[1] = FollowerStateToObject(env, report->state);
+    napi_get_global(env, &global);
+    napi_call_function(env, global, callback, 2, argv, nullptr);
   }
   
-  return result;
+  delete report;
 }
 
-napi_value GetUmpInputs(napi_env env, napi_callback_info info) {
-  napi_value result;
-  napi_create_array(env, &result);
-  
-#ifdef _WIN32
-  WindowsMIDIManager::enumerateInputs();
-#elif __APPLE__
-  MacMIDIManager::enumerateInputs();
-#elif __linux__ && HAS_ALSA
-  ALSAMIDIManager::enumerateInputs();
-#endif
+/**
+ * Follow the MIDI clock arriving on an open input:
+ *   followClock(inputHandle, callback(event, { running, locked, bpm, beats })) -> follower id
+ * Tempo and song position are estimated natively from the arrival times of
+ * Timing Clock. The callback runs on each beat while running and on
+ * 'start', 'stop', 'continue', 'position', 'lock' and 'unlock'. Timing
+ * Clock from a followed input no longer reaches onUmpInput() callbacks.
+ */
+napi_value FollowClock(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
   
-  for (size_t i = 0; i < midiInputs.size(); i++) {
-    napi_value device;
-    napi_create_object(env, &device);
-    
-    napi_value index;
-    napi_create_uint32(env, midiInputs[i].index, &index);
-    napi_set_named_property(env, device, "index", index);
-    
-    napi_value name;
-    napi_create_string_utf8(env, midiInputs[i].name, NAPI_AUTO_LENGTH, &name);
-    napi_set_named_property(env, device, "name", name);
-    
-    napi_set_element(env, result, i, device);
+  uint32_t token;
+  napi_valuetype type = napi_undefined;
+  if (argc >= 2) napi_typeof(env, argv[1], &type);
+  if (argc < 2 || !GetToken(env, argv[0], token) || type != napi_function) {
+    napi_throw_error(env, "INVALID_ARGS", "Input handle and callback function required");
+    return nullptr;
+  }
+  OpenHandle* slot = HandleTable::resolve(token);
+  if (slot == nullptr || !slot->isInput) {
+    napi_throw_error(env, "DEVICE_NOT_OPEN", "Device not open. Call openUmpInput first.");
+    return nullptr;
   }
   
+  napi_value resourceName;
+  napi_create_string_utf8(env, "midi2:clock-follower", NAPI_AUTO_LENGTH, &resourceName);
+  napi_threadsafe_function callback;
+  napi_create_threadsafe_function(env, argv[1], nullptr, resourceName, 0, 1,
+                                  nullptr, nullptr, nullptr, CallFollower, &callback);
+  napi_unref_threadsafe_function(env, callback);
+  
+  uint32_t id = ClockFollowerManager::follow(slot->deviceId, [callback](uint32_t id, ClockFollower::Event event, const ClockFollower::State& state) {
+    FollowerReport* report = new FollowerReport{ id, event, state };
+    if (napi_call_threadsafe_function(callback, report, napi_tsfn_nonblocking) != napi_ok) {
+      delete report;
+    }
+  });
+  followerCallbacks[id] = callback;
+  
+  napi_value result;
+  napi_create_uint32(env, id, &result);
   return result;
 }
 
-napi_value OpenUmpOutput(napi_env env, napi_callback_info info) {
+// Returns { running, locked, bpm, beats } with beats counted on to now
+napi_value GetClockFollowerState(napi_env env, napi_callback_info info) {
   size_t argc = 1;
   napi_value argv[1];
   napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
   
-  if (argc < 1) {
-    napi_throw_error(env, "INVALID_ARGS", "Device index required");
+  uint32_t id = 0;
+  ClockFollower::State state;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &id) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Follower id required");
+    return nullptr;
+  }
+  if (!ClockFollowerManager::state(id, state)) {
+    napi_throw_error(env, "INVALID_FOLLOWER", "Clock follower is not running");
     return nullptr;
   }
+  return FollowerStateToObject(env, state);
+}
+
+napi_value UnfollowClock(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
   
-  uint32_t deviceIndex;
-  napi_get_value_uint32(env, argv[0], &deviceIndex);
+  uint32_t id = 0;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &id) != napi_ok) return nullptr;
   
-  if (deviceIndex >= midiOutputs.size()) {
-    napi_throw_error(env, "INVALID_DEVICE", "Device index out of range");
-    return nullptr;
+  auto found = followerCallbacks.find(id);
+  if (found == followerCallbacks.end()) return nullptr;
+  
+  ClockFollowerManager::stop(id);
+  napi_release_threadsafe_function(found->second, napi_tsfn_abort);
+  followerCallbacks.erase(found);
+  return nullptr;
+}
+
+struct ChaseReport {
+  MtcChaser::Event event;
+  MtcChaser::State state;
+};
+
+static std::map<uint32_t, napi_threadsafe_function> chaseCallbacks;
+
+static napi_value ChaseStateToObject(napi_env env, const MtcChaser::State& state) {
+  napi_value result, value;
+  napi_create_object(env, &result);
+  napi_get_boolean(env, state.running, &value);
+  napi_set_named_property(env, result, "running", value);
+  napi_get_boolean(env, state.locked, &value);
+  napi_set_named_property(env, result, "locked", value);
+  napi_create_double(env, state.speed, &value);
+  napi_set_named_property(env, result, "speed", value);
+  SetTimecodeProperties(env, result, state.frames, state.rate);
+  return result;
+}
+
+static void CallChase(napi_env env, napi_value callback, void* context, void* data) {
+  ChaseReport* report = (ChaseReport*)data;
+  
+  if (env != nullptr && callback != nullptr) {
+    static const char* const EVENT_NAMES[] = { "", "lock", "position", "stop", "locate" };
+    napi_value argv[2], global;
+    napi_create_string_utf8(env, EVENT_NAMES[report->event], NAPI_AUTO_LENGTH, &argv[0]);
+    argv[1] = ChaseStateToObject(env, report->state);
+    napi_get_global(env, &global);
+    napi_call_function(env, global, callback, 2, argv, nullptr);
   }
   
-  if (midiOutputs[deviceIndex].handle != nullptr) {
-    napi_throw_error(env, "ALREADY_OPEN", "Device already open");
+  delete report;
+}
+
+/**
+ * Chase the MIDI Time Code arriving on an open input:
+ *   chaseMtc(inputHandle, callback(event, { running, locked, speed, seconds, timecode, fps })) -> chase id
+ * Quarter frames and full frames are decoded natively. The callback gets
+ * 'lock' once the time code is running, 'position' ten times a second
+ * while locked, 'stop' when quarter frames stop and 'locate' on a full
+ * frame message.
+ */
+napi_value ChaseMtc(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  uint32_t token;
+  napi_valuetype type = napi_undefined;
+  if (argc >= 2) napi_typeof(env, argv[1], &type);
+  if (argc < 2 || !GetToken(env, argv[0], token) || type != napi_function) {
+    napi_throw_error(env, "INVALID_ARGS", "Input handle and callback function required");
     return nullptr;
   }
-  
-#ifdef _WIN32
-  HMIDIOUT handle;
-  MMRESULT result = WindowsMIDIManager::openOutput(deviceIndex, handle);
-  if (result != MMSYSERR_NOERROR) {
-    std::cerr << "[MIDI2] Failed to open MIDI output. Error: " << result << std::endl;
-    napi_throw_error(env, "OPEN_FAILED", "Failed to open MIDI output device");
+  OpenHandle* slot = HandleTable::resolve(token);
+  if (slot == nullptr || !slot->isInput) {
+    napi_throw_error(env, "DEVICE_NOT_OPEN", "Device not open. Call openUmpInput first.");
     return nullptr;
   }
-  midiOutputs[deviceIndex].handle = (void*)handle;
-  std::cout << "[MIDI2] Opened MIDI output device " << deviceIndex << " (WinMM)" << std::endl;
-#endif
   
-  napi_value resultObj;
-  napi_create_object(env, &resultObj);
+  napi_value resourceName;
+  napi_create_string_utf8(env, "midi2:mtc-chase", NAPI_AUTO_LENGTH, &resourceName);
+  napi_threadsafe_function callback;
+  napi_create_threadsafe_function(env, argv[1], nullptr, resourceName, 0, 1,
+                                  nullptr, nullptr, nullptr, CallChase, &callback);
+  napi_unref_threadsafe_function(env, callback);
   
-  napi_value idx;
-  napi_create_uint32(env, deviceIndex, &idx);
-  napi_set_named_property(env, resultObj, "deviceIndex", idx);
+  uint32_t id = MtcChaseManager::follow(slot->deviceId, [callback](uint32_t id, MtcChaser::Event event, const MtcChaser::State& state) {
+    ChaseReport* report = new ChaseReport{ event, state };
+    if (napi_call_threadsafe_function(callback, report, napi_tsfn_nonblocking) != napi_ok) {
+      delete report;
+    }
+  });
+  chaseCallbacks[id] = callback;
   
-  napi_value name;
-  napi_create_string_utf8(env, midiOutputs[deviceIndex].name, NAPI_AUTO_LENGTH, &name);
-  napi_set_named_property(env, resultObj, "deviceName", name);
+  napi_value result;
+  napi_create_uint32(env, id, &result);
+  return result;
+}
+
+// Returns the chase state with the position counted on to now
+napi_value GetMtcChaseState(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
   
-  return resultObj;
+  uint32_t id = 0;
+  MtcChaser::State state;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &id) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Chase id required");
+    return nullptr;
+  }
+  if (!MtcChaseManager::state(id, state)) {
+    napi_throw_error(env, "INVALID_CHASE", "MTC chase is not running");
+    return nullptr;
+  }
+  return ChaseStateToObject(env, state);
 }
 
-napi_value CloseUmpOutput(napi_env env, napi_callback_info info) {
+napi_value StopMtcChase(napi_env env, napi_callback_info info) {
   size_t argc = 1;
   napi_value argv[1];
   napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
   
-  if (argc < 1) return nullptr;
+  uint32_t id = 0;
+  if (argc < 1 || napi_get_value_uint32(env, argv[0], &id) != napi_ok) return nullptr;
   
-  uint32_t deviceIndex;
-  napi_get_value_uint32(env, argv[0], &deviceIndex);
+  auto found = chaseCallbacks.find(id);
+  if (found == chaseCallbacks.end()) return nullptr;
   
-  if (deviceIndex < midiOutputs.size() && midiOutputs[deviceIndex].handle) {
-#ifdef _WIN32
-    midiOutClose((HMIDIOUT)midiOutputs[deviceIndex].handle);
-#endif
-    midiOutputs[deviceIndex].handle = nullptr;
+  MtcChaseManager::stop(id);
+  napi_release_threadsafe_function(found->second, napi_tsfn_abort);
+  chaseCallbacks.erase(found);
+  return nullptr;
+}
+
+static napi_value EndpointToObject(napi_env env, const EndpointInfo& endpoint) {
+  napi_value result, value;
+  napi_create_object(env, &result);
+  char idBuffer[24];
+  formatDeviceId(endpoint.deviceId, idBuffer, sizeof(idBuffer));
+  napi_create_string_utf8(env, idBuffer, NAPI_AUTO_LENGTH, &value);
+  napi_set_named_property(env, result, "deviceId", value);
+  formatDeviceId(endpoint.inputId, idBuffer, sizeof(idBuffer));
+  napi_create_string_utf8(env, idBuffer, NAPI_AUTO_LENGTH, &value);
+  napi_set_named_property(env, result, "inputId", value);
+  napi_get_boolean(env, endpoint.ump, &value);
+  napi_set_named_property(env, result, "ump", value);
+  if (!endpoint.ump) return result;
+  
+  char version[8];
+  snprintf(version, sizeof(version), "%u.%u", endpoint.versionMajor, endpoint.versionMinor);
+  napi_create_string_utf8(env, version, NAPI_AUTO_LENGTH, &value);
+  napi_set_named_property(env, result, "umpVersion", value);
+  napi_create_string_utf8(env, endpoint.name.c_str(), endpoint.name.size(), &value);
+  napi_set_named_property(env, result, "name", value);
+  napi_create_string_utf8(env, endpoint.productInstanceId.c_str(), endpoint.productInstanceId.size(), &value);
+  napi_set_named_property(env, result, "productInstanceId", value);
+  napi_get_boolean(env, endpoint.midi1Protocol, &value);
+  napi_set_named_property(env, result, "midi1Protocol", value);
+  napi_get_boolean(env, endpoint.midi2Protocol, &value);
+  napi_set_named_property(env, result, "midi2Protocol", value);
+  napi_get_boolean(env, endpoint.canReceiveJr, &value);
+  napi_set_named_property(env, result, "canReceiveJr", value);
+  napi_get_boolean(env, endpoint.canTransmitJr, &value);
+  napi_set_named_property(env, result, "canTransmitJr", value);
+  
+  if (endpoint.hasIdentity) {
+    napi_value identity, bytes;
+    napi_create_object(env, &identity);
+    napi_create_array_with_length(env, 3, &bytes);
+    for (uint32_t i = 0; i < 3; i++) {
+      napi_create_uint32(env, endpoint.manufacturer[i], &value);
+      napi_set_element(env, bytes, i, value);
+    }
+    napi_set_named_property(env, identity, "manufacturer", bytes);
+    napi_create_uint32(env, endpoint.family, &value);
+    napi_set_named_property(env, identity, "family", value);
+    napi_create_uint32(env, endpoint.model, &value);
+    napi_set_named_property(env, identity, "model", value);
+    napi_create_array_with_length(env, 4, &bytes);
+    for (uint32_t i = 0; i < 4; i++) {
+      napi_create_uint32(env, endpoint.revision[i], &value);
+      napi_set_element(env, bytes, i, value);
+    }
+    napi_set_named_property(env, identity, "revision", bytes);
+    napi_set_named_property(env, result, "identity", identity);
+  } else {
+    napi_get_null(env, &value);
+    napi_set_named_property(env, result, "identity", value);
   }
   
-  return nullptr;
+  napi_value configuration;
+  napi_create_object(env, &configuration);
+  if (endpoint.protocol == ump::stream::PROTOCOL_MIDI1 || endpoint.protocol == ump::stream::PROTOCOL_MIDI2) {
+    napi_create_string_utf8(env, endpoint.protocol == ump::stream::PROTOCOL_MIDI2 ? "midi2" : "midi1", NAPI_AUTO_LENGTH, &value);
+  } else {
+    napi_get_null(env, &value);
+  }
+  napi_set_named_property(env, configuration, "protocol", value);
+  napi_get_boolean(env, endpoint.receiveJr, &value);
+  napi_set_named_property(env, configuration, "receiveJr", value);
+  napi_get_boolean(env, endpoint.transmitJr, &value);
+  napi_set_named_property(env, configuration, "transmitJr", value);
+  napi_set_named_property(env, result, "configuration", configuration);
+  
+  static const char* const DIRECTIONS[] = { "unknown", "input", "output", "bidirectional" };
+  static const char* const MIDI1_MODES[] = { "none", "yes", "limited", "none" };
+  napi_value blocks;
+  napi_create_array(env, &blocks);
+  napi_get_boolean(env, endpoint.staticBlocks, &value);
+  napi_set_named_property(env, result, "staticFunctionBlocks", value);
+  uint32_t count = 0;
+  for (size_t i = 0; i < endpoint.blocks.size(); i++) {
+    const FunctionBlock& fb = endpoint.blocks[i];
+    if (!fb.known) continue;
+    napi_value block;
+    napi_create_object(env, &block);
+    napi_create_uint32(env, (uint32_t)i, &value);
+    napi_set_named_property(env, block, "index", value);
+    napi_create_string_utf8(env, fb.name.c_str(), fb.name.size(), &value);
+    napi_set_named_property(env, block, "name", value);
+    napi_get_boolean(env, fb.active, &value);
+    napi_set_named_property(env, block, "active", value);
+    napi_create_string_utf8(env, DIRECTIONS[fb.direction & 0x3], NAPI_AUTO_LENGTH, &value);
+    napi_set_named_property(env, block, "direction", value);
+    napi_create_uint32(env, fb.firstGroup, &value);
+    napi_set_named_property(env, block, "firstGroup", value);
+    napi_create_uint32(env, fb.groupCount, &value);
+    napi_set_named_property(env, block, "groupCount", value);
+    napi_create_string_utf8(env, MIDI1_MODES[fb.midi1 & 0x3], NAPI_AUTO_LENGTH, &value);
+    napi_set_named_property(env, block, "midi1", value);
+    napi_create_uint32(env, fb.uiHint, &value);
+    napi_set_named_property(env, block, "uiHint", value);
+    napi_create_uint32(env, fb.midiCiVersion, &value);
+    napi_set_named_property(env, block, "midiCiVersion", value);
+    napi_create_uint32(env, fb.maxSysEx8Streams, &value);
+    napi_set_named_property(env, block, "maxSysEx8Streams", value);
+    napi_set_element(env, blocks, count++, block);
+  }
+  napi_set_named_property(env, result, "functionBlocks", blocks);
+  return result;
 }
 
-napi_value SendUmp(napi_env env, napi_callback_info info) {
-  size_t argc = 2;
-  napi_value argv[2];
-  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+// A discovery or configuration waiting to resolve its promise
+struct DiscoveryRequest {
+  uint32_t id;
+  napi_deferred deferred;
+  napi_threadsafe_function callback;
+};
+
+struct DiscoveryReport {
+  DiscoveryRequest* request;
+  EndpointInfo endpoint;
+};
+
+static void CallDiscovery(napi_env env, napi_value callback, void* context, void* data) {
+  DiscoveryReport* report = (DiscoveryReport*)data;
+  DiscoveryRequest* request = report->request;
   
-  if (argc < 2) {
-    napi_throw_error(env, "INVALID_ARGS", "Device index and UMP packet required");
+  EndpointDiscoveryManager::stop(request->id);
+  if (env != nullptr) napi_resolve_deferred(env, request->deferred, EndpointToObject(env, report->endpoint));
+  napi_release_threadsafe_function(request->callback, napi_tsfn_release);
+  delete request;
+  delete report;
+}
+
+/**
+ * Shared by discoverEndpoint and configureEndpoint: checks the port pair,
+ * returns the promise and starts a session that resolves it. A port that
+ * cannot carry UMP throws UNSUPPORTED, since nothing behind it could answer.
+ */
+template<typename Begin>
+static napi_value StartDiscovery(napi_env env, napi_value* argv, size_t argc, double timeoutMs, Begin begin) {
+  uint32_t outputToken, inputToken;
+  if (argc < 2 || !GetToken(env, argv[0], outputToken) || !GetToken(env, argv[1], inputToken)) {
+    napi_throw_error(env, "INVALID_ARGS", "Output and input handles required");
+    return nullptr;
+  }
+  OpenHandle* output = ResolveOutput(env, outputToken);
+  if (output == nullptr) return nullptr;
+  OpenHandle* input = HandleTable::resolve(inputToken);
+  if (input == nullptr || !input->isInput) {
+    napi_throw_error(env, "DEVICE_NOT_OPEN", "Device not open. Call openUmpInput first.");
     return nullptr;
   }
   
-  uint32_t deviceIndex, packet;
-  napi_get_value_uint32(env, argv[0], &deviceIndex);
-  napi_get_value_uint32(env, argv[1], &packet);
-  
-  if (deviceIndex >= midiOutputs.size()) {
-    napi_throw_error(env, "INVALID_DEVICE", "Device not found");
+  // Hardware ports are written as MIDI 1.0 bytes, which have no way to
+  // carry Stream messages, so the device's own protocol cannot be learnt
+  if (!output->targets[0]->isVirtual || !input->targets[0]->isVirtual) {
+    napi_throw_error(env, "UNSUPPORTED", "Endpoint discovery needs ports that carry UMP, such as loopback ports");
     return nullptr;
   }
   
-  if (midiOutputs[deviceIndex].handle == nullptr) {
-    napi_throw_error(env, "DEVICE_NOT_OPEN", "Device not open. Call openUmpOutput first.");
+  napi_value promise;
+  napi_deferred deferred;
+  napi_create_promise(env, &deferred, &promise);
+  
+  DiscoveryRequest* request = new DiscoveryRequest{ 0, deferred, nullptr };
+  napi_value resourceName;
+  napi_create_string_utf8(env, "midi2:endpoint-discovery", NAPI_AUTO_LENGTH, &resourceName);
+  napi_create_threadsafe_function(env, nullptr, nullptr, resourceName, 0, 1,
+                                  nullptr, nullptr, nullptr, CallDiscovery, &request->callback);
+  
+  napi_threadsafe_function callback = request->callback;
+  request->id = EndpointDiscoveryManager::follow(input->deviceId, [callback, request](uint32_t id, EndpointDiscovery::Event event, const EndpointInfo& endpoint) {
+    DiscoveryReport* report = new DiscoveryReport{ request, endpoint };
+    if (napi_call_threadsafe_function(callback, report, napi_tsfn_nonblocking) != napi_ok) {
+      delete report;
+    }
+  });
+  uint64_t timeoutNs = (uint64_t)(std::max<double>(1.0, timeoutMs) * 1e6);
+  EndpointDiscoveryManager::with(request->id, [&](EndpointDiscovery& discovery) {
+    begin(discovery, outputToken, output->deviceId, input->deviceId, timeoutNs);
+  });
+  return promise;
+}
+
+static double GetTimeoutMs(napi_env env, size_t argc, napi_value* argv, size_t index) {
+  double timeoutMs = 1000;
+  napi_valuetype type = napi_undefined;
+  if (argc > index) napi_typeof(env, argv[index], &type);
+  if (type == napi_object) {
+    napi_value value;
+    bool has = false;
+    napi_has_named_property(env, argv[index], "timeoutMs", &has);
+    if (has && napi_get_named_property(env, argv[index], "timeoutMs", &value) == napi_ok) {
+      napi_get_value_double(env, value, &timeoutMs);
+    }
+  }
+  return timeoutMs;
+}
+
+/**
+ * Ask the UMP endpoint behind a pair of open ports about itself:
+ *   discoverEndpoint(outputHandle, inputHandle, { timeoutMs = 1000 }) -> Promise<endpoint>
+ * endpoint is { deviceId, inputId, ump, umpVersion, name, productInstanceId,
+ * midi1Protocol, midi2Protocol, canReceiveJr, canTransmitJr, identity,
+ * configuration: { protocol, receiveJr, transmitJr }, staticFunctionBlocks,
+ * functionBlocks: [{ index, name, active, direction, firstGroup, groupCount,
+ * midi1, uiHint, midiCiVersion, maxSysEx8Streams }] }, and is cached for
+ * getEndpointInfo(). ump is false when nothing answered in time.
+ * Stream messages need ports that carry UMP, which today are only the
+ * loopback ports; any other port throws UNSUPPORTED, as no hardware UMP
+ * transport is implemented yet.
+ */
+napi_value DiscoverEndpoint(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  return StartDiscovery(env, argv, argc, GetTimeoutMs(env, argc, argv, 2),
+                        [](EndpointDiscovery& discovery, uint32_t output, uint64_t outputId, uint64_t inputId, uint64_t timeoutNs) {
+    discovery.begin(output, outputId, inputId, timeoutNs);
+  });
+}
+
+/**
+ * Ask the endpoint to switch protocol and Jitter Reduction:
+ *   configureEndpoint(outputHandle, inputHandle, { protocol: 'midi1' | 'midi2',
+ *                     receiveJr = false, transmitJr = false, timeoutMs = 1000 }) -> Promise<endpoint>
+ * Resolves with the endpoint once it confirms, its configuration is what
+ * it actually took up. Builds on the last discovery of the pair. Loopback
+ * ports only, like discoverEndpoint().
+ */
+napi_value ConfigureEndpoint(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype type = napi_undefined;
+  if (argc >= 3) napi_typeof(env, argv[2], &type);
+  if (type != napi_object) {
+    napi_throw_error(env, "INVALID_ARGS", "Options with a protocol required");
     return nullptr;
   }
   
-#ifdef _WIN32
-  // Convert 32-bit UMP packet to byte array
-  uint8_t data[4] = {
-    (uint8_t)((packet >> 24) & 0xFF),
-    (uint8_t)((packet >> 16) & 0xFF),
-    (uint8_t)((packet >> 8) & 0xFF),
-    (uint8_t)(packet & 0xFF)
-  };
-  MMRESULT result = WindowsMIDIManager::sendData((HMIDIOUT)midiOutputs[deviceIndex].handle, data, 4);
-  if (result != MMSYSERR_NOERROR) {
-    napi_throw_error(env, "SEND_FAILED", "Failed to send MIDI message");
+  napi_value value;
+  char protocolName[8] = "";
+  size_t length = 0;
+  if (napi_get_named_property(env, argv[2], "protocol", &value) == napi_ok) {
+    napi_get_value_string_utf8(env, value, protocolName, sizeof(protocolName), &length);
   }
-#elif __APPLE__
-  MIDIEndpointRef dest = *(MIDIEndpointRef*)midiOutputs[deviceIndex].handle;
-  MacMIDIManager::sendUMP(dest, &packet, 1);
-#elif __linux__
-  ALSAMIDIManager::sendUMP((snd_rawmidi_t*)midiOutputs[deviceIndex].handle, &packet, 1);
-#endif
+  uint8_t protocol;
+  if (strcmp(protocolName, "midi1") == 0) protocol = ump::stream::PROTOCOL_MIDI1;
+  else if (strcmp(protocolName, "midi2") == 0) protocol = ump::stream::PROTOCOL_MIDI2;
+  else {
+    napi_throw_error(env, "INVALID_ARGS", "protocol must be 'midi1' or 'midi2'");
+    return nullptr;
+  }
+  bool receiveJr = false, transmitJr = false;
+  if (napi_get_named_property(env, argv[2], "receiveJr", &value) == napi_ok) napi_get_value_bool(env, value, &receiveJr);
+  if (napi_get_named_property(env, argv[2], "transmitJr", &value) == napi_ok) napi_get_value_bool(env, value, &transmitJr);
   
-  return nullptr;
+  return StartDiscovery(env, argv, argc, GetTimeoutMs(env, argc, argv, 2),
+                        [=](EndpointDiscovery& discovery, uint32_t output, uint64_t outputId, uint64_t inputId, uint64_t timeoutNs) {
+    EndpointInfo known;
+    if (!EndpointCache::find(outputId, known)) {
+      known.deviceId = outputId;
+      known.inputId = inputId;
+    }
+    discovery.configure(output, known, protocol, receiveJr, transmitJr, timeoutNs);
+  });
 }
 
-napi_value OnUmpInput(napi_env env, napi_callback_info info) {
-  // TODO: Implement input callback
-  return nullptr;
+/**
+ * getEndpointInfo(deviceId) -> the cached endpoint of an output or input id,
+ * or null if it was never discovered. Without an id, every cached endpoint.
+ */
+napi_value GetEndpointInfo(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+  
+  napi_valuetype type = napi_undefined;
+  if (argc >= 1) napi_typeof(env, argv[0], &type);
+  if (type == napi_undefined) {
+    std::vector<EndpointInfo> endpoints = EndpointCache::list();
+    napi_value result;
+    napi_create_array_with_length(env, endpoints.size(), &result);
+    for (size_t i = 0; i < endpoints.size(); i++) {
+      napi_set_element(env, result, (uint32_t)i, EndpointToObject(env, endpoints[i]));
+    }
+    return result;
+  }
+  
+  char buffer[24];
+  size_t length = 0;
+  if (type != napi_string || napi_get_value_string_utf8(env, argv[0], buffer, sizeof(buffer), &length) != napi_ok) {
+    napi_throw_error(env, "INVALID_ARGS", "Device id string required");
+    return nullptr;
+  }
+  char* end = nullptr;
+  uint64_t id = strtoull(buffer, &end, 16);
+  EndpointInfo endpoint;
+  napi_value result;
+  if (length == 0 || *end != '\0' || !EndpointCache::find(id, endpoint)) {
+    napi_get_null(env, &result);
+    return result;
+  }
+  return EndpointToObject(env, endpoint);
 }
 
 napi_value SendSysEx(napi_env env, napi_callback_info info) {
@@ -630,10 +3079,30 @@ napi_value GetCapabilities(napi_env env, napi_callback_info info) {
   napi_create_string_utf8(env, platform_str, NAPI_AUTO_LENGTH, &platform);
   napi_set_named_property(env, result, "platform", platform);
   
+  // Known only from endpoints that answered discoverEndpoint(), which needs
+  // a UMP transport; only the loopback ports are one, so hardware never
+  // shows up here. umpTransports lists what discovery can run over.
+  std::vector<EndpointInfo> endpoints = EndpointCache::list();
+  bool midi2 = false;
+  for (const EndpointInfo& endpoint : endpoints) midi2 |= endpoint.midi2Protocol;
   napi_value midi2_support;
-  napi_get_boolean(env, true, &midi2_support);
+  napi_get_boolean(env, midi2, &midi2_support);
   napi_set_named_property(env, result, "midi2Support", midi2_support);
   
+  napi_value endpoint_list;
+  napi_create_array_with_length(env, endpoints.size(), &endpoint_list);
+  for (size_t i = 0; i < endpoints.size(); i++) {
+    napi_set_element(env, endpoint_list, (uint32_t)i, EndpointToObject(env, endpoints[i]));
+  }
+  napi_set_named_property(env, result, "endpoints", endpoint_list);
+  
+  napi_value ump_transports;
+  napi_create_array_with_length(env, 1, &ump_transports);
+  napi_value loopback;
+  napi_create_string_utf8(env, "loopback", NAPI_AUTO_LENGTH, &loopback);
+  napi_set_element(env, ump_transports, 0, loopback);
+  napi_set_named_property(env, result, "umpTransports", ump_transports);
+  
   napi_value ump_support;
   napi_get_boolean(env, true, &ump_support);
   napi_set_named_property(env, result, "umpSupport", ump_support);
@@ -661,6 +3130,14 @@ napi_value GetCapabilities(napi_env env, napi_callback_info info) {
   return result;
 }
 
+static void Cleanup(void* arg) {
+  StopThreads();
+  DeviceRegistry::setChangeListener(nullptr);
+  InputHub::clear();
+  HandleTable::closeAll();
+  HandlePool::closeAll();
+}
+
 /**
  * Module initialization
  */
@@ -668,16 +3145,78 @@ napi_value Init(napi_env env, napi_value exports) {
   napi_property_descriptor properties[] = {
     { "getUmpOutputs", 0, GetUmpOutputs, 0, 0, 0, napi_default, 0 },
     { "getUmpInputs", 0, GetUmpInputs, 0, 0, 0, napi_default, 0 },
+    { "getUmpDevicesAsync", 0, GetUmpDevicesAsync, 0, 0, 0, napi_default, 0 },
     { "openUmpOutput", 0, OpenUmpOutput, 0, 0, 0, napi_default, 0 },
     { "closeUmpOutput", 0, CloseUmpOutput, 0, 0, 0, napi_default, 0 },
     { "sendUmp", 0, SendUmp, 0, 0, 0, napi_default, 0 },
+    { "sendUmpBatch", 0, SendUmpBatch, 0, 0, 0, napi_default, 0 },
+    { "encodeNotes", 0, EncodeNotes, 0, 0, 0, napi_default, 0 },
+    { "playNotes", 0, PlayNotes, 0, 0, 0, napi_default, 0 },
+    { "panic", 0, Panic, 0, 0, 0, napi_default, 0 },
+    { "openUmpInput", 0, OpenUmpInput, 0, 0, 0, napi_default, 0 },
+    { "closeUmpInput", 0, CloseUmpInput, 0, 0, 0, napi_default, 0 },
     { "onUmpInput", 0, OnUmpInput, 0, 0, 0, napi_default, 0 },
+    { "offUmpInput", 0, OffUmpInput, 0, 0, 0, napi_default, 0 },
+    { "encodeFlexData", 0, EncodeFlexData, 0, 0, 0, napi_default, 0 },
+    { "sendFlexData", 0, SendFlexData, 0, 0, 0, napi_default, 0 },
+    { "decodeFlexData", 0, DecodeFlexData, 0, 0, 0, napi_default, 0 },
+    { "onFlexData", 0, OnFlexData, 0, 0, 0, napi_default, 0 },
+    { "offFlexData", 0, OffFlexData, 0, 0, 0, napi_default, 0 },
+    { "setHandleIdleTimeout", 0, SetHandleIdleTimeout, 0, 0, 0, napi_default, 0 },
+    { "configureVirtualPorts", 0, ConfigureVirtualPorts, 0, 0, 0, napi_default, 0 },
+    { "getStats", 0, GetStats, 0, 0, 0, napi_default, 0 },
+    { "startCapture", 0, StartCapture, 0, 0, 0, napi_default, 0 },
+    { "stopCapture", 0, StopCapture, 0, 0, 0, napi_default, 0 },
+    { "openPlayer", 0, OpenPlayer, 0, 0, 0, napi_default, 0 },
+    { "playPlayer", 0, PlayPlayer, 0, 0, 0, napi_default, 0 },
+    { "pausePlayer", 0, PausePlayer, 0, 0, 0, napi_default, 0 },
+    { "seekPlayer", 0, SeekPlayer, 0, 0, 0, napi_default, 0 },
+    { "setPlayerLoop", 0, SetPlayerLoop, 0, 0, 0, napi_default, 0 },
+    { "getPlayerState", 0, GetPlayerState, 0, 0, 0, napi_default, 0 },
+    { "closePlayer", 0, ClosePlayer, 0, 0, 0, napi_default, 0 },
+    { "openClock", 0, OpenClock, 0, 0, 0, napi_default, 0 },
+    { "startClock", 0, StartClock, 0, 0, 0, napi_default, 0 },
+    { "continueClock", 0, ContinueClock, 0, 0, 0, napi_default, 0 },
+    { "stopClock", 0, StopClock, 0, 0, 0, napi_default, 0 },
+    { "setClockTempo", 0, SetClockTempo, 0, 0, 0, napi_default, 0 },
+    { "setClockSwing", 0, SetClockSwing, 0, 0, 0, napi_default, 0 },
+    { "setClockPosition", 0, SetClockPosition, 0, 0, 0, napi_default, 0 },
+    { "getClockState", 0, GetClockState, 0, 0, 0, napi_default, 0 },
+    { "closeClock", 0, CloseClock, 0, 0, 0, napi_default, 0 },
+    { "openMtc", 0, OpenMtc, 0, 0, 0, napi_default, 0 },
+    { "startMtc", 0, StartMtc, 0, 0, 0, napi_default, 0 },
+    { "stopMtc", 0, StopMtc, 0, 0, 0, napi_default, 0 },
+    { "locateMtc", 0, LocateMtc, 0, 0, 0, napi_default, 0 },
+    { "getMtcState", 0, GetMtcState, 0, 0, 0, napi_default, 0 },
+    { "closeMtc", 0, CloseMtc, 0, 0, 0, napi_default, 0 },
+    { "followClock", 0, FollowClock, 0, 0, 0, napi_default, 0 },
+    { "getClockFollowerState", 0, GetClockFollowerState, 0, 0, 0, napi_default, 0 },
+    { "unfollowClock", 0, UnfollowClock, 0, 0, 0, napi_default, 0 },
+    { "chaseMtc", 0, ChaseMtc, 0, 0, 0, napi_default, 0 },
+    { "getMtcChaseState", 0, GetMtcChaseState, 0, 0, 0, napi_default, 0 },
+    { "stopMtcChase", 0, StopMtcChase, 0, 0, 0, napi_default, 0 },
+    { "upscaleValues", 0, UpscaleValues, 0, 0, 0, napi_default, 0 },
+    { "downscaleValues", 0, DownscaleValues, 0, 0, 0, napi_default, 0 },
+    { "translateProtocol", 0, TranslateProtocol, 0, 0, 0, napi_default, 0 },
+    { "decodeMidiFile", 0, DecodeMidiFile, 0, 0, 0, napi_default, 0 },
+    { "encodeMidiFile", 0, EncodeMidiFile, 0, 0, 0, napi_default, 0 },
+    { "convertMidiFiles", 0, ConvertMidiFiles, 0, 0, 0, napi_default, 0 },
+    { "setTraceEnabled", 0, SetTraceEnabled, 0, 0, 0, napi_default, 0 },
+    { "getTrace", 0, GetTrace, 0, 0, 0, napi_default, 0 },
+    { "onDeviceChange", 0, OnDeviceChange, 0, 0, 0, napi_default, 0 },
     { "sendSysEx", 0, SendSysEx, 0, 0, 0, napi_default, 0 },
+    { "discoverEndpoint", 0, DiscoverEndpoint, 0, 0, 0, napi_default, 0 },
+    { "configureEndpoint", 0, ConfigureEndpoint, 0, 0, 0, napi_default, 0 },
+    { "getEndpointInfo", 0, GetEndpointInfo, 0, 0, 0, napi_default, 0 },
     { "getCapabilities", 0, GetCapabilities, 0, 0, 0, napi_default, 0 }
   };
   
-  napi_define_properties(env, exports, 8, properties);
+  napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties);
+  
+  StartThreads();
+  napi_add_env_cleanup_hook(env, Cleanup, nullptr);
+  std::atexit(StopThreads);
   return exports;
 }
 
-NAPI_MODULE(midi2_native, Init)
+NAPI_MODULE(midi2_native, Init)
\ No newline at end of file
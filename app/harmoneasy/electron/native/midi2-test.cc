@@ -0,0 +1,845 @@
+/**
+ * Regression tests for the native MIDI layer
+ *
+ * Runs fixtures through the same core as the addon. Anything that goes over
+ * a port uses the loopback pairs, so the suite needs no hardware:
+ * - smf.*: truncated and corrupted headers and tracks through SmfReader and
+ *   decodeColumns
+ * - convert.*: SMF <-> MIDI Clip File round trips
+ * - flex.*: Flex Data text split over several packets, decoded directly and
+ *   after a trip through a loopback port
+ * - mtc.*: 29.97 fps drop-frame labels <-> frame counts
+ * - scheduler.*: playNotes() re-trigger pairing and panic() on queued notes
+ * - discovery.*: endpoint discovery and configuration against a scripted
+ *   UMP endpoint answering on the loopback
+ *
+ * Fixtures are built in exactly sized buffers, so a build with
+ * -fsanitize=address also catches any read past a truncated file. Prints
+ * one line per test and exits non-zero if any check failed:
+ *
+ *   midi2-test [name-prefix ...]
+ *
+ * Build with: pnpm run build-native (target midi2-test)
+ */
+
+#include "midi2-core.h"
+
+#include <cstdio>
+#include <random>
+
+// ============================================================================
+// Harness
+// ============================================================================
+
+static const char* currentTest = "";
+static int currentFailures = 0;
+
+static bool check(bool ok, const char* expression, const char* file, int line) {
+  if (!ok) {
+    currentFailures++;
+    fprintf(stderr, "[MIDI2] %s: %s:%d: %s\n", currentTest, file, line, expression);
+  }
+  return ok;
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+struct TestCase {
+  const char* name;
+  void (*run)();
+};
+
+// Wait up to timeoutMs for done() to hold, polling so listener threads can run
+template<typename Done>
+static bool waitFor(Done done, uint32_t timeoutMs) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+// An open output token and input entry on loopback pair `port`
+struct LoopbackPair {
+  MIDIDevice outputDevice;
+  MIDIDevice inputDevice;
+  uint32_t token = 0;
+  PooledHandle* input = nullptr;
+
+  bool open(uint32_t port) {
+    std::vector<MIDIDevice> outputs, inputs;
+    DeviceRegistry::snapshot(outputs, inputs);
+    bool found = false;
+    for (const MIDIDevice& output : outputs) {
+      if (!output.isVirtual || output.endpoint != port) continue;
+      for (const MIDIDevice& candidate : inputs) {
+        if (candidate.isVirtual && candidate.endpoint == port) {
+          outputDevice = output;
+          inputDevice = candidate;
+          found = true;
+        }
+      }
+    }
+    if (!found) return false;
+    PooledHandle* output = nullptr;
+    if (HandlePool::acquire(outputDevice, output) < 0) return false;
+    token = HandleTable::allocate(&output, 1, nullptr);
+    return token != 0 && HandlePool::acquire(inputDevice, input) == 0;
+  }
+
+  void close() {
+    if (token != 0) HandleTable::release(token);
+    if (input != nullptr) HandlePool::release(input);
+    token = 0;
+    input = nullptr;
+  }
+
+  bool send(const uint32_t* words, size_t count) {
+    bool sent = false;
+    HandleTable::withSlot(token, [&](OpenHandle& slot) {
+      sent = WriteUmp(slot, words, count, monotonicNanoseconds());
+    });
+    return sent;
+  }
+};
+
+// Packets arriving on one input, with their arrival times
+class Recorder {
+private:
+  uint64_t deviceId;
+  uint32_t subscription;
+  std::mutex mutex;
+  std::vector<std::pair<uint64_t, std::vector<uint32_t>>> packets;
+
+public:
+  explicit Recorder(uint64_t device) : deviceId(device) {
+    subscription = InputHub::subscribe([this](uint64_t device, const uint32_t* words, size_t count, uint64_t timestampNs) {
+      if (device != deviceId) return;
+      std::lock_guard<std::mutex> lock(mutex);
+      for (size_t i = 0; i + ump::packetWordsOf(words[i]) <= count; i += ump::packetWordsOf(words[i])) {
+        packets.emplace_back(timestampNs, std::vector<uint32_t>(words + i, words + i + ump::packetWordsOf(words[i])));
+      }
+    });
+  }
+
+  ~Recorder() {
+    InputHub::unsubscribe(subscription);
+  }
+
+  std::vector<std::pair<uint64_t, std::vector<uint32_t>>> take() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return packets;
+  }
+
+  size_t count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return packets.size();
+  }
+};
+
+// ============================================================================
+// Fixtures
+// ============================================================================
+
+static void putVarLength(std::vector<uint8_t>& out, uint32_t value) {
+  uint8_t staged[4];
+  int length = 0;
+  do {
+    staged[length++] = (uint8_t)(value & 0x7F);
+    value >>= 7;
+  } while (value > 0 && length < 4);
+  while (length > 1) out.push_back(staged[--length] | 0x80);
+  out.push_back(staged[0]);
+}
+
+static void putChunk(std::vector<uint8_t>& out, const char* id, const std::vector<uint8_t>& body) {
+  out.insert(out.end(), id, id + 4);
+  uint32_t length = (uint32_t)body.size();
+  for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t)(length >> shift));
+  out.insert(out.end(), body.begin(), body.end());
+}
+
+static std::vector<uint8_t> smfHeader(uint16_t format, uint16_t tracks, uint16_t division) {
+  std::vector<uint8_t> body = { (uint8_t)(format >> 8), (uint8_t)format, (uint8_t)(tracks >> 8), (uint8_t)tracks,
+                                (uint8_t)(division >> 8), (uint8_t)division };
+  std::vector<uint8_t> out;
+  putChunk(out, "MThd", body);
+  return out;
+}
+
+// Format 1 at 96 ticks per quarter: a conductor track speeding up from 120
+// to 240 BPM after two beats, then notes with running status, a program
+// change, pitch bend, a SysEx and the sustain pedal
+static std::vector<uint8_t> smfFixture() {
+  std::vector<uint8_t> conductor;
+  auto event = [](std::vector<uint8_t>& track, uint32_t delta, std::initializer_list<uint8_t> bytes) {
+    putVarLength(track, delta);
+    track.insert(track.end(), bytes);
+  };
+  event(conductor, 0, { 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20 });
+  event(conductor, 192, { 0xFF, 0x51, 0x03, 0x03, 0xD0, 0x90 });
+  event(conductor, 0, { 0xFF, 0x2F, 0x00 });
+
+  std::vector<uint8_t> notes;
+  event(notes, 0, { 0xC0, 0x05 });
+  event(notes, 0, { 0x90, 0x3C, 0x64 });
+  event(notes, 48, { 0x3E, 0x64 });
+  event(notes, 48, { 0x80, 0x3C, 0x40 });
+  event(notes, 0, { 0x3E, 0x00 });
+  event(notes, 96, { 0xE0, 0x00, 0x40 });
+  event(notes, 0, { 0xF0, 0x05, 0x7E, 0x7F, 0x09, 0x01, 0xF7 });
+  event(notes, 96, { 0xB0, 0x40, 0x7F });
+  event(notes, 0, { 0x90, 0x43, 0x50 });
+  event(notes, 96, { 0xB0, 0x40, 0x00 });
+  event(notes, 0, { 0x80, 0x43, 0x00 });
+  event(notes, 0, { 0xFF, 0x2F, 0x00 });
+
+  std::vector<uint8_t> file = smfHeader(1, 2, 96);
+  putChunk(file, "MTrk", conductor);
+  putChunk(file, "MTrk", notes);
+  return file;
+}
+
+// One track holding `body` after a valid format 0 header
+static std::vector<uint8_t> smfWithTrack(const std::vector<uint8_t>& body) {
+  std::vector<uint8_t> file = smfHeader(0, 1, 96);
+  putChunk(file, "MTrk", body);
+  return file;
+}
+
+struct Walked {
+  uint64_t tick;
+  uint64_t timeNs;
+  std::vector<uint32_t> words;
+
+  bool operator==(const Walked& other) const {
+    return tick == other.tick && timeNs == other.timeNs && words == other.words;
+  }
+};
+
+// Every event of an SMF in an exactly sized copy, Set Tempo included
+static bool walkSmf(const std::vector<uint8_t>& file, std::vector<Walked>& events, std::string& error) {
+  std::vector<uint8_t> exact(file);
+  midifile::SmfReader reader;
+  reader.setTempoEvents(true);
+  events.clear();
+  if (!reader.open(exact.data(), exact.size(), error)) return false;
+  midifile::Event event;
+  while (reader.next(event)) {
+    events.push_back({ event.tick, event.timeNs, std::vector<uint32_t>(event.words, event.words + event.count) });
+  }
+  return true;
+}
+
+static size_t decodeRows(const std::vector<uint8_t>& file, std::string& error) {
+  std::vector<uint8_t> exact(file);
+  midifile::Columns columns;
+  midifile::SmfReader reader;
+  if (!midifile::decodeColumns(exact.data(), exact.size(), columns, reader, error)) return 0;
+  return columns.size();
+}
+
+template<typename T>
+static bool isSubsequence(const std::vector<T>& part, const std::vector<T>& whole) {
+  size_t next = 0;
+  for (const T& item : whole) {
+    if (next < part.size() && part[next] == item) next++;
+  }
+  return next == part.size();
+}
+
+// ============================================================================
+// Standard MIDI Files
+// ============================================================================
+
+static void testSmfFixture() {
+  std::vector<Walked> events;
+  std::string error;
+  CHECK(walkSmf(smfFixture(), events, error));
+  // 2 tempos, 10 channel messages, 1 SysEx
+  CHECK(events.size() == 13);
+  CHECK(decodeRows(smfFixture(), error) == 10);
+  if (events.size() < 13) return;
+  // Conductor first on a shared tick
+  CHECK(ump::flex::isSetTempo(events[0].words.data()));
+  // The running status note-on lands two beats in at 120 BPM, one beat later at 240
+  CHECK(events[3].tick == 48 && events[3].words[0] == 0x20903E64);
+  CHECK(events[7].tick == 192 && events[7].timeNs == 1000000000ULL);
+}
+
+// Every prefix of the fixture decodes to a subsequence of the whole file
+static void testSmfTruncated() {
+  std::vector<uint8_t> file = smfFixture();
+  std::vector<Walked> whole;
+  std::string error;
+  CHECK(walkSmf(file, whole, error));
+  size_t wholeRows = decodeRows(file, error);
+
+  for (size_t length = 0; length < file.size(); length++) {
+    std::vector<uint8_t> prefix(file.begin(), file.begin() + length);
+    std::vector<Walked> events;
+    std::string prefixError;
+    bool opened = walkSmf(prefix, events, prefixError);
+    if (length < 14) CHECK(!opened && prefixError == "Not a Standard MIDI File");
+    if (opened) CHECK(isSubsequence(events, whole));
+    CHECK(decodeRows(prefix, prefixError) <= wholeRows);
+  }
+}
+
+static void testSmfCorruptHeaders() {
+  std::string error;
+  std::vector<Walked> events;
+
+  std::vector<uint8_t> magic = smfFixture();
+  magic[3] = 'x';
+  CHECK(!walkSmf(magic, events, error) && error == "Not a Standard MIDI File");
+
+  // A header claiming to be longer than the file
+  std::vector<uint8_t> header = smfFixture();
+  header[4] = 0xFF;
+  CHECK(!walkSmf(header, events, error) && error == "Standard MIDI File header is truncated");
+  header[4] = 0x00;
+  header[7] = (uint8_t)(header.size() - 7);
+  CHECK(!walkSmf(header, events, error) && error == "Standard MIDI File header is truncated");
+
+  // Only unknown chunks
+  std::vector<uint8_t> unknown = smfHeader(0, 1, 96);
+  putChunk(unknown, "XFIH", { 0x00, 0x90, 0x3C, 0x64 });
+  CHECK(!walkSmf(unknown, events, error) && error == "Standard MIDI File has no tracks");
+
+  // Two tracks declared, one present
+  std::vector<uint8_t> missing = smfHeader(1, 2, 96);
+  putChunk(missing, "MTrk", { 0x00, 0x90, 0x3C, 0x64, 0x00, 0xFF, 0x2F, 0x00 });
+  CHECK(walkSmf(missing, events, error) && events.size() == 1);
+
+  // A chunk length past the end keeps what is there
+  std::vector<uint8_t> long_ = smfWithTrack({ 0x00, 0x90, 0x3C, 0x64, 0x10, 0x80, 0x3C, 0x00 });
+  long_[21] = 0x7F;
+  CHECK(walkSmf(long_, events, error) && events.size() == 2);
+}
+
+static void testSmfCorruptTracks() {
+  std::string error;
+  std::vector<Walked> events;
+  struct Case {
+    const char* name;
+    std::vector<uint8_t> body;
+    size_t expected;
+  };
+  const Case cases[] = {
+    { "empty track", {}, 0 },
+    { "ends after its first delta", { 0x00 }, 0 },
+    { "unterminated delta", { 0x81, 0x81, 0x81 }, 0 },
+    { "data byte without running status", { 0x00, 0x3C, 0x64 }, 0 },
+    { "status with no data", { 0x00, 0x90 }, 0 },
+    { "one of two data bytes", { 0x00, 0x90, 0x3C }, 0 },
+    { "event then cut delta", { 0x00, 0x90, 0x3C, 0x64, 0x81 }, 1 },
+    { "meta type cut", { 0x00, 0x90, 0x3C, 0x64, 0x00, 0xFF }, 1 },
+    { "meta length past the end", { 0x00, 0x90, 0x3C, 0x64, 0x00, 0xFF, 0x01, 0x7F, 0x41 }, 1 },
+    { "meta length unterminated", { 0x00, 0xFF, 0x01, 0xFF, 0xFF }, 0 },
+    { "SysEx length past the end", { 0x00, 0xF0, 0x40, 0x7E, 0x7F }, 0 },
+    { "events after End of Track", { 0x00, 0xFF, 0x2F, 0x00, 0x00, 0x90, 0x3C, 0x64 }, 0 },
+  };
+  for (const Case& test : cases) {
+    bool opened = walkSmf(smfWithTrack(test.body), events, error);
+    if (!check(opened && events.size() == test.expected, test.name, __FILE__, __LINE__)) continue;
+    CHECK(decodeRows(smfWithTrack(test.body), error) == test.expected);
+  }
+}
+
+// Seeded random bytes over the fixture, every decode has to end cleanly
+static void testSmfCorruptRandom() {
+  std::vector<uint8_t> file = smfFixture();
+  std::mt19937 random(7);
+  std::string error;
+  for (int iteration = 0; iteration < 5000; iteration++) {
+    std::vector<uint8_t> corrupt(file);
+    int changes = 1 + (int)(random() % 4);
+    for (int i = 0; i < changes; i++) corrupt[random() % corrupt.size()] = (uint8_t)random();
+    // Cut some of them short as well
+    if (iteration % 3 == 0) corrupt.resize(random() % corrupt.size());
+    std::vector<Walked> events;
+    if (walkSmf(corrupt, events, error)) CHECK(events.size() <= corrupt.size());
+    CHECK(decodeRows(corrupt, error) <= corrupt.size());
+  }
+}
+
+// ============================================================================
+// SMF <-> Clip Conversion
+// ============================================================================
+
+static void testConvertRoundTrip() {
+  std::vector<uint8_t> smf = smfFixture();
+  std::vector<uint8_t> clipFile, smfAgain, clipAgain;
+  uint64_t events = 0;
+  std::string error;
+  CHECK(convert::smfToClip(smf.data(), smf.size(), clipFile, events, error));
+  CHECK(events == 13);
+  CHECK(convert::clipToSmf(clipFile.data(), clipFile.size(), smfAgain, events, error));
+  CHECK(events == 13);
+
+  // Tracks are merged, everything else survives: ticks, times after the tempo map, packets
+  std::vector<Walked> before, after;
+  CHECK(walkSmf(smf, before, error));
+  CHECK(walkSmf(smfAgain, after, error));
+  CHECK(before == after);
+
+  // A second trip is stable byte for byte
+  CHECK(convert::smfToClip(smfAgain.data(), smfAgain.size(), clipAgain, events, error));
+  CHECK(clipAgain == clipFile);
+}
+
+// Columns encoded to an SMF read back as the same rows
+static void testConvertColumns() {
+  const uint32_t ticks[] = { 0, 0, 96, 96, 192, 288 };
+  const uint8_t types[] = { 0xC, 0x9, 0x8, 0xB, 0xE, 0xD };
+  const uint8_t channels[] = { 1, 1, 1, 2, 3, 4 };
+  const uint8_t data1[] = { 12, 60, 60, 7, 0x11, 90 };
+  const uint8_t data2[] = { 0, 100, 0, 90, 0x40, 0 };
+  std::vector<uint8_t> smf;
+  midifile::SmfWriter::encode(ticks, types, channels, data1, data2, 6, 96, 500000, smf);
+
+  std::vector<uint8_t> exact(smf);
+  midifile::Columns columns;
+  midifile::SmfReader reader;
+  std::string error;
+  CHECK(midifile::decodeColumns(exact.data(), exact.size(), columns, reader, error));
+  if (!CHECK(columns.size() == 6)) return;
+  for (size_t i = 0; i < 6; i++) {
+    CHECK(columns.tick[i] == ticks[i] && columns.type[i] == types[i] && columns.channel[i] == channels[i]);
+    CHECK(columns.data1[i] == data1[i] && columns.data2[i] == data2[i]);
+  }
+  CHECK(columns.time[4] == 1.0);
+}
+
+// ============================================================================
+// Flex Data
+// ============================================================================
+
+static flexdata::Message lyric(uint8_t group, const std::string& text) {
+  flexdata::Message message;
+  message.kind = flexdata::Kind::Text;
+  message.group = group;
+  message.channel = 2;
+  message.textKind = (uint8_t)flexdata::findTextKind("lyrics");
+  message.text = text;
+  return message;
+}
+
+static void testFlexText() {
+  const std::string texts[] = { "", "twelve bytes", "thirteen byte", "a lyric long enough to need four packets",
+                                "exactly twenty-four byte" };
+  for (const std::string& text : texts) {
+    std::vector<uint32_t> words;
+    flexdata::encode(lyric(5, text), words);
+    size_t packets = text.empty() ? 1 : (text.size() + 11) / 12;
+    if (!CHECK(words.size() == packets * 4)) continue;
+
+    flexdata::Decoder decoder;
+    flexdata::Message decoded;
+    for (size_t p = 0; p < packets; p++) {
+      bool done = decoder.feed(words.data() + p * 4, decoded);
+      // Only the last packet completes the message
+      CHECK(done == (p == packets - 1));
+    }
+    CHECK(decoded.kind == flexdata::Kind::Text && decoded.text == text);
+    CHECK(decoded.group == 5 && decoded.channel == 2 && decoded.textKind == flexdata::findTextKind("lyrics"));
+  }
+}
+
+static void testFlexTextInterleaved() {
+  std::vector<uint32_t> first, second;
+  flexdata::encode(lyric(0, "first group, three packets long"), first);
+  flexdata::encode(lyric(1, "second group, also three of them"), second);
+  CHECK(first.size() == 12 && second.size() == 12);
+
+  flexdata::Decoder decoder;
+  flexdata::Message decoded;
+  std::vector<std::string> texts;
+  for (size_t p = 0; p < 3; p++) {
+    if (decoder.feed(first.data() + p * 4, decoded)) texts.push_back(decoded.text);
+    if (decoder.feed(second.data() + p * 4, decoded)) texts.push_back(decoded.text);
+  }
+  CHECK(texts.size() == 2 && texts[0] == "first group, three packets long" && texts[1] == "second group, also three of them");
+
+  // A text whose start went missing is dropped, the next one decodes
+  decoder.reset();
+  CHECK(!decoder.feed(first.data() + 4, decoded));
+  CHECK(!decoder.feed(first.data() + 8, decoded));
+  for (size_t p = 0; p < 3; p++) decoder.feed(second.data() + p * 4, decoded);
+  CHECK(decoded.text == "second group, also three of them");
+}
+
+// Packets in one write arrive intact and in order on the other side
+static void testFlexLoopback() {
+  LoopbackPair pair;
+  if (!CHECK(pair.open(0))) return;
+  Recorder recorder(pair.inputDevice.id);
+
+  std::vector<uint32_t> words;
+  flexdata::Message tempo;
+  tempo.kind = flexdata::Kind::Tempo;
+  tempo.bpm = 96;
+  flexdata::encode(tempo, words);
+  flexdata::encode(lyric(3, "sung over a loopback port in four parts"), words);
+  CHECK(pair.send(words.data(), words.size()));
+  CHECK(waitFor([&]() { return recorder.count() >= 5; }, 1000));
+
+  flexdata::Decoder decoder;
+  flexdata::Message decoded;
+  std::vector<flexdata::Message> messages;
+  for (const auto& packet : recorder.take()) {
+    if (decoder.feed(packet.second.data(), decoded)) messages.push_back(decoded);
+  }
+  if (CHECK(messages.size() == 2)) {
+    CHECK(messages[0].kind == flexdata::Kind::Tempo && std::fabs(messages[0].bpm - 96) < 1e-6);
+    CHECK(messages[1].text == "sung over a loopback port in four parts" && messages[1].group == 3);
+  }
+  pair.close();
+}
+
+// ============================================================================
+// MIDI Time Code
+// ============================================================================
+
+static mtc::Timecode dropFrame(uint8_t hours, uint8_t minutes, uint8_t seconds, uint8_t frames) {
+  return mtc::Timecode{ hours, minutes, seconds, frames, mtc::Rate::Fps2997Drop };
+}
+
+static bool sameLabel(const mtc::Timecode& a, const mtc::Timecode& b) {
+  return a.hours == b.hours && a.minutes == b.minutes && a.seconds == b.seconds && a.frames == b.frames && a.rate == b.rate;
+}
+
+static void testMtcDropFrameLabels() {
+  // :00 and :01 are skipped at every minute but each tenth
+  CHECK(mtc::toFrames(dropFrame(0, 1, 0, 2)) == 1800);
+  CHECK(sameLabel(mtc::fromFrames(1799, mtc::Rate::Fps2997Drop), dropFrame(0, 0, 59, 29)));
+  CHECK(sameLabel(mtc::fromFrames(1800, mtc::Rate::Fps2997Drop), dropFrame(0, 1, 0, 2)));
+  CHECK(mtc::toFrames(dropFrame(0, 10, 0, 0)) == 17982);
+  CHECK(sameLabel(mtc::fromFrames(17982, mtc::Rate::Fps2997Drop), dropFrame(0, 10, 0, 0)));
+  CHECK(sameLabel(mtc::fromFrames(17981, mtc::Rate::Fps2997Drop), dropFrame(0, 9, 59, 29)));
+  CHECK(mtc::toFrames(dropFrame(1, 0, 0, 0)) == 107892);
+  CHECK(mtc::framesPerDay(mtc::Rate::Fps2997Drop) == 2589408);
+  // Wraps at 24 hours
+  CHECK(sameLabel(mtc::fromFrames(2589408, mtc::Rate::Fps2997Drop), dropFrame(0, 0, 0, 0)));
+
+  char text[16];
+  mtc::format(mtc::fromFrames(107892, mtc::Rate::Fps2997Drop), text, sizeof(text));
+  CHECK(strcmp(text, "01:00:00;00") == 0);
+  // Drop-frame time is real time: an hour of labels is 3599.9964 seconds
+  CHECK(std::fabs(107892 * mtc::frameSeconds(mtc::Rate::Fps2997Drop) - 3599.9964) < 1e-6);
+}
+
+// Every frame of a day maps to a label and back, and no dropped label appears
+static void testMtcDropFrameDay() {
+  const mtc::Rate rate = mtc::Rate::Fps2997Drop;
+  int mismatches = 0;
+  int dropped = 0;
+  mtc::Timecode previous = mtc::fromFrames(0, rate);
+  for (uint64_t frame = 0; frame < mtc::framesPerDay(rate); frame++) {
+    mtc::Timecode timecode = mtc::fromFrames(frame, rate);
+    if (mtc::toFrames(timecode) != frame) mismatches++;
+    if (timecode.seconds == 0 && timecode.frames < 2 && timecode.minutes % 10 != 0) dropped++;
+    // Labels only ever step forward by one frame or over the dropped pair
+    if (frame > 0) {
+      uint32_t step = (uint32_t)(timecode.frames + 30 - previous.frames) % 30;
+      if (step != 1 && step != 3) mismatches++;
+    }
+    previous = timecode;
+  }
+  CHECK(mismatches == 0);
+  CHECK(dropped == 0);
+}
+
+static void testMtcMessages() {
+  const mtc::Timecode timecodes[] = {
+    dropFrame(23, 59, 59, 29), dropFrame(0, 1, 0, 2),
+    mtc::Timecode{ 12, 34, 56, 23, mtc::Rate::Fps24 }, mtc::Timecode{ 1, 2, 3, 24, mtc::Rate::Fps25 },
+  };
+  for (const mtc::Timecode& timecode : timecodes) {
+    uint8_t pieces[8];
+    for (uint8_t piece = 0; piece < 8; piece++) pieces[piece] = mtc::quarterFrameValue(timecode, piece);
+    CHECK(sameLabel(mtc::fromQuarterFrames(pieces), timecode));
+
+    uint8_t bytes[mtc::FULL_FRAME_BYTES];
+    mtc::fullFrame(timecode, bytes);
+    mtc::Timecode parsed;
+    CHECK(mtc::parseFullFrame(bytes, sizeof(bytes), parsed) && sameLabel(parsed, timecode));
+  }
+}
+
+// ============================================================================
+// Scheduler
+// ============================================================================
+
+static const uint32_t NOTE_ON = 0x20903C40;
+static const uint32_t NOTE_OFF = 0x20803C00;
+
+// A note struck again while held is released first, and only the newer
+// note's note-off goes out
+static void testSchedulerRetrigger() {
+  LoopbackPair pair;
+  if (!CHECK(pair.open(0))) return;
+  Recorder recorder(pair.inputDevice.id);
+
+  uint64_t startNs = monotonicNanoseconds() + 20000000ULL;
+  const uint32_t other = 0x20903E40;
+  Scheduler::scheduleNote(0, pair.token, startNs, startNs + 150000000ULL, &NOTE_ON, 1);
+  Scheduler::scheduleNote(0, pair.token, startNs + 10000000ULL, startNs + 150000000ULL, &other, 1);
+  Scheduler::scheduleNote(0, pair.token, startNs + 50000000ULL, startNs + 90000000ULL, &NOTE_ON, 1);
+  CHECK(waitFor([&]() { return monotonicNanoseconds() > startNs + 250000000ULL; }, 1000));
+
+  std::vector<uint32_t> words;
+  uint64_t lastOffNs = 0;
+  for (const auto& packet : recorder.take()) {
+    if ((packet.second[0] & 0xFF00) != 0x3C00) continue;
+    words.push_back(packet.second[0]);
+    if (packet.second[0] == NOTE_OFF) lastOffNs = packet.first;
+  }
+  CHECK((words == std::vector<uint32_t>{ NOTE_ON, NOTE_OFF, NOTE_ON, NOTE_OFF }));
+  // The re-struck note ends at its own note-off, the first one's is dropped
+  CHECK(lastOffNs >= startNs + 90000000ULL && lastOffNs < startNs + 140000000ULL);
+  // Another key is left alone
+  size_t otherPackets = 0;
+  for (const auto& packet : recorder.take()) otherPackets += (packet.second[0] & 0xFF00) == 0x3E00;
+  CHECK(otherPackets == 2);
+  pair.close();
+}
+
+// panic() drops note-ons still queued and releases what did sound
+static void testSchedulerPanic() {
+  LoopbackPair pair;
+  if (!CHECK(pair.open(0))) return;
+  Recorder recorder(pair.inputDevice.id);
+
+  uint64_t startNs = monotonicNanoseconds();
+  const uint32_t strum[] = { NOTE_ON, 0x20904040, 0x20904340 };
+  for (int i = 0; i < 3; i++) {
+    uint64_t onNs = startNs + i * 100000000ULL;
+    Scheduler::scheduleNote(0, pair.token, onNs, onNs + 500000000ULL, &strum[i], 1);
+  }
+  CHECK(waitFor([&]() { return recorder.count() >= 1; }, 1000));
+
+  Scheduler::cancelNotes(pair.token);
+  size_t released = 0;
+  HandleTable::withSlot(pair.token, [&](OpenHandle& slot) { released = ReleaseHeldNotes(slot); });
+  CHECK(released == 1);
+  CHECK(waitFor([&]() { return monotonicNanoseconds() > startNs + 700000000ULL; }, 2000));
+
+  size_t noteOns = 0, noteOffs = 0;
+  for (const auto& packet : recorder.take()) {
+    uint8_t opcode = (uint8_t)((packet.second[0] >> 20) & 0xF);
+    noteOns += opcode == 0x9;
+    noteOffs += opcode == 0x8;
+  }
+  CHECK(noteOns == 1);
+  // The release, then the queued note-off of the note that sounded
+  CHECK(noteOffs == 2);
+  pair.close();
+}
+
+// ============================================================================
+// Endpoint Discovery
+// ============================================================================
+
+// Stream text as an endpoint sends it, `prefix` bytes of word 0 first
+static void appendStreamText(std::vector<uint32_t>& out, uint16_t status, const std::string& text,
+                             const std::vector<uint8_t>& prefix) {
+  size_t perPacket = 14 - prefix.size();
+  size_t packets = text.empty() ? 1 : (text.size() + perPacket - 1) / perPacket;
+  for (size_t p = 0; p < packets; p++) {
+    uint8_t form = packets == 1 ? ump::stream::FORM_COMPLETE
+                 : p == 0 ? ump::stream::FORM_START
+                 : p == packets - 1 ? ump::stream::FORM_END : ump::stream::FORM_CONTINUE;
+    uint8_t bytes[16] = { (uint8_t)(0xF0 | (form << 2) | (status >> 8)), (uint8_t)status };
+    size_t next = 2;
+    for (uint8_t byte : prefix) bytes[next++] = byte;
+    for (size_t i = p * perPacket; i < text.size() && next < 16; i++) bytes[next++] = (uint8_t)text[i];
+    for (int word = 0; word < 4; word++) {
+      out.push_back(((uint32_t)bytes[word * 4] << 24) | ((uint32_t)bytes[word * 4 + 1] << 16) |
+                    ((uint32_t)bytes[word * 4 + 2] << 8) | bytes[word * 4 + 3]);
+    }
+  }
+}
+
+static void appendPacket(std::vector<uint32_t>& out, const ump::Packet<4>& packet) {
+  out.insert(out.end(), packet.data(), packet.data() + packet.size);
+}
+
+/**
+ * Answers Stream requests seen on the loopback input by writing back into
+ * the same pair, as a MIDI 2.0 device with two function blocks would.
+ */
+class ScriptedEndpoint {
+private:
+  LoopbackPair& pair;
+  uint32_t subscription;
+  uint16_t configuration = (ump::stream::PROTOCOL_MIDI2 << 8);
+
+  void answer(const uint32_t* packet) {
+    uint16_t status = (uint16_t)ump::stream::Status::get(packet);
+    uint16_t data = (uint16_t)ump::stream::Data::get(packet);
+    std::vector<uint32_t> reply;
+    if (status == ump::stream::ENDPOINT_DISCOVERY) {
+      // UMP 1.1, 2 function blocks, both protocols, receives JR
+      appendPacket(reply, ump::stream::message(0, ump::stream::ENDPOINT_INFO, 0x0101, (2u << 24) | 0x300 | 0x2));
+      appendPacket(reply, ump::stream::message(0, ump::stream::DEVICE_IDENTITY, 0, 0x00002109, 0x05010700, 0x01020304));
+      appendStreamText(reply, ump::stream::ENDPOINT_NAME, "HarmonEasy Scripted Endpoint", {});
+      appendStreamText(reply, ump::stream::PRODUCT_INSTANCE_ID, "SN-0042", {});
+      appendPacket(reply, ump::stream::message(0, ump::stream::CONFIGURATION_NOTIFY, configuration));
+    } else if (status == ump::stream::FUNCTION_BLOCK_DISCOVERY) {
+      appendPacket(reply, ump::stream::message(0, ump::stream::FUNCTION_BLOCK_INFO, 0x8000 | (0 << 8) | (2 << 4) | 3,
+                                               (0u << 24) | (4u << 16) | (2u << 8)));
+      appendPacket(reply, ump::stream::message(0, ump::stream::FUNCTION_BLOCK_INFO, (1 << 8) | (1 << 2) | 2,
+                                               (4u << 24) | (1u << 16)));
+      appendStreamText(reply, ump::stream::FUNCTION_BLOCK_NAME, "Synth Engine with a long name", { 0 });
+      appendStreamText(reply, ump::stream::FUNCTION_BLOCK_NAME, "Pads", { 1 });
+    } else if (status == ump::stream::CONFIGURATION_REQUEST) {
+      configuration = data;
+      appendPacket(reply, ump::stream::message(0, ump::stream::CONFIGURATION_NOTIFY, configuration));
+    }
+    if (!reply.empty()) pair.send(reply.data(), reply.size());
+  }
+
+public:
+  explicit ScriptedEndpoint(LoopbackPair& loopback) : pair(loopback) {
+    // Loopback listeners may write back into the loopback
+    subscription = InputHub::subscribe([this](uint64_t device, const uint32_t* words, size_t count, uint64_t) {
+      if (device != pair.inputDevice.id) return;
+      for (size_t i = 0; i + ump::packetWordsOf(words[i]) <= count; i += ump::packetWordsOf(words[i])) {
+        if (ump::typeOf(words[i]) == ump::stream::TYPE) answer(words + i);
+      }
+    });
+  }
+
+  ~ScriptedEndpoint() {
+    InputHub::unsubscribe(subscription);
+  }
+};
+
+// Run one session against the pair and return what it reported
+template<typename Begin>
+static bool runDiscovery(LoopbackPair& pair, Begin begin, EndpointInfo& result) {
+  std::mutex mutex;
+  bool done = false;
+  uint32_t id = EndpointDiscoveryManager::follow(pair.inputDevice.id,
+    [&](uint32_t, EndpointDiscovery::Event event, const EndpointInfo& endpoint) {
+      if (event != EndpointDiscovery::DONE) return;
+      std::lock_guard<std::mutex> lock(mutex);
+      result = endpoint;
+      done = true;
+    });
+  EndpointDiscoveryManager::with(id, [&](EndpointDiscovery& discovery) { begin(discovery); });
+  bool finished = waitFor([&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return done;
+  }, 2000);
+  EndpointDiscoveryManager::stop(id);
+  return finished;
+}
+
+static void testDiscoveryScripted() {
+  LoopbackPair pair;
+  if (!CHECK(pair.open(1))) return;
+  ScriptedEndpoint endpoint(pair);
+
+  EndpointInfo info;
+  uint64_t timeoutNs = 1000000000ULL;
+  CHECK(runDiscovery(pair, [&](EndpointDiscovery& discovery) {
+    discovery.begin(pair.token, pair.outputDevice.id, pair.inputDevice.id, timeoutNs);
+  }, info));
+  CHECK(info.ump && info.versionMajor == 1 && info.versionMinor == 1);
+  CHECK(info.midi1Protocol && info.midi2Protocol && info.canReceiveJr && !info.canTransmitJr);
+  CHECK(info.hasIdentity && info.manufacturer[1] == 0x21 && info.manufacturer[2] == 0x09);
+  CHECK(info.family == 5 + (1 << 7) && info.model == 7);
+  CHECK(info.name == "HarmonEasy Scripted Endpoint" && info.productInstanceId == "SN-0042");
+  CHECK(info.protocol == ump::stream::PROTOCOL_MIDI2);
+  if (CHECK(info.blockCount == 2 && info.blocks.size() == 2)) {
+    CHECK(info.blocks[0].active && info.blocks[0].groupCount == 4 && info.blocks[0].midiCiVersion == 2);
+    CHECK(info.blocks[0].name == "Synth Engine with a long name");
+    CHECK(!info.blocks[1].active && info.blocks[1].firstGroup == 4 && info.blocks[1].midi1 == 1);
+    CHECK(info.blocks[1].name == "Pads");
+  }
+
+  // Switch to MIDI 1.0 with JR Timestamps towards the endpoint
+  EndpointInfo configured;
+  CHECK(runDiscovery(pair, [&](EndpointDiscovery& discovery) {
+    discovery.configure(pair.token, info, ump::stream::PROTOCOL_MIDI1, true, false, timeoutNs);
+  }, configured));
+  CHECK(configured.protocol == ump::stream::PROTOCOL_MIDI1 && configured.receiveJr && !configured.transmitJr);
+  CHECK(configured.name == info.name && configured.blocks.size() == 2);
+  pair.close();
+}
+
+// Nothing answering ends at the deadline with ump false
+static void testDiscoverySilent() {
+  LoopbackPair pair;
+  if (!CHECK(pair.open(1))) return;
+  EndpointInfo info;
+  uint64_t startNs = monotonicNanoseconds();
+  CHECK(runDiscovery(pair, [&](EndpointDiscovery& discovery) {
+    discovery.begin(pair.token, pair.outputDevice.id, pair.inputDevice.id, 100000000ULL);
+  }, info));
+  CHECK(!info.ump && monotonicNanoseconds() - startNs >= 100000000ULL);
+  pair.close();
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static const TestCase TESTS[] = {
+  { "smf.fixture", testSmfFixture },
+  { "smf.truncated", testSmfTruncated },
+  { "smf.corrupt-headers", testSmfCorruptHeaders },
+  { "smf.corrupt-tracks", testSmfCorruptTracks },
+  { "smf.corrupt-random", testSmfCorruptRandom },
+  { "convert.round-trip", testConvertRoundTrip },
+  { "convert.columns", testConvertColumns },
+  { "flex.text", testFlexText },
+  { "flex.text-interleaved", testFlexTextInterleaved },
+  { "flex.loopback", testFlexLoopback },
+  { "mtc.drop-frame-labels", testMtcDropFrameLabels },
+  { "mtc.drop-frame-day", testMtcDropFrameDay },
+  { "mtc.messages", testMtcMessages },
+  { "scheduler.retrigger", testSchedulerRetrigger },
+  { "scheduler.panic", testSchedulerPanic },
+  { "discovery.scripted", testDiscoveryScripted },
+  { "discovery.silent", testDiscoverySilent },
+};
+
+static bool selected(const char* name, int argc, char** argv) {
+  if (argc < 2) return true;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(name, argv[i], strlen(argv[i])) == 0) return true;
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  vmidi::LoopbackConfig loopback;
+  loopback.ports = 2;
+  loopback.exclusive = true;
+  vmidi::Loopback::configure(loopback, VirtualMIDIManager::deliver);
+
+  StartThreads();
+  DeviceRegistry::rescan();
+
+  int passed = 0, failed = 0;
+  for (const TestCase& test : TESTS) {
+    if (!selected(test.name, argc, argv)) continue;
+    currentTest = test.name;
+    currentFailures = 0;
+    test.run();
+    printf("%s %s\n", currentFailures == 0 ? "ok  " : "FAIL", test.name);
+    if (currentFailures == 0) passed++;
+    else failed++;
+  }
+  printf("%d passed, %d failed\n", passed, failed);
+
+  HandleTable::closeAll();
+  StopThreads();
+  HandlePool::closeAll();
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/**
+ * MIDI Time Code
+ *
+ * Frame counting and message layout for MTC at the four standard rates.
+ * A frame number counts real frames from 00:00:00:00, so at 29.97 fps
+ * drop-frame it skips the labels :00 and :01 at the start of every minute
+ * except each tenth, and seconds are always frames times the frame period.
+ * - Quarter frames carry a time code in eight pieces over two frames, piece
+ *   0 going out as the frame it describes starts.
+ * - A full frame message is the SysEx F0 7F <device> 01 01 hh mm ss ff F7,
+ *   sent to locate rather than to run.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+namespace mtc {
+
+// The two rate bits of the hours field
+enum class Rate : uint8_t { Fps24 = 0, Fps25 = 1, Fps2997Drop = 2, Fps30 = 3 };
+
+struct Timecode {
+  uint8_t hours;
+  uint8_t minutes;
+  uint8_t seconds;
+  uint8_t frames;
+  Rate rate;
+};
+
+// Frames per second of the labels, 30 for 29.97 drop-frame
+constexpr uint32_t labelFps(Rate rate) {
+  return rate == Rate::Fps24 ? 24 : rate == Rate::Fps25 ? 25 : 30;
+}
+
+constexpr double frameSeconds(Rate rate) {
+  return rate == Rate::Fps2997Drop ? 1001.0 / 30000.0 : 1.0 / labelFps(rate);
+}
+
+constexpr double framesPerSecond(Rate rate) {
+  return rate == Rate::Fps2997Drop ? 30000.0 / 1001.0 : (double)labelFps(rate);
+}
+
+// Frames in 24 hours, where time code wraps
+constexpr uint64_t framesPerDay(Rate rate) {
+  return rate == Rate::Fps2997Drop ? 24ull * 6 * 17982 : 24ull * 3600 * labelFps(rate);
+}
+
+inline uint64_t toFrames(const Timecode& timecode) {
+  uint32_t fps = labelFps(timecode.rate);
+  uint64_t frames = ((uint64_t)timecode.hours * 3600 + timecode.minutes * 60 + timecode.seconds) * fps + timecode.frames;
+  if (timecode.rate == Rate::Fps2997Drop) {
+    uint64_t minutes = (uint64_t)timecode.hours * 60 + timecode.minutes;
+    frames -= 2 * (minutes - minutes / 10);
+  }
+  return frames;
+}
+
+inline Timecode fromFrames(uint64_t frames, Rate rate) {
+  frames %= framesPerDay(rate);
+  if (rate == Rate::Fps2997Drop) {
+    // Put back the labels dropped so far, 18 per ten minutes
+    uint64_t tens = frames / 17982;
+    uint64_t within = frames % 17982;
+    frames += 18 * tens + (within >= 2 ? 2 * ((within - 2) / 1798) : 0);
+  }
+  uint32_t fps = labelFps(rate);
+  Timecode timecode;
+  timecode.frames = (uint8_t)(frames % fps);
+  timecode.seconds = (uint8_t)((frames / fps) % 60);
+  timecode.minutes = (uint8_t)((frames / (fps * 60)) % 60);
+  timecode.hours = (uint8_t)(frames / (fps * 3600ull));
+  timecode.rate = rate;
+  return timecode;
+}
+
+// "hh:mm:ss:ff", with ';' before the frames at drop-frame
+inline void format(const Timecode& timecode, char* buffer, size_t size) {
+  snprintf(buffer, size, "%02u:%02u:%02u%c%02u", timecode.hours, timecode.minutes, timecode.seconds,
+           timecode.rate == Rate::Fps2997Drop ? ';' : ':', timecode.frames);
+}
+
+// The 4-bit value of quarter frame piece 0-7
+constexpr uint8_t quarterFrameValue(const Timecode& timecode, uint8_t piece) {
+  return piece == 0 ? timecode.frames & 0xF
+       : piece == 1 ? (timecode.frames >> 4) & 0x1
+       : piece == 2 ? timecode.seconds & 0xF
+       : piece == 3 ? (timecode.seconds >> 4) & 0x3
+       : piece == 4 ? timecode.minutes & 0xF
+       : piece == 5 ? (timecode.minutes >> 4) & 0x3
+       : piece == 6 ? timecode.hours & 0xF
+       : (uint8_t)(((timecode.hours >> 4) & 0x1) | ((uint8_t)timecode.rate << 1));
+}
+
+// Reassemble a time code from the eight piece values
+constexpr Timecode fromQuarterFrames(const uint8_t* pieces) {
+  return Timecode{
+    (uint8_t)(((pieces[7] & 0x1) << 4) | pieces[6]),
+    (uint8_t)(((pieces[5] & 0x3) << 4) | pieces[4]),
+    (uint8_t)(((pieces[3] & 0x3) << 4) | pieces[2]),
+    (uint8_t)(((pieces[1] & 0x1) << 4) | pieces[0]),
+    (Rate)((pieces[7] >> 1) & 0x3)
+  };
+}
+
+static constexpr size_t FULL_FRAME_BYTES = 8;
+
+// Full frame message between F0 and F7
+inline void fullFrame(const Timecode& timecode, uint8_t* bytes, uint8_t device = 0x7F) {
+  bytes[0] = 0x7F;
+  bytes[1] = device;
+  bytes[2] = 0x01;
+  bytes[3] = 0x01;
+  bytes[4] = (uint8_t)(((uint8_t)timecode.rate << 5) | (timecode.hours & 0x1F));
+  bytes[5] = timecode.minutes & 0x3F;
+  bytes[6] = timecode.seconds & 0x3F;
+  bytes[7] = timecode.frames & 0x1F;
+}
+
+// Read a full frame message between F0 and F7, false if it is something else
+inline bool parseFullFrame(const uint8_t* bytes, size_t length, Timecode& timecode) {
+  if (length != FULL_FRAME_BYTES || bytes[0] != 0x7F || bytes[2] != 0x01 || bytes[3] != 0x01) return false;
+  timecode.rate = (Rate)((bytes[4] >> 5) & 0x3);
+  timecode.hours = bytes[4] & 0x1F;
+  timecode.minutes = bytes[5] & 0x3F;
+  timecode.seconds = bytes[6] & 0x3F;
+  timecode.frames = bytes[7] & 0x1F;
+  return true;
+}
+
+}  // namespace mtc
@@ -0,0 +1,229 @@
+/**
+ * Event tracing for the native MIDI paths
+ *
+ * Records what happens on the send, write, receive, route and schedule paths
+ * with nanosecond timestamps so timing jitter can be attributed to a stage.
+ * Tracing is compiled in only when MIDI2_TRACE is defined to 1 (build with
+ * `node-gyp rebuild --midi2_trace=1`); otherwise every MIDI2_TRACE_* macro
+ * expands to nothing and the paths carry no trace code at all.
+ *
+ * When compiled in, each thread writes to its own fixed-size ring, so
+ * recording is a relaxed flag check, a clock read and a few stores with no
+ * locks or atomics shared between threads. Rings keep the most recent
+ * events and overwrite older ones. They are allocated on a thread's first
+ * event and kept for the life of the process so dumps still see threads
+ * that have exited.
+ *
+ * toChromeJson() renders every ring as Chrome trace event JSON, which loads
+ * in chrome://tracing and ui.perfetto.dev. Timestamps come from
+ * steady_clock, the same monotonic clock Chromium traces use, so a dump can
+ * be lined up with a trace recorded in the Electron renderer.
+ */
+
+#pragma once
+
+#ifndef MIDI2_TRACE
+  #define MIDI2_TRACE 0
+#endif
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#if MIDI2_TRACE
+  #include <atomic>
+  #include <mutex>
+  #include <vector>
+  #include <chrono>
+  #include <memory>
+  #include <algorithm>
+#endif
+
+namespace trace {
+
+enum Event : uint16_t {
+  // UMP handed to the send path, spans translation and every port write
+  SEND,
+  // MIDI 1.0 bytes written to one platform port
+  WRITE,
+  // Input arrived from a platform port
+  RECEIVE,
+  // Incoming UMP passed to the input listeners
+  ROUTE,
+  // Packet queued for later delivery
+  SCHEDULE,
+  EVENT_COUNT
+};
+
+inline const char* eventName(uint16_t event) {
+  static const char* const names[EVENT_COUNT] = { "send", "write", "receive", "route", "schedule" };
+  return event < EVENT_COUNT ? names[event] : "unknown";
+}
+
+#if MIDI2_TRACE
+
+struct Record {
+  uint64_t timestampNs;
+  // Device id the event concerns, or the loopback port number for SCHEDULE
+  uint64_t device;
+  // First UMP word of the message, or the byte count for WRITE and RECEIVE
+  uint32_t packet;
+  uint16_t event;
+  // Chrome phase: 'B' begin, 'E' end, 'i' instant
+  char phase;
+};
+
+class Ring {
+public:
+  static constexpr size_t CAPACITY = 8192;
+
+  uint32_t threadId;
+  // Total records ever written; the owner thread is the only writer
+  std::atomic<uint64_t> head{ 0 };
+  Record records[CAPACITY];
+
+  void push(uint16_t event, char phase, uint64_t device, uint32_t packet) {
+    uint64_t index = head.load(std::memory_order_relaxed);
+    Record& record = records[index % CAPACITY];
+    record.timestampNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+    record.device = device;
+    record.packet = packet;
+    record.event = event;
+    record.phase = phase;
+    head.store(index + 1, std::memory_order_release);
+  }
+};
+
+class Tracer {
+private:
+  static inline std::mutex mutex;
+  // Never shrinks, rings outlive their threads
+  static inline std::vector<std::unique_ptr<Ring>> rings;
+  static inline std::atomic<bool> enabled{ false };
+  // Records below these head values were cleared, per ring
+  static inline std::vector<uint64_t> clearedAt;
+
+  static Ring* registerThread() {
+    std::lock_guard<std::mutex> lock(mutex);
+    rings.emplace_back(new Ring());
+    rings.back()->threadId = (uint32_t)rings.size();
+    clearedAt.push_back(0);
+    return rings.back().get();
+  }
+
+public:
+  static Ring& local() {
+    thread_local Ring* ring = registerThread();
+    return *ring;
+  }
+
+  static bool isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  static void setEnabled(bool value) {
+    enabled.store(value, std::memory_order_relaxed);
+  }
+
+  static void record(uint16_t event, char phase, uint64_t device, uint32_t packet) {
+    if (!isEnabled()) return;
+    local().push(event, phase, device, packet);
+  }
+
+  // Forget everything recorded so far; rings themselves are kept
+  static void clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < rings.size(); i++) {
+      clearedAt[i] = rings[i]->head.load(std::memory_order_acquire);
+    }
+  }
+
+  /**
+   * Render the rings as a Chrome trace event array. Rings are read while
+   * their threads keep writing, records the writer may have overwritten
+   * during the copy are discarded rather than reported torn.
+   */
+  static std::string toChromeJson() {
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+    char line[256];
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Record> copy;
+    for (size_t i = 0; i < rings.size(); i++) {
+      Ring& ring = *rings[i];
+      uint64_t end = ring.head.load(std::memory_order_acquire);
+      uint64_t begin = end > Ring::CAPACITY ? end - Ring::CAPACITY : 0;
+      if (begin < clearedAt[i]) begin = clearedAt[i];
+
+      copy.clear();
+      for (uint64_t index = begin; index < end; index++) {
+        copy.push_back(ring.records[index % Ring::CAPACITY]);
+      }
+
+      // Whatever the writer lapped while we copied is unreliable
+      uint64_t after = ring.head.load(std::memory_order_acquire);
+      size_t skip = 0;
+      if (after > Ring::CAPACITY && after - Ring::CAPACITY > begin) {
+        skip = (size_t)std::min<uint64_t>(after - Ring::CAPACITY - begin, copy.size());
+      }
+
+      for (size_t r = skip; r < copy.size(); r++) {
+        const Record& record = copy[r];
+        snprintf(line, sizeof(line),
+                 "%s\n{\"name\":\"%s\",\"cat\":\"midi2\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%u%s"
+                 "\"args\":{\"device\":\"%016llx\",\"packet\":\"0x%08x\"}}",
+                 first ? "" : ",", eventName(record.event), record.phase, record.timestampNs / 1000.0,
+                 ring.threadId, record.phase == 'i' ? ",\"s\":\"t\"," : ",",
+                 (unsigned long long)record.device, record.packet);
+        json += line;
+        first = false;
+      }
+    }
+
+    for (size_t i = 0; i < rings.size(); i++) {
+      snprintf(line, sizeof(line),
+               "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"midi2 native %u\"}}",
+               first ? "" : ",", rings[i]->threadId, rings[i]->threadId);
+      json += line;
+      first = false;
+    }
+    json += "\n],\"displayTimeUnit\":\"ns\"}";
+    return json;
+  }
+};
+
+// Records a begin event now and the matching end event when it leaves scope
+class Scope {
+private:
+  uint16_t event;
+  uint64_t device;
+  uint32_t packet;
+  bool active;
+
+public:
+  Scope(uint16_t event, uint64_t device, uint32_t packet)
+    : event(event), device(device), packet(packet), active(Tracer::isEnabled()) {
+    if (active) Tracer::local().push(event, 'B', device, packet);
+  }
+
+  ~Scope() {
+    if (active) Tracer::local().push(event, 'E', device, packet);
+  }
+};
+
+#define MIDI2_TRACE_CONCAT_(a, b) a##b
+#define MIDI2_TRACE_CONCAT(a, b) MIDI2_TRACE_CONCAT_(a, b)
+#define MIDI2_TRACE_INSTANT(event, device, packet) ::trace::Tracer::record((event), 'i', (device), (packet))
+#define MIDI2_TRACE_SCOPE(event, device, packet) ::trace::Scope MIDI2_TRACE_CONCAT(traceScope, __LINE__)((event), (device), (packet))
+
+#else
+
+#define MIDI2_TRACE_INSTANT(event, device, packet) ((void)0)
+#define MIDI2_TRACE_SCOPE(event, device, packet) ((void)0)
+
+#endif
+
+}  // namespace trace
@@ -0,0 +1,499 @@
+/**
+ * Bulk kernels over runs of UMP words
+ *
+ * Batch forms of the per-message work done on the send and receive paths:
+ * packing and unpacking MIDI 1.0 channel voice packets, scale quantisation
+ * (mirrors findClosestNoteInScale in packages/audiobus/tuning/scales.ts),
+ * a fused note transform (transpose, velocity scale, channel remap),
+ * min-center-max value scaling and MIDI 1.0 to MIDI 2.0 protocol translation.
+ *
+ * Every kernel has a scalar form; where SSE2 is available and beats what the
+ * compiler makes of the scalar loop, a vector form is provided next to it
+ * with identical results, so midi2-microbench.cc can compare the two before
+ * a vector path is wired into the module. Value
+ * scaling and protocol translation are wired in through midi2-native.cc.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "ump.h"
+#include "ump-translator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define UMP_KERNELS_SSE2 1
+#else
+  #define UMP_KERNELS_SSE2 0
+#endif
+
+namespace ump {
+namespace kernels {
+
+// ============================================================================
+// Packing
+// ============================================================================
+
+/**
+ * Pack MIDI 1.0 channel voice fields (structure of arrays) into type 0x2
+ * UMP words for one group
+ */
+inline void packMidi1Scalar(const uint8_t* status, const uint8_t* data1, const uint8_t* data2,
+                            size_t count, uint8_t group, uint32_t* words) {
+  for (size_t i = 0; i < count; i++) {
+    words[i] = midi1::fromBytes(group, status[i], data1[i], data2[i]);
+  }
+}
+
+inline void unpackMidi1Scalar(const uint32_t* words, size_t count,
+                              uint8_t* status, uint8_t* data1, uint8_t* data2) {
+  for (size_t i = 0; i < count; i++) {
+    status[i] = (uint8_t)midi1::Status::get(words + i);
+    data1[i] = (uint8_t)midi1::Data1::get(words + i);
+    data2[i] = (uint8_t)midi1::Data2::get(words + i);
+  }
+}
+
+#if UMP_KERNELS_SSE2
+
+// 16 packets per iteration: the byte lanes are interleaved into words
+// little-endian as data2, data1, status, type/group
+inline void packMidi1Sse2(const uint8_t* status, const uint8_t* data1, const uint8_t* data2,
+                          size_t count, uint8_t group, uint32_t* words) {
+  const __m128i prefix = _mm_set1_epi8((char)(0x20 | (group & 0x0F)));
+  const __m128i mask7 = _mm_set1_epi8(0x7F);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(status + i));
+    __m128i d1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(data1 + i)), mask7);
+    __m128i d2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(data2 + i)), mask7);
+
+    __m128i lowLo = _mm_unpacklo_epi8(d2, d1);
+    __m128i lowHi = _mm_unpackhi_epi8(d2, d1);
+    __m128i highLo = _mm_unpacklo_epi8(s, prefix);
+    __m128i highHi = _mm_unpackhi_epi8(s, prefix);
+
+    _mm_storeu_si128((__m128i*)(words + i), _mm_unpacklo_epi16(lowLo, highLo));
+    _mm_storeu_si128((__m128i*)(words + i + 4), _mm_unpackhi_epi16(lowLo, highLo));
+    _mm_storeu_si128((__m128i*)(words + i + 8), _mm_unpacklo_epi16(lowHi, highHi));
+    _mm_storeu_si128((__m128i*)(words + i + 12), _mm_unpackhi_epi16(lowHi, highHi));
+  }
+  packMidi1Scalar(status + i, data1 + i, data2 + i, count - i, group, words + i);
+}
+
+inline void unpackMidi1Sse2(const uint32_t* words, size_t count,
+                            uint8_t* status, uint8_t* data1, uint8_t* data2) {
+  const __m128i mask8 = _mm_set1_epi32(0xFF);
+  const __m128i mask7 = _mm_set1_epi32(0x7F);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i w0 = _mm_loadu_si128((const __m128i*)(words + i));
+    __m128i w1 = _mm_loadu_si128((const __m128i*)(words + i + 4));
+    __m128i w2 = _mm_loadu_si128((const __m128i*)(words + i + 8));
+    __m128i w3 = _mm_loadu_si128((const __m128i*)(words + i + 12));
+
+    // Every lane is at most 0xFF, so the saturating packs are exact
+    auto field = [&](int shift, __m128i mask) {
+      __m128i count32 = _mm_cvtsi32_si128(shift);
+      __m128i a = _mm_and_si128(_mm_srl_epi32(w0, count32), mask);
+      __m128i b = _mm_and_si128(_mm_srl_epi32(w1, count32), mask);
+      __m128i c = _mm_and_si128(_mm_srl_epi32(w2, count32), mask);
+      __m128i d = _mm_and_si128(_mm_srl_epi32(w3, count32), mask);
+      return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    };
+
+    _mm_storeu_si128((__m128i*)(status + i), field(16, mask8));
+    _mm_storeu_si128((__m128i*)(data1 + i), field(8, mask7));
+    _mm_storeu_si128((__m128i*)(data2 + i), field(0, mask7));
+  }
+  unpackMidi1Scalar(words + i, count - i, status + i, data1 + i, data2 + i);
+}
+
+#endif
+
+// ============================================================================
+// Scale Quantisation
+// ============================================================================
+
+/**
+ * Closest in-scale note searching up to `range` semitones either way,
+ * preferring the lower note on a tie. Matches findClosestNoteInScale.
+ * inScale is indexed by note number and has 128 entries.
+ */
+inline uint8_t quantizeSearch(uint8_t note, const bool* inScale, int range = 12) {
+  if (inScale[note]) return note;
+  for (int distance = 1; distance <= range; distance++) {
+    int lower = note - distance;
+    if (lower >= 0 && inScale[lower]) return (uint8_t)lower;
+    int upper = note + distance;
+    if (upper <= 127 && inScale[upper]) return (uint8_t)upper;
+  }
+  return note;
+}
+
+// Precompute quantizeSearch for every note so quantising is one load
+inline void buildQuantizeTable(const bool* inScale, uint8_t* table, int range = 12) {
+  for (int note = 0; note < 128; note++) {
+    table[note] = quantizeSearch((uint8_t)note, inScale, range);
+  }
+}
+
+// MIDI 1.0 note on or note off
+constexpr bool isMidi1Note(uint32_t word) {
+  return typeOf(word) == MessageType::Midi1ChannelVoice &&
+         (midi1::Opcode::get(&word) == 0x8 || midi1::Opcode::get(&word) == 0x9);
+}
+
+// Quantise the note of every note on/off word, other messages pass through.
+// in and out may be the same buffer.
+inline void quantizeNotesSearch(const uint32_t* in, uint32_t* out, size_t count, const bool* inScale) {
+  for (size_t i = 0; i < count; i++) {
+    uint32_t word = in[i];
+    if (isMidi1Note(word)) {
+      midi1::Data1::set(&word, quantizeSearch((uint8_t)midi1::Data1::get(&word), inScale));
+    }
+    out[i] = word;
+  }
+}
+
+inline void quantizeNotesTable(const uint32_t* in, uint32_t* out, size_t count, const uint8_t* table) {
+  for (size_t i = 0; i < count; i++) {
+    uint32_t word = in[i];
+    if (isMidi1Note(word)) {
+      midi1::Data1::set(&word, table[midi1::Data1::get(&word)]);
+    }
+    out[i] = word;
+  }
+}
+
+// ============================================================================
+// Note Transform
+// ============================================================================
+
+struct NoteTransform {
+  // Semitones added to note numbers, results are clamped to 0..127
+  int transpose = 0;
+  // Velocity multiplier in 1/128 steps (128 leaves velocity unchanged)
+  uint32_t velocityScale = 128;
+  // Destination channel for each source channel
+  uint8_t channelMap[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+};
+
+// Applies all three steps to one note on/off word, anything else is returned as is
+inline uint32_t transformNote(uint32_t word, const NoteTransform& transform) {
+  if (!isMidi1Note(word)) return word;
+  uint32_t kind = midi1::Opcode::get(&word);
+
+  int note = (int)midi1::Data1::get(&word) + transform.transpose;
+  note = note < 0 ? 0 : note > 127 ? 127 : note;
+
+  uint32_t velocity = midi1::Data2::get(&word);
+  uint32_t scaled = (velocity * transform.velocityScale) >> 7;
+  if (scaled > 127) scaled = 127;
+  // A note on must stay a note on
+  if (kind == 0x9 && velocity > 0 && scaled == 0) scaled = 1;
+
+  midi1::Channel::set(&word, transform.channelMap[midi1::Channel::get(&word)]);
+  midi1::Data1::set(&word, (uint32_t)note);
+  midi1::Data2::set(&word, scaled);
+  return word;
+}
+
+// in and out may be the same buffer
+inline void transformNotesScalar(const uint32_t* in, uint32_t* out, size_t count, const NoteTransform& transform) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = transformNote(in[i], transform);
+  }
+}
+
+#if UMP_KERNELS_SSE2
+
+// Signed 32-bit max/min without SSE4.1
+static inline __m128i clampEpi32(__m128i value, __m128i low, __m128i high) {
+  __m128i belowLow = _mm_cmplt_epi32(value, low);
+  value = _mm_or_si128(_mm_and_si128(belowLow, low), _mm_andnot_si128(belowLow, value));
+  __m128i aboveHigh = _mm_cmpgt_epi32(value, high);
+  return _mm_or_si128(_mm_and_si128(aboveHigh, high), _mm_andnot_si128(aboveHigh, value));
+}
+
+// Four words per iteration. Channel remapping is a table lookup, so lanes
+// that need it are done with scalar loads; the rest is branch free.
+inline void transformNotesSse2(const uint32_t* in, uint32_t* out, size_t count, const NoteTransform& transform) {
+  // The 16-bit multiply below is exact for velocity 127 up to a scale of 511
+  if (transform.velocityScale > 511) {
+    transformNotesScalar(in, out, count, transform);
+    return;
+  }
+
+  bool identityChannels = true;
+  for (uint8_t channel = 0; channel < 16; channel++) {
+    if (transform.channelMap[channel] != channel) identityChannels = false;
+  }
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i max7 = _mm_set1_epi32(127);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i transpose = _mm_set1_epi32(transform.transpose);
+  const __m128i typeMask = _mm_set1_epi32((int)0xF0E00000u);
+  const __m128i noteType = _mm_set1_epi32((int)0x20800000u);
+  const __m128i onBit = _mm_set1_epi32(0x00100000);
+  const __m128i keepMask = _mm_set1_epi32((int)0xFFFF0000u);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i w = _mm_loadu_si128((const __m128i*)(in + i));
+
+    // Type 0x2 with status 0x8n or 0x9n
+    __m128i isNote = _mm_cmpeq_epi32(_mm_and_si128(w, typeMask), noteType);
+    if (_mm_movemask_epi8(isNote) == 0) {
+      _mm_storeu_si128((__m128i*)(out + i), w);
+      continue;
+    }
+
+    __m128i note = _mm_and_si128(_mm_srli_epi32(w, 8), max7);
+    note = clampEpi32(_mm_add_epi32(note, transpose), zero, max7);
+
+    __m128i velocity = _mm_and_si128(w, max7);
+    __m128i scaled = _mm_srli_epi32(_mm_mullo_epi16(velocity, _mm_set1_epi32((int)transform.velocityScale)), 7);
+    scaled = clampEpi32(scaled, zero, max7);
+    __m128i isOn = _mm_cmpeq_epi32(_mm_and_si128(w, onBit), onBit);
+    __m128i needsFloor = _mm_and_si128(isOn, _mm_and_si128(
+      _mm_cmpgt_epi32(velocity, zero), _mm_cmpeq_epi32(scaled, zero)));
+    scaled = _mm_or_si128(_mm_andnot_si128(needsFloor, scaled), _mm_and_si128(needsFloor, one));
+
+    __m128i result = _mm_or_si128(_mm_and_si128(w, keepMask), _mm_or_si128(_mm_slli_epi32(note, 8), scaled));
+    result = _mm_or_si128(_mm_and_si128(isNote, result), _mm_andnot_si128(isNote, w));
+    _mm_storeu_si128((__m128i*)(out + i), result);
+
+    if (!identityChannels) {
+      for (size_t lane = i; lane < i + 4; lane++) {
+        if (!isMidi1Note(out[lane])) continue;
+        midi1::Channel::set(out + lane, transform.channelMap[midi1::Channel::get(out + lane)]);
+      }
+    }
+  }
+  transformNotesScalar(in + i, out + i, count - i, transform);
+}
+
+#endif
+
+// ============================================================================
+// Value Scaling
+// ============================================================================
+
+// Mask of the low `bits` bits, 1-32
+constexpr uint32_t lowBits(uint8_t bits) {
+  return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+}
+
+/**
+ * scaleUp() over a run of values with no branch per value: the repeated low
+ * bits are built for every value and masked off for those at or below the
+ * centre. Inputs are masked to sourceBits. 2 <= sourceBits <= targetBits <= 32,
+ * in and out may be the same buffer.
+ */
+inline void upscaleValuesScalar(const uint32_t* in, uint32_t* out, size_t count, uint8_t sourceBits, uint8_t targetBits) {
+  const uint8_t scaleBits = (uint8_t)(targetBits - sourceBits);
+  const uint8_t repeatBits = (uint8_t)(sourceBits - 1);
+  const uint32_t sourceMask = lowBits(sourceBits);
+  const uint32_t repeatMask = lowBits(repeatBits);
+  const uint32_t center = 1u << repeatBits;
+  const uint8_t alignLeft = scaleBits > repeatBits ? (uint8_t)(scaleBits - repeatBits) : 0;
+  const uint8_t alignRight = scaleBits > repeatBits ? 0 : (uint8_t)(repeatBits - scaleBits);
+  for (size_t i = 0; i < count; i++) {
+    uint32_t value = in[i] & sourceMask;
+    uint32_t aligned = ((value & repeatMask) << alignLeft) >> alignRight;
+    uint32_t fill = 0;
+    for (uint8_t shift = 0; shift < scaleBits; shift += repeatBits) fill |= aligned >> shift;
+    uint32_t above = 0u - (uint32_t)(value > center);
+    out[i] = (value << scaleBits) | (fill & above);
+  }
+}
+
+// scaleDown() over a run of values, 1 <= targetBits <= sourceBits <= 32.
+// A mask and a shift per value, which the compiler vectorises on its own;
+// a hand-written SSE2 form measured slower, so there is none.
+inline void downscaleValuesScalar(const uint32_t* in, uint32_t* out, size_t count, uint8_t sourceBits, uint8_t targetBits) {
+  const uint32_t sourceMask = lowBits(sourceBits);
+  const uint8_t shift = (uint8_t)(sourceBits - targetBits);
+  for (size_t i = 0; i < count; i++) {
+    out[i] = (in[i] & sourceMask) >> shift;
+  }
+}
+
+#if UMP_KERNELS_SSE2
+
+// Four values per iteration, one vector shift per repeat of the low bits
+inline void upscaleValuesSse2(const uint32_t* in, uint32_t* out, size_t count, uint8_t sourceBits, uint8_t targetBits) {
+  const uint8_t scaleBits = (uint8_t)(targetBits - sourceBits);
+  const uint8_t repeatBits = (uint8_t)(sourceBits - 1);
+  const __m128i sourceMask = _mm_set1_epi32((int)lowBits(sourceBits));
+  const __m128i repeatMask = _mm_set1_epi32((int)lowBits(repeatBits));
+  // sourceBits is at most 31 here, so the signed compare is exact
+  const __m128i center = _mm_set1_epi32((int)(1u << repeatBits));
+  const __m128i scaleCount = _mm_cvtsi32_si128(scaleBits);
+  const __m128i alignLeft = _mm_cvtsi32_si128(scaleBits > repeatBits ? scaleBits - repeatBits : 0);
+  const __m128i alignRight = _mm_cvtsi32_si128(scaleBits > repeatBits ? 0 : repeatBits - scaleBits);
+
+  __m128i repeatShifts[32];
+  size_t repeats = 0;
+  for (uint8_t shift = repeatBits; shift < scaleBits; shift += repeatBits) repeatShifts[repeats++] = _mm_cvtsi32_si128(shift);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i value = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i)), sourceMask);
+    __m128i aligned = _mm_srl_epi32(_mm_sll_epi32(_mm_and_si128(value, repeatMask), alignLeft), alignRight);
+    __m128i fill = aligned;
+    for (size_t repeat = 0; repeat < repeats; repeat++) fill = _mm_or_si128(fill, _mm_srl_epi32(aligned, repeatShifts[repeat]));
+    __m128i above = _mm_cmpgt_epi32(value, center);
+    _mm_storeu_si128((__m128i*)(out + i), _mm_or_si128(_mm_sll_epi32(value, scaleCount), _mm_and_si128(fill, above)));
+  }
+  upscaleValuesScalar(in + i, out + i, count - i, sourceBits, targetBits);
+}
+
+#endif
+
+// The vector form where there is one
+inline void upscaleValues(const uint32_t* in, uint32_t* out, size_t count, uint8_t sourceBits, uint8_t targetBits) {
+#if UMP_KERNELS_SSE2
+  upscaleValuesSse2(in, out, count, sourceBits, targetBits);
+#else
+  upscaleValuesScalar(in, out, count, sourceBits, targetBits);
+#endif
+}
+
+inline void downscaleValues(const uint32_t* in, uint32_t* out, size_t count, uint8_t sourceBits, uint8_t targetBits) {
+  downscaleValuesScalar(in, out, count, sourceBits, targetBits);
+}
+
+// ============================================================================
+// Protocol Translation
+// ============================================================================
+
+/**
+ * Translate every MIDI 1.0 channel voice packet of a UMP stream to MIDI 2.0
+ * with midi1ToMidi2(), copying other packets. out needs room for twice
+ * count words. Returns the words written.
+ */
+inline size_t midi1ToMidi2Scalar(const uint32_t* in, size_t count, uint32_t* out) {
+  size_t written = 0;
+  for (size_t i = 0; i < count;) {
+    size_t size = packetWordsOf(in[i]);
+    if (i + size > count) break;
+    if (typeOf(in[i]) == MessageType::Midi1ChannelVoice) {
+      written += midi1ToMidi2(in[i], out + written);
+    } else {
+      for (size_t word = 0; word < size; word++) out[written++] = in[i + word];
+    }
+    i += size;
+  }
+  return written;
+}
+
+// The reverse, with midi2ToMidi1(). out needs room for twice count words.
+inline size_t midi2ToMidi1Scalar(const uint32_t* in, size_t count, uint32_t* out) {
+  size_t written = 0;
+  for (size_t i = 0; i < count;) {
+    size_t size = packetWordsOf(in[i]);
+    if (i + size > count) break;
+    if (typeOf(in[i]) == MessageType::Midi2ChannelVoice) {
+      written += midi2ToMidi1(in + i, out + written);
+    } else {
+      for (size_t word = 0; word < size; word++) out[written++] = in[i + word];
+    }
+    i += size;
+  }
+  return written;
+}
+
+#if UMP_KERNELS_SSE2
+
+// 7 to 32 bit scaleUp() of four values below 128
+static inline __m128i upscale7To32(__m128i value) {
+  __m128i repeat = _mm_and_si128(value, _mm_set1_epi32(0x3F));
+  __m128i fill = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(repeat, 19), _mm_slli_epi32(repeat, 13)),
+                              _mm_or_si128(_mm_or_si128(_mm_slli_epi32(repeat, 7), _mm_slli_epi32(repeat, 1)),
+                                           _mm_srli_epi32(repeat, 5)));
+  __m128i above = _mm_cmpgt_epi32(value, _mm_set1_epi32(64));
+  return _mm_or_si128(_mm_slli_epi32(value, 25), _mm_and_si128(fill, above));
+}
+
+// 14 to 32 bit scaleUp() of four values below 0x4000
+static inline __m128i upscale14To32(__m128i value) {
+  __m128i repeat = _mm_and_si128(value, _mm_set1_epi32(0x1FFF));
+  __m128i fill = _mm_or_si128(_mm_slli_epi32(repeat, 5), _mm_srli_epi32(repeat, 8));
+  __m128i above = _mm_cmpgt_epi32(value, _mm_set1_epi32(0x2000));
+  return _mm_or_si128(_mm_slli_epi32(value, 18), _mm_and_si128(fill, above));
+}
+
+/**
+ * Four MIDI 1.0 channel voice words become four MIDI 2.0 packets per
+ * iteration, every opcode computed and the right one selected by mask. A
+ * run of four that holds anything else goes one packet through
+ * midi1ToMidi2Scalar(). Output is identical to the scalar form.
+ */
+inline size_t midi1ToMidi2Sse2(const uint32_t* in, size_t count, uint32_t* out) {
+  const __m128i typeMask = _mm_set1_epi32((int)0xF0800000u);
+  // Type 0x2 with an opcode of 0x8 to 0xE, 0xF is reserved
+  const __m128i voiceType = _mm_set1_epi32((int)0x20800000u);
+  const __m128i opcodeMask = _mm_set1_epi32(0x00F00000);
+  const __m128i mask4 = _mm_set1_epi32(0xF);
+  const __m128i mask7 = _mm_set1_epi32(0x7F);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i headType = _mm_set1_epi32((int)0x40000000u);
+  const __m128i headMask = _mm_set1_epi32(0x0FFF0000);
+  const __m128i noteOnBit = _mm_set1_epi32(0x00100000);
+  const __m128i velocityMask = _mm_set1_epi32((int)0xFFFF0000u);
+  const __m128i defaultOffVelocity = _mm_set1_epi32((int)(scaleUp(64, 7, 16) << 16));
+
+  size_t i = 0, written = 0;
+  while (i + 4 <= count) {
+    __m128i w = _mm_loadu_si128((const __m128i*)(in + i));
+    __m128i reserved = _mm_cmpeq_epi32(_mm_and_si128(w, opcodeMask), opcodeMask);
+    if (_mm_movemask_epi8(_mm_andnot_si128(reserved, _mm_cmpeq_epi32(_mm_and_si128(w, typeMask), voiceType))) != 0xFFFF) {
+      size_t size = packetWordsOf(in[i]);
+      if (i + size > count) return written;
+      written += midi1ToMidi2Scalar(in + i, size, out + written);
+      i += size;
+      continue;
+    }
+
+    __m128i opcode = _mm_and_si128(_mm_srli_epi32(w, 20), mask4);
+    __m128i data1 = _mm_and_si128(_mm_srli_epi32(w, 8), mask7);
+    __m128i data2 = _mm_and_si128(w, mask7);
+    __m128i isPressure = _mm_cmpeq_epi32(opcode, _mm_set1_epi32(midi2::CHANNEL_PRESSURE));
+    __m128i isProgram = _mm_cmpeq_epi32(opcode, _mm_set1_epi32(midi2::PROGRAM_CHANGE));
+    __m128i isBend = _mm_cmpeq_epi32(opcode, _mm_set1_epi32(midi2::PITCH_BEND));
+    // Note off, note on, poly pressure and control change keep data1 as index
+    __m128i hasIndex = _mm_cmplt_epi32(opcode, _mm_set1_epi32(midi2::PROGRAM_CHANGE));
+    __m128i isNote = _mm_cmplt_epi32(opcode, _mm_set1_epi32(midi2::POLY_PRESSURE));
+    __m128i isZeroOn = _mm_and_si128(_mm_cmpeq_epi32(opcode, _mm_set1_epi32(midi2::NOTE_ON)), _mm_cmpeq_epi32(data2, zero));
+
+    __m128i head = _mm_or_si128(headType, _mm_and_si128(w, headMask));
+    head = _mm_or_si128(head, _mm_and_si128(hasIndex, _mm_slli_epi32(data1, 8)));
+    head = _mm_xor_si128(head, _mm_and_si128(isZeroOn, noteOnBit));
+
+    __m128i value7 = _mm_or_si128(_mm_and_si128(isPressure, data1), _mm_andnot_si128(isPressure, data2));
+    __m128i scaled = upscale7To32(value7);
+    __m128i bend = upscale14To32(_mm_or_si128(_mm_slli_epi32(data2, 7), data1));
+    __m128i velocity = _mm_or_si128(_mm_and_si128(scaled, velocityMask), _mm_and_si128(isZeroOn, defaultOffVelocity));
+    __m128i isScaled = _mm_andnot_si128(_mm_or_si128(_mm_or_si128(isNote, isProgram), isBend), _mm_cmpeq_epi32(zero, zero));
+
+    __m128i data = _mm_or_si128(
+      _mm_or_si128(_mm_and_si128(isNote, velocity), _mm_and_si128(isScaled, scaled)),
+      _mm_or_si128(_mm_and_si128(isProgram, _mm_slli_epi32(data1, 24)), _mm_and_si128(isBend, bend)));
+
+    _mm_storeu_si128((__m128i*)(out + written), _mm_unpacklo_epi32(head, data));
+    _mm_storeu_si128((__m128i*)(out + written + 4), _mm_unpackhi_epi32(head, data));
+    i += 4;
+    written += 8;
+  }
+  return written + midi1ToMidi2Scalar(in + i, count - i, out + written);
+}
+
+#endif
+
+}  // namespace kernels
+}  // namespace ump
@@ -0,0 +1,364 @@
+/**
+ * MIDI 1.0 byte stream <-> UMP translation
+ *
+ * Legacy ports (ALSA rawmidi, WinMM, CoreMIDI 1.0 endpoints) carry MIDI 1.0
+ * byte streams, while the JS side and every native path speak UMP. These
+ * helpers convert between the two following the MIDI 2.0 UMP specification
+ * (M2-104-UM) default translation: channel voice and system messages map to
+ * MIDI 1.0 Channel Voice (type 0x2) and System (type 0x1) packets, SysEx maps
+ * to 7-bit SysEx packets (type 0x3). midi1ToMidi2() and midi2ToMidi1() move
+ * single channel voice packets between the MIDI 1.0 and MIDI 2.0 protocols.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "ump.h"
+
+namespace ump {
+
+/**
+ * Incremental parser from a MIDI 1.0 byte stream to UMP words.
+ * Handles running status, real-time bytes interleaved anywhere in the stream
+ * and SysEx spanning multiple reads. One parser per input port.
+ */
+class Midi1ToUmpParser {
+private:
+  uint8_t runningStatus = 0;
+  uint8_t systemStatus = 0;
+  uint8_t data[2] = { 0, 0 };
+  uint8_t dataCount = 0;
+  uint8_t dataExpected = 0;
+
+  bool inSysEx = false;
+  bool sysExStarted = false;
+  uint8_t sysEx[6] = { 0, 0, 0, 0, 0, 0 };
+  uint8_t sysExCount = 0;
+
+  static uint8_t channelDataLength(uint8_t status) {
+    uint8_t kind = status & 0xF0;
+    return (kind == 0xC0 || kind == 0xD0) ? 1 : 2;
+  }
+
+  static uint8_t systemDataLength(uint8_t status) {
+    switch (status) {
+      case 0xF1: return 1;  // MTC quarter frame
+      case 0xF2: return 2;  // Song position pointer
+      case 0xF3: return 1;  // Song select
+      default: return 0;    // Tune request and undefined statuses
+    }
+  }
+
+  // SysEx7 status: 0 complete, 1 start, 2 continue, 3 end
+  template <typename Emit>
+  void flushSysEx(bool final, Emit& emit) {
+    uint8_t status = final ? (sysExStarted ? 0x3 : 0x0) : (sysExStarted ? 0x2 : 0x1);
+    Packet<2> packet = sysex7::packet(group, status, sysEx, sysExCount);
+    emit(packet.words, 2);
+    sysExStarted = !final;
+    sysExCount = 0;
+    for (uint8_t& byte : sysEx) byte = 0;
+  }
+
+public:
+  // UMP group stamped on every packet produced by this parser
+  uint8_t group = 0;
+
+  void reset() {
+    runningStatus = 0;
+    systemStatus = 0;
+    dataCount = 0;
+    dataExpected = 0;
+    inSysEx = false;
+    sysExStarted = false;
+    sysExCount = 0;
+  }
+
+  /**
+   * Feed raw bytes. emit(const uint32_t* words, size_t count) is called once
+   * per complete UMP packet.
+   */
+  template <typename Emit>
+  void feed(const uint8_t* bytes, size_t length, Emit emit) {
+    for (size_t i = 0; i < length; i++) {
+      uint8_t byte = bytes[i];
+
+      if (byte >= 0xF8) {
+        // Real-time messages may appear between any two bytes
+        uint32_t word = system::message(group, byte);
+        emit(&word, 1);
+        continue;
+      }
+
+      if (byte & 0x80) {
+        if (inSysEx) {
+          // F7 terminates, any other status aborts but still closes the packet
+          flushSysEx(true, emit);
+          inSysEx = false;
+          if (byte == 0xF7) continue;
+        }
+
+        if (byte == 0xF0) {
+          inSysEx = true;
+          sysExStarted = false;
+          sysExCount = 0;
+          runningStatus = 0;
+        } else if (byte >= 0xF0) {
+          // System common cancels running status
+          runningStatus = 0;
+          systemStatus = byte;
+          dataCount = 0;
+          dataExpected = systemDataLength(byte);
+          if (dataExpected == 0) {
+            if (byte == 0xF6) {
+              uint32_t word = system::message(group, byte);
+              emit(&word, 1);
+            }
+            systemStatus = 0;
+          }
+        } else {
+          runningStatus = byte;
+          systemStatus = 0;
+          dataCount = 0;
+          dataExpected = channelDataLength(byte);
+        }
+        continue;
+      }
+
+      if (inSysEx) {
+        if (sysExCount == 6) {
+          flushSysEx(false, emit);
+        }
+        sysEx[sysExCount++] = byte;
+        continue;
+      }
+
+      uint8_t status = systemStatus ? systemStatus : runningStatus;
+      if (status == 0) continue;  // Stray data byte
+
+      data[dataCount++] = byte;
+      if (dataCount < dataExpected) continue;
+
+      uint8_t data2 = dataExpected == 2 ? data[1] : 0;
+      uint32_t word = systemStatus ? system::message(group, status, data[0], data2)
+                                   : midi1::fromBytes(group, status, data[0], data2);
+      emit(&word, 1);
+
+      dataCount = 0;
+      if (systemStatus) {
+        systemStatus = 0;
+        dataExpected = 0;
+      }
+    }
+  }
+};
+
+/**
+ * One MIDI 1.0 channel voice packet (type 0x2) as MIDI 2.0 (type 0x4) by the
+ * default translation: note velocities scale to 16 bits, pressures and
+ * controllers to 32, pitch bend from 14 to 32. A note on with velocity 0 is
+ * a note off at the default velocity 64. Controllers stay single controllers;
+ * RPN/NRPN and bank select sequences are not merged, which would need state
+ * per channel. Writes two words, or none for a reserved opcode.
+ */
+inline size_t midi1ToMidi2(uint32_t word, uint32_t* out) {
+  uint32_t opcode = midi1::Opcode::get(&word);
+  uint32_t data1 = midi1::Data1::get(&word);
+  uint32_t data2 = midi1::Data2::get(&word);
+  // Group, opcode and channel carry over
+  uint32_t head = ((uint32_t)MessageType::Midi2ChannelVoice << 28) | (word & 0x0FFF0000u);
+
+  switch (opcode) {
+    case midi2::NOTE_OFF:
+      out[0] = head | midi2::Note::place(data1);
+      out[1] = midi2::Velocity::place(scaleUp(data2, 7, 16));
+      return 2;
+    case midi2::NOTE_ON:
+      if (data2 == 0) {
+        out[0] = (head & ~midi2::Opcode::place(0xF)) | midi2::Opcode::place(midi2::NOTE_OFF) | midi2::Note::place(data1);
+        out[1] = midi2::Velocity::place(scaleUp(64, 7, 16));
+        return 2;
+      }
+      out[0] = head | midi2::Note::place(data1);
+      out[1] = midi2::Velocity::place(scaleUp(data2, 7, 16));
+      return 2;
+    case midi2::POLY_PRESSURE:
+    case midi2::CONTROL_CHANGE:
+      out[0] = head | midi2::Index1::place(data1);
+      out[1] = scaleUp(data2, 7, 32);
+      return 2;
+    case midi2::PROGRAM_CHANGE:
+      out[0] = head;
+      out[1] = midi2::Program::place(data1);
+      return 2;
+    case midi2::CHANNEL_PRESSURE:
+      out[0] = head;
+      out[1] = scaleUp(data1, 7, 32);
+      return 2;
+    case midi2::PITCH_BEND:
+      out[0] = head;
+      out[1] = scaleUp((data2 << 7) | data1, 14, 32);
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * One MIDI 2.0 channel voice packet as MIDI 1.0 channel voice words, the
+ * inverse of midi1ToMidi2(): values keep their high bits, a note on stays a
+ * note on, bank select and RPN/NRPN become control change sequences. Writes
+ * up to four words, none for per-note and relative controllers, which have
+ * no MIDI 1.0 form.
+ */
+inline size_t midi2ToMidi1(const uint32_t* packet, uint32_t* out) {
+  View<MessageType::Midi2ChannelVoice> view(packet);
+  uint8_t group = view.group();
+  uint8_t opcode = (uint8_t)view.get<midi2::Opcode>();
+  uint8_t channel = (uint8_t)view.get<midi2::Channel>();
+  uint8_t index1 = (uint8_t)view.get<midi2::Index1>();
+  uint8_t index2 = (uint8_t)view.get<midi2::Index2>();
+  uint32_t data = view.get<midi2::Data>();
+
+  switch (opcode) {
+    case midi2::NOTE_OFF:
+      out[0] = midi1::noteOff(group, channel, index1, (uint8_t)scaleDown(data, 32, 7));
+      return 1;
+    case midi2::NOTE_ON: {
+      // A velocity that rounds to 0 must stay a note on
+      uint8_t velocity = (uint8_t)scaleDown(data, 32, 7);
+      out[0] = midi1::noteOn(group, channel, index1, velocity == 0 ? 1 : velocity);
+      return 1;
+    }
+    case midi2::POLY_PRESSURE:
+      out[0] = midi1::polyPressure(group, channel, index1, (uint8_t)scaleDown(data, 32, 7));
+      return 1;
+    case midi2::CONTROL_CHANGE:
+      out[0] = midi1::controlChange(group, channel, index1, (uint8_t)scaleDown(data, 32, 7));
+      return 1;
+    case midi2::PROGRAM_CHANGE: {
+      size_t count = 0;
+      if (view.get<midi2::Flags>() & 0x01) {
+        out[count++] = midi1::controlChange(group, channel, 0x00, (uint8_t)view.get<midi2::BankMsb>());
+        out[count++] = midi1::controlChange(group, channel, 0x20, (uint8_t)view.get<midi2::BankLsb>());
+      }
+      out[count++] = midi1::programChange(group, channel, (uint8_t)view.get<midi2::Program>());
+      return count;
+    }
+    case midi2::CHANNEL_PRESSURE:
+      out[0] = midi1::channelPressure(group, channel, (uint8_t)scaleDown(data, 32, 7));
+      return 1;
+    case midi2::PITCH_BEND:
+      out[0] = midi1::pitchBend(group, channel, (uint16_t)scaleDown(data, 32, 14));
+      return 1;
+    case midi2::REGISTERED_CONTROLLER:
+    case midi2::ASSIGNABLE_CONTROLLER: {
+      uint16_t value = (uint16_t)scaleDown(data, 32, 14);
+      bool registered = opcode == midi2::REGISTERED_CONTROLLER;
+      out[0] = midi1::controlChange(group, channel, registered ? 101 : 99, index1);
+      out[1] = midi1::controlChange(group, channel, registered ? 100 : 98, index2);
+      out[2] = midi1::controlChange(group, channel, 6, (value >> 7) & 0x7F);
+      out[3] = midi1::controlChange(group, channel, 38, value & 0x7F);
+      return 4;
+    }
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Incremental UMP to MIDI 1.0 byte stream translator. Packets may be split
+ * across calls (senders often pass one 32-bit word at a time), so a partial
+ * packet is kept until its last word arrives. MIDI 2.0 channel voice
+ * messages are downscaled following the default translation rules; messages
+ * with no MIDI 1.0 equivalent (utility, stream, flex data, SysEx8, per-note
+ * controllers) are dropped.
+ */
+class UmpToMidi1Translator {
+private:
+  uint32_t pending[4] = { 0, 0, 0, 0 };
+  uint8_t pendingCount = 0;
+
+  template <typename Emit>
+  static void translateSystem(const uint32_t* packet, Emit& emit) {
+    View<MessageType::System> view(packet);
+    uint8_t group = view.group();
+    uint8_t status = (uint8_t)view.get<system::Status>();
+    uint8_t bytes[3] = { status, (uint8_t)view.get<system::Data1>(), (uint8_t)view.get<system::Data2>() };
+    size_t length = (status == 0xF2) ? 3 : (status == 0xF1 || status == 0xF3) ? 2 : 1;
+    emit(group, bytes, length);
+  }
+
+  template <typename Emit>
+  static void translateMidi1ChannelVoice(const uint32_t* packet, Emit& emit) {
+    View<MessageType::Midi1ChannelVoice> view(packet);
+    uint8_t group = view.group();
+    uint8_t status = (uint8_t)view.get<midi1::Status>();
+    uint8_t bytes[3] = { status, (uint8_t)view.get<midi1::Data1>(), (uint8_t)view.get<midi1::Data2>() };
+    uint8_t kind = status & 0xF0;
+    emit(group, bytes, (kind == 0xC0 || kind == 0xD0) ? 2 : 3);
+  }
+
+  template <typename Emit>
+  static void translateSysEx7(const uint32_t* packet, Emit& emit) {
+    View<MessageType::SysEx7> view(packet);
+    uint8_t group = view.group();
+    uint8_t status = (uint8_t)view.get<sysex7::Form>();
+    uint8_t count = (uint8_t)view.get<sysex7::Count>();
+    if (count > 6) count = 6;
+
+    uint8_t data[6];
+    for (uint8_t i = 0; i < 6; i++) data[i] = sysex7::byte(packet, i);
+
+    uint8_t bytes[8];
+    size_t length = 0;
+    // 0 complete, 1 start, 2 continue, 3 end
+    if (status == 0x0 || status == 0x1) bytes[length++] = 0xF0;
+    for (uint8_t i = 0; i < count; i++) bytes[length++] = data[i];
+    if (status == 0x0 || status == 0x3) bytes[length++] = 0xF7;
+    if (length > 0) emit(group, bytes, length);
+  }
+
+  template <typename Emit>
+  static void translateMidi2ChannelVoice(const uint32_t* packet, Emit& emit) {
+    uint32_t words[4];
+    size_t count = midi2ToMidi1(packet, words);
+    for (size_t i = 0; i < count; i++) translateMidi1ChannelVoice(words + i, emit);
+  }
+
+public:
+  // Number of 32-bit words in a packet, from its message type nibble
+  static constexpr uint8_t packetWords(uint8_t messageType) {
+    return ump::packetWords(messageType);
+  }
+
+  void reset() {
+    pendingCount = 0;
+  }
+
+  /**
+   * Feed UMP words. emit(uint8_t group, const uint8_t* bytes, size_t length)
+   * is called once per MIDI 1.0 message, or once per SysEx fragment.
+   */
+  template <typename Emit>
+  void feed(const uint32_t* words, size_t count, Emit emit) {
+    for (size_t i = 0; i < count; i++) {
+      pending[pendingCount++] = words[i];
+      uint8_t type = (uint8_t)typeOf(pending[0]);
+      if (pendingCount < packetWords(type)) continue;
+      pendingCount = 0;
+
+      switch (type) {
+        case 0x1: translateSystem(pending, emit); break;
+        case 0x2: translateMidi1ChannelVoice(pending, emit); break;
+        case 0x3: translateSysEx7(pending, emit); break;
+        case 0x4: translateMidi2ChannelVoice(pending, emit); break;
+        default: break;
+      }
+    }
+  }
+};
+
+}  // namespace ump
@@ -0,0 +1,485 @@
+/**
+ * Universal MIDI Packet builders and views
+ *
+ * Every field of every UMP message type (M2-104-UM) is described once, as a
+ * type giving its word, bit offset and width. Builders compose packets from
+ * fields and views read them back. Everything is constexpr and inline, so a
+ * builder compiles to the same shifts and masks as hand-written code and can
+ * produce constants at compile time.
+ *
+ * Fields are tagged with the message type they belong to. Reading a field
+ * through a View of another message type, or one that lies past the end of
+ * the packet, fails to compile:
+ *
+ *   ump::View<ump::MessageType::Midi2ChannelVoice> note(words);
+ *   uint16_t velocity = note.get<ump::midi2::Velocity>();   // ok
+ *   note.get<ump::sysex7::Count>();                         // static_assert
+ *
+ *   constexpr uint32_t allNotesOff = ump::midi1::controlChange(0, 0, 123, 0);
+ *   constexpr auto on = ump::midi2::noteOn(0, 0, 60, 0xFFFF);   // Packet<2>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace ump {
+
+enum class MessageType : uint8_t {
+  Utility = 0x0,
+  System = 0x1,
+  Midi1ChannelVoice = 0x2,
+  SysEx7 = 0x3,
+  Midi2ChannelVoice = 0x4,
+  SysEx8 = 0x5,
+  FlexData = 0xD,
+  Stream = 0xF,
+  // Tag for fields shared by every message type
+  Any = 0xFF
+};
+
+// Number of 32-bit words in a packet, from its message type nibble
+constexpr uint8_t packetWords(uint8_t messageType) {
+  constexpr uint8_t words[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+  return words[messageType & 0x0F];
+}
+
+constexpr uint8_t packetWords(MessageType type) {
+  return packetWords((uint8_t)type);
+}
+
+/**
+ * A bit field of one word of a packet. get() and set() are the only place
+ * UMP shifts and masks are written out.
+ */
+template <MessageType Owner, unsigned Word, unsigned Shift, unsigned Bits>
+struct Field {
+  static_assert(Word < 4, "UMP packets are at most four words");
+  static_assert(Bits > 0 && Shift + Bits <= 32, "A field must lie within one 32-bit word");
+  static_assert(Owner == MessageType::Any || Word < packetWords(Owner), "Field lies past the end of its packet");
+
+  static constexpr MessageType owner = Owner;
+  static constexpr unsigned word = Word;
+  static constexpr uint32_t mask = Bits == 32 ? 0xFFFFFFFFu : ((1u << Bits) - 1);
+
+  static constexpr uint32_t get(const uint32_t* words) {
+    return (words[Word] >> Shift) & mask;
+  }
+
+  static constexpr void set(uint32_t* words, uint32_t value) {
+    words[Word] = (words[Word] & ~(mask << Shift)) | ((value & mask) << Shift);
+  }
+
+  // The value shifted into place, for composing a word from several fields
+  static constexpr uint32_t place(uint32_t value) {
+    return (value & mask) << Shift;
+  }
+};
+
+using Type = Field<MessageType::Any, 0, 28, 4>;
+using Group = Field<MessageType::Any, 0, 24, 4>;
+
+// Message type of a packet from its first word
+constexpr MessageType typeOf(uint32_t first) {
+  return (MessageType)(first >> 28);
+}
+
+constexpr uint8_t packetWordsOf(uint32_t first) {
+  return packetWords((uint8_t)(first >> 28));
+}
+
+template <size_t N>
+struct Packet {
+  static_assert(N >= 1 && N <= 4, "UMP packets are one to four words");
+  static constexpr size_t size = N;
+  uint32_t words[N];
+
+  constexpr uint32_t operator[](size_t i) const { return words[i]; }
+  constexpr const uint32_t* data() const { return words; }
+};
+
+/**
+ * Read-only view of a packet of a known message type. Holds a pointer
+ * only; get<Field>() compiles to a load, a shift and a mask.
+ */
+template <MessageType T>
+class View {
+private:
+  const uint32_t* words;
+
+public:
+  static constexpr MessageType type = T;
+  static constexpr uint8_t size = packetWords(T);
+
+  constexpr explicit View(const uint32_t* packet) : words(packet) {}
+
+  template <typename F>
+  constexpr uint32_t get() const {
+    static_assert(F::owner == T || F::owner == MessageType::Any, "Field does not belong to this message type");
+    return F::get(words);
+  }
+
+  constexpr uint8_t group() const { return (uint8_t)Group::get(words); }
+  constexpr const uint32_t* data() const { return words; }
+};
+
+// ============================================================================
+// Utility (type 0x0)
+// ============================================================================
+
+namespace utility {
+  constexpr MessageType TYPE = MessageType::Utility;
+  using Status = Field<TYPE, 0, 20, 4>;
+  using Data = Field<TYPE, 0, 0, 20>;
+  using Ticks = Field<TYPE, 0, 0, 16>;
+
+  enum : uint8_t { NOOP = 0x0, JR_CLOCK = 0x1, JR_TIMESTAMP = 0x2, DELTA_TICKS_PER_QUARTER = 0x3, DELTA_CLOCKSTAMP = 0x4 };
+
+  constexpr uint32_t message(uint8_t status, uint32_t data) {
+    return Type::place((uint8_t)TYPE) | Status::place(status) | Data::place(data);
+  }
+
+  constexpr uint32_t noop() { return message(NOOP, 0); }
+  // Jitter Reduction times are in units of 1/31250 s
+  constexpr uint32_t jrClock(uint16_t time) { return message(JR_CLOCK, time); }
+  constexpr uint32_t jrTimestamp(uint16_t time) { return message(JR_TIMESTAMP, time); }
+  constexpr uint32_t deltaClockstampTicksPerQuarter(uint16_t ticks) { return message(DELTA_TICKS_PER_QUARTER, ticks); }
+  constexpr uint32_t deltaClockstamp(uint32_t ticks) { return message(DELTA_CLOCKSTAMP, ticks); }
+}
+
+// ============================================================================
+// System Common and Real Time (type 0x1)
+// ============================================================================
+
+namespace system {
+  constexpr MessageType TYPE = MessageType::System;
+  using Status = Field<TYPE, 0, 16, 8>;
+  using Data1 = Field<TYPE, 0, 8, 7>;
+  using Data2 = Field<TYPE, 0, 0, 7>;
+
+  enum : uint8_t {
+    MTC_QUARTER_FRAME = 0xF1, SONG_POSITION = 0xF2, SONG_SELECT = 0xF3, TUNE_REQUEST = 0xF6,
+    TIMING_CLOCK = 0xF8, START = 0xFA, CONTINUE = 0xFB, STOP = 0xFC, ACTIVE_SENSING = 0xFE, RESET = 0xFF
+  };
+
+  constexpr uint32_t message(uint8_t group, uint8_t status, uint8_t data1 = 0, uint8_t data2 = 0) {
+    return Type::place((uint8_t)TYPE) | Group::place(group) | Status::place(status) | Data1::place(data1) | Data2::place(data2);
+  }
+
+  constexpr uint32_t timingClock(uint8_t group) { return message(group, TIMING_CLOCK); }
+  constexpr uint32_t start(uint8_t group) { return message(group, START); }
+  constexpr uint32_t continueSong(uint8_t group) { return message(group, CONTINUE); }
+  constexpr uint32_t stop(uint8_t group) { return message(group, STOP); }
+  // Quarter frame piece 0-7 and its 4-bit value
+  constexpr uint32_t mtcQuarterFrame(uint8_t group, uint8_t piece, uint8_t value) {
+    return message(group, MTC_QUARTER_FRAME, (uint8_t)(((piece & 0x7) << 4) | (value & 0xF)));
+  }
+  // Position in MIDI beats (sixteenth notes), 14 bits
+  constexpr uint32_t songPosition(uint8_t group, uint16_t beats) {
+    return message(group, SONG_POSITION, (uint8_t)(beats & 0x7F), (uint8_t)((beats >> 7) & 0x7F));
+  }
+}
+
+// ============================================================================
+// MIDI 1.0 Channel Voice (type 0x2)
+// ============================================================================
+
+namespace midi1 {
+  constexpr MessageType TYPE = MessageType::Midi1ChannelVoice;
+  using Opcode = Field<TYPE, 0, 20, 4>;
+  using Channel = Field<TYPE, 0, 16, 4>;
+  // Opcode and channel together, as the MIDI 1.0 status byte
+  using Status = Field<TYPE, 0, 16, 8>;
+  using Data1 = Field<TYPE, 0, 8, 7>;
+  using Data2 = Field<TYPE, 0, 0, 7>;
+
+  constexpr uint32_t message(uint8_t group, uint8_t opcode, uint8_t channel, uint8_t data1, uint8_t data2 = 0) {
+    return Type::place((uint8_t)TYPE) | Group::place(group) | Opcode::place(opcode) | Channel::place(channel) |
+           Data1::place(data1) | Data2::place(data2);
+  }
+
+  // From MIDI 1.0 bytes; a status byte outside 0x80-0xEF is the caller's mistake
+  constexpr uint32_t fromBytes(uint8_t group, uint8_t status, uint8_t data1, uint8_t data2 = 0) {
+    return Type::place((uint8_t)TYPE) | Group::place(group) | Status::place(status) | Data1::place(data1) | Data2::place(data2);
+  }
+
+  constexpr uint32_t noteOff(uint8_t group, uint8_t channel, uint8_t note, uint8_t velocity = 0) { return message(group, 0x8, channel, note, velocity); }
+  constexpr uint32_t noteOn(uint8_t group, uint8_t channel, uint8_t note, uint8_t velocity) { return message(group, 0x9, channel, note, velocity); }
+  constexpr uint32_t polyPressure(uint8_t group, uint8_t channel, uint8_t note, uint8_t pressure) { return message(group, 0xA, channel, note, pressure); }
+  constexpr uint32_t controlChange(uint8_t group, uint8_t channel, uint8_t controller, uint8_t value) { return message(group, 0xB, channel, controller, value); }
+  constexpr uint32_t programChange(uint8_t group, uint8_t channel, uint8_t program) { return message(group, 0xC, channel, program); }
+  constexpr uint32_t channelPressure(uint8_t group, uint8_t channel, uint8_t pressure) { return message(group, 0xD, channel, pressure); }
+  // 14-bit value, 0x2000 is centre
+  constexpr uint32_t pitchBend(uint8_t group, uint8_t channel, uint16_t value) {
+    return message(group, 0xE, channel, (uint8_t)(value & 0x7F), (uint8_t)((value >> 7) & 0x7F));
+  }
+}
+
+// ============================================================================
+// SysEx 7-bit (type 0x3)
+// ============================================================================
+
+namespace sysex7 {
+  constexpr MessageType TYPE = MessageType::SysEx7;
+  // 0 complete in one packet, 1 start, 2 continue, 3 end
+  using Form = Field<TYPE, 0, 20, 4>;
+  using Count = Field<TYPE, 0, 16, 4>;
+  using Byte0 = Field<TYPE, 0, 8, 7>;
+  using Byte1 = Field<TYPE, 0, 0, 7>;
+  using Byte2 = Field<TYPE, 1, 24, 7>;
+  using Byte3 = Field<TYPE, 1, 16, 7>;
+  using Byte4 = Field<TYPE, 1, 8, 7>;
+  using Byte5 = Field<TYPE, 1, 0, 7>;
+
+  enum : uint8_t { COMPLETE = 0x0, START = 0x1, CONTINUE = 0x2, END = 0x3 };
+
+  // Up to six data bytes, without F0 and F7
+  constexpr Packet<2> packet(uint8_t group, uint8_t form, const uint8_t* bytes, uint8_t count) {
+    if (count > 6) count = 6;
+    uint8_t b[6] = { 0, 0, 0, 0, 0, 0 };
+    for (uint8_t i = 0; i < count; i++) b[i] = bytes[i];
+    return Packet<2>{ {
+      Type::place((uint8_t)TYPE) | Group::place(group) | Form::place(form) | Count::place(count) | Byte0::place(b[0]) | Byte1::place(b[1]),
+      Byte2::place(b[2]) | Byte3::place(b[3]) | Byte4::place(b[4]) | Byte5::place(b[5])
+    } };
+  }
+
+  // Data byte i (0-5) of a packet
+  constexpr uint8_t byte(const uint32_t* words, uint8_t i) {
+    return (uint8_t)((i < 2 ? words[0] >> (8 - i * 8) : words[1] >> (24 - (i - 2) * 8)) & 0x7F);
+  }
+}
+
+// ============================================================================
+// Value Scaling
+// ============================================================================
+
+/**
+ * Min-center-max scaling between value resolutions, the default translation
+ * rule: 0 stays 0, the centre (64 of 128) lands exactly on the wider centre
+ * and the maximum on the wider maximum. Above the centre the low bits of the
+ * value are repeated to fill the new ones, so at 16 bits 127 is 0xFFFF and
+ * 64 is 0x8000. sourceBits is 2 or more and targetBits at most 32.
+ */
+constexpr uint32_t scaleUp(uint32_t value, uint8_t sourceBits, uint8_t targetBits) {
+  uint8_t scaleBits = (uint8_t)(targetBits - sourceBits);
+  uint32_t shifted = value << scaleBits;
+  if (value <= (1u << (sourceBits - 1))) return shifted;
+  uint8_t repeatBits = (uint8_t)(sourceBits - 1);
+  uint32_t repeat = value & ((1u << repeatBits) - 1);
+  repeat = scaleBits > repeatBits ? repeat << (scaleBits - repeatBits) : repeat >> (repeatBits - scaleBits);
+  while (repeat != 0) {
+    shifted |= repeat;
+    repeat >>= repeatBits;
+  }
+  return shifted;
+}
+
+// Downscaling keeps the high bits, the inverse of scaleUp()
+constexpr uint32_t scaleDown(uint32_t value, uint8_t sourceBits, uint8_t targetBits) {
+  return value >> (sourceBits - targetBits);
+}
+
+static_assert(scaleUp(127, 7, 16) == 0xFFFF && scaleUp(64, 7, 16) == 0x8000 && scaleUp(1, 7, 16) == 0x200, "7 to 16 bit");
+static_assert(scaleUp(127, 7, 32) == 0xFFFFFFFFu && scaleUp(0x2000, 14, 32) == 0x80000000u, "to 32 bit");
+static_assert(scaleUp(0x3FFF, 14, 32) == 0xFFFFFFFFu && scaleDown(scaleUp(100, 7, 32), 32, 7) == 100, "round trip");
+
+// ============================================================================
+// MIDI 2.0 Channel Voice (type 0x4)
+// ============================================================================
+
+namespace midi2 {
+  constexpr MessageType TYPE = MessageType::Midi2ChannelVoice;
+  using Opcode = Field<TYPE, 0, 20, 4>;
+  using Channel = Field<TYPE, 0, 16, 4>;
+  // Note number, controller index or RPN/NRPN bank depending on the opcode
+  using Index1 = Field<TYPE, 0, 8, 7>;
+  using Index2 = Field<TYPE, 0, 0, 7>;
+  using Note = Field<TYPE, 0, 8, 7>;
+  using AttributeType = Field<TYPE, 0, 0, 8>;
+  using Flags = Field<TYPE, 0, 0, 8>;
+  using Velocity = Field<TYPE, 1, 16, 16>;
+  using Attribute = Field<TYPE, 1, 0, 16>;
+  using Data = Field<TYPE, 1, 0, 32>;
+  using Program = Field<TYPE, 1, 24, 7>;
+  using BankMsb = Field<TYPE, 1, 8, 7>;
+  using BankLsb = Field<TYPE, 1, 0, 7>;
+
+  enum : uint8_t {
+    REGISTERED_PER_NOTE = 0x0, ASSIGNABLE_PER_NOTE = 0x1, REGISTERED_CONTROLLER = 0x2, ASSIGNABLE_CONTROLLER = 0x3,
+    RELATIVE_REGISTERED = 0x4, RELATIVE_ASSIGNABLE = 0x5, PER_NOTE_PITCH_BEND = 0x6,
+    NOTE_OFF = 0x8, NOTE_ON = 0x9, POLY_PRESSURE = 0xA, CONTROL_CHANGE = 0xB, PROGRAM_CHANGE = 0xC,
+    CHANNEL_PRESSURE = 0xD, PITCH_BEND = 0xE, PER_NOTE_MANAGEMENT = 0xF
+  };
+
+  constexpr Packet<2> message(uint8_t group, uint8_t opcode, uint8_t channel, uint8_t index1, uint8_t index2, uint32_t data) {
+    return Packet<2>{ {
+      Type::place((uint8_t)TYPE) | Group::place(group) | Opcode::place(opcode) | Channel::place(channel) |
+        Index1::place(index1) | Index2::place(index2),
+      data
+    } };
+  }
+
+  constexpr Packet<2> noteOff(uint8_t group, uint8_t channel, uint8_t note, uint16_t velocity = 0, uint8_t attributeType = 0, uint16_t attribute = 0) {
+    return Packet<2>{ {
+      Type::place((uint8_t)TYPE) | Group::place(group) | Opcode::place(NOTE_OFF) | Channel::place(channel) |
+        Note::place(note) | AttributeType::place(attributeType),
+      Velocity::place(velocity) | Attribute::place(attribute)
+    } };
+  }
+
+  constexpr Packet<2> noteOn(uint8_t group, uint8_t channel, uint8_t note, uint16_t velocity, uint8_t attributeType = 0, uint16_t attribute = 0) {
+    return Packet<2>{ {
+      Type::place((uint8_t)TYPE) | Group::place(group) | Opcode::place(NOTE_ON) | Channel::place(channel) |
+        Note::place(note) | AttributeType::place(attributeType),
+      Velocity::place(velocity) | Attribute::place(attribute)
+    } };
+  }
+
+  constexpr Packet<2> polyPressure(uint8_t group, uint8_t channel, uint8_t note, uint32_t pressure) { return message(group, POLY_PRESSURE, channel, note, 0, pressure); }
+  constexpr Packet<2> controlChange(uint8_t group, uint8_t channel, uint8_t controller, uint32_t value) { return message(group, CONTROL_CHANGE, channel, controller, 0, value); }
+  constexpr Packet<2> channelPressure(uint8_t group, uint8_t channel, uint32_t pressure) { return message(group, CHANNEL_PRESSURE, channel, 0, 0, pressure); }
+  // 32-bit value, 0x80000000 is centre
+  constexpr Packet<2> pitchBend(uint8_t group, uint8_t channel, uint32_t value) { return message(group, PITCH_BEND, channel, 0, 0, value); }
+  constexpr Packet<2> perNotePitchBend(uint8_t group, uint8_t channel, uint8_t note, uint32_t value) { return message(group, PER_NOTE_PITCH_BEND, channel, note, 0, value); }
+  constexpr Packet<2> perNoteController(uint8_t group, uint8_t channel, uint8_t note, uint8_t controller, uint32_t value, bool registered = false) {
+    return message(group, registered ? REGISTERED_PER_NOTE : ASSIGNABLE_PER_NOTE, channel, note, controller, value);
+  }
+  constexpr Packet<2> registeredController(uint8_t group, uint8_t channel, uint8_t bank, uint8_t index, uint32_t value) { return message(group, REGISTERED_CONTROLLER, channel, bank, index, value); }
+  constexpr Packet<2> assignableController(uint8_t group, uint8_t channel, uint8_t bank, uint8_t index, uint32_t value) { return message(group, ASSIGNABLE_CONTROLLER, channel, bank, index, value); }
+
+  // Bank select is only sent when bankValid is set
+  constexpr Packet<2> programChange(uint8_t group, uint8_t channel, uint8_t program, bool bankValid = false, uint8_t bankMsb = 0, uint8_t bankLsb = 0) {
+    return Packet<2>{ {
+      Type::place((uint8_t)TYPE) | Group::place(group) | Opcode::place(PROGRAM_CHANGE) | Channel::place(channel) |
+        Flags::place(bankValid ? 0x01 : 0x00),
+      Program::place(program) | BankMsb::place(bankMsb) | BankLsb::place(bankLsb)
+    } };
+  }
+}
+
+// ============================================================================
+// SysEx 8-bit and Mixed Data Set (type 0x5)
+// ============================================================================
+
+namespace sysex8 {
+  constexpr MessageType TYPE = MessageType::SysEx8;
+  // 0 complete, 1 start, 2 continue, 3 end, 8/9 Mixed Data Set header/payload
+  using Form = Field<TYPE, 0, 20, 4>;
+  // Bytes used including the stream id, 1-14
+  using Count = Field<TYPE, 0, 16, 4>;
+  using StreamId = Field<TYPE, 0, 8, 8>;
+
+  // Up to 13 data bytes after the stream id
+  constexpr Packet<4> packet(uint8_t group, uint8_t form, uint8_t streamId, const uint8_t* bytes, uint8_t count) {
+    if (count > 13) count = 13;
+    Packet<4> result{ { 0, 0, 0, 0 } };
+    result.words[0] = Type::place((uint8_t)TYPE) | Group::place(group) | Form::place(form) |
+                      Count::place((uint8_t)(count + 1)) | StreamId::place(streamId);
+    for (uint8_t i = 0; i < count; i++) {
+      // Byte i sits after the stream id: word 0 bits 7-0, then words 1-3 from the top
+      unsigned position = i + 3;
+      result.words[position / 4] |= (uint32_t)bytes[i] << (24 - (position % 4) * 8);
+    }
+    return result;
+  }
+}
+
+// ============================================================================
+// Flex Data (type 0xD)
+// ============================================================================
+
+namespace flex {
+  constexpr MessageType TYPE = MessageType::FlexData;
+  // 0 complete, 1 start, 2 continue, 3 end
+  using Form = Field<TYPE, 0, 22, 2>;
+  // 0 a channel, 1 the whole group
+  using Address = Field<TYPE, 0, 20, 2>;
+  using Channel = Field<TYPE, 0, 16, 4>;
+  using StatusBank = Field<TYPE, 0, 8, 8>;
+  using Status = Field<TYPE, 0, 0, 8>;
+  using Data1 = Field<TYPE, 1, 0, 32>;
+  using Data2 = Field<TYPE, 2, 0, 32>;
+  using Data3 = Field<TYPE, 3, 0, 32>;
+
+  enum : uint8_t { ADDRESS_CHANNEL = 0x0, ADDRESS_GROUP = 0x1 };
+  enum : uint8_t { FORM_COMPLETE = 0x0, FORM_START = 0x1, FORM_CONTINUE = 0x2, FORM_END = 0x3 };
+  enum : uint8_t { BANK_SETUP = 0x00, BANK_METADATA_TEXT = 0x01, BANK_PERFORMANCE_TEXT = 0x02 };
+  // Status bank 0x00, setup and performance
+  enum : uint8_t { SET_TEMPO = 0x00, SET_TIME_SIGNATURE = 0x01, SET_METRONOME = 0x02, SET_KEY_SIGNATURE = 0x05, SET_CHORD_NAME = 0x06 };
+
+  constexpr Packet<4> message(uint8_t group, uint8_t form, uint8_t address, uint8_t channel, uint8_t bank, uint8_t status,
+                              uint32_t data1 = 0, uint32_t data2 = 0, uint32_t data3 = 0) {
+    return Packet<4>{ {
+      Type::place((uint8_t)TYPE) | Group::place(group) | Form::place(form) | Address::place(address) |
+        Channel::place(channel) | StatusBank::place(bank) | Status::place(status),
+      data1, data2, data3
+    } };
+  }
+
+  // Tempo in 10 ns units per quarter note
+  constexpr Packet<4> setTempo(uint8_t group, uint32_t tenNanosecondsPerQuarter) {
+    return message(group, 0, ADDRESS_GROUP, 0, 0x00, SET_TEMPO, tenNanosecondsPerQuarter);
+  }
+
+  constexpr bool isSetTempo(const uint32_t* words) {
+    return typeOf(words[0]) == TYPE && StatusBank::get(words) == 0x00 && Status::get(words) == SET_TEMPO;
+  }
+}
+
+// ============================================================================
+// UMP Stream (type 0xF)
+// ============================================================================
+
+namespace stream {
+  constexpr MessageType TYPE = MessageType::Stream;
+  using Form = Field<TYPE, 0, 26, 2>;
+  using Status = Field<TYPE, 0, 16, 10>;
+  using Data = Field<TYPE, 0, 0, 16>;
+
+  enum : uint16_t {
+    ENDPOINT_DISCOVERY = 0x00, ENDPOINT_INFO = 0x01, DEVICE_IDENTITY = 0x02, ENDPOINT_NAME = 0x03,
+    PRODUCT_INSTANCE_ID = 0x04, CONFIGURATION_REQUEST = 0x05, CONFIGURATION_NOTIFY = 0x06,
+    FUNCTION_BLOCK_DISCOVERY = 0x10, FUNCTION_BLOCK_INFO = 0x11, FUNCTION_BLOCK_NAME = 0x12,
+    START_OF_CLIP = 0x20, END_OF_CLIP = 0x21
+  };
+
+  constexpr Packet<4> message(uint8_t form, uint16_t status, uint16_t data = 0, uint32_t data1 = 0, uint32_t data2 = 0, uint32_t data3 = 0) {
+    return Packet<4>{ {
+      Type::place((uint8_t)TYPE) | Form::place(form) | Status::place(status) | Data::place(data),
+      data1, data2, data3
+    } };
+  }
+
+  // 0 complete, 1 start, 2 continue, 3 end
+  enum : uint8_t { FORM_COMPLETE = 0x0, FORM_START = 0x1, FORM_CONTINUE = 0x2, FORM_END = 0x3 };
+  enum : uint8_t { PROTOCOL_MIDI1 = 0x01, PROTOCOL_MIDI2 = 0x02 };
+  // What Endpoint Discovery asks to be sent back
+  enum : uint8_t {
+    REQUEST_INFO = 0x01, REQUEST_DEVICE_IDENTITY = 0x02, REQUEST_NAME = 0x04,
+    REQUEST_PRODUCT_INSTANCE_ID = 0x08, REQUEST_CONFIGURATION = 0x10
+  };
+  // What Function Block Discovery asks to be sent back
+  enum : uint8_t { REQUEST_BLOCK_INFO = 0x01, REQUEST_BLOCK_NAME = 0x02 };
+  static constexpr uint8_t ALL_FUNCTION_BLOCKS = 0xFF;
+
+  constexpr Packet<4> endpointDiscovery(uint8_t filter, uint8_t versionMajor = 1, uint8_t versionMinor = 1) {
+    return message(FORM_COMPLETE, ENDPOINT_DISCOVERY, (uint16_t)((versionMajor << 8) | versionMinor), filter);
+  }
+
+  constexpr Packet<4> functionBlockDiscovery(uint8_t block, uint8_t filter) {
+    return message(FORM_COMPLETE, FUNCTION_BLOCK_DISCOVERY, (uint16_t)((block << 8) | filter));
+  }
+
+  // Ask the endpoint to switch protocol and Jitter Reduction, as seen from it
+  constexpr Packet<4> configurationRequest(uint8_t protocol, bool receiveJr, bool transmitJr) {
+    return message(FORM_COMPLETE, CONFIGURATION_REQUEST,
+                   (uint16_t)((protocol << 8) | (receiveJr ? 0x2 : 0) | (transmitJr ? 0x1 : 0)));
+  }
+
+  constexpr Packet<4> startOfClip() { return message(0, START_OF_CLIP); }
+  constexpr Packet<4> endOfClip() { return message(0, END_OF_CLIP); }
+}
+
+}  // namespace ump
@@ -0,0 +1,244 @@
+/**
+ * In-process virtual MIDI loopback
+ *
+ * Every hardware backend needs a real device, so nothing in the native layer
+ * can be measured or exercised on a headless build machine. Loopback ports
+ * stand in for hardware: whatever is written to virtual output N arrives on
+ * virtual input N after an emulated transport delay.
+ *
+ * The delay model is deterministic for a given configuration and seed:
+ * - latency: fixed delay added to every message
+ * - jitter: uniform extra delay drawn from a seeded generator
+ * - baud rate: serialises messages on the emulated wire, 10 bits per byte
+ *   of the MIDI 1.0 encoding (31250 emulates a DIN cable)
+ * Messages on one port are never reordered, as on a real cable.
+ *
+ * Ports carry UMP natively, no byte translation happens on either side.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <random>
+#include <functional>
+#include <chrono>
+
+#include "ump-translator.h"
+#include "trace.h"
+
+namespace vmidi {
+
+struct LoopbackConfig {
+  // Number of output/input pairs, 0 removes the backend
+  uint32_t ports = 0;
+  double latencyMs = 0.0;
+  // Upper bound of the uniform random delay added to the latency
+  double jitterMs = 0.0;
+  // Emulated wire speed in bits per second, 0 for unlimited
+  uint32_t baudRate = 0;
+  // Seed for the jitter generator, equal seeds give equal delays
+  uint32_t seed = 1;
+  // Hide hardware ports from listings while the backend is active
+  bool exclusive = false;
+};
+
+class Loopback {
+public:
+  // Called on the delivery thread for every packet reaching virtual input `port`
+  using Deliver = std::function<void(uint32_t port, const uint32_t* words, size_t count)>;
+
+private:
+  struct Pending {
+    uint64_t dueNs;
+    // Ties keep send order for packets due at the same instant
+    uint64_t sequence;
+    uint32_t port;
+    uint8_t count;
+    uint32_t words[4];
+  };
+
+  struct Later {
+    bool operator()(const Pending& a, const Pending& b) const {
+      return a.dueNs != b.dueNs ? a.dueNs > b.dueNs : a.sequence > b.sequence;
+    }
+  };
+
+  struct PortState {
+    // Partial packet carried over between send calls
+    uint32_t partial[4] = { 0, 0, 0, 0 };
+    uint8_t partialCount = 0;
+    // When the emulated wire finishes the last queued message
+    uint64_t lineFreeNs = 0;
+    // Due time of the last queued message, later ones never overtake it
+    uint64_t lastDueNs = 0;
+    // Used only to measure the MIDI 1.0 size of a packet for baud emulation
+    ump::UmpToMidi1Translator sizer;
+    // Packets queued and not yet delivered
+    size_t inFlight = 0;
+  };
+
+  static inline std::mutex mutex;
+  static inline std::condition_variable wake;
+  static inline std::priority_queue<Pending, std::vector<Pending>, Later> queue;
+  static inline std::vector<PortState> portStates;
+  static inline LoopbackConfig settings;
+  static inline Deliver deliver;
+  static inline std::mt19937 random;
+  static inline uint64_t sequence = 0;
+  static inline std::thread thread;
+  static inline bool running = false;
+
+  static uint64_t nowNanoseconds() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static size_t wireBytes(PortState& state, const uint32_t* packet, uint8_t count) {
+    size_t bytes = 0;
+    state.sizer.feed(packet, count, [&bytes](uint8_t, const uint8_t*, size_t length) {
+      bytes += length;
+    });
+    // Packets with no MIDI 1.0 form still occupy the wire as raw UMP
+    return bytes > 0 ? bytes : count * 4;
+  }
+
+  // Must be called with the mutex held
+  static void schedule(uint32_t port, const uint32_t* packet, uint8_t count, uint64_t nowNs) {
+    MIDI2_TRACE_INSTANT(trace::SCHEDULE, port, packet[0]);
+    PortState& state = portStates[port];
+    uint64_t arrivalNs = nowNs;
+
+    if (settings.baudRate > 0) {
+      uint64_t start = state.lineFreeNs > nowNs ? state.lineFreeNs : nowNs;
+      uint64_t wireNs = (uint64_t)wireBytes(state, packet, count) * 10ULL * 1000000000ULL / settings.baudRate;
+      state.lineFreeNs = start + wireNs;
+      arrivalNs = state.lineFreeNs;
+    }
+
+    double delayMs = settings.latencyMs;
+    if (settings.jitterMs > 0.0) {
+      delayMs += std::uniform_real_distribution<double>(0.0, settings.jitterMs)(random);
+    }
+    uint64_t dueNs = arrivalNs + (uint64_t)(delayMs * 1000000.0);
+    if (dueNs < state.lastDueNs) dueNs = state.lastDueNs;
+    state.lastDueNs = dueNs;
+
+    Pending pending;
+    pending.dueNs = dueNs;
+    pending.sequence = sequence++;
+    pending.port = port;
+    pending.count = count;
+    for (uint8_t i = 0; i < count; i++) pending.words[i] = packet[i];
+    queue.push(pending);
+    state.inFlight++;
+  }
+
+  static void run() {
+    std::vector<Pending> due;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+      if (queue.empty()) {
+        wake.wait(lock);
+        continue;
+      }
+
+      uint64_t nowNs = nowNanoseconds();
+      if (queue.top().dueNs > nowNs) {
+        wake.wait_for(lock, std::chrono::nanoseconds(queue.top().dueNs - nowNs));
+        continue;
+      }
+
+      while (!queue.empty() && queue.top().dueNs <= nowNs) {
+        due.push_back(queue.top());
+        portStates[queue.top().port].inFlight--;
+        queue.pop();
+      }
+
+      // Deliver without the lock so listeners may send back into the loopback
+      Deliver target = deliver;
+      lock.unlock();
+      for (const Pending& pending : due) {
+        if (target) target(pending.port, pending.words, pending.count);
+      }
+      due.clear();
+      lock.lock();
+    }
+  }
+
+public:
+  /**
+   * Replace the configuration. Messages still in flight are dropped.
+   * The delivery thread only runs while at least one port exists.
+   */
+  static void configure(const LoopbackConfig& config, Deliver onDeliver) {
+    stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    settings = config;
+    deliver = std::move(onDeliver);
+    random.seed(config.seed);
+    sequence = 0;
+    portStates.clear();
+    portStates.resize(config.ports);
+    while (!queue.empty()) queue.pop();
+
+    if (config.ports > 0) {
+      running = true;
+      thread = std::thread(run);
+    }
+  }
+
+  static LoopbackConfig config() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return settings;
+  }
+
+  /**
+   * Queue UMP words written to virtual output `port`. Packets may be split
+   * across calls. Returns false for an unknown port.
+   */
+  static bool send(uint32_t port, const uint32_t* words, size_t count) {
+    uint64_t nowNs = nowNanoseconds();
+    bool queued = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (port >= portStates.size()) return false;
+
+      PortState& state = portStates[port];
+      for (size_t i = 0; i < count; i++) {
+        state.partial[state.partialCount++] = words[i];
+        uint8_t needed = ump::packetWordsOf(state.partial[0]);
+        if (state.partialCount < needed) continue;
+        schedule(port, state.partial, state.partialCount, nowNs);
+        state.partialCount = 0;
+        queued = true;
+      }
+    }
+    if (queued) wake.notify_one();
+    return true;
+  }
+
+  // Packets sent to `port` that have not been delivered yet
+  static size_t queued(uint32_t port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return port < portStates.size() ? portStates[port].inFlight : 0;
+  }
+
+  static void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!running) return;
+      running = false;
+    }
+    wake.notify_one();
+    if (thread.joinable()) thread.join();
+  }
+};
+
+}  // namespace vmidi
@@ -7,8 +7,8 @@ class MIDI2Handlers {
 	constructor(socketServer) {
 		this.socketServer = socketServer
 		this.midi2Native = null
-		this.activeDevices = new Map() // Track active device connections
-		this.inputListeners = new Map() // Map device index to listeners
+		this.activeDevices = new Map() // Track active device connections by device id or index
+		this.inputListeners = new Map() // Map device id or index to { handle, subscription }
 
 		// Try to load native MIDI2 module
 		try {
@@ -32,6 +32,20 @@ class MIDI2Handlers {
 		this.registerInputHandlers()
 		this.registerDiscoveryHandlers()
 		this.registerCapabilityHandlers()
+		this.registerDeviceChangeHandler()
+	}
+
+	/**
+	 * Forward native hotplug notifications to connected clients
+	 */
+	registerDeviceChangeHandler() {
+		if (typeof this.midi2Native.onDeviceChange !== 'function') {
+			return
+		}
+
+		this.midi2Native.onDeviceChange((change) => {
+			this.notifyDeviceChange(change.deviceIndex, change.changeType, change)
+		})
 	}
 
 	/**
@@ -56,11 +70,21 @@ class MIDI2Handlers {
 		// Open MIDI 2.0 output device
 		this.socketServer.on('midi2:open-output', (ws, payload, id) => {
 			try {
-				const { deviceIndex } = payload
-				this.midi2Native.openUmpOutput(deviceIndex)
-				this.activeDevices.set(deviceIndex, { type: 'output', ws })
+				const { deviceIndex, deviceId, multiPort, jitterReduction } = payload
+				const device = deviceId ?? deviceIndex
+				// multiPort routes UMP group N to subdevice N of the interface
+				const opened = this.midi2Native.openUmpOutput(device, {
+					multiPort: !!multiPort,
+					jitterReduction: !!jitterReduction
+				})
+				this.activeDevices.set(device, { type: 'output', ws, handle: opened.handle })
 
-				this.socketServer.send(ws, 'midi2:output-opened', { deviceIndex, id })
+				this.socketServer.send(ws, 'midi2:output-opened', {
+					deviceIndex: opened.deviceIndex,
+					deviceId: opened.deviceId,
+					jitterReduction: opened.jitterReduction,
+					id
+				})
 			} catch (error) {
 				console.error('[MIDI2Handlers] Error opening output:', error)
 				this.socketServer.send(ws, 'midi2:error', {
@@ -74,11 +98,15 @@ class MIDI2Handlers {
 		// Close MIDI 2.0 output device
 		this.socketServer.on('midi2:close-output', (ws, payload, id) => {
 			try {
-				const { deviceIndex } = payload
-				this.midi2Native.closeUmpOutput(deviceIndex)
-				this.activeDevices.delete(deviceIndex)
+				const { deviceIndex, deviceId } = payload
+				const device = deviceId ?? deviceIndex
+				const active = this.activeDevices.get(device)
+				if (active) {
+					this.midi2Native.closeUmpOutput(active.handle)
+					this.activeDevices.delete(device)
+				}
 
-				this.socketServer.send(ws, 'midi2:output-closed', { deviceIndex, id })
+				this.socketServer.send(ws, 'midi2:output-closed', { deviceIndex, deviceId, id })
 			} catch (error) {
 				console.error('[MIDI2Handlers] Error closing output:', error)
 				this.socketServer.send(ws, 'midi2:error', {
@@ -92,13 +120,13 @@ class MIDI2Handlers {
 		// Send UMP packet
 		this.socketServer.on('midi2:send-ump', (ws, payload, id) => {
 			try {
-				const { deviceIndex, umpPacket } = payload
+				const { deviceIndex, deviceId, umpPacket } = payload
 
 				if (!Number.isInteger(umpPacket) || umpPacket < 0 || umpPacket > 0xFFFFFFFF) {
 					throw new Error('Invalid UMP packet: must be a 32-bit unsigned integer')
 				}
 
-				this.midi2Native.sendUmp(deviceIndex, umpPacket)
+				this.midi2Native.sendUmp(this.getOutputHandle(deviceId ?? deviceIndex), umpPacket)
 
 				if (id) {
 					this.socketServer.send(ws, 'midi2:ump-sent', { deviceIndex, id })
@@ -116,19 +144,19 @@ class MIDI2Handlers {
 		// Send multiple UMP packets (batch)
 		this.socketServer.on('midi2:send-ump-batch', (ws, payload, id) => {
 			try {
-				const { deviceIndex, umpPackets } = payload
+				const { deviceIndex, deviceId, umpPackets } = payload
 
 				if (!Array.isArray(umpPackets)) {
 					throw new Error('umpPackets must be an array')
 				}
 
-				let sentCount = 0
-				for (const packet of umpPackets) {
-					if (Number.isInteger(packet) && packet >= 0 && packet <= 0xFFFFFFFF) {
-						this.midi2Native.sendUmp(deviceIndex, packet)
-						sentCount++
-					}
-				}
+				const handle = this.getOutputHandle(deviceId ?? deviceIndex)
+				const words = Uint32Array.from(umpPackets.filter(packet =>
+					Number.isInteger(packet) && packet >= 0 && packet <= 0xFFFFFFFF
+				))
+				// One native call, coalesced into a single write per port
+				this.midi2Native.sendUmpBatch(handle, words)
+				const sentCount = words.length
 
 				this.socketServer.send(ws, 'midi2:ump-batch-sent', {
 					deviceIndex,
@@ -147,6 +175,17 @@ class MIDI2Handlers {
 		})
 	}
 
+	/**
+	 * Look up the native handle of an output opened through this server
+	 */
+	getOutputHandle(device) {
+		const active = this.activeDevices.get(device)
+		if (!active || active.type !== 'output') {
+			throw new Error('Device not open. Send midi2:open-output first.')
+		}
+		return active.handle
+	}
+
 	/**
 	 * Register MIDI 2.0 input handlers
 	 */
@@ -169,21 +208,37 @@ class MIDI2Handlers {
 		// Start listening for MIDI 2.0 input
 		this.socketServer.on('midi2:listen-input', (ws, payload, id) => {
 			try {
-				const { deviceIndex } = payload
+				const { deviceIndex, deviceId, jitterReduction } = payload
+				const device = deviceId ?? deviceIndex
+				if (this.inputListeners.has(device)) {
+					this.stopListening(device)
+				}
+
+				// Inputs are opened lazily, so listening opens the device
+				const opened = this.midi2Native.openUmpInput(device, { jitterReduction: !!jitterReduction })
 
 				// Create input listener callback
-				const inputListener = (inDeviceIndex, umpPacket) => {
+				const inputListener = (inDeviceId, umpPacket) => {
+					if (inDeviceId !== opened.deviceId) {
+						return
+					}
 					this.socketServer.send(ws, 'midi2:ump-input', {
-						deviceIndex: inDeviceIndex,
+						deviceIndex: opened.deviceIndex,
+						deviceId: inDeviceId,
 						umpPacket,
 						timestamp: Date.now()
 					})
 				}
 
-				this.inputListeners.set(deviceIndex, inputListener)
-				this.midi2Native.onUmpInput(inputListener)
+				const subscription = this.midi2Native.onUmpInput(inputListener)
+				this.inputListeners.set(device, { handle: opened.handle, subscription })
 
-				this.socketServer.send(ws, 'midi2:input-listening', { deviceIndex, id })
+				this.socketServer.send(ws, 'midi2:input-listening', {
+					deviceIndex: opened.deviceIndex,
+					deviceId: opened.deviceId,
+					jitterReduction: opened.jitterReduction,
+					id
+				})
 			} catch (error) {
 				console.error('[MIDI2Handlers] Error starting input listener:', error)
 				this.socketServer.send(ws, 'midi2:error', {
@@ -197,10 +252,10 @@ class MIDI2Handlers {
 		// Stop listening for MIDI 2.0 input
 		this.socketServer.on('midi2:stop-listening-input', (ws, payload, id) => {
 			try {
-				const { deviceIndex } = payload
-				this.inputListeners.delete(deviceIndex)
+				const { deviceIndex, deviceId } = payload
+				this.stopListening(deviceId ?? deviceIndex)
 
-				this.socketServer.send(ws, 'midi2:input-stopped', { deviceIndex, id })
+				this.socketServer.send(ws, 'midi2:input-stopped', { deviceIndex, deviceId, id })
 			} catch (error) {
 				console.error('[MIDI2Handlers] Error stopping input listener:', error)
 				this.socketServer.send(ws, 'midi2:error', {
@@ -212,10 +267,38 @@ class MIDI2Handlers {
 		})
 	}
 
+	/**
+	 * Unsubscribe from an input and release its native handle
+	 */
+	stopListening(device) {
+		const listener = this.inputListeners.get(device)
+		if (!listener) {
+			return
+		}
+		this.midi2Native.offUmpInput(listener.subscription)
+		this.midi2Native.closeUmpInput(listener.handle)
+		this.inputListeners.delete(device)
+	}
+
 	/**
 	 * Register MIDI-CI discovery handlers
 	 */
 	registerDiscoveryHandlers() {
+		// Rescan all MIDI 2.0 devices without blocking the main thread
+		this.socketServer.on('midi2:get-devices', async (ws, payload, id) => {
+			try {
+				const { outputs, inputs } = await this.midi2Native.getUmpDevicesAsync()
+				this.socketServer.send(ws, 'midi2:devices', { outputs, inputs, id })
+			} catch (error) {
+				console.error('[MIDI2Handlers] Error enumerating devices:', error)
+				this.socketServer.send(ws, 'midi2:error', {
+					operation: 'get-devices',
+					error: error.message,
+					id
+				})
+			}
+		})
+
 		// Discover MIDI 2.0 devices (MIDI-CI)
 		this.socketServer.on('midi2:discover', (ws, payload, id) => {
 			try {
@@ -296,10 +379,13 @@ class MIDI2Handlers {
 	/**
 	 * Notify clients of MIDI 2.0 device change
 	 */
-	notifyDeviceChange(deviceIndex, changeType) {
+	notifyDeviceChange(deviceIndex, changeType, device = {}) {
 		this.broadcastEvent('device-change', {
 			deviceIndex,
-			changeType // 'connected', 'disconnected'
+			changeType, // 'connected', 'disconnected'
+			deviceId: device.deviceId,
+			name: device.name,
+			direction: device.direction // 'input', 'output'
 		})
 	}
 }
@@ -26,11 +26,59 @@ export const saveBlobToLocalFileSystem = (blob:Blob, fileName:string ) => {
  * @param recording 
  * @param timer 
  */
+let nativeMIDI: any = null
+
+// Native encoder is only available in Electron/Node.js
+async function loadNativeMIDI(): Promise<any> {
+    if (nativeMIDI !== null || typeof window !== 'undefined') {
+        return nativeMIDI
+    }
+    try {
+        nativeMIDI = await import('../../build/Release/midi2-native.node' as any)
+    } catch (e) {
+        nativeMIDI = false
+    }
+    return nativeMIDI
+}
+
+/**
+ * Encode the notes natively from typed array columns, a note on and a
+ * note off row per note, in the same layout decodeMidiFile() returns
+ */
+const createMIDIFileNative = (native:any, data:AudioEvent[], BPM:number):Blob => {
+    const notes = data.filter(command => command.type === NOTE_ON)
+    const count = notes.length * 2
+    const time = new Float64Array(count)
+    const type = new Uint8Array(count)
+    const channel = new Uint8Array(count)
+    const data1 = new Uint8Array(count)
+    const data2 = new Uint8Array(count)
+
+    notes.forEach((command, index) => {
+        const on = index * 2
+        const off = on + 1
+        time[on] = command.startAt
+        time[off] = command.startAt + command.duration
+        type[on] = 0x9
+        type[off] = 0x8
+        data1[on] = data1[off] = command.noteNumber
+        data2[on] = 127
+    })
+
+    const bytes = native.encodeMidiFile({ time, type, channel, data1, data2 }, { tempo: BPM })
+    return new Blob( [bytes], { type: 'application/octet-stream' })
+}
+
 export const createMIDIFileFromAudioEventRecording = async (recording:RecorderAudioEvent, timer:Timer ):Promise<Blob> => {
     const BPM = timer.BPM
     const data:AudioEvent[] = recording.exportData()
     const duration:number = recording.duration   
 
+    const native = await loadNativeMIDI()
+    if (native && native.encodeMidiFile) {
+        return createMIDIFileNative(native, data, BPM)
+    }
+
     const midi = new Midi()
     const track = midi.addTrack()
 
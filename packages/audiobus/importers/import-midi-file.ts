@@ -3,9 +3,82 @@ import type { IAudioCommand } from "../audio-command-interface"
 import { NOTE_OFF, NOTE_ON } from '../commands'
 import AudioCommand from "../audio-command"
 
+let nativeMIDI: any = null
+
+// Native decoder is only available in Electron/Node.js
+async function loadNativeMIDI(): Promise<any> {
+	if (nativeMIDI !== null || typeof window !== 'undefined') {
+		return nativeMIDI
+	}
+	try {
+		nativeMIDI = await import('../../build/Release/midi2-native.node' as any)
+	} catch (e) {
+		nativeMIDI = false
+	}
+	return nativeMIDI
+}
+
+/**
+ * Decode with the native addon into typed array columns in a single pass,
+ * without building an object per event the way @tonejs/midi does
+ */
+const importMIDIFileNative = (native: any, file: File, arrayBuffer: ArrayBuffer) => {
+	const columns = native.decodeMidiFile(arrayBuffer)
+	const { count, time, type, channel, data1, data2 } = columns
+
+	const commands: IAudioCommand[] = []
+	const patches = new Uint8Array(16)
+	let noteCount = 0
+	let duration = 0
+
+	for (let i = 0; i < count; i++) {
+		const status = type[i]
+		if (status === 0xC) {
+			patches[channel[i]] = data1[i]
+			continue
+		}
+		if (status !== 0x8 && status !== 0x9) {
+			continue
+		}
+
+		const isNoteOn = status === 0x9 && data2[i] > 0
+		const command = new AudioCommand()
+		command.type = isNoteOn ? NOTE_ON : NOTE_OFF
+		command.number = data1[i]
+		command.velocity = isNoteOn ? data2[i] : 100
+		command.startAt = time[i]
+		command.from = file.name
+		command.channel = channel[i]
+		command.patch = patches[channel[i]]
+		commands.push(command)
+
+		if (isNoteOn) {
+			noteCount++
+		}
+		duration = time[i]
+	}
+
+	console.info("MIDI file loaded natively", {
+		fileName: file.name,
+		noteCount,
+		duration,
+		tracks: columns.tracks
+	})
+
+	return {
+		commands,
+		noteCount
+	}
+}
+
 export const importMIDIFile = async(file: File) => {
 	const arrayBuffer = await file.arrayBuffer()
 
+	const native = await loadNativeMIDI()
+	if (native && native.decodeMidiFile) {
+		return importMIDIFileNative(native, file, arrayBuffer)
+	}
+
 	// Parse MIDI using @tonejs/midi
 	const midi = new Midi(arrayBuffer)
 
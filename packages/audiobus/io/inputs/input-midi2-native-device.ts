@@ -17,9 +17,15 @@ export const MIDI2_NATIVE_INPUT_ID = "MIDI 2.0 Native"
 
 interface NativeDevice {
 	index: number
+	id: string
 	name: string
 }
 
+interface NativeListener {
+	handle: number
+	subscription: number
+}
+
 interface PerNoteData {
 	velocity: number // 0-65535 (16-bit)
 	controllers: Map<number, number>
@@ -71,7 +77,7 @@ export default class InputMIDI2Native extends AbstractInput implements IAudioInp
 	
 	#devices: NativeDevice[] = []
 	#activeDevices: Set<number> = new Set()
-	#listeners: Map<number, Function> = new Map()
+	#listeners: Map<number, NativeListener> = new Map()
 	#nativeMIDIEnabled: boolean = false
 	#activeNotes: Map<number, PerNoteData> = new Map()
 
@@ -155,16 +161,21 @@ export default class InputMIDI2Native extends AbstractInput implements IAudioInp
 	async #listenToDevice(deviceIndex: number): Promise<void> {
 		if (!nativeMIDI) return
 
-		const listener = (inDeviceIndex: number, umpPacket: number) => {
-			if (inDeviceIndex === deviceIndex) {
+		const device = this.#devices[deviceIndex]
+		if (!device) return
+
+		const listener = (inDeviceId: string, umpPacket: number) => {
+			if (inDeviceId === device.id) {
 				this.#handleUmpPacket(deviceIndex, umpPacket)
 			}
 		}
 
 		try {
-			this.#listeners.set(deviceIndex, listener)
+			// Inputs are opened lazily, so listening opens the device
+			const { handle } = nativeMIDI.openUmpInput(device.id)
+			const subscription = nativeMIDI.onUmpInput(listener)
+			this.#listeners.set(deviceIndex, { handle, subscription })
 			this.#activeDevices.add(deviceIndex)
-			nativeMIDI.onUmpInput(listener)
 			console.info('[InputMIDI2Native] Listening to device', deviceIndex)
 		} catch (error) {
 			console.error('[InputMIDI2Native] Error listening to device:', error)
@@ -178,6 +189,11 @@ export default class InputMIDI2Native extends AbstractInput implements IAudioInp
 		if (!nativeMIDI) return
 
 		try {
+			const listener = this.#listeners.get(deviceIndex)
+			if (listener) {
+				nativeMIDI.offUmpInput(listener.subscription)
+				nativeMIDI.closeUmpInput(listener.handle)
+			}
 			this.#listeners.delete(deviceIndex)
 			console.info('[InputMIDI2Native] Stopped listening to device', deviceIndex)
 		} catch (error) {
@@ -12,9 +12,15 @@ export const NATIVE_MIDI_INPUT_ID = "Native MIDI"
 
 interface NativeDevice {
 	index: number
+	id: string
 	name: string
 }
 
+interface NativeListener {
+	handle: number
+	subscription: number
+}
+
 let nativeMIDI: any = null
 
 // Try to load native MIDI module (dynamically loaded in constructor)
@@ -49,7 +55,7 @@ export default class InputNativeMIDIDevice extends AbstractInput implements IAud
 	
 	#devices: NativeDevice[] = []
 	#activeDevices: Set<number> = new Set()
-	#listeners: Map<number, Function> = new Map()
+	#listeners: Map<number, NativeListener> = new Map()
 	#nativeMIDIEnabled: boolean = false
 
 	get name(): string {
@@ -131,16 +137,21 @@ export default class InputNativeMIDIDevice extends AbstractInput implements IAud
 	async #listenToDevice(deviceIndex: number): Promise<void> {
 		if (!nativeMIDI) return
 
-		const listener = (inDeviceIndex: number, umpPacket: number) => {
-			if (inDeviceIndex === deviceIndex) {
+		const device = this.#devices[deviceIndex]
+		if (!device) return
+
+		const listener = (inDeviceId: string, umpPacket: number) => {
+			if (inDeviceId === device.id) {
 				this.#handleUmpPacket(deviceIndex, umpPacket)
 			}
 		}
 
 		try {
-			this.#listeners.set(deviceIndex, listener)
+			// Inputs are opened lazily, so listening opens the device
+			const { handle } = nativeMIDI.openUmpInput(device.id)
+			const subscription = nativeMIDI.onUmpInput(listener)
+			this.#listeners.set(deviceIndex, { handle, subscription })
 			this.#activeDevices.add(deviceIndex)
-			nativeMIDI.onUmpInput(listener)
 			console.info('[InputNativeMIDIDevice] Listening to device', deviceIndex)
 		} catch (error) {
 			console.error('[InputNativeMIDIDevice] Error listening to device:', error)
@@ -154,6 +165,11 @@ export default class InputNativeMIDIDevice extends AbstractInput implements IAud
 		if (!nativeMIDI) return
 
 		try {
+			const listener = this.#listeners.get(deviceIndex)
+			if (listener) {
+				nativeMIDI.offUmpInput(listener.subscription)
+				nativeMIDI.closeUmpInput(listener.handle)
+			}
 			this.#listeners.delete(deviceIndex)
 			console.info('[InputNativeMIDIDevice] Stopped listening to device', deviceIndex)
 		} catch (error) {
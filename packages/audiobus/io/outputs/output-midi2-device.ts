@@ -83,6 +83,7 @@ export default class OutputMIDI2 implements IAudioOutput {
     private deviceIndex: number
     private deviceInfo: any
     private midi2Native: any = null
+    private handle: number | null = null
 
     private currentGroup: number = 0
 
@@ -261,7 +262,7 @@ export default class OutputMIDI2 implements IAudioOutput {
 
         if (this.midi2Native) {
             try {
-                this.midi2Native.openUmpOutput(this.deviceIndex);
+                this.handle = this.midi2Native.openUmpOutput(this.deviceInfo?.id ?? this.deviceIndex).handle;
                 this.#connected = true;
                 console.log(`[OutputMIDI2] Opened: ${this.deviceInfo.name}`);
             } catch (error) {
@@ -281,7 +282,8 @@ export default class OutputMIDI2 implements IAudioOutput {
 
         if (this.midi2Native) {
             try {
-                this.midi2Native.closeUmpOutput(this.deviceIndex);
+                this.midi2Native.closeUmpOutput(this.handle);
+                this.handle = null;
                 this.#connected = false;
                 console.log(`[OutputMIDI2] Closed: ${this.deviceInfo.name}`);
             } catch (error) {
@@ -347,10 +349,10 @@ export default class OutputMIDI2 implements IAudioOutput {
      * Send raw UMP packet
      */
     private sendUmp(packet: UMPPacket): void {
-        if (!this.midi2Native) return;
+        if (!this.midi2Native || this.handle === null) return;
 
         try {
-            this.midi2Native.sendUmp(this.deviceIndex, packet);
+            this.midi2Native.sendUmp(this.handle, packet);
         } catch (error) {
             console.error(`[OutputMIDI2] Failed to send UMP: ${error}`);
         }
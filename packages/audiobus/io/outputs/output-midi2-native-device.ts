@@ -26,6 +26,7 @@ export const MIDI2_NATIVE_OUTPUT_ID = "MIDI 2.0 Native"
 
 interface NativeDevice {
 	index: number
+	id: string
 	name: string
 }
 
@@ -82,6 +83,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 
 	#uuid: string
 	#deviceIndex: number | null = null
+	#handle: number | null = null
 	#activeNotes: Map<number, { velocity: number; controllers: Map<number, number> }> = new Map()
 	#options: any
 	#devices: NativeDevice[] = []
@@ -138,7 +140,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 
 			// Use first device by default
 			this.#deviceIndex = 0
-			nativeMIDI.openUmpOutput(this.#deviceIndex)
+			this.#handle = nativeMIDI.openUmpOutput(this.#devices[this.#deviceIndex].id).handle
 			this.#isConnected = true
 
 			console.info('[OutputMIDI2Native] Connected to device:', this.#devices[this.#deviceIndex])
@@ -153,14 +155,15 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Disconnect from MIDI device
 	 */
 	async disconnect(): Promise<void> {
-		if (this.#deviceIndex !== null && nativeMIDI) {
+		if (this.#handle !== null && nativeMIDI) {
 			try {
-				nativeMIDI.closeUmpOutput(this.#deviceIndex)
+				nativeMIDI.closeUmpOutput(this.#handle)
 			} catch (error) {
 				console.error('[OutputMIDI2Native] Error closing device:', error)
 			}
 		}
 		this.#deviceIndex = null
+		this.#handle = null
 		this.#isConnected = false
 	}
 
@@ -189,7 +192,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Send MIDI 2.0 Note On with 16-bit velocity
 	 */
 	noteOn(noteNumber: number, velocity: number = 100, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -211,7 +214,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 			// Uses group 0 (all devices), channel, note, velocity
 			const ump = createNoteOn(0, ch, note, midi2Velocity)
 
-			nativeMIDI.sendUmp(this.#deviceIndex, ump)
+			nativeMIDI.sendUmp(this.#handle, ump)
 
 			console.debug('[OutputMIDI2Native] Note On sent', {
 				note,
@@ -227,7 +230,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Send MIDI 2.0 Note Off
 	 */
 	noteOff(noteNumber: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -244,7 +247,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 			// Create MIDI 2.0 Note Off UMP packet
 			const ump = createNoteOff(0, ch, note, velocity)
 
-			nativeMIDI.sendUmp(this.#deviceIndex, ump)
+			nativeMIDI.sendUmp(this.#handle, ump)
 
 			console.debug('[OutputMIDI2Native] Note Off sent', {
 				note,
@@ -260,7 +263,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Send All Notes Off (CC#123)
 	 */
 	allNotesOff(channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -270,7 +273,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 		try {
 			// Create MIDI 2.0 Control Change UMP for All Notes Off (CC#123)
 			const ump = createControlChange(0, ch, 123, 0)
-			nativeMIDI.sendUmp(this.#deviceIndex, ump)
+			nativeMIDI.sendUmp(this.#handle, ump)
 
 			console.debug('[OutputMIDI2Native] All Notes Off sent', { channel })
 			this.#activeNotes.clear()
@@ -283,7 +286,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Send MIDI 2.0 Control Change with 16-bit resolution
 	 */
 	sendControlChange(controlNumber: number, value: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -296,7 +299,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 		try {
 			// Create MIDI 2.0 Control Change UMP packet with 16-bit value
 			const ump = createControlChange(0, ch, controlNumber, midi2Value)
-			nativeMIDI.sendUmp(this.#deviceIndex, ump)
+			nativeMIDI.sendUmp(this.#handle, ump)
 
 			console.debug('[OutputMIDI2Native] Control Change sent', {
 				controller: controlNumber,
@@ -318,7 +321,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 		value: number,
 		channel: number = 1
 	): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -341,7 +344,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 		try {
 			// Create MIDI 2.0 Per-Note Controller UMP packet
 			const ump = createPerNoteController(0, ch, note, controllerType, midi2Value)
-			nativeMIDI.sendUmp(this.#deviceIndex, ump)
+			nativeMIDI.sendUmp(this.#handle, ump)
 
 			console.debug('[OutputMIDI2Native] Per-Note Controller sent', {
 				note,
@@ -358,7 +361,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Send MIDI 2.0 Program Change
 	 */
 	sendProgramChange(program: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -366,7 +369,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 		try {
 			const status = 0xC0 | (channel - 1)
 			const msg = status | (program << 8)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputMIDI2Native] MIDI 2.0 Program Change sent', {
 				program,
@@ -381,7 +384,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Send MIDI 2.0 Pitch Bend with 32-bit precision
 	 */
 	sendPitchBend(value: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -394,8 +397,8 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 			const msg32 = status | ((midi2PitchBend & 0xFFFF) << 8)
 			const msg32_2 = (midi2PitchBend >> 16) & 0xFFFF
 
-			nativeMIDI.sendUmp(this.#deviceIndex, msg32)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg32_2)
+			nativeMIDI.sendUmp(this.#handle, msg32)
+			nativeMIDI.sendUmp(this.#handle, msg32_2)
 
 			console.info('[OutputMIDI2Native] MIDI 2.0 Pitch Bend sent', {
 				value: midi2PitchBend,
@@ -410,7 +413,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Send MIDI 2.0 Channel Pressure
 	 */
 	sendChannelAftertouch(pressure: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -422,8 +425,8 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 			const msg32 = status | ((midi2Pressure & 0xFF) << 8)
 			const msg32_2 = (midi2Pressure >> 8) & 0xFF
 
-			nativeMIDI.sendUmp(this.#deviceIndex, msg32)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg32_2)
+			nativeMIDI.sendUmp(this.#handle, msg32)
+			nativeMIDI.sendUmp(this.#handle, msg32_2)
 
 			console.info('[OutputMIDI2Native] MIDI 2.0 Channel Aftertouch sent', {
 				pressure: midi2Pressure,
@@ -438,7 +441,7 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 	 * Send MIDI 2.0 Polyphonic Aftertouch
 	 */
 	sendPolyphonicAftertouch(note: number, pressure: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputMIDI2Native] No active device')
 			return
 		}
@@ -450,8 +453,8 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 			const msg32 = status | (note << 8) | ((midi2Pressure & 0xFF) << 16)
 			const msg32_2 = (midi2Pressure >> 8) & 0xFF
 
-			nativeMIDI.sendUmp(this.#deviceIndex, msg32)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg32_2)
+			nativeMIDI.sendUmp(this.#handle, msg32)
+			nativeMIDI.sendUmp(this.#handle, msg32_2)
 
 			console.info('[OutputMIDI2Native] MIDI 2.0 Polyphonic Aftertouch sent', {
 				note,
@@ -482,12 +485,13 @@ export default class OutputMIDI2Native extends EventTarget implements IAudioOutp
 			throw new Error('Device index out of range')
 		}
 
-		if (this.#deviceIndex !== null) {
-			nativeMIDI.closeUmpOutput(this.#deviceIndex)
+		if (this.#handle !== null) {
+			nativeMIDI.closeUmpOutput(this.#handle)
+			this.#handle = null
 		}
 
 		this.#deviceIndex = deviceIndex
-		nativeMIDI.openUmpOutput(this.#deviceIndex)
+		this.#handle = nativeMIDI.openUmpOutput(this.#devices[deviceIndex].id).handle
 		console.info('[OutputMIDI2Native] Switched to device:', this.#devices[deviceIndex])
 	}
 
@@ -11,6 +11,7 @@ export const NATIVE_MIDI_OUTPUT_ID = "Native MIDI"
 
 interface NativeDevice {
 	index: number
+	id: string
 	name: string
 }
 
@@ -46,6 +47,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 
 	#uuid: string = "Output-NativeMIDI-" + (OutputNativeMIDIDevice.ID++)
 	#deviceIndex: number | null = null
+	#handle: number | null = null
 	#activeNotes: Set<number> = new Set()
 	#options: any
 	#devices: NativeDevice[] = []
@@ -101,7 +103,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 
 			// Use first device by default
 			this.#deviceIndex = 0
-			nativeMIDI.openUmpOutput(this.#deviceIndex)
+			this.#handle = nativeMIDI.openUmpOutput(this.#devices[this.#deviceIndex].id).handle
 			this.#isConnected = true
 
 			console.info('[OutputNativeMIDIDevice] Connected to device:', this.#devices[this.#deviceIndex])
@@ -116,14 +118,15 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Disconnect from MIDI device
 	 */
 	async disconnect(): Promise<void> {
-		if (this.#deviceIndex !== null && nativeMIDI) {
+		if (this.#handle !== null && nativeMIDI) {
 			try {
-				nativeMIDI.closeUmpOutput(this.#deviceIndex)
+				nativeMIDI.closeUmpOutput(this.#handle)
 			} catch (error) {
 				console.error('[OutputNativeMIDIDevice] Error closing device:', error)
 			}
 		}
 		this.#deviceIndex = null
+		this.#handle = null
 		this.#isConnected = false
 	}
 
@@ -152,7 +155,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Send MIDI note on
 	 */
 	noteOn(noteNumber: number, velocity: number = 100, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputNativeMIDIDevice] No active device')
 			return
 		}
@@ -162,7 +165,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 		try {
 			const status = 0x90 | (channel - 1)
 			const msg = status | (noteNumber << 8) | (velocity << 16)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputNativeMIDIDevice] Note On sent', {
 				note: noteNumber,
@@ -178,7 +181,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Send MIDI note off
 	 */
 	noteOff(noteNumber: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputNativeMIDIDevice] No active device')
 			return
 		}
@@ -188,7 +191,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 		try {
 			const status = 0x80 | (channel - 1)
 			const msg = status | (noteNumber << 8)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputNativeMIDIDevice] Note Off sent', {
 				note: noteNumber,
@@ -203,7 +206,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Send All Notes Off (CC#123)
 	 */
 	allNotesOff(channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputNativeMIDIDevice] No active device')
 			return
 		}
@@ -211,7 +214,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 		try {
 			const status = 0xB0 | (channel - 1)
 			const msg = status | (123 << 8) | (0 << 16)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputNativeMIDIDevice] All Notes Off sent', {
 				channel
@@ -226,7 +229,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Send MIDI control change
 	 */
 	sendControlChange(controlNumber: number, value: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputNativeMIDIDevice] No active device')
 			return
 		}
@@ -234,7 +237,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 		try {
 			const status = 0xB0 | (channel - 1)
 			const msg = status | (controlNumber << 8) | (value << 16)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputNativeMIDIDevice] Control Change sent', {
 				controller: controlNumber,
@@ -250,7 +253,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Send MIDI program change
 	 */
 	sendProgramChange(program: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputNativeMIDIDevice] No active device')
 			return
 		}
@@ -258,7 +261,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 		try {
 			const status = 0xC0 | (channel - 1)
 			const msg = status | (program << 8)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputNativeMIDIDevice] Program Change sent', {
 				program,
@@ -273,7 +276,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Send MIDI pitch bend
 	 */
 	sendPitchBend(value: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputNativeMIDIDevice] No active device')
 			return
 		}
@@ -283,7 +286,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 			const lsb = value & 0x7F
 			const msb = (value >> 7) & 0x7F
 			const msg = status | (lsb << 8) | (msb << 16)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputNativeMIDIDevice] Pitch Bend sent', {
 				value,
@@ -298,7 +301,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Send Polyphonic Aftertouch (Key Pressure)
 	 */
 	sendPolyphonicAftertouch(note: number, pressure: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputNativeMIDIDevice] No active device')
 			return
 		}
@@ -306,7 +309,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 		try {
 			const status = 0xA0 | (channel - 1)
 			const msg = status | (note << 8) | (pressure << 16)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputNativeMIDIDevice] Polyphonic Aftertouch sent', {
 				note,
@@ -322,7 +325,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 	 * Send Channel Aftertouch (Channel Pressure)
 	 */
 	sendChannelAftertouch(pressure: number, channel: number = 1): void {
-		if (this.#deviceIndex === null || !nativeMIDI) {
+		if (this.#handle === null || !nativeMIDI) {
 			console.warn('[OutputNativeMIDIDevice] No active device')
 			return
 		}
@@ -330,7 +333,7 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 		try {
 			const status = 0xD0 | (channel - 1)
 			const msg = status | (pressure << 8)
-			nativeMIDI.sendUmp(this.#deviceIndex, msg)
+			nativeMIDI.sendUmp(this.#handle, msg)
 
 			console.info('[OutputNativeMIDIDevice] Channel Aftertouch sent', {
 				pressure,
@@ -360,12 +363,13 @@ export default class OutputNativeMIDIDevice extends EventTarget implements IAudi
 			throw new Error('Device index out of range')
 		}
 
-		if (this.#deviceIndex !== null) {
-			nativeMIDI.closeUmpOutput(this.#deviceIndex)
+		if (this.#handle !== null) {
+			nativeMIDI.closeUmpOutput(this.#handle)
+			this.#handle = null
 		}
 
 		this.#deviceIndex = deviceIndex
-		nativeMIDI.openUmpOutput(this.#deviceIndex)
+		this.#handle = nativeMIDI.openUmpOutput(this.#devices[deviceIndex].id).handle
 		console.info('[OutputNativeMIDIDevice] Switched to device:', this.#devices[deviceIndex])
 	}
 